@@ -0,0 +1,7 @@
+# Prints the size of FILE, used to keep an eye on the module download sizes.
+#
+#   cmake -DFILE=<path> -P report_size.cmake
+
+file(SIZE ${FILE} size)
+cmake_path(GET FILE FILENAME name)
+message(STATUS "${name}: ${size} bytes")
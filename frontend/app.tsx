@@ -197,11 +197,11 @@ function useCaInterface(props: CaInterfaceProps)
 
     const [tab, setTab] = useState(CaTab.Configure)
 
-    const getCertificate = (certMaker: CertMaker): SigningInfo => {
+    const getCertificate = async (certMaker: CertMaker): Promise<SigningInfo> => {
         if (tab === CaTab.Configure) {
             let certInfo = confCertInfo
             if (pemDataFor !== props.caCertSettings) {
-                certInfo = certMaker.makeCertificate({
+                certInfo = await certMaker.makeCertificate({
                     ...props.caCertSettings,
                     issuerName: props.caCertSettings.subjectName,
                     signMethod: "selfsigned",
@@ -277,13 +277,16 @@ function useCaInterface(props: CaInterfaceProps)
             let certInfo: CertificateInfo | CertificateKeyInfo
             try {
                 certInfo = keyContent
-                    ? certMaker.getCertificateKeyInfo(certContent, keyContent)
-                    : certMaker.getCertificateInfo(certContent)
+                    ? await certMaker.getCertificateKeyInfo(certContent, keyContent)
+                    : await certMaker.getCertificateInfo(certContent)
             } catch (error) {
-                handleFileError(error)
+                if (!ignore)
+                    handleFileError(error)
                 return
             }
 
+            if (ignore) return
+
             setCertFileInfo(certInfo)
         })
 
@@ -426,12 +429,16 @@ function CertificateSettingsForm(props: CertificateSettingsParams)
         try {
             const certMaker = await CertMaker.get()
 
-            const signingInfo = caInterface.getCertificate(certMaker)
+            // The leaf key doesn't depend on the CA, so generate it on another
+            // worker while the CA certificate is being made.
+            const pendingLeafKey = certMaker.generateKey(leafSettings.keyGen)
+            const signingInfo = await caInterface.getCertificate(certMaker)
 
             const settings: CertificateSettings = {
                 ...leafSettings,
                 signMethod: "selfsigned",
                 issuerName: undefined,
+                subjectKeyPem: await pendingLeafKey,
             }
 
             if (signingInfo !== "selfsigned") {
@@ -439,10 +446,11 @@ function CertificateSettingsForm(props: CertificateSettingsParams)
                 settings.signMethod = {
                     pem: signingInfo.keyPem,
                     akid: signingInfo.skid,
+                    certPem: signingInfo.certPem,
                 }
             }
 
-            const certData = certMaker.makeCertificate(settings)
+            const certData = await certMaker.makeCertificate(settings)
 
             const result: CreateResult = {
                 endCert: certData.certPem,
@@ -512,12 +520,13 @@ function certFileName(settings: CertificateSettings) {
 export function App() {
     const [error, setError] = useState<any>()
 
-    const onDownload = (result: CreateResult) => {
+    const onDownload = async (result: CreateResult) => {
         setError(undefined)
 
         const name = certFileName(result.endSettings)
 
-        const writer = new ZipWriter()
+        const certMaker = await CertMaker.get()
+        const writer = new ZipWriter(certMaker)
         writer.addFile(`${name}/${name}.crt`, new TextEncoder().encode(result.endCert))
         writer.addFile(`${name}/${name}.key`, new TextEncoder().encode(result.endKey))
 
@@ -527,7 +536,7 @@ export function App() {
         if (result.caKey)
             writer.addFile(`${name}/ca_cert.key`, new TextEncoder().encode(result.caKey))
 
-        saveAs(writer.complete(), `${name}.zip`)
+        saveAs(await writer.complete(), `${name}.zip`)
     }
 
     return (
@@ -0,0 +1,129 @@
+// Headless time-to-first-certificate benchmark.
+//
+// Usage: node bench_startup.mjs <sign.wasm> [<other sign.wasm> ...]
+//
+// For every module it repeatedly measures a cold start: compile, instantiate,
+// initialise and generate one P-256 self-signed certificate. Pass a regular
+// build and a BB_SNAPSHOT=ON build to compare them.
+
+import { readFile } from "node:fs/promises"
+import { ConsoleStdout, File, OpenFile, PreopenDirectory, WASI } from "@bjorn3/browser_wasi_shim"
+
+const iterations = Number(process.env.ITERATIONS ?? 20)
+
+function encodeInput()
+{
+    const parts = []
+    const uint = n => { const b = new Uint8Array(4); new DataView(b.buffer).setUint32(0, n, true); parts.push(b) }
+    const bool = b => parts.push(new Uint8Array([b ? 1 : 0]))
+    const string = s => { const utf8 = new TextEncoder().encode(s); uint(utf8.byteLength); parts.push(utf8) }
+
+    string("CN=bench") // Issuer
+    string("CN=bench") // Subject
+    bool(false) // CA
+    bool(true) // Self-signed
+    string("") // AKID
+    uint(0) // SAN count
+    uint(0) // Key type: P-256
+    uint(1) // Message digest: SHA-256
+    string("20250101000000")
+    string("20260101000000")
+    uint(0x80) // Key usage: digital signature
+    uint(0) // Extended key usage
+
+    const size = parts.reduce((acc, p) => acc + p.byteLength, 0)
+    const result = new Uint8Array(size)
+    let offset = 0
+    for (const p of parts) {
+        result.set(p, offset)
+        offset += p.byteLength
+    }
+    return result
+}
+
+async function coldStart(wasmBytes, input)
+{
+    const times = {}
+    let mark = performance.now()
+    const lap = name => {
+        const now = performance.now()
+        times[name] = now - mark
+        mark = now
+    }
+
+    const module = await WebAssembly.compile(wasmBytes)
+    lap("compile")
+
+    const directory = new PreopenDirectory(".", {
+        "input": new File(input, {readonly: false}),
+        "cert": new File([], {readonly: false}),
+        "key": new File([], {readonly: false}),
+        "result": new File([], {readonly: false}),
+    })
+    const fds = [
+        new OpenFile(new File([])),
+        ConsoleStdout.lineBuffered(msg => console.log(`[WASI stdout] ${msg}`)),
+        ConsoleStdout.lineBuffered(msg => console.warn(`[WASI stderr] ${msg}`)),
+        directory,
+    ]
+    const wasi = new WASI([], [], fds)
+
+    let instance
+    instance = await WebAssembly.instantiate(module, {
+        wasi_snapshot_preview1: wasi.wasiImport,
+        crypto: {
+            fill_random: (offset, length) => {
+                crypto.getRandomValues(new Uint8Array(instance.exports.memory.buffer, offset, length))
+            },
+        },
+    })
+    lap("instantiate")
+
+    if ("_initialize" in instance.exports)
+        wasi.initialize(instance)
+    else
+        wasi.inst = instance
+    lap("initialise")
+
+    const status = instance.exports.run()
+    if (status !== 0)
+        throw Error(`run() failed with ${status}`)
+    lap("firstCertificate")
+
+    times.total = Object.values(times).reduce((a, b) => a + b, 0)
+    return times
+}
+
+function median(values)
+{
+    const sorted = [...values].sort((a, b) => a - b)
+    return sorted[Math.floor(sorted.length / 2)]
+}
+
+async function main()
+{
+    const paths = process.argv.slice(2)
+    if (!paths.length) {
+        console.error("Usage: node bench_startup.mjs <sign.wasm> [<other sign.wasm> ...]")
+        process.exit(1)
+    }
+
+    const input = encodeInput()
+
+    for (const path of paths) {
+        const wasmBytes = await readFile(path)
+
+        const samples = []
+        for (let i = 0; i !== iterations; ++i)
+            samples.push(await coldStart(wasmBytes, input))
+
+        console.log(`${path} (${wasmBytes.byteLength} bytes, median of ${iterations})`)
+        for (const name of Object.keys(samples[0]))
+            console.log(`  ${name.padEnd(18)} ${median(samples.map(s => s[name])).toFixed(2)} ms`)
+    }
+}
+
+main().catch(err => {
+    console.error(err)
+    process.exit(1)
+})
@@ -0,0 +1,152 @@
+// Scaling benchmark for the threaded module (BB_WASI_THREADS).
+//
+// Usage: node bench_threads.mjs <sign.wasm> [key type] [key count]
+//
+// Generates a batch of keys with gen_keys using 1, 2, 4 and 8 threads and
+// prints the median time of each and the speedup over one thread. The key type
+// is an index into the gen_key_type enum, 0 (P-256) by default. Threads are
+// worker_threads, each instantiating the module on the shared memory.
+
+import { readFile } from "node:fs/promises"
+import { Worker, isMainThread, workerData } from "node:worker_threads"
+import { ConsoleStdout, File, OpenFile, PreopenDirectory, WASI } from "@bjorn3/browser_wasi_shim"
+
+const iterations = Number(process.env.ITERATIONS ?? 5)
+const threadCounts = [1, 2, 4, 8]
+
+// Must match --initial-memory and --max-memory in CMakeLists.txt
+const memoryPages = { initial: 256, maximum: 4096, shared: true }
+
+// The WASI shim decodes paths and console output straight from the memory
+const decode = TextDecoder.prototype.decode
+TextDecoder.prototype.decode = function(input, options) {
+    if (ArrayBuffer.isView(input) && input.buffer instanceof SharedArrayBuffer)
+        input = new Uint8Array(input.buffer, input.byteOffset, input.byteLength).slice()
+
+    return decode.call(this, input, options)
+}
+
+function fillRandom(memory, offset, length)
+{
+    const bytes = new Uint8Array(length)
+    crypto.getRandomValues(bytes)
+    new Uint8Array(memory.buffer, offset, length).set(bytes)
+}
+
+function makeWasi(fds)
+{
+    return new WASI([], [], [
+        new OpenFile(new File([])),
+        ConsoleStdout.lineBuffered(msg => console.log(`[WASI stdout] ${msg}`)),
+        ConsoleStdout.lineBuffered(msg => console.warn(`[WASI stderr] ${msg}`)),
+        ...fds,
+    ])
+}
+
+function imports(module, memory, wasi)
+{
+    let nextTid = 1
+    return {
+        env: { memory },
+        wasi: {
+            "thread-spawn": arg => {
+                const tid = nextTid++
+                new Worker(new URL(import.meta.url), { workerData: { module, memory, tid, arg } })
+                return tid
+            },
+        },
+        wasi_snapshot_preview1: wasi.wasiImport,
+        crypto: {
+            fill_random: (offset, length) => fillRandom(memory, offset, length),
+        },
+    }
+}
+
+async function threadMain()
+{
+    const { module, memory, tid, arg } = workerData
+    const wasi = makeWasi([])
+    const instance = await WebAssembly.instantiate(module, imports(module, memory, wasi))
+    wasi.inst = instance
+    instance.exports.wasi_thread_start(tid, arg)
+}
+
+function encodeInput(keyType, count)
+{
+    const input = new Uint8Array(8)
+    const view = new DataView(input.buffer)
+    view.setUint32(0, keyType, true)
+    view.setUint32(4, count, true)
+    return input
+}
+
+function median(values)
+{
+    const sorted = [...values].sort((a, b) => a - b)
+    return sorted[Math.floor(sorted.length / 2)]
+}
+
+async function main()
+{
+    const [path, keyTypeArg, countArg] = process.argv.slice(2)
+    if (!path) {
+        console.error("Usage: node bench_threads.mjs <sign.wasm> [key type] [key count]")
+        process.exit(1)
+    }
+
+    const keyType = Number(keyTypeArg ?? 0)
+    const count = Number(countArg ?? 256)
+
+    const module = await WebAssembly.compile(await readFile(path))
+    if (!WebAssembly.Module.imports(module).some(i => i.module === "wasi" && i.name === "thread-spawn")) {
+        console.error(`${path} isn't a threaded build, configure with tc/clang-wasi-threads.cmake.`)
+        process.exit(1)
+    }
+
+    const directory = new PreopenDirectory(".", {})
+    const wasi = makeWasi([directory])
+    const memory = new WebAssembly.Memory(memoryPages)
+    const instance = await WebAssembly.instantiate(module, imports(module, memory, wasi))
+    wasi.initialize(instance)
+
+    const run = () => {
+        directory.dir.contents["input"] = new File(encodeInput(keyType, count), {readonly: false})
+        directory.dir.contents["result"] = new File([], {readonly: false})
+
+        const start = performance.now()
+        const status = instance.exports.gen_keys()
+        if (status !== 0)
+            throw Error(`gen_keys() failed with ${status}`)
+        return performance.now() - start
+    }
+
+    console.log(`${count} keys of type ${keyType}, median of ${iterations}`)
+
+    let baseline
+    for (const threads of threadCounts) {
+        const actual = instance.exports.set_thread_count(threads)
+
+        // New threads start while this runs, they take part from the next run
+        run()
+
+        const samples = []
+        for (let i = 0; i !== iterations; ++i)
+            samples.push(run())
+
+        const time = median(samples)
+        baseline ??= time
+        console.log(`  ${String(actual).padStart(2)} threads ${time.toFixed(1).padStart(9)} ms  ${(baseline / time).toFixed(2)}x`)
+    }
+
+    // The module's threads never exit
+    process.exit(0)
+}
+
+if (isMainThread) {
+    main().catch(err => {
+        console.error(err)
+        process.exit(1)
+    })
+} else {
+    threadMain()
+}
@@ -1,7 +1,6 @@
-import { ConsoleStdout, File, OpenFile, PreopenDirectory, WASI } from "@bjorn3/browser_wasi_shim"
-import { WComms } from "./wcomms"
-
 import signPath from "sign.wasm"
+import signRsaPath from "sign_rsa.wasm"
+import { WComms } from "./wcomms"
 import { KeyOption, keyOptions } from "./key_options"
 import { ValidityRange } from "./validity"
 import { MD, mdOptions } from "./md_options"
@@ -10,219 +9,693 @@ import { KeyUsage } from "./key_usage"
 import { ExtKeyUsage } from "./ext_key_usage"
 import { InterfaceErrorCode, InterfaceException } from "./interface_error"
 import { RComms } from "./rcomms"
-
-function checkError(status: InterfaceErrorCode)
-{
-    if (status !== InterfaceErrorCode.Success)
-        throw new InterfaceException(status)
+import { binaryFile, certificateFiles, readCert, resultCert, resultCertDetails, validityString } from "./certificate_files"
+import { SpscRing } from "./spsc_ring"
+import type { ModuleCall, ModuleFiles } from "./sign_module"
+import type { ModuleVariant, StreamRings, WorkerRequest, WorkerResponse } from "./cert_worker"
+
+const modulePaths: Record<ModuleVariant, string> = {
+    "core": signPath,
+    "rsa": signRsaPath,
 }
 
-function validityString(d: Date)
+// The core module fails with these when it's given an RSA key or certificate
+const rsaRetryCodes = [
+    InterfaceErrorCode.ReadCert,
+    InterfaceErrorCode.ReadKey,
+]
+
+// Browsers no longer allow storing a WebAssembly.Module in IndexedDB. Instead
+// keep the response in Cache Storage and compile it with compileStreaming, which
+// lets the engine reuse its cached machine code for the same response on later
+// visits. The file names contain a content hash, so entries never go stale;
+// ones for older builds are removed.
+async function fetchSignWasm(path: string): Promise<Response>
 {
-    const dateTimeStr = d.toISOString().substring(0, 19)
-    return Array.from(dateTimeStr).filter(c => c >= "0" && c <= "9").join("")
+    if (!("caches" in globalThis))
+        return fetch(path)
+
+    try {
+        const cache = await caches.open("sign-wasm")
+        const url = new URL(path, document.baseURI).href
+        const currentUrls = Object.values(modulePaths).map(p => new URL(p, document.baseURI).href)
+
+        for (const request of await cache.keys()) {
+            if (!currentUrls.includes(request.url))
+                cache.delete(request)
+        }
+
+        const cached = await cache.match(url)
+        if (cached)
+            return cached
+
+        const response = await fetch(url)
+        if (response.ok)
+            await cache.put(url, response.clone())
+
+        return response
+    } catch (error) {
+        // Cache Storage is unavailable in some contexts (e.g. private browsing)
+        return fetch(path)
+    }
 }
 
-function cleanSubject(settings: CertificateSettings)
-{
-    let subject = settings.subjectName.trim()
-    if (subject.includes("CN=") || settings.sanList.length === 0)
-        return subject
+interface PoolWorker {
+    worker: Worker
+    busy: boolean
+}
 
-    return [subject, `CN=${settings.sanList[0][1]}`].filter(Boolean).join(",")
+interface Job {
+    id: number
+    variant: ModuleVariant
+    module: WebAssembly.Module
+    calls: ModuleCall[]
+    resolve: (files: ModuleFiles) => void
+    reject: (error: Error) => void
+
+    // Set for generateKeyInSteps instead of calls
+    keygen?: { keyType: number, budgetMs: number, onProgress?: (progress: number) => void }
+    // Set for openStream, resolved once the stream is closed
+    stream?: { files: ModuleFiles, onOpen: (rings: StreamRings) => void }
+    worker?: PoolWorker
 }
 
+// Runs the WASM module in a pool of Web Workers so certificate generation
+// doesn't block the page and independent keys can be generated in parallel.
+// The module is compiled once here and shared with every worker.
+//
+// RSA support lives in a separate, larger module. It's only fetched and
+// compiled the first time something needs it.
 export class CertMaker {
-    wasi: WASI
-    instance: WebAssembly.Instance | undefined
-    input: File
-    output: File
-    directory: PreopenDirectory
+    private modules = new Map<ModuleVariant, Promise<WebAssembly.Module>>()
+    private coreModule: WebAssembly.Module
+    private maxWorkers: number
+    private workers: PoolWorker[] = []
+    private queue: Job[] = []
+    private pending = new Map<number, Job>()
+    private nextId = 0
+
+    private constructor(coreModule: WebAssembly.Module)
+    {
+        this.coreModule = coreModule
+        this.modules.set("core", Promise.resolve(coreModule))
+        this.maxWorkers = Math.max(1, navigator.hardwareConcurrency || 1)
+        this.spawnWorker()
+    }
 
-    private constructor(wasi: WASI, input: File, output: File, directory: PreopenDirectory)
+    private static async make(): Promise<CertMaker>
     {
-        this.wasi = wasi
-        this.input = input
-        this.output = output
-        this.directory = directory
+        const module = await WebAssembly.compileStreaming(fetchSignWasm(signPath))
+        return new CertMaker(module)
     }
 
-    private fillRandom(offset: number, length: number)
+    private static pendingCertMaker: Promise<CertMaker> | undefined
+    static async get(): Promise<CertMaker>
     {
-        // @ts-ignore
-        const memory = this.instance.exports.memory.buffer as ArrayBuffer
-        globalThis.crypto.getRandomValues(new Uint8Array(memory, offset, length))
+        if (!CertMaker.pendingCertMaker) {
+            CertMaker.pendingCertMaker = CertMaker.make()
+        }
+
+        return CertMaker.pendingCertMaker
     }
 
-    private static async make(): Promise<CertMaker>
+    private spawnWorker(): PoolWorker
     {
-        const input = new File([])
-        const output = new File([])
+        const poolWorker = {
+            worker: new Worker(CERT_WORKER_PATH),
+            busy: false,
+        }
 
-        const args: string[] = []
-        const env: string[] = []
-        const directory = new PreopenDirectory(".", {
-            "input": input,
-            "result": output,
-        })
-        const fds = [
-            new OpenFile(new File([])),
-            ConsoleStdout.lineBuffered(msg => console.log(`[WASI stdout] ${msg}`)),
-            ConsoleStdout.lineBuffered(msg => console.warn(`[WASI stderr] ${msg}`)),
-            directory,
-        ]
-
-        const wasi = new WASI(args, env, fds, {debug: DEBUG})
-        let certMaker = new CertMaker(
-            wasi,
-            input,
-            output,
-            directory,
-        )
-
-        const module = await WebAssembly.compileStreaming(fetch(signPath))
-        const instance = await WebAssembly.instantiate(module, {
-            wasi_snapshot_preview1: wasi.wasiImport,
-            crypto: {
-                fill_random: certMaker.fillRandom.bind(certMaker)
+        poolWorker.worker.onmessage = (event: MessageEvent<WorkerResponse>) => {
+            if ("progress" in event.data) {
+                this.pending.get(event.data.id)?.keygen?.onProgress?.(event.data.progress)
+                return
             }
-        })
 
-        // @ts-ignore
-        wasi.initialize(instance)
-        certMaker.instance = instance
+            if ("stream" in event.data) {
+                this.pending.get(event.data.id)?.stream?.onOpen(event.data.stream)
+                return
+            }
+
+            poolWorker.busy = false
+            this.finishJob(event.data)
+            this.schedule()
+        }
+
+        const init: WorkerRequest = { type: "init", variant: "core", module: this.coreModule }
+        poolWorker.worker.postMessage(init)
 
-        return certMaker
+        this.workers.push(poolWorker)
+        return poolWorker
     }
 
-    private static pendingCertMaker: Promise<CertMaker> | undefined
-    static async get(): Promise<CertMaker>
+    private finishJob(response: WorkerResponse)
     {
-        if (!CertMaker.pendingCertMaker) {
-            CertMaker.pendingCertMaker = CertMaker.make()
+        const job = this.pending.get(response.id)
+        if (!job)
+            return
+
+        this.pending.delete(response.id)
+
+        if ("files" in response)
+            job.resolve(response.files)
+        else if ("errorCode" in response)
+            job.reject(new InterfaceException(response.errorCode))
+        else
+            job.reject(Error(response.errorMessage))
+    }
+
+    private schedule()
+    {
+        while (this.queue.length) {
+            let poolWorker = this.workers.find(w => !w.busy)
+            if (!poolWorker) {
+                if (this.workers.length >= this.maxWorkers)
+                    return
+
+                poolWorker = this.spawnWorker()
+            }
+
+            const job = this.queue.shift() as Job
+            this.pending.set(job.id, job)
+            poolWorker.busy = true
+            job.worker = poolWorker
+
+            if (job.keygen) {
+                const request: WorkerRequest = {
+                    type: "keygen",
+                    id: job.id,
+                    variant: job.variant,
+                    module: job.module,
+                    keyType: job.keygen.keyType,
+                    budgetMs: job.keygen.budgetMs,
+                }
+                poolWorker.worker.postMessage(request)
+                continue
+            }
+
+            if (job.stream) {
+                const request: WorkerRequest = {
+                    type: "stream",
+                    id: job.id,
+                    variant: job.variant,
+                    module: job.module,
+                    files: job.stream.files,
+                }
+                poolWorker.worker.postMessage(request, [...new Set(Object.values(job.stream.files).map(data => data.buffer as ArrayBuffer))])
+                continue
+            }
+
+            const transfer = new Set<ArrayBuffer>()
+            for (const call of job.calls) {
+                for (const data of Object.values(call.files))
+                    transfer.add(data.buffer as ArrayBuffer)
+            }
+
+            const request: WorkerRequest = {
+                type: "run",
+                id: job.id,
+                variant: job.variant,
+                module: job.module,
+                calls: job.calls,
+            }
+            poolWorker.worker.postMessage(request, [...transfer])
         }
+    }
 
-        return CertMaker.pendingCertMaker
+    private getModule(variant: ModuleVariant): Promise<WebAssembly.Module>
+    {
+        let module = this.modules.get(variant)
+        if (!module) {
+            module = WebAssembly.compileStreaming(fetchSignWasm(modulePaths[variant]))
+            this.modules.set(variant, module)
+        }
+
+        return module
     }
 
-    private setInput(c: WComms)
+    // The buffers in calls are transferred to the worker, callers must not use
+    // them afterwards.
+    private async dispatch(variant: ModuleVariant, calls: ModuleCall[]): Promise<ModuleFiles>
     {
-        this.input.truncate()
-        this.input.data = c.complete()
+        const module = await this.getModule(variant)
+
+        return new Promise((resolve, reject) => {
+            this.queue.push({ id: this.nextId++, variant, module, calls, resolve, reject })
+            this.schedule()
+        })
     }
 
-    makeCertificate(settings: CertificateSettings): CertificateKeyInfo
+    // Tries the core module first unless RSA is known to be needed. Whether
+    // user supplied keys or certificates are RSA is left to the module: if
+    // the core module can't read them, the calls are repeated with RSA support.
+    private async dispatchAny(rsaNeeded: boolean, makeCalls: () => ModuleCall[]): Promise<ModuleFiles>
     {
-        this.output.truncate()
-        const certFile = new File([], {readonly: false})
-        let keyFile: File
+        if (!rsaNeeded) {
+            try {
+                return await this.dispatch("core", makeCalls())
+            } catch (error) {
+                if (!(error instanceof InterfaceException) || !rsaRetryCodes.includes(error.code))
+                    throw error
+            }
+        }
+
+        return this.dispatch("rsa", makeCalls())
+    }
 
+    async generateKey(keyGen: KeyOption): Promise<string>
+    {
         const c = new WComms()
-        const subject = cleanSubject(settings)
-        c.addString(settings.issuerName ?? subject)
-        c.addString(subject)
+        c.addUint32(keyOptions.indexOf(keyGen))
+
+        const files = await this.dispatchAny(keyGen.type === "rsa", () => [{
+            exportName: "gen_key",
+            files: {
+                "input": c.complete(),
+                "key": new Uint8Array(),
+            },
+        }])
+
+        return new TextDecoder().decode(files["key"])
+    }
+
+    // Like generateKey, but the worker generates the key in steps of about
+    // budgetMs. onProgress gets an estimate between 0 and 1 after each step.
+    // Aborting the signal stops the key generation and rejects with its reason.
+    async generateKeyInSteps(keyGen: KeyOption, options: SteppedKeygenOptions = {}): Promise<string>
+    {
+        const { signal, onProgress, budgetMs = 50 } = options
+        signal?.throwIfAborted()
+
+        const variant: ModuleVariant = keyGen.type === "rsa" ? "rsa" : "core"
+        const module = await this.getModule(variant)
+        signal?.throwIfAborted()
+
+        const files = await new Promise<ModuleFiles>((resolve, reject) => {
+            const job: Job = {
+                id: this.nextId++,
+                variant,
+                module,
+                calls: [],
+                resolve,
+                reject,
+                keygen: { keyType: keyOptions.indexOf(keyGen), budgetMs, onProgress },
+            }
+
+            signal?.addEventListener("abort", () => this.cancelJob(job, signal.reason), { once: true })
 
-        c.addBool(settings.isCa)
-        c.addBool(settings.signMethod === "selfsigned")
+            this.queue.push(job)
+            this.schedule()
+        })
+
+        return new TextDecoder().decode(files["key"])
+    }
 
-        if (settings.signMethod === "selfsigned") {
-            keyFile = new File([], {readonly: false})
-            c.addString("") // AKID
+    // The worker stays busy until it notices, its answer is then ignored
+    private cancelJob(job: Job, reason: unknown)
+    {
+        const queued = this.queue.indexOf(job)
+        if (queued !== -1) {
+            this.queue.splice(queued, 1)
+        } else if (this.pending.delete(job.id)) {
+            const request: WorkerRequest = { type: "cancel", id: job.id }
+            job.worker?.worker.postMessage(request)
         } else {
-            keyFile = this.binaryFile(new TextEncoder().encode(settings.signMethod.pem))
-            c.addByteArray(settings.signMethod.akid)
+            return
         }
 
-        this.directory.dir.contents["cert"] = certFile
-        this.directory.dir.contents["key"] = keyFile
+        job.reject(reason instanceof Error ? reason : Error(String(reason)))
+    }
 
-        c.addUint32(settings.sanList.length)
-        for (const [type, value] of settings.sanList) {
-            c.addUint32(type)
-            c.addString(value)
-        }
-        c.addUint32(keyOptions.indexOf(settings.keyGen))
-        c.addUint32(mdOptions.indexOf(settings.md))
-        c.addString(validityString(settings.validity.notBefore))
-        c.addString(validityString(settings.validity.notAfter))
-        c.addUint32(settings.keyUsage)
-        c.addUint32(settings.extKeyUsage)
-        this.setInput(c)
+    // Several keys in one call. The threaded module generates them in
+    // parallel, others one after the other.
+    async generateKeys(keyGen: KeyOption, count: number): Promise<string[]>
+    {
+        const c = new WComms()
+        c.addUint32(keyOptions.indexOf(keyGen))
+        c.addUint32(count)
+
+        const files = await this.dispatchAny(keyGen.type === "rsa", () => [{
+            exportName: "gen_keys",
+            files: {
+                "input": c.complete(),
+            },
+        }])
+
+        const r = new RComms(files["result"])
+        const count = r.read_uint()
+        const keys: string[] = []
+        for (let i = 0; i < count; ++i)
+            keys.push(r.read_string())
+
+        return keys
+    }
 
-        // @ts-ignore
-        checkError(this.instance.exports.run())
+    async makeCertificate(settings: CertificateSettings): Promise<CertificateKeyInfo>
+    {
+        const files = await this.dispatchAny(settings.keyGen.type === "rsa", () => [{
+            exportName: "run",
+            files: certificateFiles(settings),
+        }])
 
-        const keyPem = new TextDecoder().decode(keyFile.data)
+        const keyPem = new TextDecoder().decode(files["key"])
 
-        return {...this.resultCert(), keyPem}
+        return {...resultCert(files), keyPem}
     }
 
-    private binaryFile(certificateData: ArrayBuffer)
+    // Keeps one worker issuing certificates until the stream is closed.
+    // Requests and results go through rings in the module's shared memory
+    // instead of a message and an export call each, so needs the threaded
+    // module. CA-signed requests are all signed with options.caKeyPem.
+    async openStream(options: StreamOptions = {}): Promise<CertStream>
     {
+        const { rsa = false, requestCapacity = 64 * 1024, resultCapacity = 256 * 1024 } = options
+
+        const variant: ModuleVariant = rsa ? "rsa" : "core"
+        const module = await this.getModule(variant)
+
         const c = new WComms()
-        c.addByteArray(certificateData)
-        return new File(c.complete(), {readonly: false})
+        c.addUint32(requestCapacity)
+        c.addUint32(resultCapacity)
+
+        const files: ModuleFiles = { "input": c.complete() }
+        if (options.caKeyPem)
+            files["key"] = binaryFile(new TextEncoder().encode(options.caKeyPem))
+        if (options.caCertPem)
+            files["issuer_cert"] = binaryFile(new TextEncoder().encode(options.caCertPem))
+
+        return new Promise((resolve, reject) => {
+            let stream: CertStream | undefined
+            const done = new Promise<void>((resolveDone, rejectDone) => {
+                this.queue.push({
+                    id: this.nextId++,
+                    variant,
+                    module,
+                    calls: [],
+                    resolve: () => resolveDone(),
+                    reject: error => stream ? rejectDone(error) : reject(error),
+                    stream: { files, onOpen: rings => resolve(stream = new CertStream(rings, done)) },
+                })
+                this.schedule()
+            })
+        })
     }
 
-    getCertificateInfo(certificateData: ArrayBuffer): CertificateInfo
+    async getCertificateInfo(certificateData: ArrayBuffer): Promise<CertificateInfo>
     {
-        this.output.truncate()
+        const files = await this.dispatchAny(false, () => [{
+            exportName: "cert_info",
+            files: {
+                "cert": binaryFile(certificateData),
+            },
+        }])
+
+        return resultCert(files)
+    }
+
+    async getCertificateKeyInfo(certificateData: ArrayBuffer, keyData: ArrayBuffer): Promise<CertificateKeyInfo>
+    {
+        const files = await this.dispatchAny(false, () => [{
+            exportName: "cert_key_info",
+            files: {
+                "cert": binaryFile(certificateData),
+                "key": binaryFile(keyData),
+            },
+        }])
+
+        const keyPem = new TextDecoder().decode(files["key"])
+        return {
+            ...resultCert(files),
+            keyPem,
+        }
+    }
 
-        const certFile = this.binaryFile(certificateData)
-        this.directory.dir.contents["cert"] = certFile
+    async makeZip(dosDate: number, dosTime: number, entries: ZipEntry[]): Promise<Uint8Array>
+    {
+        const begin = new WComms()
+        begin.addUint32(dosDate)
+        begin.addUint32(dosTime)
+
+        const calls: ModuleCall[] = [{ exportName: "zip_begin", files: { "input": begin.complete() } }]
+
+        for (const entry of entries) {
+            const c = new WComms()
+            c.addString(entry.fileName)
+            c.addByteArray(entry.content)
+            c.addUint32(entry.mode)
+            c.addBool(entry.compress)
+            calls.push({ exportName: "zip_add", files: { "input": c.complete() } })
+        }
 
-        // @ts-ignore
-        checkError(this.instance.exports.cert_info())
+        calls.push({ exportName: "zip_end", files: {} })
 
-        return this.resultCert()
+        const files = await this.dispatch("core", calls)
+        return files["result"]
     }
 
-    getCertificateKeyInfo(certificateData: ArrayBuffer, keyData: ArrayBuffer): CertificateKeyInfo
+    // Signs a CRL revoking the given certificates. Entries of `existingCrl`
+    // (DER or PEM, same CA) are carried over, new entries replace ones with the
+    // same serial.
+    async makeCrl(settings: CrlSettings): Promise<Uint8Array>
     {
-        this.output.truncate()
+        const files = await this.dispatchAny(false, () => {
+            const c = new WComms()
+            c.addUint32(mdOptions.indexOf(settings.md))
+            c.addString(validityString(settings.thisUpdate))
+            c.addString(validityString(settings.nextUpdate))
+            c.addUint32(settings.crlNumber)
+            c.addBool(settings.pem)
+            c.addUint32(settings.revoked.length)
+            for (const entry of settings.revoked) {
+                c.addByteArray(entry.serial)
+                c.addString(validityString(entry.revocationDate))
+                c.addUint32(entry.reason)
+            }
 
-        const certFile = this.binaryFile(certificateData)
-        const keyFile = this.binaryFile(keyData)
-        this.directory.dir.contents["cert"] = certFile
-        this.directory.dir.contents["key"] = keyFile
+            const moduleFiles: ModuleFiles = {
+                "input": c.complete(),
+                "cert": binaryFile(new TextEncoder().encode(settings.caCertPem)),
+                "key": binaryFile(new TextEncoder().encode(settings.caKeyPem)),
+            }
 
-        // @ts-ignore
-        checkError(this.instance.exports.cert_key_info())
+            if (settings.existingCrl)
+                moduleFiles["crl"] = binaryFile(settings.existingCrl)
 
-        const keyPem = new TextDecoder().decode(keyFile.data)
-        return {
-            ...this.resultCert(),
-            keyPem,
+            return [{ exportName: "write_crl", files: moduleFiles }]
+        })
+
+        return files["result"]
+    }
+
+    // SHA-1 and SHA-256 of every certificate in a PEM bundle or DER file
+    async getFingerprints(certificateData: ArrayBuffer): Promise<Fingerprints[]>
+    {
+        const files = await this.dispatchAny(false, () => [{
+            exportName: "fingerprints",
+            files: {
+                "cert": binaryFile(certificateData),
+            },
+        }])
+
+        const r = new RComms(files["result"])
+        const count = r.read_uint()
+        const result: Fingerprints[] = []
+        for (let i = 0; i < count; ++i) {
+            const sha1 = r.read_bytes()
+            const sha256 = r.read_bytes()
+            result.push({ sha1, sha256 })
         }
+
+        return result
     }
 
-    private resultCert(): CertificateInfo
+    // Every field of every certificate in a PEM bundle or DER file, decoded
+    // in a single pass by the module
+    async getCertificateDetails(certificateData: ArrayBuffer): Promise<CertificateDetails[]>
     {
-        const certFile = this.directory.dir.contents["cert"] as File
-        const r = new RComms(certFile.data)
+        const files = await this.dispatchAny(false, () => [{
+            exportName: "cert_details",
+            files: {
+                "cert": binaryFile(certificateData),
+            },
+        }])
+
+        return resultCertDetails(files)
+    }
 
-        const certPem = r.read_string()
-        const isCa = r.read_bool()
-        const subjectName = r.read_string()
-        const skid = r.read_bytes()
+    // Pre-signs one OCSP response per entry, returned as DER in input order.
+    async presignOcsp(settings: OcspSettings): Promise<ArrayBuffer[]>
+    {
+        const files = await this.dispatchAny(false, () => {
+            const c = new WComms()
+            c.addUint32(mdOptions.indexOf(settings.md))
+            c.addString(validityString(settings.thisUpdate))
+            c.addString(settings.nextUpdate ? validityString(settings.nextUpdate) : "")
+            c.addUint32(settings.entries.length)
+            for (const entry of settings.entries) {
+                c.addByteArray(entry.serial)
+                c.addUint32(entry.status)
+                c.addString(entry.revocationDate ? validityString(entry.revocationDate) : "")
+                c.addUint32(entry.reason ?? RevocationReason.Unspecified)
+            }
 
-        return {
-            certPem,
-            isCa,
-            subjectName,
-            skid,
+            return [{
+                exportName: "ocsp_sign",
+                files: {
+                    "input": c.complete(),
+                    "cert": binaryFile(new TextEncoder().encode(settings.caCertPem)),
+                    "key": binaryFile(new TextEncoder().encode(settings.caKeyPem)),
+                },
+            }]
+        })
+
+        const r = new RComms(files["result"])
+        const count = r.read_uint()
+        const responses: ArrayBuffer[] = []
+        for (let i = 0; i < count; ++i)
+            responses.push(r.read_bytes())
+
+        return responses
+    }
+
+    // New certificates for the same subjects and keys, issued by settings' CA
+    async resign(settings: ResignSettings): Promise<string[]>
+    {
+        const files = await this.dispatchAny(false, () => {
+            const c = new WComms()
+            c.addUint32(mdOptions.indexOf(settings.md))
+            c.addString(validityString(settings.validity.notBefore))
+            c.addString(validityString(settings.validity.notAfter))
+
+            return [{
+                exportName: "resign",
+                files: {
+                    "input": c.complete(),
+                    "cert": binaryFile(settings.certificates),
+                    "issuer_cert": binaryFile(new TextEncoder().encode(settings.caCertPem)),
+                    "key": binaryFile(new TextEncoder().encode(settings.caKeyPem)),
+                },
+            }]
+        })
+
+        const r = new RComms(files["result"])
+        const count = r.read_uint()
+        const certificates: string[] = []
+        for (let i = 0; i < count; ++i)
+            certificates.push(r.read_string())
+
+        return certificates
+    }
+}
+
+// A result of stream_serve: the status, then on success what write_cert
+// writes and the subject key as PEM
+function streamResult(record: Uint8Array): CertificateKeyInfo
+{
+    const r = new RComms(record)
+    const status = r.read_uint()
+    if (status !== InterfaceErrorCode.Success)
+        throw new InterfaceException(status)
+
+    const info = readCert(r)
+    const keyPem = new TextDecoder().decode(record.subarray(r.offset))
+    return { ...info, keyPem }
+}
+
+// A stream opened by CertMaker.openStream. Results come back in the order the
+// requests went in.
+export class CertStream {
+    private requests: SpscRing
+    private results: SpscRing
+    private waiting: { resolve: (info: CertificateKeyInfo) => void, reject: (error: Error) => void }[] = []
+    private sending: Promise<unknown> = Promise.resolve()
+    private reading = false
+    private closed = false
+    private error: Error | undefined
+    private stopped = () => this.error !== undefined
+    private done: Promise<void>
+
+    constructor(rings: StreamRings, done: Promise<void>)
+    {
+        const buffer = rings.memory.buffer as SharedArrayBuffer
+        this.requests = new SpscRing(buffer, rings.requestRing)
+        this.results = new SpscRing(buffer, rings.resultRing)
+        this.done = done
+        done.catch(error => this.fail(error))
+    }
+
+    private fail(error: Error)
+    {
+        this.error ??= error
+        for (const { reject } of this.waiting.splice(0))
+            reject(this.error)
+    }
+
+    // Like makeCertificate. The subject key is always generated by the
+    // module, subjectKeyPem isn't supported.
+    issue(settings: CertificateSettings): Promise<CertificateKeyInfo>
+    {
+        if (this.closed || this.error)
+            return Promise.reject(this.error ?? Error("Stream is closed"))
+
+        if (settings.subjectKeyPem)
+            return Promise.reject(Error("Streamed requests can't take a subject key"))
+
+        const input = certificateFiles(settings)["input"]
+        if (input.byteLength > this.requests.maxRecord)
+            return Promise.reject(Error("Request doesn't fit in the request ring"))
+
+        const result = new Promise<CertificateKeyInfo>((resolve, reject) => this.waiting.push({ resolve, reject }))
+        this.sending = this.sending.then(() => this.requests.pushWait(input, this.stopped))
+        this.readResults()
+
+        return result
+    }
+
+    private async readResults()
+    {
+        if (this.reading)
+            return
+
+        this.reading = true
+        while (this.waiting.length) {
+            const record = await this.results.popWait(this.stopped)
+            if (!record)
+                break
+
+            const { resolve, reject } = this.waiting.shift()!
+            try {
+                resolve(streamResult(record))
+            } catch (error) {
+                reject(error as Error)
+            }
         }
+        this.reading = false
+    }
+
+    // Resolves once the module has answered every request and the worker is
+    // free again
+    async close()
+    {
+        this.closed = true
+        await this.sending
+        await this.requests.closeWait(this.stopped)
+        await this.done
     }
 }
 
-type SignMethod = "selfsigned" | { pem: string, akid: ArrayBuffer }
+type SignMethod = "selfsigned" | { pem: string, akid: ArrayBuffer, certPem?: string }
 
 export interface CertificateSettings {
     issuerName?: string
     subjectName: string
     signMethod: SignMethod
     sanList: SANList
+    // Orders the SANs by their encoding and drops duplicates
+    sortSanList?: boolean
     keyGen: KeyOption
+    // Key from generateKey() to use instead of generating one for keyGen
+    subjectKeyPem?: string
     md: MD
     validity: ValidityRange
     keyUsage: KeyUsage
@@ -240,3 +713,151 @@ export type CertificateInfo = {
 export type CertificateKeyInfo = CertificateInfo & {
     keyPem: string
 }
+
+export type Fingerprints = {
+    sha1: ArrayBuffer
+    sha256: ArrayBuffer
+}
+
+export enum PublicKeyType {
+    Unknown = 0,
+    Rsa = 1,
+    Ec = 2,
+    Ed25519 = 3,
+    Ed448 = 4,
+}
+
+export type NameAttribute = {
+    // Short name like CN or O, or the dotted OID
+    name: string
+    value: string
+}
+
+// OIDs are the DER content bytes
+export type CertificateExtension = {
+    oid: ArrayBuffer
+    critical: boolean
+    value: ArrayBuffer
+}
+
+export type SubjectAltName = {
+    // GeneralName choice, e.g. 2 for dNSName and 7 for iPAddress
+    tag: number
+    value: ArrayBuffer
+}
+
+export type CertificateDetails = {
+    version: number
+    serial: ArrayBuffer
+    signatureAlgorithm: ArrayBuffer
+    issuer: NameAttribute[]
+    subject: NameAttribute[]
+    notBefore: Date
+    notAfter: Date
+    keyType: PublicKeyType
+    keyBits: number
+    curve: ArrayBuffer
+    extensions: CertificateExtension[]
+    // Only with a basic constraints extension
+    isCa?: boolean
+    pathLength?: number
+    // MBEDTLS_X509_KU_* bits, only with a key usage extension
+    keyUsage?: number
+    extKeyUsage: ArrayBuffer[]
+    subjectAltNames: SubjectAltName[]
+    skid?: ArrayBuffer
+    akid?: ArrayBuffer
+}
+
+// RFC 5280 CRLReason, 0 (unspecified) leaves the reason out
+export enum RevocationReason {
+    Unspecified = 0,
+    KeyCompromise = 1,
+    CaCompromise = 2,
+    AffiliationChanged = 3,
+    Superseded = 4,
+    CessationOfOperation = 5,
+    CertificateHold = 6,
+    RemoveFromCrl = 8,
+    PrivilegeWithdrawn = 9,
+    AaCompromise = 10,
+}
+
+export interface RevokedCertificate {
+    // Unsigned big-endian, at most 20 bytes
+    serial: ArrayBuffer
+    revocationDate: Date
+    reason: RevocationReason
+}
+
+export interface CrlSettings {
+    caCertPem: string
+    caKeyPem: string
+    md: MD
+    thisUpdate: Date
+    nextUpdate: Date
+    crlNumber: number
+    pem: boolean
+    revoked: RevokedCertificate[]
+    existingCrl?: ArrayBuffer
+}
+
+export enum OcspStatus {
+    Good = 0,
+    Revoked = 1,
+    Unknown = 2,
+}
+
+export interface OcspEntry {
+    // Unsigned big-endian, at most 20 bytes
+    serial: ArrayBuffer
+    status: OcspStatus
+    // Only for revoked serials
+    revocationDate?: Date
+    reason?: RevocationReason
+}
+
+export interface OcspSettings {
+    caCertPem: string
+    caKeyPem: string
+    md: MD
+    thisUpdate: Date
+    nextUpdate?: Date
+    entries: OcspEntry[]
+}
+
+export interface ResignSettings {
+    // PEM bundle or a single DER certificate
+    certificates: ArrayBuffer
+    caCertPem: string
+    caKeyPem: string
+    md: MD
+    validity: ValidityRange
+}
+
+export interface StreamOptions {
+    // Whether requests or the CA key use RSA
+    rsa?: boolean
+    // Powers of two of at least 4 KiB. A request or result can take up to
+    // half of its ring. 64 KiB and 256 KiB by default.
+    requestCapacity?: number
+    resultCapacity?: number
+    // For CA-signed requests
+    caKeyPem?: string
+    caCertPem?: string
+}
+
+export interface SteppedKeygenOptions {
+    signal?: AbortSignal
+    onProgress?: (progress: number) => void
+    // Longest the worker works before reporting progress and checking for
+    // cancellation, 50 ms by default
+    budgetMs?: number
+}
+
+export interface ZipEntry {
+    fileName: string
+    content: ArrayBuffer
+    mode: number
+    compress: boolean
+}
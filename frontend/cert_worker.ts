@@ -0,0 +1,143 @@
+import { InterfaceException } from "./interface_error"
+import { RComms } from "./rcomms"
+import { ModuleCall, ModuleFiles, SignModule } from "./sign_module"
+import { WComms } from "./wcomms"
+
+// Worker side of the CertMaker pool, each worker owns one module instance.
+
+// "core" is the small default module, "rsa" adds RSA support
+export type ModuleVariant = "core" | "rsa"
+
+export type WorkerRequest =
+    | { type: "init", variant: ModuleVariant, module: WebAssembly.Module }
+    | { type: "run", id: number, variant: ModuleVariant, module: WebAssembly.Module, calls: ModuleCall[] }
+    | { type: "keygen", id: number, variant: ModuleVariant, module: WebAssembly.Module, keyType: number, budgetMs: number }
+    | { type: "stream", id: number, variant: ModuleVariant, module: WebAssembly.Module, files: ModuleFiles }
+    | { type: "cancel", id: number }
+
+export type WorkerResponse =
+    | { id: number, files: {[name: string]: Uint8Array} }
+    | { id: number, progress: number }
+    | { id: number, stream: StreamRings }
+    | { id: number, errorCode: number }
+    | { id: number, errorMessage: string }
+
+// Where stream_open put the rings, in the module's shared memory
+export type StreamRings = {
+    memory: WebAssembly.Memory
+    requestRing: number
+    resultRing: number
+}
+
+const ctx = self as unknown as Worker
+
+const instances = new Map<ModuleVariant, Promise<SignModule>>()
+
+function getInstance(variant: ModuleVariant, module: WebAssembly.Module): Promise<SignModule>
+{
+    let instance = instances.get(variant)
+    if (!instance) {
+        instance = SignModule.instantiate(module)
+        instances.set(variant, instance)
+    }
+
+    return instance
+}
+
+// Keygen jobs that haven't settled yet, and those of them the main thread
+// gave up on, checked between steps. A cancel for a job that already settled
+// is dropped, so ids don't pile up.
+const running = new Set<number>()
+const cancelled = new Set<number>()
+
+// Runs keygen_step until the key is done, posting the progress after each step.
+// Yielding in between lets "cancel" messages through.
+async function generateKeyInSteps(signModule: SignModule, request: WorkerRequest & { type: "keygen" }): Promise<ModuleFiles>
+{
+    const begin = new WComms()
+    begin.addUint32(request.keyType)
+    signModule.run([{ exportName: "keygen_begin", files: { "input": begin.complete() } }])
+
+    for (;;) {
+        await new Promise(resolve => setTimeout(resolve, 0))
+
+        if (cancelled.delete(request.id)) {
+            signModule.run([{ exportName: "keygen_cancel", files: {} }])
+            throw Error("Key generation cancelled")
+        }
+
+        const step = new WComms()
+        step.addUint32(request.budgetMs)
+        const files = signModule.run([{ exportName: "keygen_step", files: { "input": step.complete() } }])
+
+        const r = new RComms(files["result"])
+        const done = r.read_bool()
+        const progress = r.read_uint() / 1000
+        r.read_uint() // Candidates tested
+
+        if (done)
+            return { "key": new Uint8Array(r.read_bytes()) }
+
+        const response: WorkerResponse = { id: request.id, progress }
+        ctx.postMessage(response)
+    }
+}
+
+// Opens the rings, hands them to the main thread and answers requests from
+// them until it closes the request ring. The worker is busy all that time.
+function serveStream(signModule: SignModule, request: WorkerRequest & { type: "stream" }): ModuleFiles
+{
+    const memory = signModule.memory
+    if (!memory || !(memory.buffer instanceof SharedArrayBuffer))
+        throw Error("Streaming needs the threaded module")
+
+    const files = signModule.run([{ exportName: "stream_open", files: request.files }])
+    const r = new RComms(files["result"])
+    const response: WorkerResponse = {
+        id: request.id,
+        stream: { memory, requestRing: r.read_uint(), resultRing: r.read_uint() },
+    }
+    ctx.postMessage(response)
+
+    return signModule.run([{ exportName: "stream_serve", files: {} }])
+}
+
+ctx.onmessage = async (event: MessageEvent<WorkerRequest>) => {
+    const request = event.data
+
+    if (request.type === "init") {
+        getInstance(request.variant, request.module)
+        return
+    }
+
+    if (request.type === "cancel") {
+        if (running.has(request.id))
+            cancelled.add(request.id)
+        return
+    }
+
+    let response: WorkerResponse
+    let transfer: Transferable[] = []
+
+    if (request.type === "keygen")
+        running.add(request.id)
+
+    try {
+        const signModule = await getInstance(request.variant, request.module)
+        const files = request.type === "keygen" ? await generateKeyInSteps(signModule, request)
+            : request.type === "stream" ? serveStream(signModule, request)
+            : signModule.run(request.calls)
+
+        response = { id: request.id, files }
+        transfer = [...new Set(Object.values(files).map(data => data.buffer))]
+    } catch (error) {
+        response = error instanceof InterfaceException
+            ? { id: request.id, errorCode: error.code }
+            : { id: request.id, errorMessage: String(error) }
+    } finally {
+        running.delete(request.id)
+        cancelled.delete(request.id)
+    }
+
+    ctx.postMessage(response, transfer)
+}
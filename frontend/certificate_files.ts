@@ -0,0 +1,215 @@
+import { keyOptions } from "./key_options"
+import { mdOptions } from "./md_options"
+import { RComms } from "./rcomms"
+import { WComms } from "./wcomms"
+import type { CertificateDetails, CertificateInfo, CertificateSettings, PublicKeyType } from "./cert_maker"
+import type { ModuleFiles } from "./sign_module"
+
+// How CertMaker's requests become the module's input files and how its result
+// files are read back. Shared with the Node addon's wrapper in node/, which
+// hands the same files to the native build.
+
+export function validityString(d: Date)
+{
+    const dateTimeStr = d.toISOString().substring(0, 19)
+    return Array.from(dateTimeStr).filter(c => c >= "0" && c <= "9").join("")
+}
+
+function cleanSubject(settings: CertificateSettings)
+{
+    let subject = settings.subjectName.trim()
+    if (subject.includes("CN=") || settings.sanList.length === 0)
+        return subject
+
+    return [subject, `CN=${settings.sanList[0][1]}`].filter(Boolean).join(",")
+}
+
+export function binaryFile(data: ArrayBuffer): Uint8Array
+{
+    const c = new WComms()
+    c.addByteArray(data)
+    return c.complete()
+}
+
+export function resultCert(files: ModuleFiles): CertificateInfo
+{
+    return readCert(new RComms(files["cert"]))
+}
+
+// What bb::write_cert writes, also found in the middle of stream results
+export function readCert(r: RComms): CertificateInfo
+{
+    const certPem = r.read_string()
+    const isCa = r.read_bool()
+    const subjectName = r.read_string()
+    const skid = r.read_bytes()
+
+    return {
+        certPem,
+        isCa,
+        subjectName,
+        skid,
+    }
+}
+
+// Field numbers of the cert_details export, bb::cert_field
+enum CertField {
+    End,
+    Version,
+    Serial,
+    SignatureAlgorithm,
+    IssuerAttribute,
+    NotBefore,
+    NotAfter,
+    SubjectAttribute,
+    PublicKey,
+    Extension,
+    BasicConstraints,
+    KeyUsage,
+    ExtKeyUsage,
+    SubjectAltName,
+    SubjectKeyId,
+    AuthorityKeyId,
+}
+
+const noPathLength = 0xffffffff
+
+// YYYYMMDDhhmmss in UTC
+function fieldDate(text: string): Date
+{
+    const part = (begin: number, end: number) => Number(text.substring(begin, end))
+    return new Date(Date.UTC(part(0, 4), part(4, 6) - 1, part(6, 8), part(8, 10), part(10, 12), part(12, 14)))
+}
+
+export function resultCertDetails(files: ModuleFiles): CertificateDetails[]
+{
+    const r = new RComms(files["result"])
+    const count = r.read_uint()
+    const result: CertificateDetails[] = []
+
+    for (let i = 0; i < count; ++i) {
+        const details: CertificateDetails = {
+            version: 1,
+            serial: new ArrayBuffer(0),
+            signatureAlgorithm: new ArrayBuffer(0),
+            issuer: [],
+            subject: [],
+            notBefore: new Date(0),
+            notAfter: new Date(0),
+            keyType: 0 as PublicKeyType,
+            keyBits: 0,
+            curve: new ArrayBuffer(0),
+            extensions: [],
+            extKeyUsage: [],
+            subjectAltNames: [],
+        }
+
+        for (let field = r.read_uint(); field !== CertField.End; field = r.read_uint()) {
+            switch (field) {
+                case CertField.Version:
+                    details.version = r.read_uint()
+                    break
+                case CertField.Serial:
+                    details.serial = r.read_bytes()
+                    break
+                case CertField.SignatureAlgorithm:
+                    details.signatureAlgorithm = r.read_bytes()
+                    break
+                case CertField.IssuerAttribute:
+                    details.issuer.push({ name: r.read_string(), value: r.read_string() })
+                    break
+                case CertField.NotBefore:
+                    details.notBefore = fieldDate(r.read_string())
+                    break
+                case CertField.NotAfter:
+                    details.notAfter = fieldDate(r.read_string())
+                    break
+                case CertField.SubjectAttribute:
+                    details.subject.push({ name: r.read_string(), value: r.read_string() })
+                    break
+                case CertField.PublicKey:
+                    details.keyType = r.read_uint()
+                    details.keyBits = r.read_uint()
+                    details.curve = r.read_bytes()
+                    break
+                case CertField.Extension:
+                    details.extensions.push({ oid: r.read_bytes(), critical: r.read_bool(), value: r.read_bytes() })
+                    break
+                case CertField.BasicConstraints: {
+                    details.isCa = r.read_bool()
+                    const pathLength = r.read_uint()
+                    if (pathLength !== noPathLength)
+                        details.pathLength = pathLength
+                    break
+                }
+                case CertField.KeyUsage:
+                    details.keyUsage = r.read_uint()
+                    break
+                case CertField.ExtKeyUsage:
+                    details.extKeyUsage.push(r.read_bytes())
+                    break
+                case CertField.SubjectAltName:
+                    details.subjectAltNames.push({ tag: r.read_uint(), value: r.read_bytes() })
+                    break
+                case CertField.SubjectKeyId:
+                    details.skid = r.read_bytes()
+                    break
+                case CertField.AuthorityKeyId:
+                    details.akid = r.read_bytes()
+                    break
+                default:
+                    throw Error(`Unknown certificate field ${field}`)
+            }
+        }
+
+        result.push(details)
+    }
+
+    return result
+}
+
+export function certificateFiles(settings: CertificateSettings): ModuleFiles
+{
+    const moduleFiles: ModuleFiles = {
+        "cert": new Uint8Array(),
+    }
+
+    const c = new WComms()
+    const subject = cleanSubject(settings)
+    c.addString(settings.issuerName ?? subject)
+    c.addString(subject)
+
+    c.addBool(settings.isCa)
+    c.addBool(settings.signMethod === "selfsigned")
+
+    if (settings.signMethod === "selfsigned") {
+        moduleFiles["key"] = new Uint8Array()
+        c.addString("") // AKID
+    } else {
+        moduleFiles["key"] = binaryFile(new TextEncoder().encode(settings.signMethod.pem))
+        c.addByteArray(settings.signMethod.akid)
+
+        // The issuer name is then copied from the CA's subject DER
+        if (settings.signMethod.certPem)
+            moduleFiles["issuer_cert"] = binaryFile(new TextEncoder().encode(settings.signMethod.certPem))
+    }
+
+    if (settings.subjectKeyPem)
+        moduleFiles["subject_key"] = binaryFile(new TextEncoder().encode(settings.subjectKeyPem))
+
+    c.addUint32(settings.sanList.length)
+    for (const [type, value] of settings.sanList) {
+        c.addUint32(type)
+        c.addString(value)
+    }
+    c.addBool(settings.sortSanList ?? false)
+    c.addUint32(keyOptions.indexOf(settings.keyGen))
+    c.addUint32(mdOptions.indexOf(settings.md))
+    c.addString(validityString(settings.validity.notBefore))
+    c.addString(validityString(settings.validity.notAfter))
+    c.addUint32(settings.keyUsage)
+    c.addUint32(settings.extKeyUsage)
+    moduleFiles["input"] = c.complete()
+
+    return moduleFiles
+}
@@ -25,6 +25,7 @@ const isDev = !envbool("OPTIMISE")
 const outDir = envstr("OUTPUT_DIR")
 const scratchDir = envstr("SCRATCH_DIR")
 const signPath = envstr("SIGN_PATH")
+const signRsaPath = envstr("SIGN_RSA_PATH")
 
 // Esbuild variables
 
@@ -50,6 +51,7 @@ const jsCommonSettings = {
     },
     alias: {
         "sign.wasm": signPath,
+        "sign_rsa.wasm": signRsaPath,
     },
 }
 
@@ -130,6 +132,27 @@ function mdRender(markdownText)
     }
 }
 
+// Worker bundles: cert_worker runs the WASM module off the main thread,
+// thread_worker runs the extra threads of a threaded module
+
+async function makeWorkerBundle(entryPoint) {
+    const result = await esbuild.build({
+        ...jsCommonSettings,
+        entryPoints: [entryPoint],
+        platform: "browser",
+        outdir: outDir,
+        entryNames: "[dir]/[name]-[hash]",
+        metafile: true,
+    })
+
+    for (const [output, props] of Object.entries(result.metafile.outputs)) {
+        if (props.entryPoint === entryPoint)
+            return path.basename(output)
+    }
+
+    throw Error("Couldn't find worker in esbuild result")
+}
+
 // Main application bundle
 
 async function makeBundle() {
@@ -282,6 +305,15 @@ async function saveHtml({html, pagePath, description}) {
 
 
 async function makeAppHtml(indexHtml) {
+    // The bundles refer to the workers by their hashed file names. Worker
+    // paths are relative to the worker that starts them, which is in the same
+    // directory.
+    const threadWorkerJs = await makeWorkerBundle("thread_worker.ts")
+    defines.THREAD_WORKER_PATH = JSON.stringify(`./${threadWorkerJs}`)
+
+    const workerJs = await makeWorkerBundle("cert_worker.ts")
+    defines.CERT_WORKER_PATH = JSON.stringify(`./${workerJs}`)
+
     const [prerender, bundleResult] = await Promise.all([
         getAppPrerender(),
         makeBundle(),
@@ -4,4 +4,6 @@ declare module "*.wasm" {
 }
 
 const DEBUG: boolean
+const CERT_WORKER_PATH: string
+const THREAD_WORKER_PATH: string
 function require(path: string): any
@@ -5,10 +5,14 @@ export enum InterfaceErrorCode
     ReadInput = 100,
     ReadCert,
     ReadKey,
+    ReadCrl,
 
     WriteCert = 200,
     WriteCertInfo,
     WriteKey,
+    WriteZip,
+    WriteCrl,
+    WriteMemStats,
 
     CertSetSerial = 300,
     CertSetValidity,
@@ -26,6 +30,11 @@ export enum InterfaceErrorCode
     KeyMismatch,
     ConvertPem,
     OpenFile,
+    GenerateCrl,
+    GenerateOcsp,
+    NoKeygenJob,
+    AuditLog,
+    NoStream,
 }
 
 export class InterfaceException extends Error {
@@ -0,0 +1,178 @@
+import { ConsoleStdout, File, OpenFile, PreopenDirectory, WASI } from "@bjorn3/browser_wasi_shim"
+import { InterfaceErrorCode, InterfaceException } from "./interface_error"
+import { RComms } from "./rcomms"
+import { ThreadStart, allowSharedDecode, createSharedMemory, fillRandom, isThreaded } from "./wasi_threads"
+
+function checkError(status: InterfaceErrorCode)
+{
+    if (status !== InterfaceErrorCode.Success)
+        throw new InterfaceException(status)
+}
+
+export type ModuleFiles = {[name: string]: Uint8Array}
+
+// One call of an exported function. The files are placed in the module's
+// directory before the call, "input" carries the RComms encoded arguments.
+export interface ModuleCall {
+    exportName: string
+    files: ModuleFiles
+}
+
+// Threads a threaded build starts for batched exports, the calling thread
+// included
+const maxModuleThreads = 8
+
+// Wraps a single instance of sign.wasm. Used from the worker threads, the
+// main thread talks to it through CertMaker.
+export class SignModule {
+    wasi: WASI
+    instance: WebAssembly.Instance | undefined
+    // Shared in threaded builds, the host can then work on it from other
+    // threads
+    memory: WebAssembly.Memory | undefined
+    directory: PreopenDirectory
+
+    private constructor(wasi: WASI, directory: PreopenDirectory)
+    {
+        this.wasi = wasi
+        this.directory = directory
+    }
+
+    private fillRandom(offset: number, length: number)
+    {
+        // @ts-ignore
+        const memory = this.instance.exports.memory.buffer as ArrayBuffer
+        globalThis.crypto.getRandomValues(new Uint8Array(memory, offset, length))
+    }
+
+    static async instantiate(module: WebAssembly.Module): Promise<SignModule>
+    {
+        const args: string[] = []
+        const env: string[] = []
+        const directory = new PreopenDirectory(".", {})
+        const fds = [
+            new OpenFile(new File([])),
+            ConsoleStdout.lineBuffered(msg => console.log(`[WASI stdout] ${msg}`)),
+            ConsoleStdout.lineBuffered(msg => console.warn(`[WASI stderr] ${msg}`)),
+            directory,
+        ]
+
+        const wasi = new WASI(args, env, fds, {debug: DEBUG})
+        const signModule = new SignModule(wasi, directory)
+
+        const imports: WebAssembly.Imports = {
+            wasi_snapshot_preview1: wasi.wasiImport,
+            crypto: {
+                fill_random: signModule.fillRandom.bind(signModule)
+            }
+        }
+
+        const threaded = isThreaded(module)
+        if (threaded)
+            SignModule.addThreadImports(module, imports)
+
+        const instance = await WebAssembly.instantiate(module, imports)
+
+        // Snapshotted builds ran their initialisation at build time and no
+        // longer export _initialize.
+        if ("_initialize" in instance.exports) {
+            // @ts-ignore
+            wasi.initialize(instance)
+        } else {
+            // @ts-ignore
+            wasi.inst = instance
+        }
+        signModule.instance = instance
+        signModule.memory = (threaded ? imports.env!.memory : instance.exports.memory) as WebAssembly.Memory
+
+        if (threaded) {
+            const threads = Math.min(maxModuleThreads, navigator.hardwareConcurrency || 1)
+            // @ts-ignore
+            instance.exports.set_thread_count(threads)
+        }
+
+        return signModule
+    }
+
+    // The memory is shared with a Worker per thread, each running its own
+    // instance of the module. Needs a cross-origin isolated page.
+    private static addThreadImports(module: WebAssembly.Module, imports: WebAssembly.Imports)
+    {
+        allowSharedDecode()
+
+        const memory = createSharedMemory()
+        let nextTid = 1
+
+        imports.env = { memory }
+        imports.wasi = {
+            "thread-spawn": (arg: number) => {
+                const start: ThreadStart = { module, memory, tid: nextTid++, arg }
+                new Worker(THREAD_WORKER_PATH).postMessage(start)
+                return start.tid
+            },
+        }
+        imports.crypto = {
+            fill_random: (offset: number, length: number) => fillRandom(memory, offset, length),
+        }
+    }
+
+    // Builds with BB_MEM_STATS count allocations, report them per export
+    private logMemStats(exportName: string)
+    {
+        const contents = this.directory.dir.contents
+
+        // @ts-ignore
+        checkError(this.instance.exports.mem_stats())
+        const r = new RComms((contents["mem_stats"] as File).data)
+        delete contents["mem_stats"]
+
+        const allocations = r.read_uint()
+        const frees = r.read_uint()
+        // 64-bit, low half first
+        const allocatedBytes = r.read_uint() + r.read_uint() * 2 ** 32
+        const [liveBytes, peakBytes, memoryBytes] = Array.from({length: 3}, () => r.read_uint())
+
+        const histogram = Array.from({length: r.read_uint()}, () => r.read_uint())
+
+        console.log(
+            `[sign] ${exportName}: ${allocations} allocations, ${frees} frees, ${allocatedBytes} bytes allocated, ` +
+            `${liveBytes} live, ${peakBytes} peak, ${memoryBytes} bytes linear memory`)
+
+        if (histogram.length)
+            console.log(`[sign] ${exportName} allocations by size (<=16, <=32, ...): ${histogram.join(" ")}`)
+    }
+
+    // Runs the calls in order and returns the directory's files afterwards.
+    // Files are kept between the calls of one sequence, so stateful exports
+    // such as zip_begin/zip_add/zip_end can be chained.
+    run(calls: ModuleCall[]): ModuleFiles
+    {
+        const contents = this.directory.dir.contents
+        for (const name of Object.keys(contents))
+            delete contents[name]
+
+        contents["result"] = new File([], {readonly: false})
+
+        for (const call of calls) {
+            for (const [name, data] of Object.entries(call.files))
+                contents[name] = new File(data, {readonly: false})
+
+            // @ts-ignore
+            checkError(this.instance.exports[call.exportName]())
+
+            if (DEBUG && call.exportName === "run") {
+                // @ts-ignore
+                console.log(`[sign] Host RNG calls during run: ${this.instance.exports.rng_host_calls()}`)
+            }
+
+            if ("mem_stats" in this.instance!.exports)
+                this.logMemStats(call.exportName)
+        }
+
+        const result: ModuleFiles = {}
+        for (const [name, file] of Object.entries(contents))
+            result[name] = (file as File).data
+
+        return result
+    }
+}
@@ -0,0 +1,178 @@
+// Host side of a ring in the threaded module's shared memory, the twin of
+// bb::SpscRing in src/spsc_ring.hpp. Same layout and markers: head at word 0,
+// capacity at word 1, tail at word 16, the data after 128 bytes. Records are
+// a uint32 length and that many bytes, padded to four, and never wrap.
+//
+// Both sides wait on the other's position word. The page can't block, so
+// waits here go through Atomics.waitAsync, or poll where it's missing.
+
+const headIndex = 0
+const capacityIndex = 1
+const tailIndex = 16
+const headerSize = 128
+
+const skipMarker = 0xffffffff
+const endMarker = 0xfffffffe
+
+// Longest wait before looking again, so a stopped stream is noticed
+const maxWaitMs = 100
+
+function padded(length: number)
+{
+    return (length + 3) & ~3
+}
+
+async function waitWhile(words: Int32Array, index: number, value: number)
+{
+    if ("waitAsync" in Atomics) {
+        // @ts-ignore
+        const result = Atomics.waitAsync(words, index, value | 0, maxWaitMs)
+        if (result.async)
+            await result.value
+        return
+    }
+
+    await new Promise(resolve => setTimeout(resolve, 1))
+}
+
+export class SpscRing {
+    private words: Int32Array
+    private data: Uint8Array
+    private view: DataView
+    readonly capacity: number
+
+    constructor(buffer: SharedArrayBuffer, address: number)
+    {
+        this.words = new Int32Array(buffer, address, headerSize / 4)
+        this.capacity = Atomics.load(this.words, capacityIndex) >>> 0
+        this.data = new Uint8Array(buffer, address + headerSize, this.capacity)
+        this.view = new DataView(buffer, address + headerSize, this.capacity)
+    }
+
+    // A record and its length take at most half the data area
+    get maxRecord(): number
+    {
+        return this.capacity / 2 - 4
+    }
+
+    private load(index: number): number
+    {
+        return Atomics.load(this.words, index) >>> 0
+    }
+
+    private store(index: number, position: number)
+    {
+        Atomics.store(this.words, index, position | 0)
+        Atomics.notify(this.words, index, 1)
+    }
+
+    // Producer. Appends a copy of payload, false if there's no room for it yet.
+    push(payload: Uint8Array): boolean
+    {
+        if (payload.byteLength > this.maxRecord)
+            throw Error(`Record of ${payload.byteLength} bytes doesn't fit in the ring`)
+
+        const tail = this.load(tailIndex)
+        const head = this.load(headIndex)
+        const offset = tail & (this.capacity - 1)
+        const size = 4 + padded(payload.byteLength)
+        const skip = this.capacity - offset < size ? this.capacity - offset : 0
+
+        if (this.capacity - ((tail - head) >>> 0) < skip + size)
+            return false
+
+        if (skip)
+            this.view.setUint32(offset, skipMarker, true)
+
+        const start = (offset + skip) & (this.capacity - 1)
+        this.view.setUint32(start, payload.byteLength, true)
+        this.data.set(payload, start + 4)
+        this.store(tailIndex, tail + skip + size)
+        return true
+    }
+
+    // Waits for room while stopped() is false. False once stopped.
+    async pushWait(payload: Uint8Array, stopped: () => boolean): Promise<boolean>
+    {
+        while (!stopped()) {
+            const head = this.load(headIndex)
+            if (this.push(payload))
+                return true
+
+            await waitWhile(this.words, headIndex, head)
+        }
+
+        return false
+    }
+
+    // Ends the ring, false if there's no room for the marker yet
+    close(): boolean
+    {
+        const tail = this.load(tailIndex)
+        const head = this.load(headIndex)
+        if (this.capacity - ((tail - head) >>> 0) < 4)
+            return false
+
+        this.view.setUint32(tail & (this.capacity - 1), endMarker, true)
+        this.store(tailIndex, tail + 4)
+        return true
+    }
+
+    async closeWait(stopped: () => boolean): Promise<boolean>
+    {
+        while (!stopped()) {
+            const head = this.load(headIndex)
+            if (this.close())
+                return true
+
+            await waitWhile(this.words, headIndex, head)
+        }
+
+        return false
+    }
+
+    // Consumer. A copy of the next record, undefined if the ring is empty or
+    // closed.
+    pop(): Uint8Array | undefined
+    {
+        for (;;) {
+            const head = this.load(headIndex)
+            const tail = this.load(tailIndex)
+            if (head === tail)
+                return undefined
+
+            const offset = head & (this.capacity - 1)
+            const length = this.view.getUint32(offset, true)
+
+            if (length === endMarker)
+                return undefined
+
+            if (length === skipMarker) {
+                this.store(headIndex, head + (this.capacity - offset))
+                continue
+            }
+
+            if (length > this.capacity - offset - 4)
+                throw Error("Corrupt ring record")
+
+            const record = this.data.slice(offset + 4, offset + 4 + length)
+            this.store(headIndex, head + 4 + padded(length))
+            return record
+        }
+    }
+
+    // Waits for a record while stopped() is false. Undefined once stopped.
+    async popWait(stopped: () => boolean): Promise<Uint8Array | undefined>
+    {
+        while (!stopped()) {
+            const tail = this.load(tailIndex)
+            const record = this.pop()
+            if (record)
+                return record
+
+            await waitWhile(this.words, tailIndex, tail)
+        }
+
+        return undefined
+    }
+}
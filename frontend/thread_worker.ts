@@ -0,0 +1,39 @@
+import { ConsoleStdout, OpenFile, File, WASI } from "@bjorn3/browser_wasi_shim"
+import { ThreadStart, allowSharedDecode, fillRandom } from "./wasi_threads"
+
+// One thread of the threaded module. Runs the thread's start function and
+// never returns: the module's pool threads live as long as the instance.
+
+const ctx = self as unknown as Worker
+
+allowSharedDecode()
+
+ctx.onmessage = async (event: MessageEvent<ThreadStart>) => {
+    const { module, memory, tid, arg } = event.data
+
+    // Threads only log, files are opened by the thread calling the export
+    const fds = [
+        new OpenFile(new File([])),
+        ConsoleStdout.lineBuffered(msg => console.log(`[WASI stdout ${tid}] ${msg}`)),
+        ConsoleStdout.lineBuffered(msg => console.warn(`[WASI stderr ${tid}] ${msg}`)),
+    ]
+    const wasi = new WASI([], [], fds, {debug: DEBUG})
+
+    const instance = await WebAssembly.instantiate(module, {
+        env: { memory },
+        wasi: {
+            // Pool threads don't start threads of their own
+            "thread-spawn": () => -1,
+        },
+        wasi_snapshot_preview1: wasi.wasiImport,
+        crypto: {
+            fill_random: (offset: number, length: number) => fillRandom(memory, offset, length),
+        },
+    })
+
+    // @ts-ignore
+    wasi.inst = instance
+
+    // @ts-ignore
+    instance.exports.wasi_thread_start(tid, arg)
+}
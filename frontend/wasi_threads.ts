@@ -0,0 +1,47 @@
+// Host side of wasi-threads for the threaded module (BB_WASI_THREADS). The
+// module imports a shared memory, and each thread it starts is another
+// instance of the same module on that memory, running in its own Worker.
+
+// Must match --initial-memory and --max-memory in CMakeLists.txt, in 64 KiB
+// pages.
+const initialPages = 256
+const maximumPages = 4096
+
+export interface ThreadStart {
+    module: WebAssembly.Module
+    memory: WebAssembly.Memory
+    tid: number
+    arg: number
+}
+
+export function isThreaded(module: WebAssembly.Module): boolean
+{
+    return WebAssembly.Module.imports(module).some(i => i.module === "wasi" && i.name === "thread-spawn")
+}
+
+export function createSharedMemory(): WebAssembly.Memory
+{
+    return new WebAssembly.Memory({ initial: initialPages, maximum: maximumPages, shared: true })
+}
+
+// getRandomValues refuses views of a SharedArrayBuffer
+export function fillRandom(memory: WebAssembly.Memory, offset: number, length: number)
+{
+    const bytes = new Uint8Array(length)
+    globalThis.crypto.getRandomValues(bytes)
+    new Uint8Array(memory.buffer, offset, length).set(bytes)
+}
+
+// So does TextDecoder, which the WASI shim uses on paths and console output.
+// Shared views are copied first. Only ever called in workers that host the
+// threaded module.
+export function allowSharedDecode()
+{
+    const decode = TextDecoder.prototype.decode
+    TextDecoder.prototype.decode = function(input?: AllowSharedBufferSource, options?: TextDecodeOptions) {
+        if (ArrayBuffer.isView(input) && input.buffer instanceof SharedArrayBuffer)
+            input = new Uint8Array(input.buffer, input.byteOffset, input.byteLength).slice()
+
+        return decode.call(this, input, options)
+    }
+}
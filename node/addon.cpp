@@ -0,0 +1,296 @@
+// Node-API addon running the issuance core natively.
+//
+// makeCertificate, getCertificateInfo and getCertificateKeyInfo take an object
+// with the files the module's run, cert_info and cert_key_info exports read
+// ("input", "cert", "key", "subject_key", "issuer_cert"), encoded the same way
+// as for the module. Each returns a Promise for an object with the files the
+// export writes: "cert", and "key" where it writes one. Empty files count as
+// missing, like the placeholders CertMaker passes for the outputs.
+//
+// The work runs on the libuv thread pool, so calls run in parallel. A failure
+// rejects with an Error whose code is the interface_error. index.ts wraps this
+// with CertMaker's signatures.
+
+#include <node_api.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cert_calls.hpp"
+#include "cstr.hpp"
+#include "interface_error.hpp"
+#include "rcomms.hpp"
+#include "wcomms.hpp"
+
+namespace {
+
+enum class operation {
+    make_certificate,
+    certificate_info,
+    certificate_key_info,
+};
+
+// Every file the calls read, see cert_calls.hpp
+const char* const file_names[] {
+    "input",
+    "cert",
+    "key",
+    "subject_key",
+    "issuer_cert",
+};
+
+const size_t file_count = sizeof(file_names) / sizeof(file_names[0]);
+
+// An output file, grows as it's written
+struct MemoryFile {
+    char* data = nullptr;
+    size_t size = 0;
+
+    MemoryFile() = default;
+    MemoryFile(const MemoryFile&) = delete;
+    MemoryFile& operator=(const MemoryFile&) = delete;
+
+    ~MemoryFile()
+    {
+        free(data);
+    }
+
+    FILE* open()
+    {
+        return open_memstream(&data, &size);
+    }
+};
+
+struct Work {
+    operation op;
+    bb::cstr files[file_count];
+
+    napi_async_work async_work = nullptr;
+    napi_deferred deferred = nullptr;
+
+    bb::interface_error status = bb::interface_error::success;
+    MemoryFile cert;
+    MemoryFile key;
+    bool wrote_key = false;
+};
+
+bb::opt<bb::rcomms> open_file(void* ctx, const char* name)
+{
+    auto& work = *static_cast<Work*>(ctx);
+    for (size_t i = 0; i != file_count; ++i) {
+        auto& file = work.files[i];
+        if (strcmp(file_names[i], name) != 0 || file.empty())
+            continue;
+
+        auto f = fmemopen(file.str, file.len, "rb");
+        if (!f)
+            return {};
+
+        return bb::rcomms{f};
+    }
+
+    return {};
+}
+
+// Only "cert" and "key" are written
+bb::opt<bb::wcomms> create_file(void* ctx, const char* name)
+{
+    auto& work = *static_cast<Work*>(ctx);
+    bool is_key = strcmp(name, "key") == 0;
+    if (!is_key && strcmp(name, "cert") != 0)
+        return {};
+
+    auto f = is_key ? work.key.open() : work.cert.open();
+    if (!f)
+        return {};
+
+    work.wrote_key = work.wrote_key || is_key;
+    return bb::wcomms{f};
+}
+
+// On a thread pool thread, mustn't touch JavaScript values
+void execute(napi_env, void* data)
+{
+    auto& work = *static_cast<Work*>(data);
+
+    bb::CallFiles files;
+    files.ctx = &work;
+    files.open = open_file;
+    files.create = create_file;
+
+    switch (work.op) {
+    case operation::make_certificate:
+        work.status = bb::run_call(files);
+        break;
+    case operation::certificate_info:
+        work.status = bb::cert_info_call(files);
+        break;
+    case operation::certificate_key_info:
+        work.status = bb::cert_key_info_call(files);
+        break;
+    }
+}
+
+// A Uint8Array with an ArrayBuffer of its own, RComms reads from its start
+napi_value make_file(napi_env env, const MemoryFile& file)
+{
+    void* data;
+    napi_value buffer;
+    napi_value array;
+    if (napi_create_arraybuffer(env, file.size, &data, &buffer) != napi_ok)
+        return nullptr;
+
+    memcpy(data, file.data, file.size);
+
+    if (napi_create_typedarray(env, napi_uint8_array, file.size, buffer, 0, &array) != napi_ok)
+        return nullptr;
+
+    return array;
+}
+
+napi_value make_error(napi_env env, bb::interface_error status)
+{
+    char message[64];
+    snprintf(message, sizeof(message), "Interface error %u", (unsigned)status);
+
+    napi_value message_value;
+    napi_value code;
+    napi_value error;
+    napi_create_string_utf8(env, message, NAPI_AUTO_LENGTH, &message_value);
+    napi_create_uint32(env, (uint32_t)status, &code);
+    napi_create_error(env, nullptr, message_value, &error);
+    napi_set_named_property(env, error, "code", code);
+
+    return error;
+}
+
+// Back on the JavaScript thread
+void complete(napi_env env, napi_status, void* data)
+{
+    auto work = static_cast<Work*>(data);
+
+    napi_value result = nullptr;
+    if (work->status == bb::interface_error::success && napi_create_object(env, &result) == napi_ok) {
+        auto cert = make_file(env, work->cert);
+        auto key = work->wrote_key ? make_file(env, work->key) : nullptr;
+
+        if (!cert || (work->wrote_key && !key)
+            || napi_set_named_property(env, result, "cert", cert) != napi_ok
+            || (key && napi_set_named_property(env, result, "key", key) != napi_ok))
+            result = nullptr;
+    }
+
+    if (result)
+        napi_resolve_deferred(env, work->deferred, result);
+    else
+        napi_reject_deferred(env, work->deferred, make_error(env, work->status));
+
+    napi_delete_async_work(env, work->async_work);
+    delete work;
+}
+
+// Copies the files out of the argument, the thread pool can't read JavaScript
+// values
+bool read_files(napi_env env, napi_value object, Work* work)
+{
+    napi_valuetype type;
+    if (napi_typeof(env, object, &type) != napi_ok || type != napi_object)
+        return false;
+
+    for (int i = 0; i != file_count; ++i) {
+        bool has;
+        if (napi_has_named_property(env, object, file_names[i], &has) != napi_ok)
+            return false;
+
+        if (!has)
+            continue;
+
+        napi_value value;
+        bool is_typedarray;
+        if (napi_get_named_property(env, object, file_names[i], &value) != napi_ok
+            || napi_is_typedarray(env, value, &is_typedarray) != napi_ok
+            || !is_typedarray)
+            return false;
+
+        napi_typedarray_type array_type;
+        size_t length;
+        void* data;
+        if (napi_get_typedarray_info(env, value, &array_type, &length, &data, nullptr, nullptr) != napi_ok
+            || array_type != napi_uint8_array)
+            return false;
+
+        if (length) {
+            work->files[i] = bb::cstr(length);
+            memcpy(work->files[i].str, data, length);
+        }
+    }
+
+    return true;
+}
+
+napi_value start(napi_env env, napi_callback_info info, operation op)
+{
+    size_t argc = 1;
+    napi_value files = nullptr;
+    if (napi_get_cb_info(env, info, &argc, &files, nullptr, nullptr) != napi_ok)
+        return nullptr;
+
+    auto work = new Work;
+    work->op = op;
+
+    if (argc < 1 || !read_files(env, files, work)) {
+        delete work;
+        napi_throw_type_error(env, nullptr, "Expected an object of Uint8Array files.");
+        return nullptr;
+    }
+
+    napi_value name;
+    napi_value promise;
+    bool queued = napi_create_string_utf8(env, "self_signed", NAPI_AUTO_LENGTH, &name) == napi_ok
+        && napi_create_promise(env, &work->deferred, &promise) == napi_ok
+        && napi_create_async_work(env, nullptr, name, execute, complete, work, &work->async_work) == napi_ok
+        && napi_queue_async_work(env, work->async_work) == napi_ok;
+
+    if (!queued) {
+        // The promise, if it was made, is never settled
+        if (work->async_work)
+            napi_delete_async_work(env, work->async_work);
+        delete work;
+        napi_throw_error(env, nullptr, "Couldn't queue work.");
+        return nullptr;
+    }
+
+    return promise;
+}
+
+napi_value make_certificate_js(napi_env env, napi_callback_info info)
+{
+    return start(env, info, operation::make_certificate);
+}
+
+napi_value get_certificate_info_js(napi_env env, napi_callback_info info)
+{
+    return start(env, info, operation::certificate_info);
+}
+
+napi_value get_certificate_key_info_js(napi_env env, napi_callback_info info)
+{
+    return start(env, info, operation::certificate_key_info);
+}
+
+} // namespace
+
+NAPI_MODULE_INIT()
+{
+    napi_property_descriptor properties[] {
+        { "makeCertificate", nullptr, make_certificate_js, nullptr, nullptr, nullptr, napi_enumerable, nullptr },
+        { "getCertificateInfo", nullptr, get_certificate_info_js, nullptr, nullptr, nullptr, napi_enumerable, nullptr },
+        { "getCertificateKeyInfo", nullptr, get_certificate_key_info_js, nullptr, nullptr, nullptr, napi_enumerable, nullptr },
+    };
+
+    if (napi_define_properties(env, exports, sizeof(properties) / sizeof(properties[0]), properties) != napi_ok)
+        return nullptr;
+
+    return exports;
+}
@@ -0,0 +1,27 @@
+// Bundles index.ts into OUTPUT_DIR/index.js, next to self_signed.node, and the
+// parity check into parity.js. Run by CMake, esbuild comes from the frontend's
+// dependencies.
+
+import { createRequire } from "node:module"
+
+const esbuild = createRequire(new URL("../frontend/package.json", import.meta.url))("esbuild")
+
+const outDir = process.env.OUTPUT_DIR
+if (outDir === undefined)
+    throw Error("Environment variable OUTPUT_DIR must be set.")
+
+await esbuild.build({
+    entryPoints: ["index.ts", "parity.ts"],
+    outdir: outDir,
+    bundle: true,
+    platform: "node",
+    format: "esm",
+    target: "node18",
+    charset: "utf8",
+    external: ["./self_signed.node"],
+    // parity.ts runs the unthreaded module through SignModule
+    define: {
+        DEBUG: "false",
+        THREAD_WORKER_PATH: "\"\"",
+    },
+})
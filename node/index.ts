@@ -0,0 +1,73 @@
+import { createRequire } from "node:module"
+import { binaryFile, certificateFiles, resultCert } from "../frontend/certificate_files"
+import { InterfaceException } from "../frontend/interface_error"
+import type { CertificateInfo, CertificateKeyInfo, CertificateSettings } from "../frontend/cert_maker"
+import type { ModuleFiles } from "../frontend/sign_module"
+
+// CertMaker's certificate functions for Node, running the native build of the
+// issuance code (addon.cpp) instead of sign.wasm. Settings are built from the
+// same option lists as in the frontend, they're exported here for that.
+
+export { keyOptions } from "../frontend/key_options"
+export { mdOptions } from "../frontend/md_options"
+export { KeyUsage } from "../frontend/key_usage"
+export { ExtKeyUsage } from "../frontend/ext_key_usage"
+export { SANType } from "../frontend/san_list"
+export { InterfaceErrorCode, InterfaceException } from "../frontend/interface_error"
+export type { CertificateInfo, CertificateKeyInfo, CertificateSettings }
+
+type AddonCall = (files: ModuleFiles) => Promise<ModuleFiles>
+
+interface Addon {
+    makeCertificate: AddonCall
+    getCertificateInfo: AddonCall
+    getCertificateKeyInfo: AddonCall
+}
+
+// Next to the bundled index.js
+const addon: Addon = createRequire(import.meta.url)("./self_signed.node")
+
+// Rejects with InterfaceException like CertMaker does
+async function call(fn: AddonCall, files: ModuleFiles): Promise<ModuleFiles>
+{
+    try {
+        return await fn(files)
+    } catch (error) {
+        const code = (error as { code?: unknown }).code
+        if (typeof code === "number")
+            throw new InterfaceException(code)
+
+        throw error
+    }
+}
+
+export async function makeCertificate(settings: CertificateSettings): Promise<CertificateKeyInfo>
+{
+    const files = await call(addon.makeCertificate, certificateFiles(settings))
+    const keyPem = new TextDecoder().decode(files["key"])
+
+    return {...resultCert(files), keyPem}
+}
+
+export async function getCertificateInfo(certificateData: ArrayBuffer): Promise<CertificateInfo>
+{
+    const files = await call(addon.getCertificateInfo, {
+        "cert": binaryFile(certificateData),
+    })
+
+    return resultCert(files)
+}
+
+export async function getCertificateKeyInfo(certificateData: ArrayBuffer, keyData: ArrayBuffer): Promise<CertificateKeyInfo>
+{
+    const files = await call(addon.getCertificateKeyInfo, {
+        "cert": binaryFile(certificateData),
+        "key": binaryFile(keyData),
+    })
+
+    const keyPem = new TextDecoder().decode(files["key"])
+    return {
+        ...resultCert(files),
+        keyPem,
+    }
+}
@@ -0,0 +1,298 @@
+import { deepStrictEqual } from "node:assert/strict"
+import { readFile } from "node:fs/promises"
+import { binaryFile, certificateFiles, resultCert, resultCertDetails } from "../frontend/certificate_files"
+import { InterfaceErrorCode, InterfaceException } from "../frontend/interface_error"
+import { ecP256 } from "../frontend/key_options"
+import { sha2_256 } from "../frontend/md_options"
+import { ModuleCall, ModuleFiles, SignModule } from "../frontend/sign_module"
+import type { CertificateDetails, CertificateInfo, CertificateKeyInfo, CertificateSettings } from "../frontend/cert_maker"
+import * as addon from "./index"
+
+// Checks that the addon gives the same answers as the module.
+//
+// Usage: node parity.js <sign.wasm> <sign_rsa.wasm>
+//
+// The modules have to come from an unthreaded build. Every case goes through
+// makeCertificate, getCertificateInfo or getCertificateKeyInfo on both sides
+// and the results are compared field by field, certificates decoded with the
+// module's cert_details. Serials, and keys and key identifiers where a new
+// key is generated, are random and left out.
+
+type Side = {
+    makeCertificate(settings: CertificateSettings): Promise<CertificateKeyInfo>
+    getCertificateInfo(certificateData: ArrayBuffer): Promise<CertificateInfo>
+    getCertificateKeyInfo(certificateData: ArrayBuffer, keyData: ArrayBuffer): Promise<CertificateKeyInfo>
+}
+
+// Subject and authority key identifier extensions
+const skidOid = "551d0e"
+const akidOid = "551d23"
+
+const [signPath, signRsaPath] = process.argv.slice(2)
+if (signPath === undefined || signRsaPath === undefined)
+    throw Error("Usage: node parity.js <sign.wasm> <sign_rsa.wasm>")
+
+const core = await SignModule.instantiate(await WebAssembly.compile(await readFile(signPath)))
+const rsa = await SignModule.instantiate(await WebAssembly.compile(await readFile(signRsaPath)))
+
+// Like CertMaker.dispatchAny: the core module first, unless RSA is known to
+// be needed, then again with RSA support if it couldn't read a key or cert
+function run(rsaNeeded: boolean, makeCalls: () => ModuleCall[]): ModuleFiles
+{
+    if (!rsaNeeded) {
+        try {
+            return core.run(makeCalls())
+        } catch (error) {
+            const retry = [InterfaceErrorCode.ReadCert, InterfaceErrorCode.ReadKey]
+            if (!(error instanceof InterfaceException) || !retry.includes(error.code))
+                throw error
+        }
+    }
+
+    return rsa.run(makeCalls())
+}
+
+const wasm: Side = {
+    async makeCertificate(settings)
+    {
+        const files = run(settings.keyGen.type === "rsa", () => [{ exportName: "run", files: certificateFiles(settings) }])
+        return { ...resultCert(files), keyPem: new TextDecoder().decode(files["key"]) }
+    },
+
+    async getCertificateInfo(certificateData)
+    {
+        const files = run(false, () => [{ exportName: "cert_info", files: { "cert": binaryFile(certificateData) } }])
+        return resultCert(files)
+    },
+
+    async getCertificateKeyInfo(certificateData, keyData)
+    {
+        const files = run(false, () => [{
+            exportName: "cert_key_info",
+            files: { "cert": binaryFile(certificateData), "key": binaryFile(keyData) },
+        }])
+
+        return { ...resultCert(files), keyPem: new TextDecoder().decode(files["key"]) }
+    },
+}
+
+const native: Side = addon
+
+function encode(text: string): ArrayBuffer
+{
+    return new TextEncoder().encode(text).buffer as ArrayBuffer
+}
+
+function hex(data: ArrayBuffer | Uint8Array): string
+{
+    const bytes = data instanceof Uint8Array ? data : new Uint8Array(data)
+    return Array.from(bytes, byte => byte.toString(16).padStart(2, "0")).join("")
+}
+
+// Buffers as hex and dates as strings, so assert prints readable differences
+function plain(value: unknown): unknown
+{
+    if (value instanceof ArrayBuffer || value instanceof Uint8Array)
+        return hex(value)
+
+    if (value instanceof Date)
+        return value.toISOString()
+
+    if (Array.isArray(value))
+        return value.map(plain)
+
+    if (typeof value === "object" && value !== null)
+        return Object.fromEntries(Object.entries(value).map(([key, field]) => [key, plain(field)]))
+
+    return value
+}
+
+function details(certPem: string): CertificateDetails
+{
+    const files = run(true, () => [{ exportName: "cert_details", files: { "cert": binaryFile(encode(certPem)) } }])
+    return resultCertDetails(files)[0]
+}
+
+// The decoded certificate without what's random. With a fixed key only the
+// serial is.
+function comparable(info: CertificateKeyInfo, fixedKey: boolean)
+{
+    const { serial, ...fields } = details(info.certPem)
+    const keyType = info.keyPem.split("\n")[0]
+
+    if (fixedKey)
+        return plain({ ...fields, isCa: info.isCa, subjectName: info.subjectName, skid: info.skid, keyType })
+
+    const { skid, akid, extensions, ...rest } = fields
+    return plain({
+        ...rest,
+        extensions: extensions.filter(ext => hex(ext.oid) !== skidOid && hex(ext.oid) !== akidOid),
+        hasSkid: skid !== undefined,
+        hasAkid: akid !== undefined,
+        isCa: info.isCa,
+        subjectName: info.subjectName,
+        skidLength: info.skid.byteLength,
+        keyType,
+    })
+}
+
+// The error code a call fails with, 0 if it succeeds
+async function errorCode(call: () => Promise<unknown>): Promise<number>
+{
+    try {
+        await call()
+        return InterfaceErrorCode.Success
+    } catch (error) {
+        if (error instanceof InterfaceException)
+            return error.code
+
+        throw error
+    }
+}
+
+const notBefore = new Date(Date.UTC(2025, 0, 1))
+const notAfter = new Date(Date.UTC(2026, 0, 1))
+
+function settings(overrides: Partial<CertificateSettings>): CertificateSettings
+{
+    return {
+        subjectName: "CN=parity",
+        signMethod: "selfsigned",
+        sanList: [],
+        keyGen: ecP256,
+        md: sha2_256,
+        validity: { notBefore, notAfter },
+        keyUsage: addon.KeyUsage.digitalSignature,
+        extKeyUsage: addon.ExtKeyUsage.none,
+        isCa: false,
+        ...overrides,
+    }
+}
+
+// Made by the addon, the same CA then signs on both sides
+const ca = await native.makeCertificate(settings({
+    subjectName: "CN=Parity CA,O=Self-signed,C=NL",
+    keyGen: addon.keyOptions[1],
+    md: addon.mdOptions[2],
+    keyUsage: addon.KeyUsage.keyCertSign | addon.KeyUsage.crlSign,
+    isCa: true,
+}))
+
+const subjectKey = await native.makeCertificate(settings({}))
+
+const caSigned = { pem: ca.keyPem, akid: ca.skid, certPem: ca.certPem }
+
+const issueCases: [string, CertificateSettings][] = [
+    ["self-signed P-256 server", settings({
+        subjectName: "CN=example.com",
+        sanList: [
+            [addon.SANType.dns, "example.com"],
+            [addon.SANType.dns, "*.example.com"],
+            [addon.SANType.ip, "192.0.2.1"],
+            [addon.SANType.ip, "2001:db8::1"],
+            [addon.SANType.email, "admin@example.com"],
+        ],
+        keyUsage: addon.KeyUsage.digitalSignature | addon.KeyUsage.keyEncipherment,
+        extKeyUsage: addon.ExtKeyUsage.serverAuth | addon.ExtKeyUsage.clientAuth,
+    })],
+    ["SAN only, sorted", settings({
+        subjectName: "",
+        sanList: [
+            [addon.SANType.dns, "b.example"],
+            [addon.SANType.dns, "a.example"],
+            [addon.SANType.dns, "b.example"],
+        ],
+        sortSanList: true,
+    })],
+    ["self-signed P-384 CA", settings({
+        subjectName: "CN=Root,OU=Testing,O=Self-signed",
+        keyGen: addon.keyOptions[1],
+        md: addon.mdOptions[3],
+        keyUsage: addon.KeyUsage.keyCertSign | addon.KeyUsage.crlSign | addon.KeyUsage.digitalSignature,
+        isCa: true,
+    })],
+    ["self-signed RSA 2048", settings({
+        keyGen: addon.keyOptions[2],
+        md: addon.mdOptions[0],
+        keyUsage: addon.KeyUsage.digitalSignature | addon.KeyUsage.keyEncipherment,
+        extKeyUsage: addon.ExtKeyUsage.codeSigning | addon.ExtKeyUsage.timeStamping,
+    })],
+    ["CA-signed leaf", settings({
+        subjectName: "CN=leaf.example",
+        signMethod: caSigned,
+        sanList: [[addon.SANType.dns, "leaf.example"]],
+        extKeyUsage: addon.ExtKeyUsage.serverAuth,
+    })],
+]
+
+const fixedKeyCases: [string, CertificateSettings][] = [
+    ["self-signed, given key", settings({
+        subjectName: "CN=given key",
+        subjectKeyPem: subjectKey.keyPem,
+        extKeyUsage: addon.ExtKeyUsage.emailProtection,
+    })],
+    ["CA-signed, given key", settings({
+        subjectName: "CN=given key,O=Leaf",
+        signMethod: caSigned,
+        subjectKeyPem: subjectKey.keyPem,
+        extKeyUsage: addon.ExtKeyUsage.any,
+    })],
+]
+
+const chain = encode(subjectKey.certPem + ca.certPem)
+
+// The module's own output goes through both sides too
+const fromModule = await wasm.makeCertificate(settings({ subjectName: "CN=made by the module" }))
+
+const infoCases: [string, ArrayBuffer][] = [
+    ["EC certificate", encode(subjectKey.certPem)],
+    ["chain, last certificate", chain],
+    ["made by the module", encode(fromModule.certPem)],
+]
+
+const keyInfoCases: [string, ArrayBuffer, ArrayBuffer][] = [
+    ["EC certificate and key", encode(subjectKey.certPem), encode(subjectKey.keyPem)],
+    ["chain, the CA's key", chain, encode(ca.keyPem)],
+    ["made by the module", encode(fromModule.certPem), encode(fromModule.keyPem)],
+]
+
+const errorCases: [string, (side: Side) => Promise<unknown>][] = [
+    ["key of another certificate", side => side.getCertificateKeyInfo(encode(subjectKey.certPem), encode(ca.keyPem))],
+    ["not a certificate", side => side.getCertificateInfo(encode("parity"))],
+    ["empty subject, no SANs", side => side.makeCertificate(settings({ subjectName: "" }))],
+]
+
+let failed = 0
+
+async function check(name: string, compute: (side: Side) => Promise<unknown>)
+{
+    try {
+        deepStrictEqual(await compute(native), await compute(wasm))
+        console.log(`ok      ${name}`)
+    } catch (error) {
+        ++failed
+        console.log(`FAILED  ${name}\n${error}`)
+    }
+}
+
+for (const [name, request] of issueCases)
+    await check(`makeCertificate: ${name}`, async side => comparable(await side.makeCertificate(request), false))
+
+for (const [name, request] of fixedKeyCases)
+    await check(`makeCertificate: ${name}`, async side => comparable(await side.makeCertificate(request), true))
+
+for (const [name, cert] of infoCases)
+    await check(`getCertificateInfo: ${name}`, async side => plain(await side.getCertificateInfo(cert)))
+
+for (const [name, cert, key] of keyInfoCases)
+    await check(`getCertificateKeyInfo: ${name}`, async side => plain(await side.getCertificateKeyInfo(cert, key)))
+
+for (const [name, call] of errorCases)
+    await check(`error: ${name}`, side => errorCode(() => call(side)))
+
+if (failed) {
+    console.log(`${failed} parity checks failed.`)
+    process.exit(1)
+}
+
+console.log("The addon and the module agree.")
@@ -4,15 +4,22 @@
 #include <mbedtls/pk.h>
 #include <mbedtls/x509_crt.h>
 
+#include "cstr.hpp"
+
 namespace bb {
 
 struct Cert : mbedtls_x509_crt {
+    // The DER that certificates parsed without copying point into. Destroyed
+    // after the chain.
+    cstr der;
+
     Cert() noexcept
     {
         mbedtls_x509_crt_init(static_cast<mbedtls_x509_crt*>(this));
     }
 
     Cert(Cert&& other) noexcept
+        : der{static_cast<cstr&&>(other.der)}
     {
         this->mbedtls_x509_crt::operator=(other);
         mbedtls_x509_crt_init(static_cast<mbedtls_x509_crt*>(&other));
@@ -27,6 +34,7 @@ struct Cert : mbedtls_x509_crt {
 
         this->mbedtls_x509_crt::operator=(other);
         mbedtls_x509_crt_init(static_cast<mbedtls_x509_crt*>(&other));
+        der = static_cast<cstr&&>(other.der);
 
         return *this;
     }
@@ -0,0 +1,178 @@
+#include <mbedtls/pk.h>
+
+#include <stdio.h>
+
+#include "cert.hpp"
+#include "cert_io.hpp"
+#include "cstr.hpp"
+#include "interface_key.hpp"
+#include "issue.hpp"
+#include "random.hpp"
+
+#include "cert_calls.hpp"
+
+namespace {
+
+// A file holding a single byte string, like "cert" and "key"
+bool read_file_data(const bb::CallFiles& files, const char* name, bb::cstr* out)
+{
+    auto c = files.open(files.ctx, name);
+    return c && bb::cread(*c, out);
+}
+
+bb::opt<bb::Cert> read_cert(const bb::CallFiles& files)
+{
+    bb::cstr data;
+    if (!read_file_data(files, "cert", &data)) {
+        fprintf(stderr, "Couldn't read cert file.\n");
+        return {};
+    }
+
+    return bb::parse_cert(static_cast<bb::cstr&&>(data));
+}
+
+bb::opt<bb::Key> read_key(const bb::CallFiles& files, const char* name)
+{
+    bb::cstr data;
+    if (!read_file_data(files, name, &data)) {
+        fprintf(stderr, "Couldn't read %s file.\n", name);
+        return {};
+    }
+
+    return bb::parse_key(data);
+}
+
+// before_write, then the certificate and the key if there is one
+bb::interface_error write_outputs(const bb::CallFiles& files, mbedtls_x509_crt* cert, mbedtls_pk_context* key)
+{
+    if (files.before_write) {
+        auto err = files.before_write(files.ctx, cert);
+        if (err != bb::interface_error::success)
+            return err;
+    }
+
+    if (key) {
+        auto key_out = files.create(files.ctx, "key");
+        if (!key_out || !bb::write_key(*key_out, key)) {
+            fprintf(stderr, "Couldn't write key.\n");
+            return bb::interface_error::write_key;
+        }
+    }
+
+    auto out = files.create(files.ctx, "cert");
+    if (!out) {
+        fprintf(stderr, "Couldn't open cert file.\n");
+        return bb::interface_error::open_file;
+    }
+
+    auto err = bb::write_cert(*out, cert);
+    if (err != bb::interface_error::success)
+        return err;
+
+    return (*out).good() ? bb::interface_error::success : bb::interface_error::write_cert;
+}
+
+} // namespace
+
+namespace bb {
+
+interface_error run_call(const CallFiles& files)
+{
+    IssueRequest request;
+    {
+        auto cc = files.open(files.ctx, "input");
+        if (!cc) {
+            fprintf(stderr, "Couldn't open input file.\n");
+            return interface_error::read_input;
+        }
+
+        if (!read_issue_request(*cc, &request))
+            return interface_error::read_input;
+    }
+
+    // The host can hand over a key made ahead of time by gen_key, e.g.
+    // generated in parallel with the CA certificate
+    cstr subject_key_data;
+    auto opt_subject_key = read_file_data(files, "subject_key", &subject_key_data)
+        ? parse_key(subject_key_data)
+        : generate_key(request.key_type);
+
+    if (!opt_subject_key) {
+        fprintf(stderr, "Couldn't get subject key.\n");
+        return interface_error::generate_key;
+    }
+
+    auto subject_key = &opt_subject_key.data;
+
+    mbedtls_pk_context* authority_key;
+    Key ak_owner;
+
+    if (request.self_signed) {
+        authority_key = subject_key;
+    } else if (auto key = read_key(files, "key")) {
+        ak_owner = static_cast<Key&&>(key.data);
+        authority_key = &ak_owner;
+    } else {
+        fprintf(stderr, "Couldn't get authority key.\n");
+        return interface_error::read_key;
+    }
+
+    // The CA certificate can come along with a CA-signed request, its subject
+    // is then used as the issuer name as is
+    cstr issuer_cert;
+    if (!request.self_signed && read_file_data(files, "issuer_cert", &issuer_cert))
+        request.issuer_cert = &issuer_cert;
+
+    cstr der_buffer;
+    Cert out_cert;
+    auto err = issue(request, subject_key, authority_key, &der_buffer, &out_cert);
+    if (err != interface_error::success)
+        return err;
+
+    return write_outputs(files, &out_cert, subject_key);
+}
+
+interface_error cert_info_call(const CallFiles& files)
+{
+    auto opt_cert = read_cert(files);
+    if (!opt_cert) {
+        fprintf(stderr, "Couldn't get certificate.\n");
+        return interface_error::read_cert;
+    }
+
+    mbedtls_x509_crt* last_cert = &*opt_cert;
+    while (last_cert->next)
+        last_cert = last_cert->next;
+
+    return write_outputs(files, last_cert, nullptr);
+}
+
+interface_error cert_key_info_call(const CallFiles& files)
+{
+    auto opt_cert = read_cert(files);
+    if (!opt_cert) {
+        fprintf(stderr, "Couldn't get certificate.\n");
+        return interface_error::read_cert;
+    }
+
+    auto opt_key = read_key(files, "key");
+    if (!opt_key) {
+        fprintf(stderr, "Couldn't get key.\n");
+        return interface_error::read_key;
+    }
+
+    auto& key = *opt_key;
+
+    mbedtls_x509_crt* cert = &*opt_cert;
+    while (cert && mbedtls_pk_check_pair(&cert->pk, &key, mt_rng, nullptr) != 0)
+        cert = cert->next;
+
+    if (!cert) {
+        fprintf(stderr, "No cert in chain matches given key.\n");
+        return interface_error::key_mismatch;
+    }
+
+    return write_outputs(files, cert, &key);
+}
+
+} // namespace bb
@@ -0,0 +1,43 @@
+#ifndef BB_CERT_CALLS_HPP
+#define BB_CERT_CALLS_HPP
+
+#include <mbedtls/x509_crt.h>
+
+#include "interface_error.hpp"
+#include "opt.hpp"
+#include "rcomms.hpp"
+#include "wcomms.hpp"
+
+namespace bb {
+
+// The files of a run, cert_info or cert_key_info call, by the names the
+// module uses: "input", "cert", "key", "subject_key" and "issuer_cert" are
+// read, "cert" and "key" written. The module opens them in its directory, the
+// Node addon and loadgen keep them in memory. Outputs are only created once
+// every input has been read, since "cert" and "key" can be both.
+struct CallFiles {
+    void* ctx = nullptr;
+
+    // Unset when the host didn't pass the file
+    opt<rcomms> (*open)(void* ctx, const char* name) = nullptr;
+    opt<wcomms> (*create)(void* ctx, const char* name) = nullptr;
+
+    // Optional, sees the certificate before it's written out. Any error ends
+    // the call with that error.
+    interface_error (*before_write)(void* ctx, const mbedtls_x509_crt* cert) = nullptr;
+};
+
+// The run export: issues a certificate for the request in "input" and writes
+// it and its key.
+interface_error run_call(const CallFiles& files);
+
+// The cert_info export: the last certificate of the chain in "cert".
+interface_error cert_info_call(const CallFiles& files);
+
+// The cert_key_info export: the certificate of the chain in "cert" that
+// belongs to the key in "key", and the key.
+interface_error cert_key_info_call(const CallFiles& files);
+
+} // namespace bb
+
+#endif // Header guard
@@ -0,0 +1,605 @@
+#include <mbedtls/asn1.h>
+#include <mbedtls/oid.h>
+
+#include <string.h>
+
+#include "cert_decode.hpp"
+#include "der.hpp"
+
+namespace {
+
+
+// A DER value, or the rest of one still to be read
+struct Der {
+    const unsigned char* p = nullptr;
+    const unsigned char* end = nullptr;
+
+    size_t size() const { return end - p; }
+    bool empty() const { return p == end; }
+
+    bool peek(unsigned char tag) const { return p != end && *p == tag; }
+
+    // Tag and definite length, at most four length bytes. content is the
+    // value, this moves past it.
+    bool next(unsigned char* tag, Der* content)
+    {
+        if (end - p < 2)
+            return false;
+
+        *tag = p[0];
+        size_t len = p[1];
+        p += 2;
+
+        if (len & 0x80) {
+            size_t length_bytes = len & 0x7f;
+            if (length_bytes == 0 || length_bytes > 4 || (size_t)(end - p) < length_bytes)
+                return false;
+
+            len = 0;
+            for (size_t i = 0; i != length_bytes; ++i)
+                len = len << 8 | *p++;
+        }
+
+        if ((size_t)(end - p) < len)
+            return false;
+
+        content->p = p;
+        content->end = p + len;
+        p += len;
+        return true;
+    }
+
+    bool next(unsigned char expected, Der* content)
+    {
+        unsigned char tag;
+        return next(&tag, content) && tag == expected;
+    }
+};
+
+bool oid_is(const Der& oid, const char* expected, size_t expected_len)
+{
+    return oid.size() == expected_len && memcmp(oid.p, expected, expected_len) == 0;
+}
+
+#define OID_IS(oid, name) oid_is(oid, name, MBEDTLS_OID_SIZE(name))
+
+void write_der(bb::wcomms& out, const Der& value)
+{
+    out.write_bytelen(value.p, value.size());
+}
+
+void write_field(bb::wcomms& out, bb::cert_field field)
+{
+    out.write_uint((uint32_t)field);
+}
+
+struct AttributeName {
+    const char* oid;
+    size_t oid_len;
+    const char* name;
+};
+
+#define ATTRIBUTE(oid, name) { oid, MBEDTLS_OID_SIZE(oid), name }
+
+// The names mbedtls_x509_dn_gets uses
+const AttributeName attribute_names[] {
+    ATTRIBUTE(MBEDTLS_OID_AT_CN, "CN"),
+    ATTRIBUTE(MBEDTLS_OID_AT_COUNTRY, "C"),
+    ATTRIBUTE(MBEDTLS_OID_AT_LOCALITY, "L"),
+    ATTRIBUTE(MBEDTLS_OID_AT_STATE, "ST"),
+    ATTRIBUTE(MBEDTLS_OID_AT_ORGANIZATION, "O"),
+    ATTRIBUTE(MBEDTLS_OID_AT_ORG_UNIT, "OU"),
+    ATTRIBUTE(MBEDTLS_OID_PKCS9_EMAIL, "emailAddress"),
+    ATTRIBUTE(MBEDTLS_OID_AT_SERIAL_NUMBER, "serialNumber"),
+    ATTRIBUTE(MBEDTLS_OID_AT_POSTAL_ADDRESS, "postalAddress"),
+    ATTRIBUTE(MBEDTLS_OID_AT_POSTAL_CODE, "postalCode"),
+    ATTRIBUTE(MBEDTLS_OID_AT_SUR_NAME, "SN"),
+    ATTRIBUTE(MBEDTLS_OID_AT_GIVEN_NAME, "GN"),
+    ATTRIBUTE(MBEDTLS_OID_AT_INITIALS, "initials"),
+    ATTRIBUTE(MBEDTLS_OID_AT_GENERATION_QUALIFIER, "generationQualifier"),
+    ATTRIBUTE(MBEDTLS_OID_AT_TITLE, "title"),
+    ATTRIBUTE(MBEDTLS_OID_AT_DN_QUALIFIER, "dnQualifier"),
+    ATTRIBUTE(MBEDTLS_OID_AT_PSEUDONYM, "pseudonym"),
+    ATTRIBUTE(MBEDTLS_OID_AT_UNIQUE_IDENTIFIER, "uniqueIdentifier"),
+    ATTRIBUTE(MBEDTLS_OID_DOMAIN_COMPONENT, "DC"),
+    ATTRIBUTE(MBEDTLS_OID_UID, "uid"),
+};
+
+void write_attribute_name(bb::wcomms& out, const Der& oid)
+{
+    for (auto& attribute : attribute_names) {
+        if (oid_is(oid, attribute.oid, attribute.oid_len)) {
+            out.write_bytelen(attribute.name, strlen(attribute.name));
+            return;
+        }
+    }
+
+    mbedtls_asn1_buf buf;
+    buf.tag = MBEDTLS_ASN1_OID;
+    buf.len = oid.size();
+    buf.p = const_cast<unsigned char*>(oid.p);
+
+    char dotted[128];
+    int len = mbedtls_oid_get_numeric_string(dotted, sizeof(dotted), &buf);
+    out.write_bytelen(dotted, len > 0 ? len : 0);
+}
+
+// Next code point of a BMPString or UniversalString, U+FFFD for ones that
+// aren't valid
+uint32_t next_code_point(Der* value, unsigned char tag)
+{
+    if (tag == MBEDTLS_ASN1_UNIVERSAL_STRING) {
+        if (value->size() < 4) {
+            value->p = value->end;
+            return 0xfffd;
+        }
+
+        uint32_t cp = (uint32_t)value->p[0] << 24 | value->p[1] << 16 | value->p[2] << 8 | value->p[3];
+        value->p += 4;
+        return cp <= 0x10ffff && (cp < 0xd800 || cp > 0xdfff) ? cp : 0xfffd;
+    }
+
+    if (value->size() < 2) {
+        value->p = value->end;
+        return 0xfffd;
+    }
+
+    uint32_t unit = value->p[0] << 8 | value->p[1];
+    value->p += 2;
+    if (unit < 0xd800 || unit > 0xdfff)
+        return unit;
+
+    if (unit > 0xdbff || value->size() < 2)
+        return 0xfffd;
+
+    uint32_t low = value->p[0] << 8 | value->p[1];
+    if (low < 0xdc00 || low > 0xdfff)
+        return 0xfffd;
+
+    value->p += 2;
+    return 0x10000 + ((unit - 0xd800) << 10) + (low - 0xdc00);
+}
+
+size_t utf8_encode(uint32_t cp, unsigned char* out)
+{
+    if (cp < 0x80) {
+        out[0] = (unsigned char)cp;
+        return 1;
+    }
+
+    if (cp < 0x800) {
+        out[0] = (unsigned char)(0xc0 | cp >> 6);
+        out[1] = (unsigned char)(0x80 | (cp & 0x3f));
+        return 2;
+    }
+
+    if (cp < 0x10000) {
+        out[0] = (unsigned char)(0xe0 | cp >> 12);
+        out[1] = (unsigned char)(0x80 | (cp >> 6 & 0x3f));
+        out[2] = (unsigned char)(0x80 | (cp & 0x3f));
+        return 3;
+    }
+
+    out[0] = (unsigned char)(0xf0 | cp >> 18);
+    out[1] = (unsigned char)(0x80 | (cp >> 12 & 0x3f));
+    out[2] = (unsigned char)(0x80 | (cp >> 6 & 0x3f));
+    out[3] = (unsigned char)(0x80 | (cp & 0x3f));
+    return 4;
+}
+
+// The other string types are written as they are. BMP and Universal strings
+// are converted, their UTF-8 length is counted first so the value can be
+// written in small pieces.
+void write_attribute_value(bb::wcomms& out, unsigned char tag, const Der& value)
+{
+    if (tag != MBEDTLS_ASN1_BMP_STRING && tag != MBEDTLS_ASN1_UNIVERSAL_STRING) {
+        write_der(out, value);
+        return;
+    }
+
+    unsigned char utf8[4];
+
+    uint32_t len = 0;
+    for (auto rest = value; !rest.empty();)
+        len += utf8_encode(next_code_point(&rest, tag), utf8);
+
+    out.write_uint(len);
+    for (auto rest = value; !rest.empty();)
+        out.write_exact(utf8, utf8_encode(next_code_point(&rest, tag), utf8));
+}
+
+// Name: SEQUENCE OF RelativeDistinguishedName, each a SET OF
+// AttributeTypeAndValue. Multi-valued RDNs come out as consecutive attributes.
+bool decode_name(Der name, bb::cert_field field, bb::wcomms& out)
+{
+    while (!name.empty()) {
+        Der rdn;
+        if (!name.next(bb::der_set, &rdn) || rdn.empty())
+            return false;
+
+        while (!rdn.empty()) {
+            Der attribute;
+            Der oid;
+            Der value;
+            unsigned char value_tag;
+            if (!rdn.next(bb::der_sequence, &attribute)
+                || !attribute.next(MBEDTLS_ASN1_OID, &oid)
+                || !attribute.next(&value_tag, &value)
+                || !attribute.empty())
+            {
+                return false;
+            }
+
+            write_field(out, field);
+            write_attribute_name(out, oid);
+            write_attribute_value(out, value_tag, value);
+        }
+    }
+
+    return true;
+}
+
+bool is_digits(const unsigned char* p, size_t len)
+{
+    for (size_t i = 0; i != len; ++i) {
+        if (p[i] < '0' || p[i] > '9')
+            return false;
+    }
+
+    return true;
+}
+
+// UTCTime YYMMDDhhmmssZ or GeneralizedTime YYYYMMDDhhmmssZ, both as
+// YYYYMMDDhhmmss. Two digit years are 1950 to 2049 as RFC 5280 says.
+bool decode_time(Der* validity, bb::cert_field field, bb::wcomms& out)
+{
+    unsigned char tag;
+    Der time;
+    if (!validity->next(&tag, &time))
+        return false;
+
+    char text[14];
+    if (tag == MBEDTLS_ASN1_UTC_TIME && time.size() == 13 && is_digits(time.p, 12) && time.p[12] == 'Z') {
+        bool before_2000 = time.p[0] >= '5';
+        text[0] = before_2000 ? '1' : '2';
+        text[1] = before_2000 ? '9' : '0';
+        memcpy(text + 2, time.p, 12);
+    } else if (tag == MBEDTLS_ASN1_GENERALIZED_TIME && time.size() == 15 && is_digits(time.p, 14) && time.p[14] == 'Z') {
+        memcpy(text, time.p, 14);
+    } else {
+        return false;
+    }
+
+    write_field(out, field);
+    out.write_bytelen(text, sizeof(text));
+    return true;
+}
+
+struct CurveSize {
+    const char* oid;
+    size_t oid_len;
+    uint32_t bits;
+};
+
+#define CURVE(oid, bits) { oid, MBEDTLS_OID_SIZE(oid), bits }
+
+const CurveSize curve_sizes[] {
+    CURVE(MBEDTLS_OID_EC_GRP_SECP256R1, 256),
+    CURVE(MBEDTLS_OID_EC_GRP_SECP384R1, 384),
+    CURVE(MBEDTLS_OID_EC_GRP_SECP521R1, 521),
+    CURVE(MBEDTLS_OID_EC_GRP_SECP256K1, 256),
+    CURVE(MBEDTLS_OID_EC_GRP_BP256R1, 256),
+    CURVE(MBEDTLS_OID_EC_GRP_BP384R1, 384),
+    CURVE(MBEDTLS_OID_EC_GRP_BP512R1, 512),
+};
+
+// Bits of an unsigned big-endian integer
+uint32_t bit_length(Der value)
+{
+    while (!value.empty() && *value.p == 0)
+        ++value.p;
+
+    if (value.empty())
+        return 0;
+
+    return (uint32_t)value.size() * 8 - (__builtin_clz(*value.p) - 24);
+}
+
+// SubjectPublicKeyInfo: the key type and size, not the key
+bool decode_public_key(Der spki, bb::wcomms& out)
+{
+    Der algorithm;
+    Der oid;
+    Der key;
+    if (!spki.next(bb::der_sequence, &algorithm)
+        || !algorithm.next(MBEDTLS_ASN1_OID, &oid)
+        || !spki.next(MBEDTLS_ASN1_BIT_STRING, &key)
+        || key.empty() || *key.p != 0)
+    {
+        return false;
+    }
+    ++key.p;
+
+    auto type = bb::public_key_type::unknown;
+    uint32_t bits = 0;
+    Der curve;
+
+    if (OID_IS(oid, MBEDTLS_OID_PKCS1_RSA) || OID_IS(oid, MBEDTLS_OID_RSASSA_PSS)) {
+        type = bb::public_key_type::rsa;
+
+        Der rsa_key;
+        Der modulus;
+        if (key.next(bb::der_sequence, &rsa_key) && rsa_key.next(MBEDTLS_ASN1_INTEGER, &modulus))
+            bits = bit_length(modulus);
+    } else if (OID_IS(oid, MBEDTLS_OID_EC_ALG_UNRESTRICTED)) {
+        type = bb::public_key_type::ec;
+
+        if (algorithm.peek(MBEDTLS_ASN1_OID) && algorithm.next(MBEDTLS_ASN1_OID, &curve)) {
+            for (auto& size : curve_sizes) {
+                if (oid_is(curve, size.oid, size.oid_len))
+                    bits = size.bits;
+            }
+        }
+    } else if (OID_IS(oid, MBEDTLS_OID_ED25519)) {
+        type = bb::public_key_type::ed25519;
+        bits = 256;
+    } else if (OID_IS(oid, MBEDTLS_OID_ED448)) {
+        type = bb::public_key_type::ed448;
+        bits = 456;
+    }
+
+    write_field(out, bb::cert_field::public_key);
+    out.write_uint((uint32_t)type);
+    out.write_uint(bits);
+    write_der(out, curve);
+    return true;
+}
+
+// BasicConstraints ::= SEQUENCE { cA BOOLEAN DEFAULT FALSE, pathLenConstraint INTEGER OPTIONAL }
+bool decode_basic_constraints(Der value, bb::wcomms& out)
+{
+    Der constraints;
+    if (!value.next(bb::der_sequence, &constraints))
+        return false;
+
+    bool ca = false;
+    Der part;
+    if (constraints.peek(MBEDTLS_ASN1_BOOLEAN)) {
+        if (!constraints.next(MBEDTLS_ASN1_BOOLEAN, &part) || part.size() != 1)
+            return false;
+
+        ca = *part.p != 0;
+    }
+
+    uint32_t path_length = bb::no_path_length;
+    if (constraints.peek(MBEDTLS_ASN1_INTEGER)) {
+        if (!constraints.next(MBEDTLS_ASN1_INTEGER, &part) || part.empty() || part.size() > 4 || (*part.p & 0x80))
+            return false;
+
+        path_length = 0;
+        for (auto p = part.p; p != part.end; ++p)
+            path_length = path_length << 8 | *p;
+    }
+
+    write_field(out, bb::cert_field::basic_constraints);
+    out.write_bool(ca);
+    out.write_uint(path_length);
+    return true;
+}
+
+// KeyUsage BIT STRING, the first byte of named bits is the low byte like
+// Mbed TLS' MBEDTLS_X509_KU_* flags
+bool decode_key_usage(Der value, bb::wcomms& out)
+{
+    Der bits;
+    if (!value.next(MBEDTLS_ASN1_BIT_STRING, &bits) || bits.empty())
+        return false;
+
+    uint32_t usage = 0;
+    for (size_t i = 1; i != bits.size() && i <= 2; ++i)
+        usage |= (uint32_t)bits.p[i] << (8 * (i - 1));
+
+    write_field(out, bb::cert_field::key_usage);
+    out.write_uint(usage);
+    return true;
+}
+
+bool decode_ext_key_usage(Der value, bb::wcomms& out)
+{
+    Der purposes;
+    if (!value.next(bb::der_sequence, &purposes))
+        return false;
+
+    while (!purposes.empty()) {
+        Der oid;
+        if (!purposes.next(MBEDTLS_ASN1_OID, &oid))
+            return false;
+
+        write_field(out, bb::cert_field::ext_key_usage);
+        write_der(out, oid);
+    }
+
+    return true;
+}
+
+// GeneralNames, any of the choices. Constructed ones (otherName,
+// directoryName, ...) give their content DER.
+bool decode_subject_alt_name(Der value, bb::wcomms& out)
+{
+    Der names;
+    if (!value.next(bb::der_sequence, &names))
+        return false;
+
+    while (!names.empty()) {
+        unsigned char tag;
+        Der name;
+        if (!names.next(&tag, &name) || (tag & MBEDTLS_ASN1_TAG_CLASS_MASK) != MBEDTLS_ASN1_CONTEXT_SPECIFIC)
+            return false;
+
+        write_field(out, bb::cert_field::subject_alt_name);
+        out.write_uint(tag & MBEDTLS_ASN1_TAG_VALUE_MASK);
+        write_der(out, name);
+    }
+
+    return true;
+}
+
+bool decode_subject_key_id(Der value, bb::wcomms& out)
+{
+    Der id;
+    if (!value.next(MBEDTLS_ASN1_OCTET_STRING, &id))
+        return false;
+
+    write_field(out, bb::cert_field::subject_key_id);
+    write_der(out, id);
+    return true;
+}
+
+// AuthorityKeyIdentifier ::= SEQUENCE { keyIdentifier [0] IMPLICIT OPTIONAL, ... }
+bool decode_authority_key_id(Der value, bb::wcomms& out)
+{
+    Der akid;
+    if (!value.next(bb::der_sequence, &akid))
+        return false;
+
+    Der id;
+    if (!akid.peek(MBEDTLS_ASN1_CONTEXT_SPECIFIC | 0))
+        return true;
+
+    if (!akid.next(MBEDTLS_ASN1_CONTEXT_SPECIFIC | 0, &id))
+        return false;
+
+    write_field(out, bb::cert_field::authority_key_id);
+    write_der(out, id);
+    return true;
+}
+
+bool decode_extensions(Der extensions, bb::wcomms& out)
+{
+    Der list;
+    if (!extensions.next(bb::der_sequence, &list) || !extensions.empty())
+        return false;
+
+    while (!list.empty()) {
+        Der extension;
+        Der oid;
+        Der part;
+        Der value;
+        bool critical = false;
+
+        if (!list.next(bb::der_sequence, &extension) || !extension.next(MBEDTLS_ASN1_OID, &oid))
+            return false;
+
+        if (extension.peek(MBEDTLS_ASN1_BOOLEAN)) {
+            if (!extension.next(MBEDTLS_ASN1_BOOLEAN, &part) || part.size() != 1)
+                return false;
+
+            critical = *part.p != 0;
+        }
+
+        if (!extension.next(MBEDTLS_ASN1_OCTET_STRING, &value) || !extension.empty())
+            return false;
+
+        write_field(out, bb::cert_field::extension);
+        write_der(out, oid);
+        out.write_bool(critical);
+        write_der(out, value);
+
+        bool ok = true;
+        if (OID_IS(oid, MBEDTLS_OID_BASIC_CONSTRAINTS))
+            ok = decode_basic_constraints(value, out);
+        else if (OID_IS(oid, MBEDTLS_OID_KEY_USAGE))
+            ok = decode_key_usage(value, out);
+        else if (OID_IS(oid, MBEDTLS_OID_EXTENDED_KEY_USAGE))
+            ok = decode_ext_key_usage(value, out);
+        else if (OID_IS(oid, MBEDTLS_OID_SUBJECT_ALT_NAME))
+            ok = decode_subject_alt_name(value, out);
+        else if (OID_IS(oid, MBEDTLS_OID_SUBJECT_KEY_IDENTIFIER))
+            ok = decode_subject_key_id(value, out);
+        else if (OID_IS(oid, MBEDTLS_OID_AUTHORITY_KEY_IDENTIFIER))
+            ok = decode_authority_key_id(value, out);
+
+        if (!ok)
+            return false;
+    }
+
+    return true;
+}
+
+} // namespace
+
+namespace bb {
+
+bool decode_cert(const unsigned char* der, size_t len, wcomms& out)
+{
+    Der input{der, der + len};
+    Der cert;
+    Der tbs;
+    if (!input.next(der_sequence, &cert) || !cert.next(der_sequence, &tbs))
+        return false;
+
+    uint32_t version = 1;
+    Der part;
+    if (tbs.peek(der_context(0))) {
+        Der version_int;
+        if (!tbs.next(der_context(0), &part)
+            || !part.next(MBEDTLS_ASN1_INTEGER, &version_int)
+            || version_int.size() != 1 || *version_int.p > 2)
+        {
+            return false;
+        }
+
+        version = *version_int.p + 1;
+    }
+
+    write_field(out, cert_field::version);
+    out.write_uint(version);
+
+    if (!tbs.next(MBEDTLS_ASN1_INTEGER, &part) || part.empty())
+        return false;
+
+    write_field(out, cert_field::serial);
+    write_der(out, part);
+
+    Der algorithm;
+    Der oid;
+    if (!tbs.next(der_sequence, &algorithm) || !algorithm.next(MBEDTLS_ASN1_OID, &oid))
+        return false;
+
+    write_field(out, cert_field::signature_algorithm);
+    write_der(out, oid);
+
+    Der validity;
+    if (!tbs.next(der_sequence, &part)
+        || !decode_name(part, cert_field::issuer_attribute, out)
+        || !tbs.next(der_sequence, &validity)
+        || !decode_time(&validity, cert_field::not_before, out)
+        || !decode_time(&validity, cert_field::not_after, out)
+        || !tbs.next(der_sequence, &part)
+        || !decode_name(part, cert_field::subject_attribute, out)
+        || !tbs.next(der_sequence, &part)
+        || !decode_public_key(part, out))
+    {
+        return false;
+    }
+
+    // issuerUniqueID [1] and subjectUniqueID [2], nobody uses them
+    const unsigned char issuer_unique_id = MBEDTLS_ASN1_CONTEXT_SPECIFIC | 1;
+    const unsigned char subject_unique_id = MBEDTLS_ASN1_CONTEXT_SPECIFIC | 2;
+    if (tbs.peek(issuer_unique_id) && !tbs.next(issuer_unique_id, &part))
+        return false;
+
+    if (tbs.peek(subject_unique_id) && !tbs.next(subject_unique_id, &part))
+        return false;
+
+    if (tbs.peek(der_context(3)) && (!tbs.next(der_context(3), &part) || !decode_extensions(part, out)))
+        return false;
+
+    if (!tbs.empty())
+        return false;
+
+    write_field(out, cert_field::end);
+    return true;
+}
+
+} // namespace bb
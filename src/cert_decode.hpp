@@ -0,0 +1,57 @@
+#ifndef BB_CERT_DECODE_HPP
+#define BB_CERT_DECODE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wcomms.hpp"
+
+namespace bb {
+
+// Fields of decode_cert's output. Each is written as its number, then the
+// values listed. Strings and byte strings are length prefixed as usual, OIDs
+// are the DER content bytes.
+enum class [[clang::enum_extensibility(closed)]] cert_field {
+    end,                 // Nothing, closes the certificate
+    version,             // uint, 1 to 3
+    serial,              // bytes, the INTEGER's content octets
+    signature_algorithm, // OID
+    issuer_attribute,    // string name, string value; once per attribute
+    not_before,          // string, YYYYMMDDhhmmss in UTC
+    not_after,           // string, same
+    subject_attribute,   // string name, string value; once per attribute
+    public_key,          // uint public_key_type, uint bits, OID of the curve or empty
+    extension,           // OID, bool critical, bytes value; every extension
+    basic_constraints,   // bool ca, uint path length or no_path_length
+    key_usage,           // uint, bb::key_usage bits
+    ext_key_usage,       // OID; once per purpose
+    subject_alt_name,    // uint GeneralName tag number, bytes content
+    subject_key_id,      // bytes
+    authority_key_id,    // bytes, the keyIdentifier
+    max_enum_value = authority_key_id,
+};
+
+enum class [[clang::enum_extensibility(closed)]] public_key_type {
+    unknown,
+    rsa,
+    ec,
+    ed25519,
+    ed448,
+    max_enum_value = ed448,
+};
+
+const uint32_t no_path_length = 0xffffffff;
+
+// Writes the fields of one DER certificate to out, ending with
+// cert_field::end. The certificate is read front to back once and nothing is
+// allocated, values are written straight from der. Attribute names are the
+// usual short names (CN, O, ...) or the dotted OID, values are UTF-8. The
+// extensions Mbed TLS knows get a decoded field after their extension field.
+//
+// Returns false for DER that isn't a certificate, out then has a partial
+// record.
+bool decode_cert(const unsigned char* der, size_t len, wcomms& out);
+
+} // namespace bb
+
+#endif // Header guard
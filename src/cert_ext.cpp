@@ -5,6 +5,132 @@
 #include <mbedtls/x509_crt.h>
 
 #include "cert_ext.hpp"
+#include "der.hpp"
+
+namespace {
+
+template<size_t Count, size_t Size>
+struct DerTable {
+    unsigned char len[Count];
+    unsigned char der[Count][Size];
+};
+
+// KeyUsage BIT STRING with the trailing zero bits left out, as
+// mbedtls_asn1_write_named_bitstring writes it. Indexed by the low byte of the
+// Mbed TLS flags, with decipherOnly (0x8000) moved to bit 8.
+const size_t key_usage_count = 512;
+
+constexpr DerTable<key_usage_count, 5> make_key_usage_table()
+{
+    DerTable<key_usage_count, 5> table{};
+
+    for (size_t i = 0; i != key_usage_count; ++i) {
+        unsigned char bytes[2] = {(unsigned char)(i & 0xff), (unsigned char)(i & 0x100 ? 0x80 : 0)};
+
+        size_t bits = 0;
+        if (bytes[1]) {
+            bits = 9;
+        } else if (bytes[0]) {
+            bits = 8;
+            while (!(bytes[0] & (1 << (8 - bits))))
+                --bits;
+        }
+
+        auto byte_len = (bits + 7) / 8;
+        auto der = table.der[i];
+        der[0] = MBEDTLS_ASN1_BIT_STRING;
+        der[1] = (unsigned char)(byte_len + 1);
+        der[2] = (unsigned char)(byte_len * 8 - bits);
+        for (size_t b = 0; b != byte_len; ++b)
+            der[3 + b] = bytes[b];
+
+        table.len[i] = (unsigned char)(3 + byte_len);
+    }
+
+    return table;
+}
+
+constexpr auto key_usage_table = make_key_usage_table();
+
+static_assert(key_usage_table.len[0] == 3 && key_usage_table.der[0][2] == 0);
+
+// digitalSignature, keyEncipherment: 5 unused bits
+static_assert(key_usage_table.len[0xa0] == 4 && key_usage_table.der[0xa0][2] == 5 && key_usage_table.der[0xa0][3] == 0xa0);
+
+struct Oid {
+    const char* oid;
+    size_t len;
+};
+
+#define BB_OID(oid) Oid{oid, MBEDTLS_OID_SIZE(oid)}
+
+// In ext_key_usage bit order
+constexpr Oid ext_key_usage_oids[] {
+    BB_OID(MBEDTLS_OID_SERVER_AUTH),
+    BB_OID(MBEDTLS_OID_CLIENT_AUTH),
+    BB_OID(MBEDTLS_OID_CODE_SIGNING),
+    BB_OID(MBEDTLS_OID_EMAIL_PROTECTION),
+    BB_OID(MBEDTLS_OID_TIME_STAMPING),
+    BB_OID(MBEDTLS_OID_OCSP_SIGNING),
+    BB_OID(MBEDTLS_OID_ANY_EXTENDED_KEY_USAGE),
+};
+
+#undef BB_OID
+
+const size_t ext_key_usage_count = 1 << (sizeof(ext_key_usage_oids) / sizeof(ext_key_usage_oids[0]));
+
+constexpr size_t ext_key_usage_size()
+{
+    size_t size = 2;
+    for (auto& oid : ext_key_usage_oids)
+        size += 2 + oid.len;
+    return size;
+}
+
+static_assert(ext_key_usage_size() < 128, "Lengths are written in short form");
+
+// ExtKeyUsageSyntax, a SEQUENCE of the selected OIDs in bit order. Indexed by
+// the ext_key_usage flags, 0 is unused.
+constexpr DerTable<ext_key_usage_count, ext_key_usage_size()> make_ext_key_usage_table()
+{
+    DerTable<ext_key_usage_count, ext_key_usage_size()> table{};
+
+    for (size_t i = 1; i != ext_key_usage_count; ++i) {
+        auto der = table.der[i];
+        size_t pos = 2;
+
+        for (size_t bit = 0; (1u << bit) != ext_key_usage_count; ++bit) {
+            if (!(i & (1u << bit)))
+                continue;
+
+            auto& oid = ext_key_usage_oids[bit];
+            der[pos++] = MBEDTLS_ASN1_OID;
+            der[pos++] = (unsigned char)oid.len;
+            for (size_t b = 0; b != oid.len; ++b)
+                der[pos++] = (unsigned char)oid.oid[b];
+        }
+
+        der[0] = bb::der_sequence;
+        der[1] = (unsigned char)(pos - 2);
+        table.len[i] = (unsigned char)pos;
+    }
+
+    return table;
+}
+
+constexpr auto ext_key_usage_table = make_ext_key_usage_table();
+
+// BasicConstraints with cA left at its default, and with cA TRUE
+constexpr unsigned char basic_constraints_leaf[] {
+    bb::der_sequence, 0,
+};
+
+constexpr unsigned char basic_constraints_ca[] {
+    bb::der_sequence, 3,
+        MBEDTLS_ASN1_BOOLEAN, 1, 0xff,
+};
+
+} // namespace
 
 namespace bb {
 
@@ -22,7 +148,7 @@ int set_akid(mbedtls_x509write_cert* ctx, const unsigned char* kid, size_t kid_l
     MBEDTLS_ASN1_CHK_ADD(len, mbedtls_asn1_write_tag(&c, buf, MBEDTLS_ASN1_CONTEXT_SPECIFIC | 0));
 
     MBEDTLS_ASN1_CHK_ADD(len, mbedtls_asn1_write_len(&c, buf, len));
-    MBEDTLS_ASN1_CHK_ADD(len, mbedtls_asn1_write_tag(&c, buf, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE));
+    MBEDTLS_ASN1_CHK_ADD(len, mbedtls_asn1_write_tag(&c, buf, der_sequence));
 
     return mbedtls_x509write_crt_set_extension(
         ctx,
@@ -31,4 +157,54 @@ int set_akid(mbedtls_x509write_cert* ctx, const unsigned char* kid, size_t kid_l
         0, c, len);
 }
 
+int set_basic_constraints(mbedtls_x509write_cert* ctx, bool is_ca)
+{
+    // Critical for CAs, like Mbed TLS does it
+    return mbedtls_x509write_crt_set_extension(
+        ctx,
+        MBEDTLS_OID_BASIC_CONSTRAINTS,
+        MBEDTLS_OID_SIZE(MBEDTLS_OID_BASIC_CONSTRAINTS),
+        is_ca,
+        is_ca ? basic_constraints_ca : basic_constraints_leaf,
+        is_ca ? sizeof(basic_constraints_ca) : sizeof(basic_constraints_leaf));
+}
+
+int set_key_usage(mbedtls_x509write_cert* ctx, key_usage usage)
+{
+    auto index = (usage & 0xff) | (usage & decipher_only ? 0x100 : 0);
+
+    return mbedtls_x509write_crt_set_extension(
+        ctx,
+        MBEDTLS_OID_KEY_USAGE,
+        MBEDTLS_OID_SIZE(MBEDTLS_OID_KEY_USAGE),
+        1,
+        key_usage_table.der[index],
+        key_usage_table.len[index]);
+}
+
+int set_ext_key_usage(mbedtls_x509write_cert* ctx, ext_key_usage usage)
+{
+    if (!usage)
+        return 0;
+
+    return mbedtls_x509write_crt_set_extension(
+        ctx,
+        MBEDTLS_OID_EXTENDED_KEY_USAGE,
+        MBEDTLS_OID_SIZE(MBEDTLS_OID_EXTENDED_KEY_USAGE),
+        1,
+        ext_key_usage_table.der[usage],
+        ext_key_usage_table.len[usage]);
+}
+
+int set_subject_alt_name(mbedtls_x509write_cert* ctx, const SanList& san_list)
+{
+    return mbedtls_x509write_crt_set_extension(
+        ctx,
+        MBEDTLS_OID_SUBJECT_ALT_NAME,
+        MBEDTLS_OID_SIZE(MBEDTLS_OID_SUBJECT_ALT_NAME),
+        0,
+        san_list.der(),
+        san_list.der_size());
+}
+
 } // namespace bb
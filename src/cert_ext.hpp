@@ -5,10 +5,24 @@
 
 #include <mbedtls/x509_crt.h>
 
+#include "interface_ext_key_usage.hpp"
+#include "interface_key_usage.hpp"
+#include "interface_san.hpp"
+
 namespace bb {
 
 int set_akid(mbedtls_x509write_cert* ctx, const unsigned char* kid, size_t kid_len);
 
+// Same extensions as mbedtls_x509write_crt_set_basic_constraints (without a
+// path length), set_key_usage and set_ext_key_usage, copied from encodings
+// of every possible value built at compile time. An empty ext_key_usage adds
+// nothing.
+int set_basic_constraints(mbedtls_x509write_cert* ctx, bool is_ca);
+int set_key_usage(mbedtls_x509write_cert* ctx, key_usage usage);
+int set_ext_key_usage(mbedtls_x509write_cert* ctx, ext_key_usage usage);
+
+int set_subject_alt_name(mbedtls_x509write_cert* ctx, const SanList& san_list);
+
 }
 
 #endif // Header guard
@@ -0,0 +1,210 @@
+#include <mbedtls/error.h>
+#include <mbedtls/pem.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/platform.h>
+#include <mbedtls/x509.h>
+#include <mbedtls/x509_crt.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cert.hpp"
+#include "cstr.hpp"
+#include "interface_error.hpp"
+#include "interface_key.hpp"
+#include "pem_scan.hpp"
+#include "random.hpp"
+#include "scheduler.hpp"
+#include "vec.hpp"
+#include "wcomms.hpp"
+
+#include "cert_io.hpp"
+
+namespace {
+
+// Reused between calls so a bundle costs no allocations beyond what Mbed TLS
+// does per certificate. Per thread for signd.
+struct ParseScratch {
+    bb::vec<bb::PemBlock> blocks;
+    bb::vec<mbedtls_x509_crt*> nodes;
+    bb::vec<int> errors;
+};
+
+thread_local ParseScratch scratch;
+
+void report_parse_error(int err)
+{
+    fprintf(stderr, "Couldn't parse certificate.\n");
+    fprintf(stderr, "Err (%d): [%s] %s\n", err, mbedtls_low_level_strerr(err), mbedtls_high_level_strerr(err));
+}
+
+// PEM of a private key, NUL-terminated in out
+bool key_pem(mbedtls_pk_context* pk, bb::cstr* out)
+{
+    auto max_der = 10240; // Kind or arbitrary
+
+    *out = bb::cstr(32 * 2 + max_der * 2);
+    auto pem_result = mbedtls_pk_write_key_pem(pk, (unsigned char*)out->str, out->len);
+    if (pem_result != 0) {
+        fprintf(stderr, "Couldn't turn key DER into PEM.\n");
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace
+
+namespace bb {
+
+opt<Cert> parse_cert(cstr&& data)
+{
+    auto& blocks = scratch.blocks;
+    auto& nodes = scratch.nodes;
+    auto& errors = scratch.errors;
+
+    Cert cert_chain;
+    cert_chain.der = static_cast<cstr&&>(data);
+    auto text = cert_chain.der.str;
+
+    blocks.clear();
+    if (!find_pem_blocks(text, cert_chain.der.len, "CERTIFICATE", &blocks)) {
+        auto err = mbedtls_x509_crt_parse_der_nocopy(&cert_chain, (const unsigned char*)text, cert_chain.der.len);
+        if (err) {
+            report_parse_error(err);
+            return {};
+        }
+
+        return cert_chain;
+    }
+
+    // Each block decodes to its own start, so they don't overlap and can be
+    // parsed at the same time
+    nodes.resize(blocks.size);
+    errors.resize(blocks.size);
+    parallel_for(blocks.size, [&](size_t i, unsigned) {
+        auto& block = blocks[i];
+        auto der = text + block.begin;
+        auto der_len = base64_decode_in_place(der, block.end - block.begin);
+
+        nodes[i] = nullptr;
+        errors[i] = MBEDTLS_ERR_PEM_INVALID_DATA;
+        if (!der_len)
+            return;
+
+        auto node = (mbedtls_x509_crt*)mbedtls_calloc(1, sizeof(mbedtls_x509_crt));
+        errors[i] = MBEDTLS_ERR_X509_ALLOC_FAILED;
+        if (!node)
+            return;
+
+        mbedtls_x509_crt_init(node);
+        errors[i] = mbedtls_x509_crt_parse_der_nocopy(node, (const unsigned char*)der, der_len);
+        if (errors[i]) {
+            mbedtls_x509_crt_free(node);
+            mbedtls_free(node);
+            return;
+        }
+
+        nodes[i] = node;
+    });
+
+    // Like mbedtls_x509_crt_parse, bad blocks are skipped as long as one
+    // certificate could be parsed
+    mbedtls_x509_crt* head = nullptr;
+    mbedtls_x509_crt** tail = &head;
+    for (size_t i = 0; i != nodes.size; ++i) {
+        if (nodes[i]) {
+            *tail = nodes[i];
+            tail = &nodes[i]->next;
+        }
+    }
+
+    if (!head) {
+        report_parse_error(blocks.size ? errors[0] : MBEDTLS_ERR_X509_CERT_UNKNOWN_FORMAT);
+        return {};
+    }
+
+    // The Cert itself is the first certificate of the chain
+    cert_chain.mbedtls_x509_crt::operator=(*head);
+    mbedtls_free(head);
+
+    return cert_chain;
+}
+
+opt<Cert> parse_cert(const cstr& data)
+{
+    return parse_cert(cstr(data));
+}
+
+opt<Key> parse_key(const cstr& data)
+{
+    int keylen = data.len;
+    if (strstr(data.str, "-----BEGIN ")) {
+        ++keylen; // For PEM the keylen parameter must include the null byte
+    }
+
+    Key key;
+    if (mbedtls_pk_parse_key(&key, (const unsigned char*)data.str, keylen, nullptr, 0, mt_rng, nullptr)) {
+        fprintf(stderr, "Couldn't parse key.\n");
+        return {};
+    }
+
+    return key;
+}
+
+interface_error write_cert(wcomms& out, mbedtls_x509_crt* cert)
+{
+    auto pem_buffer = cstr(28 * 2 + cert->raw.len * 2);
+    auto pem_buffer_len = pem_buffer.len;
+
+    auto pem_result = mbedtls_pem_write_buffer(
+        "-----BEGIN CERTIFICATE-----\n",
+        "-----END CERTIFICATE-----\n",
+        cert->raw.p,
+        cert->raw.len,
+        (unsigned char*)pem_buffer.str,
+        pem_buffer_len,
+        &pem_buffer_len
+    );
+
+    if (pem_result != 0) {
+        fprintf(stderr, "Couldn't turn cert DER into PEM.\n");
+        return interface_error::convert_pem;
+    }
+
+    auto len_without_null = pem_buffer_len - 1;
+
+    char dnstr[1024];
+    int dnlength = mbedtls_x509_dn_gets(dnstr, sizeof(dnstr), &cert->subject);
+    if (dnlength < 0) {
+        fprintf(stderr, "Couldn't get certificate subject.\n");
+        return interface_error::cert_info;
+    }
+
+    bool is_ca = cert->private_ext_types & MBEDTLS_X509_EXT_BASIC_CONSTRAINTS && cert->private_ca_istrue;
+
+    out.write_bytelen(pem_buffer.str, len_without_null);
+    out.write_bool(is_ca);
+    out.write_bytelen(dnstr, dnlength);
+    out.write_bytelen(cert->subject_key_id.p, cert->subject_key_id.len);
+
+    return interface_error::success;
+}
+
+bool write_key(FILE* out, mbedtls_pk_context* pk)
+{
+    cstr pem;
+    return key_pem(pk, &pem) && fputs(pem.str, out) >= 0;
+}
+
+bool write_key(wcomms& out, mbedtls_pk_context* pk)
+{
+    cstr pem;
+    if (!key_pem(pk, &pem))
+        return false;
+
+    out.write_exact(pem.str, strlen(pem.str));
+    return out.good();
+}
+
+} // namespace bb
@@ -0,0 +1,36 @@
+#ifndef BB_CERT_IO_HPP
+#define BB_CERT_IO_HPP
+
+#include <stdio.h>
+
+#include <mbedtls/pk.h>
+#include <mbedtls/x509_crt.h>
+
+#include "cert.hpp"
+#include "cstr.hpp"
+#include "interface_error.hpp"
+#include "interface_key.hpp"
+#include "opt.hpp"
+#include "wcomms.hpp"
+
+namespace bb {
+
+// PEM or DER. PEM data may contain a whole chain.
+//
+// The rvalue overload decodes PEM in place and parses without copying, the
+// returned Cert takes over data and the certificates point into it. The other
+// one copies data first.
+opt<Cert> parse_cert(cstr&& data);
+opt<Cert> parse_cert(const cstr& data);
+opt<Key> parse_key(const cstr& data);
+
+// PEM, is CA flag, subject DN and SKID, in the format CertMaker expects.
+interface_error write_cert(wcomms& out, mbedtls_x509_crt* cert);
+
+// Raw PEM, no length prefix.
+bool write_key(FILE* out, mbedtls_pk_context* pk);
+bool write_key(wcomms& out, mbedtls_pk_context* pk);
+
+} // namespace bb
+
+#endif // Header guard
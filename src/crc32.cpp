@@ -0,0 +1,67 @@
+#include "crc32.hpp"
+#include "endian.hpp"
+
+namespace {
+
+// Slicing-by-8 tables: table[0] is the classic byte-at-a-time table,
+// table[k][n] is the CRC of byte n followed by k zero bytes.
+struct Crc32Tables {
+    uint32_t table[8][256];
+
+    constexpr Crc32Tables()
+        : table{}
+    {
+        for (uint32_t n = 0; n != 256; ++n) {
+            uint32_t crc = n;
+            for (int bit = 0; bit != 8; ++bit)
+                crc = crc & 1 ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+
+            table[0][n] = crc;
+        }
+
+        for (uint32_t n = 0; n != 256; ++n) {
+            for (int k = 1; k != 8; ++k) {
+                auto prev = table[k - 1][n];
+                table[k][n] = (prev >> 8) ^ table[0][prev & 0xff];
+            }
+        }
+    }
+};
+
+constexpr Crc32Tables tables;
+
+} // namespace
+
+namespace bb {
+
+uint32_t crc32(uint32_t crc, const void* data, size_t len)
+{
+    auto& t = tables.table;
+    auto p = static_cast<const unsigned char*>(data);
+
+    crc = ~crc;
+
+    while (len >= 8) {
+        auto one = load_le32(p) ^ crc;
+        auto two = load_le32(p + 4);
+
+        crc = t[7][one & 0xff]
+            ^ t[6][(one >> 8) & 0xff]
+            ^ t[5][(one >> 16) & 0xff]
+            ^ t[4][one >> 24]
+            ^ t[3][two & 0xff]
+            ^ t[2][(two >> 8) & 0xff]
+            ^ t[1][(two >> 16) & 0xff]
+            ^ t[0][two >> 24];
+
+        p += 8;
+        len -= 8;
+    }
+
+    while (len--)
+        crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+
+    return ~crc;
+}
+
+} // namespace bb
@@ -0,0 +1,15 @@
+#ifndef BB_CRC32_HPP
+#define BB_CRC32_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace bb {
+
+// CRC-32 as used by ZIP and gzip. Pass the previous result as crc to continue
+// a checksum over multiple buffers, start with 0.
+uint32_t crc32(uint32_t crc, const void* data, size_t len);
+
+} // namespace bb
+
+#endif // Header guard
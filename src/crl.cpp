@@ -0,0 +1,431 @@
+#include <mbedtls/asn1.h>
+#include <mbedtls/error.h>
+#include <mbedtls/md.h>
+#include <mbedtls/pk.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "der.hpp"
+#include "pem_writer.hpp"
+#include "random.hpp"
+#include "sort.hpp"
+
+#include "crl.hpp"
+
+namespace {
+
+
+// RFC 5280 section 4.1.2.2
+const size_t max_serial_length = 20;
+
+// Entries CrlBuilder::reserve makes room for at most
+const size_t max_reserved_entries = 1 << 20;
+
+// Forward DER writer for the small fixed parts of the CRL.
+template<size_t N>
+struct DerBuffer {
+    unsigned char data[N];
+    size_t len = 0;
+
+    void header(unsigned char tag, size_t content_len)
+    {
+        len += bb::der_header(data + len, tag, content_len);
+    }
+
+    void bytes(const void* p, size_t n)
+    {
+        memcpy(data + len, p, n);
+        len += n;
+    }
+};
+
+int compare_serials(const unsigned char* a, size_t a_len, const unsigned char* b, size_t b_len)
+{
+    // Minimal positive INTEGERs, so the longer one is the larger number.
+    if (a_len != b_len)
+        return a_len < b_len ? -1 : 1;
+
+    return memcmp(a, b, a_len);
+}
+
+bool skip_tag(unsigned char** p, const unsigned char* end, int tag)
+{
+    size_t len;
+    if (mbedtls_asn1_get_tag(p, end, &len, tag))
+        return false;
+
+    *p += len;
+    return true;
+}
+
+bool is_time(const unsigned char* p, const unsigned char* end)
+{
+    return p < end && (*p == MBEDTLS_ASN1_UTC_TIME || *p == MBEDTLS_ASN1_GENERALIZED_TIME);
+}
+
+} // namespace
+
+namespace bb {
+
+template<typename Emit>
+void CrlBuilder::for_each_entry(Emit&& emit) const
+{
+    auto existing_base = (const unsigned char*)existing_der.str;
+    auto added_base = arena.data;
+
+    auto a = existing.begin();
+    auto b = added.begin();
+
+    auto compare = [](const unsigned char* x_base, const Entry* x, const unsigned char* y_base, const Entry* y) {
+        return compare_serials(
+            x_base + x->serial_offset, x->serial_length,
+            y_base + y->serial_offset, y->serial_length);
+    };
+
+    while (a != existing.end() || b != added.end()) {
+        // Duplicates within a run are next to each other, the last one wins.
+        if (b != added.end() && b + 1 != added.end() && compare(added_base, b, added_base, b + 1) == 0) {
+            ++b;
+            continue;
+        }
+
+        if (a != existing.end() && a + 1 != existing.end() && compare(existing_base, a, existing_base, a + 1) == 0) {
+            ++a;
+            continue;
+        }
+
+        int order = a == existing.end() ? 1
+            : b == added.end() ? -1
+            : compare(existing_base, a, added_base, b);
+
+        if (order < 0) {
+            emit(existing_base + a->offset, a->length);
+            ++a;
+        } else if (order > 0) {
+            emit(added_base + b->offset, b->length);
+            ++b;
+        } else {
+            // Replaced by the new entry
+            ++a;
+        }
+    }
+}
+
+bool CrlBuilder::load_existing(cstr der, const mbedtls_x509_buf& issuer_raw)
+{
+    existing_der = static_cast<cstr&&>(der);
+    existing.clear();
+
+    auto base = (unsigned char*)existing_der.str;
+    auto p = base;
+    const unsigned char* end = base + existing_der.len;
+    size_t len;
+
+    // CertificateList, then TBSCertList
+    if (mbedtls_asn1_get_tag(&p, end, &len, der_sequence))
+        return false;
+    end = p + len;
+
+    if (mbedtls_asn1_get_tag(&p, end, &len, der_sequence))
+        return false;
+    auto tbs_end = p + len;
+
+    if (p < tbs_end && *p == MBEDTLS_ASN1_INTEGER && !skip_tag(&p, tbs_end, MBEDTLS_ASN1_INTEGER))
+        return false;
+
+    if (!skip_tag(&p, tbs_end, der_sequence)) // signature
+        return false;
+
+    auto issuer = p;
+    if (!skip_tag(&p, tbs_end, der_sequence))
+        return false;
+
+    if ((size_t)(p - issuer) != issuer_raw.len || memcmp(issuer, issuer_raw.p, issuer_raw.len) != 0) {
+        fprintf(stderr, "CRL has a different issuer.\n");
+        return false;
+    }
+
+    if (!is_time(p, tbs_end) || !skip_tag(&p, tbs_end, *p)) // thisUpdate
+        return false;
+
+    if (is_time(p, tbs_end) && !skip_tag(&p, tbs_end, *p)) // nextUpdate
+        return false;
+
+    if (p == tbs_end || *p != der_sequence)
+        return true; // No revoked certificates
+
+    if (mbedtls_asn1_get_tag(&p, tbs_end, &len, der_sequence))
+        return false;
+    auto list_end = p + len;
+
+    while (p < list_end) {
+        auto entry = p;
+        if (mbedtls_asn1_get_tag(&p, list_end, &len, der_sequence))
+            return false;
+        auto entry_end = p + len;
+
+        if (mbedtls_asn1_get_tag(&p, entry_end, &len, MBEDTLS_ASN1_INTEGER))
+            return false;
+
+        existing.push_back(Entry{
+            (uint32_t)(entry - base),
+            (uint32_t)(entry_end - entry),
+            (uint32_t)(p - base),
+            (uint32_t)len,
+        });
+
+        p = entry_end;
+    }
+
+    return true;
+}
+
+void CrlBuilder::reserve(size_t count)
+{
+    // count comes from the input, a larger list grows as it's added
+    if (count > max_reserved_entries)
+        count = max_reserved_entries;
+
+    // Serial, time and reason code of a typical entry
+    arena.reserve(arena.size + count * 48);
+    added.reserve(added.size + count);
+}
+
+bool CrlBuilder::add(const unsigned char* serial, size_t serial_len, const char* revocation_date, size_t date_len, uint32_t reason)
+{
+    if (serial_len == 0 || serial_len > max_serial_length)
+        return false;
+
+    // CRLReason, 7 is unused
+    if (reason > 10 || reason == 7)
+        return false;
+
+    unsigned char serial_der[max_serial_length + 3];
+    auto serial_der_len = der_unsigned_integer(serial_der, serial, serial_len);
+
+    unsigned char time_der[17];
+    auto time_len = der_time(time_der, revocation_date, date_len);
+    if (!time_len)
+        return false;
+
+    // crlEntryExtensions with a reasonCode extension
+    const unsigned char reason_ext[] {
+        0x30, 12,
+            0x30, 10,
+                0x06, 3, 0x55, 0x1d, 0x15,
+                0x04, 3,
+                    0x0a, 1, (unsigned char)reason,
+    };
+
+    auto content_len = serial_der_len + time_len + (reason ? sizeof(reason_ext) : 0);
+
+    if (arena.size + der_tlv_size(content_len) > UINT32_MAX)
+        return false;
+
+    unsigned char header[6];
+    auto header_len = der_header(header, der_sequence, content_len);
+
+    Entry entry;
+    entry.offset = arena.size;
+    arena.append(header, header_len);
+
+    // Serials are short, the INTEGER header is always two bytes
+    entry.serial_offset = arena.size + 2;
+    entry.serial_length = serial_der_len - 2;
+    arena.append(serial_der, serial_der_len);
+
+    arena.append(time_der, time_len);
+    if (reason)
+        arena.append(reason_ext, sizeof(reason_ext));
+
+    entry.length = arena.size - entry.offset;
+    added.push_back(entry);
+
+    return true;
+}
+
+interface_error CrlBuilder::write(
+    FILE* out,
+    bool pem,
+    const mbedtls_x509_crt* issuer,
+    mbedtls_pk_context* key,
+    mbedtls_md_type_t md,
+    const char* this_update,
+    const char* next_update,
+    uint32_t crl_number)
+{
+    auto existing_base = (const unsigned char*)existing_der.str;
+    auto added_base = arena.data;
+
+    // Ties are broken by position so the last of equal serials ends up last.
+    auto existing_less = [existing_base](const Entry& x, const Entry& y) {
+        auto order = compare_serials(
+            existing_base + x.serial_offset, x.serial_length,
+            existing_base + y.serial_offset, y.serial_length);
+        return order ? order < 0 : x.offset < y.offset;
+    };
+
+    auto added_less = [added_base](const Entry& x, const Entry& y) {
+        auto order = compare_serials(
+            added_base + x.serial_offset, x.serial_length,
+            added_base + y.serial_offset, y.serial_length);
+        return order ? order < 0 : x.offset < y.offset;
+    };
+
+    // A CRL written by us is already in order
+    if (!is_sorted(existing.data, existing.size, existing_less))
+        sort(existing.data, existing.size, existing_less);
+
+    sort(added.data, added.size, added_less);
+
+    size_t entries_len = 0;
+    for_each_entry([&](const unsigned char*, size_t len) { entries_len += len; });
+
+    const unsigned char version[] { MBEDTLS_ASN1_INTEGER, 1, 1 }; // v2
+
+    DerBuffer<32> sig_alg;
+    sig_alg.len = der_signature_algorithm(sig_alg.data, key, md);
+    if (!sig_alg.len) {
+        fprintf(stderr, "No signature algorithm for this key and digest.\n");
+        return interface_error::generate_crl;
+    }
+
+    unsigned char this_update_der[17];
+    unsigned char next_update_der[17];
+    auto this_update_len = der_time(this_update_der, this_update, strlen(this_update));
+    auto next_update_len = der_time(next_update_der, next_update, strlen(next_update));
+    if (!this_update_len || !next_update_len) {
+        fprintf(stderr, "Invalid thisUpdate or nextUpdate.\n");
+        return interface_error::read_input;
+    }
+
+    // crlExtensions: authorityKeyIdentifier and cRLNumber
+    const unsigned char akid_oid[] { 0x55, 0x1d, 0x23 };
+    const unsigned char crl_number_oid[] { 0x55, 0x1d, 0x14 };
+
+    auto& skid = issuer->subject_key_id;
+    bool has_akid = skid.len && skid.len <= 64;
+    auto keyid_len = der_tlv_size(skid.len);
+    auto akid_value_len = der_tlv_size(keyid_len);
+    auto akid_len = der_tlv_size(sizeof(akid_oid)) + der_tlv_size(akid_value_len);
+
+    unsigned char crl_number_be[] {
+        (unsigned char)(crl_number >> 24),
+        (unsigned char)(crl_number >> 16),
+        (unsigned char)(crl_number >> 8),
+        (unsigned char)crl_number,
+    };
+    unsigned char crl_number_der[7];
+    auto crl_number_der_len = der_unsigned_integer(crl_number_der, crl_number_be, sizeof(crl_number_be));
+    auto crl_number_len = der_tlv_size(sizeof(crl_number_oid)) + der_tlv_size(crl_number_der_len);
+
+    auto extensions_len = (has_akid ? der_tlv_size(akid_len) : 0) + der_tlv_size(crl_number_len);
+
+    DerBuffer<160> extensions;
+    extensions.header(der_context(0), der_tlv_size(extensions_len));
+    extensions.header(der_sequence, extensions_len);
+    if (has_akid) {
+        extensions.header(der_sequence, akid_len);
+        extensions.header(MBEDTLS_ASN1_OID, sizeof(akid_oid));
+        extensions.bytes(akid_oid, sizeof(akid_oid));
+        extensions.header(MBEDTLS_ASN1_OCTET_STRING, akid_value_len);
+        extensions.header(der_sequence, keyid_len);
+        extensions.header(MBEDTLS_ASN1_CONTEXT_SPECIFIC | 0, skid.len);
+        extensions.bytes(skid.p, skid.len);
+    }
+    extensions.header(der_sequence, crl_number_len);
+    extensions.header(MBEDTLS_ASN1_OID, sizeof(crl_number_oid));
+    extensions.bytes(crl_number_oid, sizeof(crl_number_oid));
+    extensions.header(MBEDTLS_ASN1_OCTET_STRING, crl_number_der_len);
+    extensions.bytes(crl_number_der, crl_number_der_len);
+
+    auto tbs_content_len = sizeof(version)
+        + sig_alg.len
+        + issuer->subject_raw.len
+        + this_update_len
+        + next_update_len
+        + (entries_len ? der_tlv_size(entries_len) : 0)
+        + extensions.len;
+
+    auto emit_tbs = [&](auto&& put) {
+        unsigned char header[6];
+        put(header, der_header(header, der_sequence, tbs_content_len));
+        put(version, sizeof(version));
+        put(sig_alg.data, sig_alg.len);
+        put(issuer->subject_raw.p, issuer->subject_raw.len);
+        put(this_update_der, this_update_len);
+        put(next_update_der, next_update_len);
+        if (entries_len) {
+            put(header, der_header(header, der_sequence, entries_len));
+            for_each_entry(put);
+        }
+        put(extensions.data, extensions.len);
+    };
+
+    // First pass: hash the TBSCertList and sign it. The second pass writes it
+    // out, once the signature's length is known.
+    auto md_info = mbedtls_md_info_from_type(md);
+    unsigned char hash[MBEDTLS_MD_MAX_SIZE];
+
+    mbedtls_md_context_t md_ctx;
+    mbedtls_md_init(&md_ctx);
+    int md_err = mbedtls_md_setup(&md_ctx, md_info, 0);
+    if (!md_err)
+        md_err = mbedtls_md_starts(&md_ctx);
+    if (!md_err) {
+        emit_tbs([&](const unsigned char* p, size_t len) { mbedtls_md_update(&md_ctx, p, len); });
+        md_err = mbedtls_md_finish(&md_ctx, hash);
+    }
+    mbedtls_md_free(&md_ctx);
+
+    if (md_err) {
+        fprintf(stderr, "Couldn't hash CRL.\n");
+        return interface_error::generate_crl;
+    }
+
+    unsigned char signature[MBEDTLS_PK_SIGNATURE_MAX_SIZE];
+    size_t signature_len;
+    auto sign_err = mbedtls_pk_sign(
+        key, md,
+        hash, mbedtls_md_get_size(md_info),
+        signature, sizeof(signature), &signature_len,
+        mt_rng, nullptr);
+
+    if (sign_err) {
+        fprintf(stderr, "Couldn't sign CRL.\n");
+        fprintf(stderr, "Err (%d): [%s] %s\n", sign_err, mbedtls_low_level_strerr(sign_err), mbedtls_high_level_strerr(sign_err));
+        return interface_error::generate_crl;
+    }
+
+    auto crl_content_len = der_tlv_size(tbs_content_len)
+        + sig_alg.len
+        + der_tlv_size(signature_len + 1);
+
+    auto emit_crl = [&](auto&& put) {
+        unsigned char header[8];
+        put(header, der_header(header, der_sequence, crl_content_len));
+        emit_tbs(put);
+        put(sig_alg.data, sig_alg.len);
+
+        auto header_len = der_header(header, MBEDTLS_ASN1_BIT_STRING, signature_len + 1);
+        header[header_len++] = 0; // No unused bits
+        put(header, header_len);
+        put(signature, signature_len);
+    };
+
+    if (pem) {
+        PemWriter writer{out, "X509 CRL"};
+        emit_crl([&](const unsigned char* p, size_t len) { writer.write(p, len); });
+        if (!writer.finish())
+            return interface_error::write_crl;
+    } else {
+        emit_crl([&](const unsigned char* p, size_t len) { fwrite(p, 1, len, out); });
+        if (fflush(out) != 0 || ferror(out))
+            return interface_error::write_crl;
+    }
+
+    return interface_error::success;
+}
+
+} // namespace bb
@@ -0,0 +1,72 @@
+#ifndef BB_CRL_HPP
+#define BB_CRL_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <mbedtls/md.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/x509_crt.h>
+
+#include "cstr.hpp"
+#include "interface_error.hpp"
+#include "vec.hpp"
+
+namespace bb {
+
+// Builds an X.509 v2 CRL (RFC 5280 section 5), Mbed TLS only parses them.
+//
+// Every revoked entry is kept as its finished DER in one arena, with a small
+// index record pointing at it and at its serial. Entries from an earlier CRL
+// are taken over as they were encoded. The index is sorted by serial when the
+// CRL is written, and the two runs are merged while writing, so nothing is
+// re-encoded and the output never has to exist in memory as a whole.
+class CrlBuilder {
+    struct Entry {
+        uint32_t offset;
+        uint32_t length;
+        uint32_t serial_offset;
+        uint32_t serial_length;
+    };
+
+    cstr existing_der;
+    vec<Entry> existing;
+
+    vec<unsigned char> arena;
+    vec<Entry> added;
+
+    template<typename Emit>
+    void for_each_entry(Emit&& emit) const;
+
+public:
+    // Takes over the entries of a DER CRL by the given issuer. Entries added
+    // later replace existing ones with the same serial.
+    bool load_existing(cstr der, const mbedtls_x509_buf& issuer_raw);
+
+    // Makes room for count more entries up front, at most 2^20 of them.
+    void reserve(size_t count);
+
+    // serial is an unsigned big-endian number, revocation_date a
+    // YYYYMMDDhhmmss string. A reason of 0 (unspecified) leaves out the
+    // reasonCode extension.
+    bool add(const unsigned char* serial, size_t serial_len, const char* revocation_date, size_t date_len, uint32_t reason);
+
+    size_t size() const { return existing.size + added.size; }
+
+    // Signs the CRL with key, which has to belong to issuer, and writes it
+    // out as DER or PEM.
+    interface_error write(
+        FILE* out,
+        bool pem,
+        const mbedtls_x509_crt* issuer,
+        mbedtls_pk_context* key,
+        mbedtls_md_type_t md,
+        const char* this_update,
+        const char* next_update,
+        uint32_t crl_number);
+};
+
+} // namespace bb
+
+#endif // Header guard
@@ -0,0 +1,566 @@
+#include <mbedtls/asn1.h>
+#include <mbedtls/md.h>
+#include <mbedtls/oid.h>
+#include <mbedtls/pk.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "der.hpp"
+#include "pem_scan.hpp"
+#include "sort.hpp"
+
+#include "crl_index.hpp"
+
+namespace {
+
+
+const size_t chunk_size = 4096;
+
+// Larger issuer names are refused, real ones are a few hundred bytes
+const size_t max_name_size = 8192;
+
+const char pem_begin[] = "-----BEGIN X509 CRL-----";
+
+bool is_base64(char ch)
+{
+    return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9')
+        || ch == '+' || ch == '/' || ch == '=';
+}
+
+bool is_time_tag(unsigned char tag)
+{
+    return tag == MBEDTLS_ASN1_UTC_TIME || tag == MBEDTLS_ASN1_GENERALIZED_TIME;
+}
+
+// Days from 1970-01-01 to a date in the proleptic Gregorian calendar
+int64_t days_from_civil(int64_t year, unsigned month, unsigned day)
+{
+    year -= month <= 2;
+    auto era = (year >= 0 ? year : year - 399) / 400;
+    auto year_of_era = (unsigned)(year - era * 400);
+    auto day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    auto day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + (int64_t)day_of_era - 719468;
+}
+
+// UTCTime YYMMDDHHMMSSZ or GeneralizedTime YYYYMMDDHHMMSSZ, the forms RFC 5280
+// allows, to seconds since the Unix epoch
+bool parse_time(unsigned char tag, const unsigned char* text, size_t len, int64_t* out)
+{
+    size_t year_digits = tag == MBEDTLS_ASN1_UTC_TIME ? 2 : 4;
+    if (len != year_digits + 11 || text[len - 1] != 'Z')
+        return false;
+
+    for (size_t i = 0; i != len - 1; ++i) {
+        if (text[i] < '0' || text[i] > '9')
+            return false;
+    }
+
+    auto number = [&](size_t at, size_t digits) {
+        unsigned value = 0;
+        for (size_t i = 0; i != digits; ++i)
+            value = value * 10 + (text[at + i] - '0');
+        return value;
+    };
+
+    int64_t year = number(0, year_digits);
+    if (year_digits == 2)
+        year += year < 50 ? 2000 : 1900;
+
+    auto month = number(year_digits, 2);
+    auto day = number(year_digits + 2, 2);
+    auto hour = number(year_digits + 4, 2);
+    auto minute = number(year_digits + 6, 2);
+    auto second = number(year_digits + 8, 2);
+
+    if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 59)
+        return false;
+
+    *out = days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+    return true;
+}
+
+// Big-endian serial to a right-aligned record, false if it doesn't fit
+bool to_record(const unsigned char* serial, size_t len, bb::CrlIndex::Serial* out)
+{
+    while (len && *serial == 0) {
+        ++serial;
+        --len;
+    }
+
+    if (len > sizeof(out->bytes))
+        return false;
+
+    memset(out->bytes, 0, sizeof(out->bytes) - len);
+    memcpy(out->bytes + sizeof(out->bytes) - len, serial, len);
+    return true;
+}
+
+int compare(const bb::CrlIndex::Serial& a, const bb::CrlIndex::Serial& b)
+{
+    return memcmp(a.bytes, b.bytes, sizeof(a.bytes));
+}
+
+struct MdContext : mbedtls_md_context_t {
+    MdContext() { mbedtls_md_init(this); }
+    ~MdContext() { mbedtls_md_free(this); }
+
+    MdContext(const MdContext&) = delete;
+    MdContext& operator=(const MdContext&) = delete;
+};
+
+// The DER of a CRL byte string, read a chunk at a time. PEM is decoded on the
+// way, up to the first END line. Everything consumed between hold and
+// stop_hash goes into the digest: it's kept aside until start_hash says which
+// one that is, since the TBSCertList only names it after its first few bytes.
+class CrlStream {
+    bb::rcomms& c;
+    size_t remaining = 0;
+
+    char raw[chunk_size];
+    size_t raw_len = 0;
+
+    bool pem = false;
+    bool in_header = true;
+    bool at_end = false;
+
+    // Base64 characters waiting to be decoded, and the last decoded bytes
+    char text[chunk_size + 4];
+    size_t text_len = 0;
+    unsigned char decoded[chunk_size];
+
+    unsigned char* data = nullptr;
+    size_t pos = 0;
+    size_t len = 0;
+
+    size_t consumed = 0;
+
+    bool holding = false;
+    bb::vec<unsigned char> held;
+    mbedtls_md_context_t* md = nullptr;
+
+    bool read_raw()
+    {
+        raw_len = remaining < sizeof(raw) ? remaining : sizeof(raw);
+        if (!c.read_exact(raw, raw_len))
+            return false;
+
+        remaining -= raw_len;
+        return true;
+    }
+
+    bool fill()
+    {
+        pos = 0;
+        len = 0;
+
+        if (!pem) {
+            if (!raw_len && !read_raw())
+                return false;
+
+            data = (unsigned char*)raw;
+            len = raw_len;
+            raw_len = 0;
+            return len != 0;
+        }
+
+        while (!len) {
+            if (at_end)
+                return false;
+
+            if (!raw_len && (!remaining || !read_raw()))
+                return false;
+
+            for (size_t i = 0; i != raw_len && !at_end; ++i) {
+                auto ch = raw[i];
+                if (in_header)
+                    in_header = ch != '\n';
+                else if (ch == '-')
+                    at_end = true;
+                else if (is_base64(ch))
+                    text[text_len++] = ch;
+            }
+            raw_len = 0;
+
+            // Whole groups of four, the rest waits for the next chunk
+            auto usable = at_end ? text_len : text_len & ~(size_t)3;
+            if (!usable)
+                continue;
+
+            len = bb::base64_decode_in_place(text, usable);
+            if (!len)
+                return false;
+
+            // Decoding shrinks it, so the leftover characters can go after
+            // the bytes only once they're copied out
+            memcpy(decoded, text, len);
+            memmove(text, text + usable, text_len - usable);
+            text_len -= usable;
+            data = decoded;
+        }
+
+        return true;
+    }
+
+    void tap(const unsigned char* bytes, size_t n)
+    {
+        consumed += n;
+        if (md)
+            mbedtls_md_update(md, bytes, n);
+        else if (holding)
+            held.append(bytes, n);
+    }
+
+public:
+    explicit CrlStream(bb::rcomms& c)
+        : c{c}
+    {
+    }
+
+    bool start()
+    {
+        auto length = c.read_uint();
+        if (!length)
+            return false;
+
+        remaining = *length;
+        if (!read_raw())
+            return false;
+
+        auto begin_len = sizeof(pem_begin) - 1;
+        pem = raw_len >= begin_len && memcmp(raw, pem_begin, begin_len) == 0;
+        return true;
+    }
+
+    bool read(void* out, size_t n)
+    {
+        auto dest = (unsigned char*)out;
+        while (n) {
+            if (pos == len && !fill())
+                return false;
+
+            auto take = len - pos < n ? len - pos : n;
+            memcpy(dest, data + pos, take);
+            tap(data + pos, take);
+
+            pos += take;
+            dest += take;
+            n -= take;
+        }
+
+        return true;
+    }
+
+    bool skip(size_t n)
+    {
+        while (n) {
+            if (pos == len && !fill())
+                return false;
+
+            auto take = len - pos < n ? len - pos : n;
+            tap(data + pos, take);
+
+            pos += take;
+            n -= take;
+        }
+
+        return true;
+    }
+
+    // Tag and definite length, at most four length bytes
+    bool header(unsigned char* tag, size_t* out_len)
+    {
+        unsigned char first[2];
+        if (!read(first, 2))
+            return false;
+
+        *tag = first[0];
+        if (first[1] < 0x80) {
+            *out_len = first[1];
+            return true;
+        }
+
+        auto length_bytes = first[1] & 0x7f;
+        if (length_bytes == 0 || length_bytes > 4)
+            return false;
+
+        unsigned char bytes[4];
+        if (!read(bytes, length_bytes))
+            return false;
+
+        *out_len = 0;
+        for (int i = 0; i != length_bytes; ++i)
+            *out_len = *out_len << 8 | bytes[i];
+
+        return true;
+    }
+
+    size_t position() const { return consumed; }
+
+    void hold() { holding = true; }
+
+    bool start_hash(mbedtls_md_context_t* ctx)
+    {
+        md = ctx;
+        holding = false;
+        auto err = mbedtls_md_update(md, held.data, held.size);
+        held.reset();
+        return err == 0;
+    }
+
+    void stop_hash() { md = nullptr; }
+};
+
+// A time TLV's contents after its header was read
+bool read_time(CrlStream& s, unsigned char tag, size_t len, int64_t* out)
+{
+    unsigned char text[15];
+    return is_time_tag(tag) && len <= sizeof(text) && s.read(text, len) && parse_time(tag, text, len, out);
+}
+
+} // namespace
+
+namespace bb {
+
+interface_error CrlIndex::load(rcomms& c, const mbedtls_x509_crt* issuer)
+{
+    issuer_name.clear();
+    serials.clear();
+    this_update = 0;
+    next_update = no_next_update;
+
+    CrlStream s{c};
+    unsigned char tag;
+    size_t len;
+
+    // CertificateList, then TBSCertList
+    if (!s.start() || !s.header(&tag, &len) || tag != der_sequence)
+        return interface_error::read_crl;
+
+    s.hold();
+    if (!s.header(&tag, &len) || tag != der_sequence)
+        return interface_error::read_crl;
+    auto tbs_end = s.position() + len;
+
+    if (!s.header(&tag, &len))
+        return interface_error::read_crl;
+
+    if (tag == MBEDTLS_ASN1_INTEGER) { // version
+        if (!s.skip(len) || !s.header(&tag, &len))
+            return interface_error::read_crl;
+    }
+
+    // signature, the same AlgorithmIdentifier comes again after the TBSCertList
+    unsigned char algorithm[64];
+    auto algorithm_len = len;
+    if (tag != der_sequence || len > sizeof(algorithm) || !s.read(algorithm, len))
+        return interface_error::read_crl;
+
+    auto p = algorithm;
+    size_t oid_len;
+    if (mbedtls_asn1_get_tag(&p, algorithm + algorithm_len, &oid_len, MBEDTLS_ASN1_OID))
+        return interface_error::read_crl;
+
+    mbedtls_asn1_buf oid;
+    oid.tag = MBEDTLS_ASN1_OID;
+    oid.len = oid_len;
+    oid.p = p;
+
+    mbedtls_md_type_t md_type;
+    mbedtls_pk_type_t pk_type;
+    if (mbedtls_oid_get_sig_alg(&oid, &md_type, &pk_type)
+        || (pk_type != MBEDTLS_PK_RSA && pk_type != MBEDTLS_PK_ECDSA)
+        || !mbedtls_pk_can_do(&issuer->pk, pk_type))
+    {
+        fprintf(stderr, "Unsupported CRL signature algorithm.\n");
+        return interface_error::read_crl;
+    }
+
+    auto md_info = mbedtls_md_info_from_type(md_type);
+    MdContext md;
+    if (!md_info || mbedtls_md_setup(&md, md_info, 0) || mbedtls_md_starts(&md) || !s.start_hash(&md))
+        return interface_error::read_crl;
+
+    // issuer, compared as a whole TLV with the CA's subject
+    if (!s.header(&tag, &len) || tag != der_sequence || len > max_name_size)
+        return interface_error::read_crl;
+
+    issuer_name.resize(der_tlv_size(len));
+    auto name_header_len = der_header(issuer_name.data, tag, len);
+    if (!s.read(issuer_name.data + name_header_len, len))
+        return interface_error::read_crl;
+
+    if (issuer_name.size != issuer->subject_raw.len || memcmp(issuer_name.data, issuer->subject_raw.p, issuer_name.size) != 0) {
+        fprintf(stderr, "CRL has a different issuer.\n");
+        return interface_error::read_crl;
+    }
+
+    // thisUpdate
+    if (!s.header(&tag, &len) || !read_time(s, tag, len, &this_update)) {
+        fprintf(stderr, "Invalid CRL thisUpdate.\n");
+        return interface_error::read_crl;
+    }
+
+    // nextUpdate, revokedCertificates and crlExtensions, all optional
+    while (s.position() < tbs_end) {
+        if (!s.header(&tag, &len))
+            return interface_error::read_crl;
+
+        if (is_time_tag(tag)) {
+            if (!read_time(s, tag, len, &next_update)) {
+                fprintf(stderr, "Invalid CRL nextUpdate.\n");
+                return interface_error::read_crl;
+            }
+
+            continue;
+        }
+
+        if (tag != der_sequence) {
+            if (tag != der_context(0) || !s.skip(len))
+                return interface_error::read_crl;
+
+            continue;
+        }
+
+        auto list_end = s.position() + len;
+        while (s.position() < list_end) {
+            if (!s.header(&tag, &len) || tag != der_sequence)
+                return interface_error::read_crl;
+            auto entry_end = s.position() + len;
+
+            unsigned char serial[21];
+            Serial record;
+            if (!s.header(&tag, &len) || tag != MBEDTLS_ASN1_INTEGER || len > sizeof(serial)
+                || !s.read(serial, len)
+                || !to_record(serial, len, &record))
+            {
+                fprintf(stderr, "Invalid serial in CRL entry %zu.\n", serials.size);
+                return interface_error::read_crl;
+            }
+
+            serials.push_back(record);
+
+            // revocationDate and crlEntryExtensions
+            if (s.position() > entry_end || !s.skip(entry_end - s.position()))
+                return interface_error::read_crl;
+        }
+
+        if (s.position() != list_end)
+            return interface_error::read_crl;
+    }
+
+    if (s.position() != tbs_end)
+        return interface_error::read_crl;
+
+    s.stop_hash();
+    unsigned char hash[MBEDTLS_MD_MAX_SIZE];
+    if (mbedtls_md_finish(&md, hash))
+        return interface_error::read_crl;
+
+    // signatureAlgorithm and signatureValue
+    unsigned char outer_algorithm[sizeof(algorithm)];
+    if (!s.header(&tag, &len) || tag != der_sequence || len != algorithm_len
+        || !s.read(outer_algorithm, len)
+        || memcmp(outer_algorithm, algorithm, len) != 0)
+    {
+        fprintf(stderr, "CRL signature algorithms differ.\n");
+        return interface_error::read_crl;
+    }
+
+    unsigned char signature[MBEDTLS_PK_SIGNATURE_MAX_SIZE + 1];
+    if (!s.header(&tag, &len) || tag != MBEDTLS_ASN1_BIT_STRING || len < 2 || len > sizeof(signature)
+        || !s.read(signature, len)
+        || signature[0] != 0)
+    {
+        return interface_error::read_crl;
+    }
+
+    auto verify_err = mbedtls_pk_verify(
+        const_cast<mbedtls_pk_context*>(&issuer->pk), md_type,
+        hash, mbedtls_md_get_size(md_info),
+        signature + 1, len - 1);
+
+    if (verify_err) {
+        fprintf(stderr, "CRL signature doesn't verify.\n");
+        return interface_error::read_crl;
+    }
+
+    sort(serials.data, serials.size, [](const Serial& a, const Serial& b) {
+        return compare(a, b) < 0;
+    });
+
+    // A CRL shouldn't list a serial twice, but if it does one copy is enough
+    size_t unique = 0;
+    for (size_t i = 0; i != serials.size; ++i) {
+        if (unique == 0 || compare(serials[unique - 1], serials[i]) != 0)
+            serials[unique++] = serials[i];
+    }
+    serials.resize(unique);
+
+    return interface_error::success;
+}
+
+bool CrlIndex::has_issuer(const mbedtls_x509_buf& issuer_raw) const
+{
+    return issuer_name.size == issuer_raw.len && memcmp(issuer_name.data, issuer_raw.p, issuer_raw.len) == 0;
+}
+
+bool CrlIndex::contains(const unsigned char* serial, size_t len) const
+{
+    Serial key;
+    if (!to_record(serial, len, &key))
+        return false;
+
+    size_t low = 0;
+    size_t high = serials.size;
+    while (low < high) {
+        auto middle = low + (high - low) / 2;
+        auto order = compare(serials[middle], key);
+        if (order == 0)
+            return true;
+
+        if (order < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return false;
+}
+
+bool CrlCache::put(CrlIndex&& index, const mbedtls_x509_buf& issuer_raw)
+{
+    for (auto& existing : indexes) {
+        if (existing.has_issuer(issuer_raw)) {
+            // A replayed older CRL could bring back a revoked certificate
+            if (index.issued() < existing.issued())
+                return false;
+
+            existing = static_cast<CrlIndex&&>(index);
+            return true;
+        }
+    }
+
+    indexes.push_back(static_cast<CrlIndex&&>(index));
+    return true;
+}
+
+revocation_status CrlCache::check(const mbedtls_x509_crt* cert) const
+{
+    int64_t now = time(nullptr);
+    for (auto& index : indexes) {
+        if (!index.has_issuer(cert->issuer_raw))
+            continue;
+
+        if (index.expired(now))
+            return revocation_status::unknown;
+
+        return index.contains(cert->serial.p, cert->serial.len) ? revocation_status::revoked : revocation_status::good;
+    }
+
+    return revocation_status::unknown;
+}
+
+} // namespace bb
@@ -0,0 +1,86 @@
+#ifndef BB_CRL_INDEX_HPP
+#define BB_CRL_INDEX_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <mbedtls/x509_crt.h>
+
+#include "interface_error.hpp"
+#include "rcomms.hpp"
+#include "vec.hpp"
+
+namespace bb {
+
+enum class [[clang::enum_extensibility(closed)]] revocation_status {
+    unknown, // No CRL loaded for the certificate's issuer, or it's past its nextUpdate
+    good,
+    revoked,
+    max_enum_value = revoked,
+};
+
+// The serials one issuer's CRL revokes, for lookups only.
+//
+// Each serial is stored as 20 bytes, right-aligned and zero-padded, in one
+// sorted array, so comparing records with memcmp compares the numbers and a
+// lookup is a binary search through a few cache lines. Besides those only
+// thisUpdate and nextUpdate are kept: entry dates, reasons and extensions are
+// skipped while the CRL is read.
+//
+// load streams the CRL in small chunks, decoding PEM on the way and hashing
+// the TBSCertList as it passes, and checks the signature against the issuer
+// certificate at the end. Memory use is the 20 bytes per entry, not a copy of
+// the CRL, let alone Mbed TLS' list of mbedtls_x509_crl_entry.
+class CrlIndex {
+public:
+    struct Serial {
+        unsigned char bytes[20];
+    };
+
+private:
+    vec<unsigned char> issuer_name;
+    vec<Serial> serials;
+
+    // Seconds since the Unix epoch
+    int64_t this_update = 0;
+    int64_t next_update = no_next_update;
+
+public:
+    // next_update of a CRL without one
+    static const int64_t no_next_update = INT64_MAX;
+
+    // Reads a DER or PEM CRL as a byte string from c. issuer has to be the
+    // certificate of the CA that signed it.
+    interface_error load(rcomms& c, const mbedtls_x509_crt* issuer);
+
+    // issuer_raw is the DER of an issuer or subject Name
+    bool has_issuer(const mbedtls_x509_buf& issuer_raw) const;
+
+    // Serial as in an INTEGER, leading zeros are ignored.
+    bool contains(const unsigned char* serial, size_t len) const;
+
+    size_t size() const { return serials.size; }
+
+    int64_t issued() const { return this_update; }
+
+    // Whether now is past nextUpdate, the CRL can't vouch for anything then.
+    bool expired(int64_t now) const { return now > next_update; }
+};
+
+// CRLs that stay loaded between calls, one per issuer.
+class CrlCache {
+    vec<CrlIndex> indexes;
+
+public:
+    // Replaces the index for the same issuer, if there is one. Returns false,
+    // and keeps the loaded one, if index was issued before it.
+    bool put(CrlIndex&& index, const mbedtls_x509_buf& issuer_raw);
+
+    bool empty() const { return indexes.empty(); }
+
+    revocation_status check(const mbedtls_x509_crt* cert) const;
+};
+
+} // namespace bb
+
+#endif // Header guard
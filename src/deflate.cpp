@@ -0,0 +1,189 @@
+#include <string.h>
+
+#include "deflate.hpp"
+
+namespace {
+
+const int hash_bits = 15;
+const uint32_t window_size = 32768;
+const uint32_t window_mask = window_size - 1;
+const size_t min_match = 3;
+const size_t max_match = 258;
+const int max_chain = 64;
+
+class BitWriter {
+    bb::vec<unsigned char>* out;
+    uint32_t acc = 0;
+    int count = 0;
+
+public:
+    explicit BitWriter(bb::vec<unsigned char>* o)
+        : out{o}
+    {
+    }
+
+    // Bits are packed starting at the least significant bit.
+    void put(uint32_t bits, int n)
+    {
+        acc |= bits << count;
+        count += n;
+        while (count >= 8) {
+            out->push_back((unsigned char)acc);
+            acc >>= 8;
+            count -= 8;
+        }
+    }
+
+    // Huffman codes are defined most significant bit first.
+    void put_code(uint32_t code, int n)
+    {
+        uint32_t reversed = 0;
+        for (int i = 0; i != n; ++i) {
+            reversed = reversed << 1 | (code & 1);
+            code >>= 1;
+        }
+        put(reversed, n);
+    }
+
+    void flush()
+    {
+        if (count)
+            out->push_back((unsigned char)acc);
+
+        acc = 0;
+        count = 0;
+    }
+};
+
+void put_symbol(BitWriter& bits, uint32_t symbol)
+{
+    if (symbol < 144)
+        bits.put_code(0x30 + symbol, 8);
+    else if (symbol < 256)
+        bits.put_code(0x190 + symbol - 144, 9);
+    else if (symbol < 280)
+        bits.put_code(symbol - 256, 7);
+    else
+        bits.put_code(0xc0 + symbol - 280, 8);
+}
+
+int log2_floor(uint32_t value)
+{
+    int result = 0;
+    while (value >>= 1)
+        ++result;
+    return result;
+}
+
+void put_match(BitWriter& bits, uint32_t length, uint32_t distance)
+{
+    // Length codes 257..284 cover 3..257 in groups of four with an increasing
+    // number of extra bits, 258 has its own code.
+    auto l = length - 3;
+    if (length == max_match) {
+        put_symbol(bits, 285);
+    } else if (l < 8) {
+        put_symbol(bits, 257 + l);
+    } else {
+        auto n = log2_floor(l);
+        put_symbol(bits, 257 + 4 * (n - 1) + ((l >> (n - 2)) & 3));
+        bits.put(l & ((1u << (n - 2)) - 1), n - 2);
+    }
+
+    // Distance codes come in pairs with the same number of extra bits.
+    auto d = distance - 1;
+    if (d < 4) {
+        bits.put_code(d, 5);
+    } else {
+        auto n = log2_floor(d);
+        bits.put_code(2 * n + ((d >> (n - 1)) & 1), 5);
+        bits.put(d & ((1u << (n - 1)) - 1), n - 1);
+    }
+}
+
+uint32_t hash(const unsigned char* p)
+{
+    auto v = (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+    return (v * 2654435761u) >> (32 - hash_bits);
+}
+
+} // namespace
+
+namespace bb {
+
+void Deflater::compress(const void* data, size_t len, vec<unsigned char>* out)
+{
+    auto in = static_cast<const unsigned char*>(data);
+
+    if (head.empty()) {
+        head.resize(1u << hash_bits);
+        prev.resize(window_size);
+    } else {
+        memset(head.data, 0, head.size * sizeof(uint32_t));
+    }
+
+    BitWriter bits{out};
+    bits.put(1, 1); // BFINAL
+    bits.put(1, 2); // BTYPE: fixed Huffman codes
+
+    // Positions are stored plus one so zero can mean "no entry".
+    auto insert = [&](size_t pos) {
+        auto h = hash(in + pos);
+        prev[pos & window_mask] = head[h];
+        head[h] = pos + 1;
+    };
+
+    size_t pos = 0;
+    while (pos < len) {
+        size_t best_length = 0;
+        size_t best_distance = 0;
+
+        if (len - pos >= min_match) {
+            auto limit = len - pos < max_match ? len - pos : max_match;
+            auto candidate = head[hash(in + pos)];
+
+            for (int chain = max_chain; candidate && chain; --chain) {
+                size_t start = candidate - 1;
+                if (pos - start > window_size)
+                    break;
+
+                size_t length = 0;
+                while (length < limit && in[start + length] == in[pos + length])
+                    ++length;
+
+                if (length > best_length) {
+                    best_length = length;
+                    best_distance = pos - start;
+                    if (length == limit)
+                        break;
+                }
+
+                auto next = prev[start & window_mask];
+                // The slot may already hold a newer position from a later
+                // window, which would send us forward again.
+                if (next >= candidate)
+                    break;
+                candidate = next;
+            }
+
+            insert(pos);
+        }
+
+        if (best_length >= min_match) {
+            put_match(bits, best_length, best_distance);
+            for (size_t i = 1; i != best_length; ++i) {
+                if (len - (pos + i) >= min_match)
+                    insert(pos + i);
+            }
+            pos += best_length;
+        } else {
+            put_symbol(bits, in[pos]);
+            ++pos;
+        }
+    }
+
+    put_symbol(bits, 256); // End of block
+    bits.flush();
+}
+
+} // namespace bb
@@ -0,0 +1,26 @@
+#ifndef BB_DEFLATE_HPP
+#define BB_DEFLATE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vec.hpp"
+
+namespace bb {
+
+// Raw deflate (RFC 1951) compressor producing a single block with the fixed
+// Huffman codes. Certificates and keys are short, so the gain of dynamic codes
+// doesn't justify the extra code size. The match tables are kept between calls
+// so one Deflater can be reused for many entries.
+class Deflater {
+    vec<uint32_t> head;
+    vec<uint32_t> prev;
+
+public:
+    // Appends the compressed form of data to out.
+    void compress(const void* data, size_t len, vec<unsigned char>* out);
+};
+
+} // namespace bb
+
+#endif // Header guard
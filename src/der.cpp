@@ -0,0 +1,98 @@
+#include <mbedtls/asn1.h>
+#include <mbedtls/oid.h>
+
+#include <string.h>
+
+#include "der.hpp"
+
+namespace bb {
+
+namespace {
+
+bool valid_time(const char* time, size_t time_len)
+{
+    if (time_len != 14)
+        return false;
+
+    for (size_t i = 0; i != time_len; ++i) {
+        if (time[i] < '0' || time[i] > '9')
+            return false;
+    }
+
+    return true;
+}
+
+} // namespace
+
+size_t der_time(unsigned char* out, const char* time, size_t time_len)
+{
+    if (!valid_time(time, time_len))
+        return 0;
+
+    auto year = (time[0] - '0') * 1000 + (time[1] - '0') * 100 + (time[2] - '0') * 10 + (time[3] - '0');
+
+    if (year >= 1950 && year < 2050) {
+        out[0] = MBEDTLS_ASN1_UTC_TIME;
+        out[1] = 13;
+        memcpy(out + 2, time + 2, 12);
+        out[14] = 'Z';
+        return 15;
+    }
+
+    return der_generalized_time(out, time, time_len);
+}
+
+size_t der_generalized_time(unsigned char* out, const char* time, size_t time_len)
+{
+    if (!valid_time(time, time_len))
+        return 0;
+
+    out[0] = MBEDTLS_ASN1_GENERALIZED_TIME;
+    out[1] = 15;
+    memcpy(out + 2, time, 14);
+    out[16] = 'Z';
+    return 17;
+}
+
+size_t der_unsigned_integer(unsigned char* out, const unsigned char* value, size_t len)
+{
+    while (len > 1 && value[0] == 0) {
+        ++value;
+        --len;
+    }
+
+    bool pad = len == 0 || value[0] & 0x80;
+    auto content_len = len + pad;
+
+    auto pos = der_header(out, MBEDTLS_ASN1_INTEGER, content_len);
+    if (pad)
+        out[pos++] = 0;
+
+    memcpy(out + pos, value, len);
+    return pos + len;
+}
+
+size_t der_signature_algorithm(unsigned char* out, const mbedtls_pk_context* key, mbedtls_md_type_t md)
+{
+    auto pk_alg = mbedtls_pk_can_do(key, MBEDTLS_PK_ECDSA) ? MBEDTLS_PK_ECDSA : MBEDTLS_PK_RSA;
+
+    const char* oid;
+    size_t oid_len;
+    if (mbedtls_oid_get_oid_by_sig_alg(pk_alg, md, &oid, &oid_len))
+        return 0;
+
+    // RSA signatures have NULL parameters, ECDSA ones none at all
+    size_t params_len = pk_alg == MBEDTLS_PK_RSA ? 2 : 0;
+
+    auto pos = der_header(out, bb::der_sequence, der_tlv_size(oid_len) + params_len);
+    pos += der_header(out + pos, MBEDTLS_ASN1_OID, oid_len);
+    memcpy(out + pos, oid, oid_len);
+    pos += oid_len;
+
+    if (params_len)
+        pos += der_header(out + pos, MBEDTLS_ASN1_NULL, 0);
+
+    return pos;
+}
+
+} // namespace bb
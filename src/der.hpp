@@ -0,0 +1,86 @@
+#ifndef BB_DER_HPP
+#define BB_DER_HPP
+
+#include <stddef.h>
+
+#include <mbedtls/asn1.h>
+#include <mbedtls/md.h>
+#include <mbedtls/pk.h>
+
+#include "vec.hpp"
+
+// Helpers for writing DER front to back. Mbed TLS' asn1write works back to
+// front into a single buffer, which doesn't work when the output is streamed.
+
+namespace bb {
+
+const unsigned char der_sequence = MBEDTLS_ASN1_SEQUENCE | MBEDTLS_ASN1_CONSTRUCTED;
+const unsigned char der_set = MBEDTLS_ASN1_SET | MBEDTLS_ASN1_CONSTRUCTED;
+
+// [n] around a constructed value, e.g. an EXPLICIT tag
+constexpr unsigned char der_context(unsigned char n)
+{
+    return MBEDTLS_ASN1_CONTEXT_SPECIFIC | MBEDTLS_ASN1_CONSTRUCTED | n;
+}
+
+// Size of the length field for a value of len bytes.
+constexpr size_t der_length_size(size_t len)
+{
+    return len < 0x80 ? 1
+        : len <= 0xff ? 2
+        : len <= 0xffff ? 3
+        : len <= 0xffffff ? 4
+        : 5;
+}
+
+// Size of a complete tag-length-value with len bytes of content.
+constexpr size_t der_tlv_size(size_t len)
+{
+    return 1 + der_length_size(len) + len;
+}
+
+// Writes tag and length, at most 6 bytes. Returns the number of bytes written.
+constexpr size_t der_header(unsigned char* out, unsigned char tag, size_t len)
+{
+    out[0] = tag;
+
+    auto length_size = der_length_size(len);
+    if (length_size == 1) {
+        out[1] = (unsigned char)len;
+        return 2;
+    }
+
+    auto length_bytes = length_size - 1;
+    out[1] = (unsigned char)(0x80 | length_bytes);
+    for (size_t i = 0; i != length_bytes; ++i)
+        out[2 + i] = (unsigned char)(len >> (8 * (length_bytes - 1 - i)));
+
+    return 1 + length_size;
+}
+
+// Appends tag and length to a vec being filled front to back.
+inline void der_put_header(vec<unsigned char>* out, unsigned char tag, size_t len)
+{
+    unsigned char header[6];
+    out->append(header, der_header(header, tag, len));
+}
+
+// Writes the complete UTCTime or GeneralizedTime (from 2050 on, as RFC 5280
+// requires) for a YYYYMMDDhhmmss string, at most 17 bytes. Returns 0 if the
+// string isn't in that format.
+size_t der_time(unsigned char* out, const char* time, size_t time_len);
+
+// GeneralizedTime only, as OCSP uses. Always 17 bytes, 0 on a bad string.
+size_t der_generalized_time(unsigned char* out, const char* time, size_t time_len);
+
+// Writes an INTEGER for the unsigned big-endian value, at most len + 3 bytes.
+// Leading zeros are dropped and one is added when the top bit is set.
+size_t der_unsigned_integer(unsigned char* out, const unsigned char* value, size_t len);
+
+// AlgorithmIdentifier for signatures made with key and md, at most 32 bytes.
+// Returns 0 for unsupported combinations.
+size_t der_signature_algorithm(unsigned char* out, const mbedtls_pk_context* key, mbedtls_md_type_t md);
+
+} // namespace bb
+
+#endif // Header guard
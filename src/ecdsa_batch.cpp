@@ -0,0 +1,260 @@
+#include <mbedtls/asn1.h>
+#include <mbedtls/ecdsa.h>
+#include <mbedtls/platform_util.h>
+
+#include <string.h>
+
+#include "der.hpp"
+#include "random.hpp"
+
+#include "ecdsa_batch.hpp"
+
+namespace {
+
+
+// Nonces tried per signature before giving up, like mbedtls_ecdsa_sign
+const int max_nonce_tries = 10;
+
+// The hash as an integer mod N, truncated to N's bit length (SEC 1 4.1.3 step
+// 5), the same as mbedtls_ecdsa_sign
+bool hash_to_mpi(const mbedtls_ecp_group* grp, const unsigned char* hash, size_t hash_len, mbedtls_mpi* out)
+{
+    auto n_size = (grp->nbits + 7) / 8;
+    auto use_size = hash_len > n_size ? n_size : hash_len;
+
+    if (mbedtls_mpi_read_binary(out, hash, use_size))
+        return false;
+
+    if (use_size * 8 > grp->nbits && mbedtls_mpi_shift_r(out, use_size * 8 - grp->nbits))
+        return false;
+
+    return mbedtls_mpi_cmp_mpi(out, &grp->N) < 0 || mbedtls_mpi_sub_mpi(out, out, &grp->N) == 0;
+}
+
+// Ecdsa-Sig-Value
+bool write_signature(const mbedtls_mpi* r, const mbedtls_mpi* s, unsigned char* out, size_t out_size, size_t* out_len)
+{
+    unsigned char r_bytes[MBEDTLS_ECP_MAX_BYTES];
+    unsigned char s_bytes[MBEDTLS_ECP_MAX_BYTES];
+    auto r_len = mbedtls_mpi_size(r);
+    auto s_len = mbedtls_mpi_size(s);
+    if (mbedtls_mpi_write_binary(r, r_bytes, r_len) || mbedtls_mpi_write_binary(s, s_bytes, s_len))
+        return false;
+
+    unsigned char integers[2 * (MBEDTLS_ECP_MAX_BYTES + 3)];
+    auto integers_len = bb::der_unsigned_integer(integers, r_bytes, r_len);
+    integers_len += bb::der_unsigned_integer(integers + integers_len, s_bytes, s_len);
+
+    if (bb::der_tlv_size(integers_len) > out_size)
+        return false;
+
+    auto pos = bb::der_header(out, bb::der_sequence, integers_len);
+    memcpy(out + pos, integers, integers_len);
+    *out_len = pos + integers_len;
+
+    return true;
+}
+
+// Zero, with the limbs kept
+void wipe_mpi(mbedtls_mpi* x)
+{
+    if (x->private_p)
+        mbedtls_platform_zeroize(x->private_p, x->private_n * sizeof(mbedtls_mpi_uint));
+
+    mbedtls_mpi_lset(x, 0);
+}
+
+} // namespace
+
+namespace bb {
+
+EcdsaBatch::EcdsaBatch()
+{
+    for (auto& worker : scratch) {
+        mbedtls_ecp_point_init(&worker.point);
+        mbedtls_mpi_init(&worker.s);
+    }
+
+    mbedtls_mpi_init(&inverse);
+    mbedtls_mpi_init(&product);
+}
+
+EcdsaBatch::~EcdsaBatch()
+{
+    for (auto& worker : scratch) {
+        mbedtls_ecp_point_free(&worker.point);
+        mbedtls_mpi_free(&worker.s);
+    }
+
+    mbedtls_mpi_free(&inverse);
+    mbedtls_mpi_free(&product);
+
+    vec<mbedtls_mpi>* arrays[] { &k, &t, &blinded, &prefix, &r, &e };
+    for (auto array : arrays) {
+        for (auto& value : *array)
+            mbedtls_mpi_free(&value);
+    }
+}
+
+// The arrays only grow, so their limbs are reused from one batch to the next
+void EcdsaBatch::grow(size_t count)
+{
+    vec<mbedtls_mpi>* arrays[] { &k, &t, &blinded, &prefix, &r, &e };
+    for (auto array : arrays) {
+        auto old_size = array->size;
+        if (count <= old_size)
+            continue;
+
+        array->resize(count);
+        for (size_t i = old_size; i != count; ++i)
+            mbedtls_mpi_init(&(*array)[i]);
+    }
+}
+
+// Everything computed from the nonces, r aside, and the r d products left in
+// the scratch space
+void EcdsaBatch::wipe(size_t count)
+{
+    vec<mbedtls_mpi>* arrays[] { &k, &t, &blinded, &prefix };
+    for (auto array : arrays) {
+        for (size_t i = 0; i != count; ++i)
+            wipe_mpi(&(*array)[i]);
+    }
+
+    for (auto& worker : scratch)
+        wipe_mpi(&worker.s);
+
+    wipe_mpi(&inverse);
+    wipe_mpi(&product);
+}
+
+bool EcdsaBatch::sign(
+    mbedtls_ecp_keypair* key,
+    const unsigned char* hashes,
+    size_t hash_len,
+    size_t count,
+    unsigned char* signatures,
+    size_t stride,
+    size_t* signature_lens)
+{
+    if (!count)
+        return true;
+
+    grow(count);
+    bool signed_all = sign_batch(key, hashes, hash_len, count, signatures, stride, signature_lens);
+    wipe(count);
+    return signed_all;
+}
+
+bool EcdsaBatch::sign_batch(
+    mbedtls_ecp_keypair* key,
+    const unsigned char* hashes,
+    size_t hash_len,
+    size_t count,
+    unsigned char* signatures,
+    size_t stride,
+    size_t* signature_lens)
+{
+    auto grp = &key->private_grp;
+    auto n = &grp->N;
+
+    // k, r = (k G).x mod N, t and k t
+    auto start = [&](size_t i, unsigned worker) {
+        auto point = &scratch[worker].point;
+        for (int tries = 0; tries != max_nonce_tries; ++tries) {
+            if (mbedtls_ecp_gen_privkey(grp, &k[i], mt_rng, nullptr))
+                return false;
+
+            if (mbedtls_ecp_mul(grp, point, &k[i], &grp->G, mt_rng, nullptr))
+                return false;
+
+            if (mbedtls_mpi_mod_mpi(&r[i], &point->private_X, n))
+                return false;
+
+            if (mbedtls_mpi_cmp_int(&r[i], 0) != 0) {
+                return mbedtls_ecp_gen_privkey(grp, &t[i], mt_rng, nullptr) == 0
+                    && mbedtls_mpi_mul_mpi(&blinded[i], &k[i], &t[i]) == 0
+                    && mbedtls_mpi_mod_mpi(&blinded[i], &blinded[i], n) == 0
+                    && hash_to_mpi(grp, hashes + i * hash_len, hash_len, &e[i]);
+            }
+        }
+
+        return false;
+    };
+
+    // The first one goes alone: Mbed TLS fills in the group's table of
+    // multiples of the generator on first use, the others then only read it
+    bool failed = !start(0, 0);
+    if (count > 1 && !failed) {
+        parallel_for(count - 1, [&](size_t i, unsigned worker) {
+            if (!start(i + 1, worker))
+                __atomic_store_n(&failed, true, __ATOMIC_RELAXED);
+        });
+    }
+
+    if (failed)
+        return false;
+
+    // Running products, a single inversion of the last one, then walk back:
+    // (k_i t_i)^-1 = prefix[i - 1] * (prefix[i])^-1, and the inverse for
+    // i - 1 is (prefix[i])^-1 * k_i t_i
+    if (mbedtls_mpi_copy(&prefix[0], &blinded[0]))
+        return false;
+
+    for (size_t i = 1; i != count; ++i) {
+        if (mbedtls_mpi_mul_mpi(&prefix[i], &prefix[i - 1], &blinded[i]) || mbedtls_mpi_mod_mpi(&prefix[i], &prefix[i], n))
+            return false;
+    }
+
+    if (mbedtls_mpi_inv_mod(&inverse, &prefix[count - 1], n))
+        return false;
+
+    for (size_t i = count; i-- != 0;) {
+        if (i) {
+            bool stepped = mbedtls_mpi_mul_mpi(&product, &inverse, &prefix[i - 1]) == 0
+                && mbedtls_mpi_mod_mpi(&product, &product, n) == 0
+                && mbedtls_mpi_mul_mpi(&inverse, &inverse, &blinded[i]) == 0
+                && mbedtls_mpi_mod_mpi(&inverse, &inverse, n) == 0;
+
+            if (!stepped)
+                return false;
+        } else {
+            mbedtls_mpi_swap(&product, &inverse);
+        }
+
+        // k^-1 = t (k t)^-1
+        if (mbedtls_mpi_mul_mpi(&k[i], &product, &t[i]) || mbedtls_mpi_mod_mpi(&k[i], &k[i], n))
+            return false;
+    }
+
+    // s = k^-1 (e + r d)
+    auto finish = [&](size_t i, unsigned worker) {
+        auto s = &scratch[worker].s;
+        bool computed = mbedtls_mpi_mul_mpi(s, &r[i], &key->private_d) == 0
+            && mbedtls_mpi_add_mpi(s, s, &e[i]) == 0
+            && mbedtls_mpi_mod_mpi(s, s, n) == 0
+            && mbedtls_mpi_mul_mpi(s, s, &k[i]) == 0
+            && mbedtls_mpi_mod_mpi(s, s, n) == 0;
+
+        if (!computed)
+            return false;
+
+        // Practically never, but mbedtls_ecdsa_sign would pick another nonce
+        if (mbedtls_mpi_cmp_int(s, 0) == 0) {
+            auto hash = hashes + i * hash_len;
+            if (mbedtls_ecdsa_sign(grp, &r[i], s, &key->private_d, hash, hash_len, mt_rng, nullptr))
+                return false;
+        }
+
+        return write_signature(&r[i], s, signatures + i * stride, stride, &signature_lens[i]);
+    };
+
+    parallel_for(count, [&](size_t i, unsigned worker) {
+        if (!finish(i, worker))
+            __atomic_store_n(&failed, true, __ATOMIC_RELAXED);
+    });
+
+    return !failed;
+}
+
+} // namespace bb
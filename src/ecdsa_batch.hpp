@@ -0,0 +1,81 @@
+#ifndef BB_ECDSA_BATCH_HPP
+#define BB_ECDSA_BATCH_HPP
+
+#include <stddef.h>
+
+#include <mbedtls/bignum.h>
+#include <mbedtls/ecp.h>
+
+#include "scheduler.hpp"
+#include "vec.hpp"
+
+namespace bb {
+
+// ECDSA signatures over a batch of hashes with one key, sharing the modular
+// inversion of the nonces between them.
+//
+// mbedtls_ecdsa_sign inverts each (blinded) nonce on its own. Here every nonce
+// k is multiplied by a random t, the products are inverted all at once with
+// Montgomery's trick (one inversion plus three multiplications per signature)
+// and k^-1 is t * (k t)^-1. Each quantity is kept in its own array, indexed by
+// signature. The scalar multiplications k G, which still dominate, and the
+// final s values are spread over the scheduler's threads.
+//
+// One k^-1 next to its published signature gives away the private key, so
+// every value derived from the nonces is zeroed when sign returns. The limbs
+// themselves are kept for the next batch.
+class EcdsaBatch {
+    // One entry per signature
+    vec<mbedtls_mpi> k; // k, then k^-1
+    vec<mbedtls_mpi> t;
+    vec<mbedtls_mpi> blinded; // k t
+    vec<mbedtls_mpi> prefix; // Product of blinded[0..i]
+    vec<mbedtls_mpi> r;
+    vec<mbedtls_mpi> e;
+
+    struct Scratch {
+        mbedtls_ecp_point point;
+        mbedtls_mpi s;
+    };
+
+    Scratch scratch[max_threads];
+
+    mbedtls_mpi inverse;
+    mbedtls_mpi product;
+
+    void grow(size_t count);
+    void wipe(size_t count);
+
+    bool sign_batch(
+        mbedtls_ecp_keypair* key,
+        const unsigned char* hashes,
+        size_t hash_len,
+        size_t count,
+        unsigned char* signatures,
+        size_t stride,
+        size_t* signature_lens);
+
+public:
+    EcdsaBatch();
+    ~EcdsaBatch();
+
+    EcdsaBatch(const EcdsaBatch&) = delete;
+    EcdsaBatch& operator=(const EcdsaBatch&) = delete;
+
+    // Signs count hashes of hash_len bytes each, stored back to back. The
+    // DER Ecdsa-Sig-Value of hash i goes to signatures + i * stride, its
+    // length to signature_lens[i]. stride has to fit a signature for the
+    // key's curve, MBEDTLS_ECDSA_MAX_LEN covers all of them.
+    bool sign(
+        mbedtls_ecp_keypair* key,
+        const unsigned char* hashes,
+        size_t hash_len,
+        size_t count,
+        unsigned char* signatures,
+        size_t stride,
+        size_t* signature_lens);
+};
+
+} // namespace bb
+
+#endif // Header guard
@@ -0,0 +1,40 @@
+#ifndef BB_ENDIAN_HPP
+#define BB_ENDIAN_HPP
+
+#include <stdint.h>
+
+namespace bb {
+
+// Little-endian integers in byte buffers, for file formats and ring records
+// that have to read the same on every host.
+
+inline uint32_t load_le32(const unsigned char* p)
+{
+    return (uint32_t)p[0]
+        | (uint32_t)p[1] << 8
+        | (uint32_t)p[2] << 16
+        | (uint32_t)p[3] << 24;
+}
+
+inline uint64_t load_le64(const unsigned char* p)
+{
+    return load_le32(p) | (uint64_t)load_le32(p + 4) << 32;
+}
+
+inline void store_le32(unsigned char* p, uint32_t value)
+{
+    p[0] = (unsigned char)(value);
+    p[1] = (unsigned char)(value >> 8);
+    p[2] = (unsigned char)(value >> 16);
+    p[3] = (unsigned char)(value >> 24);
+}
+
+inline void store_le64(unsigned char* p, uint64_t value)
+{
+    store_le32(p, (uint32_t)value);
+    store_le32(p + 4, (uint32_t)(value >> 32));
+}
+
+} // namespace bb
+
+#endif // Header guard
@@ -0,0 +1,51 @@
+#include <mbedtls/sha1.h>
+
+#include "scheduler.hpp"
+#include "sha256x4.hpp"
+
+#include "fingerprint.hpp"
+
+namespace {
+
+// Certificates per task. Enough to keep the SIMD lanes filled and to make a
+// task worth handing to another thread.
+const size_t chunk_size = 16;
+
+} // namespace
+
+namespace bb {
+
+bool fingerprint_chain(const mbedtls_x509_crt* chain, Fingerprints* out)
+{
+    vec<const unsigned char*> data;
+    vec<size_t> lens;
+
+    // An empty mbedtls_x509_crt is a chain of nothing
+    for (auto cert = chain; cert && cert->raw.p; cert = cert->next) {
+        data.push_back(cert->raw.p);
+        lens.push_back(cert->raw.len);
+    }
+
+    out->count = data.size;
+    out->sha1.resize(data.size * sha1_size);
+    out->sha256.resize(data.size * sha256_size);
+
+    bool failed = false;
+    auto chunks = (data.size + chunk_size - 1) / chunk_size;
+    parallel_for(chunks, [&](size_t chunk, unsigned) {
+        auto begin = chunk * chunk_size;
+        auto count = data.size - begin < chunk_size ? data.size - begin : chunk_size;
+
+        // A chunk's SHA-256s in one go so the SIMD build can interleave them
+        sha256_many(data.data + begin, lens.data + begin, count, out->sha256.data + begin * sha256_size);
+
+        for (auto i = begin; i != begin + count; ++i) {
+            if (mbedtls_sha1(data[i], lens[i], out->sha1.data + i * sha1_size))
+                __atomic_store_n(&failed, true, __ATOMIC_RELAXED);
+        }
+    });
+
+    return !failed;
+}
+
+} // namespace bb
@@ -0,0 +1,28 @@
+#ifndef BB_FINGERPRINT_HPP
+#define BB_FINGERPRINT_HPP
+
+#include <stddef.h>
+
+#include <mbedtls/x509_crt.h>
+
+#include "vec.hpp"
+
+namespace bb {
+
+const size_t sha1_size = 20;
+const size_t sha256_size = 32;
+
+// SHA-1 and SHA-256 over the DER of every certificate in a chain, in chain
+// order: certificate i's hashes start at sha1[i * sha1_size] and
+// sha256[i * sha256_size].
+struct Fingerprints {
+    size_t count = 0;
+    vec<unsigned char> sha1;
+    vec<unsigned char> sha256;
+};
+
+bool fingerprint_chain(const mbedtls_x509_crt* chain, Fingerprints* out);
+
+} // namespace bb
+
+#endif // Header guard
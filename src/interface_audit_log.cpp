@@ -0,0 +1,207 @@
+#include <mbedtls/md.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/sha256.h>
+#include <mbedtls/x509_crt.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "interface_error.hpp"
+#include "interface_key.hpp"
+#include "merkle_log.hpp"
+#include "random.hpp"
+#include "rcomms.hpp"
+#include "vec.hpp"
+#include "wcomms.hpp"
+
+// Issuance log: a Merkle tree over the DER of every certificate run() issues,
+// hashed like a Certificate Transparency log (see MerkleLog).
+//
+// The host turns it on by providing an "audit_log" file, an empty one starts
+// a new log. The tree's nodes go to "audit_log_nodes" next to it. Each run()
+// then appends its certificate before handing it out and fails with
+// audit_log if it can't. A certificate's leaf index is the tree size before
+// the run() that issued it.
+//
+// log_tree_head signs the current tree head with the key in "key". The
+// "result" file gets the signed data, a TreeHeadSignature from RFC 6962
+// section 3.5 (version, signature type, timestamp in milliseconds, tree size
+// and root hash, big-endian), followed by the signature over its SHA-256.
+//
+// log_inclusion_proof reads a leaf index and tree size from "input",
+// log_consistency_proof two tree sizes. Both write the number of hashes in
+// the proof to "result" followed by each hash as a byte string, in RFC 6962
+// order.
+
+bb::opt<bb::Key> read_key();
+
+namespace {
+
+const char* const frontier_path = "audit_log";
+const char* const nodes_path = "audit_log_nodes";
+
+// version, signature_type, timestamp, tree_size, sha256_root_hash
+const size_t tree_head_size = 1 + 1 + 8 + 8 + bb::merkle_hash_size;
+
+void store_be64(unsigned char* p, uint64_t value)
+{
+    for (int i = 0; i != 8; ++i)
+        p[i] = (unsigned char)(value >> (56 - 8 * i));
+}
+
+bb::opt<bb::MerkleLog> open_log()
+{
+    auto log = bb::MerkleLog::open(frontier_path, nodes_path);
+    if (!log)
+        fprintf(stderr, "Couldn't open audit log.\n");
+
+    return log;
+}
+
+bb::interface_error write_proof(const bb::vec<unsigned char>& proof)
+{
+    auto out_ = bb::wcomms::open("result");
+    if (!out_) {
+        fprintf(stderr, "Couldn't open result file.\n");
+        return bb::interface_error::open_file;
+    }
+    auto& out = *out_;
+
+    auto count = proof.size / bb::merkle_hash_size;
+    out.write_uint(count);
+    for (size_t i = 0; i != count; ++i)
+        out.write_bytelen(proof.data + i * bb::merkle_hash_size, bb::merkle_hash_size);
+
+    return out.good() ? bb::interface_error::success : bb::interface_error::audit_log;
+}
+
+} // namespace
+
+// Called by run() with the certificate it's about to hand out. Does nothing
+// if the host has no audit log.
+bool append_audit_log(const mbedtls_x509_crt* cert)
+{
+    auto exists = fopen(frontier_path, "rb");
+    if (!exists)
+        return true;
+    fclose(exists);
+
+    auto log = open_log();
+    if (!log || !(*log).append(cert->raw.p, cert->raw.len)) {
+        fprintf(stderr, "Couldn't append to audit log.\n");
+        return false;
+    }
+
+    return true;
+}
+
+[[clang::export_name("log_tree_head")]]
+bb::interface_error log_tree_head()
+{
+    auto log = open_log();
+    if (!log)
+        return bb::interface_error::audit_log;
+
+    auto opt_key = read_key();
+    if (!opt_key) {
+        fprintf(stderr, "Couldn't get log key.\n");
+        return bb::interface_error::read_key;
+    }
+
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t timestamp = (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+
+    unsigned char tree_head[tree_head_size];
+    tree_head[0] = 0; // v1
+    tree_head[1] = 1; // tree_hash
+    store_be64(tree_head + 2, timestamp);
+    store_be64(tree_head + 10, (*log).size());
+    (*log).root(tree_head + 18);
+
+    unsigned char hash[32];
+    unsigned char signature[MBEDTLS_PK_SIGNATURE_MAX_SIZE];
+    size_t signature_len;
+    bool signed_head = mbedtls_sha256(tree_head, sizeof(tree_head), hash, 0) == 0
+        && mbedtls_pk_sign(
+            &*opt_key, MBEDTLS_MD_SHA256,
+            hash, sizeof(hash),
+            signature, sizeof(signature), &signature_len,
+            mt_rng, nullptr) == 0;
+
+    if (!signed_head) {
+        fprintf(stderr, "Couldn't sign tree head.\n");
+        return bb::interface_error::audit_log;
+    }
+
+    auto out_ = bb::wcomms::open("result");
+    if (!out_) {
+        fprintf(stderr, "Couldn't open result file.\n");
+        return bb::interface_error::open_file;
+    }
+    auto& out = *out_;
+
+    out.write_bytelen(tree_head, sizeof(tree_head));
+    out.write_bytelen(signature, signature_len);
+
+    return out.good() ? bb::interface_error::success : bb::interface_error::audit_log;
+}
+
+[[clang::export_name("log_inclusion_proof")]]
+bb::interface_error log_inclusion_proof()
+{
+    auto cc = bb::rcomms::open("input");
+    if (!cc) {
+        fprintf(stderr, "Couldn't open input file.\n");
+        return bb::interface_error::read_input;
+    }
+
+    uint32_t index;
+    uint32_t tree_size;
+    if (!bb::cread(*cc, &index) || !bb::cread(*cc, &tree_size)) {
+        fprintf(stderr, "Couldn't read leaf index and tree size.\n");
+        return bb::interface_error::read_input;
+    }
+
+    auto log = open_log();
+    if (!log)
+        return bb::interface_error::audit_log;
+
+    bb::vec<unsigned char> proof;
+    if (!(*log).inclusion_proof(index, tree_size, &proof)) {
+        fprintf(stderr, "No inclusion proof for leaf %u in a tree of %u.\n", index, tree_size);
+        return bb::interface_error::audit_log;
+    }
+
+    return write_proof(proof);
+}
+
+[[clang::export_name("log_consistency_proof")]]
+bb::interface_error log_consistency_proof()
+{
+    auto cc = bb::rcomms::open("input");
+    if (!cc) {
+        fprintf(stderr, "Couldn't open input file.\n");
+        return bb::interface_error::read_input;
+    }
+
+    uint32_t first;
+    uint32_t second;
+    if (!bb::cread(*cc, &first) || !bb::cread(*cc, &second)) {
+        fprintf(stderr, "Couldn't read tree sizes.\n");
+        return bb::interface_error::read_input;
+    }
+
+    auto log = open_log();
+    if (!log)
+        return bb::interface_error::audit_log;
+
+    bb::vec<unsigned char> proof;
+    if (!(*log).consistency_proof(first, second, &proof)) {
+        fprintf(stderr, "No consistency proof from %u to %u.\n", first, second);
+        return bb::interface_error::audit_log;
+    }
+
+    return write_proof(proof);
+}
@@ -0,0 +1,76 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cert_decode.hpp"
+#include "cstr.hpp"
+#include "interface_error.hpp"
+#include "pem_scan.hpp"
+#include "rcomms.hpp"
+#include "vec.hpp"
+#include "wcomms.hpp"
+
+// Everything about every certificate in the "cert" file (PEM bundle or a
+// single DER certificate), for the UI and inventory tools. The "result" file
+// gets the number of certificates, then for each the fields decode_cert
+// writes, in bundle order. Mbed TLS doesn't parse the certificates, the
+// bundle is decoded once in place and read once.
+
+namespace {
+
+// Reused between calls, so a bundle costs the input buffer and nothing else
+bb::vec<bb::PemBlock> blocks;
+
+} // namespace
+
+[[clang::export_name("cert_details")]]
+bb::interface_error cert_details()
+{
+    auto cc = bb::rcomms::open("cert");
+    if (!cc) {
+        fprintf(stderr, "Couldn't open cert file.\n");
+        return bb::interface_error::read_cert;
+    }
+
+    bb::cstr data;
+    if (!bb::cread(*cc, &data)) {
+        fprintf(stderr, "Couldn't read input buffer.\n");
+        return bb::interface_error::read_cert;
+    }
+
+    blocks.clear();
+    bool pem = bb::find_pem_blocks(data.str, data.len, "CERTIFICATE", &blocks);
+    if (pem && blocks.empty()) {
+        fprintf(stderr, "No certificates in PEM data.\n");
+        return bb::interface_error::read_cert;
+    }
+
+    auto out_ = bb::wcomms::open("result");
+    if (!out_) {
+        fprintf(stderr, "Couldn't open result file.\n");
+        return bb::interface_error::open_file;
+    }
+    auto& out = *out_;
+
+    if (!pem) {
+        out.write_uint(1);
+        if (!bb::decode_cert((const unsigned char*)data.str, data.len, out)) {
+            fprintf(stderr, "Couldn't decode certificate.\n");
+            return bb::interface_error::cert_info;
+        }
+
+        return out.good() ? bb::interface_error::success : bb::interface_error::write_cert_info;
+    }
+
+    out.write_uint(blocks.size);
+    for (size_t i = 0; i != blocks.size; ++i) {
+        auto der = data.str + blocks[i].begin;
+        auto der_len = bb::base64_decode_in_place(der, blocks[i].end - blocks[i].begin);
+
+        if (!der_len || !bb::decode_cert((const unsigned char*)der, der_len, out)) {
+            fprintf(stderr, "Couldn't decode certificate %zu.\n", i);
+            return bb::interface_error::cert_info;
+        }
+    }
+
+    return out.good() ? bb::interface_error::success : bb::interface_error::write_cert_info;
+}
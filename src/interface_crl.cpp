@@ -0,0 +1,234 @@
+#include <mbedtls/pem.h>
+#include <mbedtls/pk.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cert.hpp"
+#include "crl.hpp"
+#include "crl_index.hpp"
+#include "cstr.hpp"
+#include "interface_error.hpp"
+#include "interface_key.hpp"
+#include "interface_md.hpp"
+#include "random.hpp"
+#include "rcomms.hpp"
+#include "wcomms.hpp"
+
+// Revocation lists. The CA certificate and key come in through the "cert" and
+// "key" files. An earlier CRL from the same CA can be passed as "crl", its
+// entries are kept. The signed CRL is written to the "result" file.
+//
+// load_crl keeps a CRL around for revocation checks instead: the CA
+// certificate comes in through "cert", the CRL through "crl". Only its serials
+// and dates stay, sorted, and replace an earlier CRL from the same CA unless
+// that one has a later thisUpdate. The number of distinct serials is written
+// to "result". They last as long as the instance, cert_info and cert_key_info
+// then also write the certificate's revocation_status to the "revocation"
+// file, unknown once the CRL is past its nextUpdate.
+
+bb::opt<bb::Cert> read_cert();
+bb::opt<bb::Key> read_key();
+
+namespace {
+
+bb::CrlCache crl_cache;
+
+// DER of the CRL in the "crl" file, PEM is decoded.
+bool read_existing_crl(bb::rcomms& c, bb::cstr* out)
+{
+    bb::cstr data;
+    if (!bb::cread(c, &data))
+        return false;
+
+    if (!strstr(data.str, "-----BEGIN X509 CRL-----")) {
+        *out = static_cast<bb::cstr&&>(data);
+        return true;
+    }
+
+    mbedtls_pem_context pem;
+    mbedtls_pem_init(&pem);
+
+    size_t used;
+    auto err = mbedtls_pem_read_buffer(
+        &pem,
+        "-----BEGIN X509 CRL-----",
+        "-----END X509 CRL-----",
+        (const unsigned char*)data.str,
+        nullptr, 0,
+        &used);
+
+    if (!err) {
+        *out = bb::cstr(pem.private_buflen);
+        memcpy(out->str, pem.private_buf, pem.private_buflen);
+    }
+
+    mbedtls_pem_free(&pem);
+    return err == 0;
+}
+
+} // namespace
+
+[[clang::export_name("write_crl")]]
+bb::interface_error write_crl()
+{
+    auto cc = bb::rcomms::open("input");
+    if (!cc) {
+        fprintf(stderr, "Couldn't open input file.\n");
+        return bb::interface_error::read_input;
+    }
+
+    auto& c = *cc;
+
+    auto opt_md_type = bb::read_md_type(c);
+    if (!opt_md_type) {
+        fprintf(stderr, "Couldn't read message digest type.\n");
+        return bb::interface_error::read_input;
+    }
+
+    bb::cstr this_update;
+    bb::cstr next_update;
+    uint32_t crl_number;
+    bool pem;
+
+    if (!bb::cread(c, &this_update)
+        || !bb::cread(c, &next_update)
+        || !bb::cread(c, &crl_number)
+        || !bb::cread(c, &pem))
+    {
+        fprintf(stderr, "Couldn't read CRL fields.\n");
+        return bb::interface_error::read_input;
+    }
+
+    auto opt_cert = read_cert();
+    if (!opt_cert) {
+        fprintf(stderr, "Couldn't get CA certificate.\n");
+        return bb::interface_error::read_cert;
+    }
+
+    auto opt_key = read_key();
+    if (!opt_key) {
+        fprintf(stderr, "Couldn't get CA key.\n");
+        return bb::interface_error::read_key;
+    }
+
+    auto& ca_cert = *opt_cert;
+    auto& ca_key = *opt_key;
+
+    if (mbedtls_pk_check_pair(&ca_cert.pk, &ca_key, mt_rng, nullptr) != 0) {
+        fprintf(stderr, "CA key doesn't belong to the CA certificate.\n");
+        return bb::interface_error::key_mismatch;
+    }
+
+    bb::CrlBuilder crl;
+
+    if (auto crl_cc = bb::rcomms::open("crl")) {
+        bb::cstr existing;
+        if (!read_existing_crl(*crl_cc, &existing)
+            || !crl.load_existing(static_cast<bb::cstr&&>(existing), ca_cert.subject_raw))
+        {
+            fprintf(stderr, "Couldn't read existing CRL.\n");
+            return bb::interface_error::read_crl;
+        }
+    }
+
+    uint32_t count;
+    if (!bb::cread(c, &count)) {
+        fprintf(stderr, "Couldn't read revoked certificate count.\n");
+        return bb::interface_error::read_input;
+    }
+
+    crl.reserve(count);
+
+    for (uint32_t i = 0; i != count; ++i) {
+        unsigned char serial[20];
+        char date[14];
+        uint32_t reason;
+
+        auto serial_len = c.read_bytelen(serial, sizeof(serial));
+        auto date_len = c.read_bytelen(date, sizeof(date));
+        if (!serial_len || !date_len || !bb::cread(c, &reason)) {
+            fprintf(stderr, "Couldn't read revoked certificate %u.\n", i);
+            return bb::interface_error::read_input;
+        }
+
+        if (!crl.add(serial, *serial_len, date, *date_len, reason)) {
+            fprintf(stderr, "Invalid revoked certificate %u.\n", i);
+            return bb::interface_error::read_input;
+        }
+    }
+
+    auto out = fopen("result", "wb");
+    if (!out) {
+        fprintf(stderr, "Couldn't open result file.\n");
+        return bb::interface_error::open_file;
+    }
+
+    auto err = crl.write(
+        out, pem,
+        &ca_cert, &ca_key,
+        bb::get_md(*opt_md_type),
+        this_update.str, next_update.str,
+        crl_number);
+
+    fclose(out);
+    return err;
+}
+
+[[clang::export_name("load_crl")]]
+bb::interface_error load_crl()
+{
+    auto opt_cert = read_cert();
+    if (!opt_cert) {
+        fprintf(stderr, "Couldn't get CA certificate.\n");
+        return bb::interface_error::read_cert;
+    }
+
+    auto& ca_cert = *opt_cert;
+
+    auto cc = bb::rcomms::open("crl");
+    if (!cc) {
+        fprintf(stderr, "Couldn't open crl file.\n");
+        return bb::interface_error::read_crl;
+    }
+
+    bb::CrlIndex index;
+    auto err = index.load(*cc, &ca_cert);
+    if (err != bb::interface_error::success) {
+        fprintf(stderr, "Couldn't load CRL.\n");
+        return err;
+    }
+
+    auto count = index.size();
+    if (!crl_cache.put(static_cast<bb::CrlIndex&&>(index), ca_cert.subject_raw)) {
+        fprintf(stderr, "CRL is older than the one already loaded.\n");
+        return bb::interface_error::read_crl;
+    }
+
+    auto out = bb::wcomms::open("result");
+    if (!out) {
+        fprintf(stderr, "Couldn't open result file.\n");
+        return bb::interface_error::open_file;
+    }
+
+    (*out).write_uint(count);
+    return (*out).good() ? bb::interface_error::success : bb::interface_error::open_file;
+}
+
+// Writes the certificate's revocation status to the "revocation" file if any
+// CRL has been loaded.
+bool write_revocation(const mbedtls_x509_crt* cert)
+{
+    if (crl_cache.empty())
+        return true;
+
+    auto out = bb::wcomms::open("revocation");
+    if (!out) {
+        fprintf(stderr, "Couldn't open revocation file.\n");
+        return false;
+    }
+
+    (*out).write_uint((uint32_t)crl_cache.check(cert));
+    return (*out).good();
+}
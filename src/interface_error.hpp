@@ -10,10 +10,14 @@ enum class [[clang::enum_extensibility(closed)]] interface_error
     read_input = 100,
     read_cert,
     read_key,
+    read_crl,
 
     write_cert = 200,
     write_cert_info,
     write_key,
+    write_zip,
+    write_crl,
+    write_mem_stats,
 
     cert_set_serial = 300,
     cert_set_validity,
@@ -31,6 +35,11 @@ enum class [[clang::enum_extensibility(closed)]] interface_error
     key_mismatch,
     convert_pem,
     open_file,
+    generate_crl,
+    generate_ocsp,
+    no_keygen_job,
+    audit_log,
+    no_stream,
 
 };
 
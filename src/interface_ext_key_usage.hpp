@@ -2,9 +2,6 @@
 #define BB_INTERFACE_EXT_KEY_USAGE_HPP
 
 #include "rcomms.hpp"
-#include "uniqptr.hpp"
-
-#include <mbedtls/asn1.h>
 
 namespace bb {
 
@@ -40,22 +37,6 @@ inline bool cread(rcomms& c, ext_key_usage* out)
     return true;
 }
 
-struct ExtKeyUsageListDeleter {
-    void operator()(mbedtls_asn1_sequence* exts)
-    {
-        auto next = exts->next;
-
-        delete exts;
-
-        if (next)
-            (*this)(next);
-    }
-};
-
-using ExtKeyUsageList = uniqptr<mbedtls_asn1_sequence, ExtKeyUsageListDeleter>;
-
-bool cread(rcomms& c, ExtKeyUsageList* out);
-
 } // namespace bb
 
 #endif // Header guard
@@ -0,0 +1,45 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cert.hpp"
+#include "fingerprint.hpp"
+#include "interface_error.hpp"
+#include "wcomms.hpp"
+
+// SHA-1 and SHA-256 fingerprints of every certificate in the "cert" file (PEM
+// bundle or a single DER certificate). The "result" file gets the number of
+// certificates, then for each its SHA-1 and its SHA-256 as byte strings, in
+// bundle order.
+
+bb::opt<bb::Cert> read_cert();
+
+[[clang::export_name("fingerprints")]]
+bb::interface_error fingerprints()
+{
+    auto opt_cert = read_cert();
+    if (!opt_cert) {
+        fprintf(stderr, "Couldn't get certificates.\n");
+        return bb::interface_error::read_cert;
+    }
+
+    bb::Fingerprints fingerprints;
+    if (!bb::fingerprint_chain(&*opt_cert, &fingerprints)) {
+        fprintf(stderr, "Couldn't hash certificates.\n");
+        return bb::interface_error::cert_info;
+    }
+
+    auto out_ = bb::wcomms::open("result");
+    if (!out_) {
+        fprintf(stderr, "Couldn't open result file.\n");
+        return bb::interface_error::open_file;
+    }
+    auto& out = *out_;
+
+    out.write_uint(fingerprints.count);
+    for (size_t i = 0; i != fingerprints.count; ++i) {
+        out.write_bytelen(fingerprints.sha1.data + i * bb::sha1_size, bb::sha1_size);
+        out.write_bytelen(fingerprints.sha256.data + i * bb::sha256_size, bb::sha256_size);
+    }
+
+    return out.good() ? bb::interface_error::success : bb::interface_error::write_cert_info;
+}
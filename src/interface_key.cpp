@@ -9,6 +9,8 @@
 
 namespace {
 
+#if defined(MBEDTLS_RSA_C)
+
 bb::opt<bb::Key> generate_rsa(int bits)
 {
     bb::Key key;
@@ -22,6 +24,17 @@ bb::opt<bb::Key> generate_rsa(int bits)
     return key;
 }
 
+#else
+
+// The core module is built without RSA, the host switches to the sign_rsa
+// module for RSA keys.
+bb::opt<bb::Key> generate_rsa(int)
+{
+    return {};
+}
+
+#endif
+
 bb::opt<bb::Key> generate_ec(mbedtls_ecp_group_id curve)
 {
     bb::Key key;
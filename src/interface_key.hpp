@@ -4,6 +4,7 @@
 #include <mbedtls/pk.h>
 
 #include "opt.hpp"
+#include "rcomms.hpp"
 
 namespace bb {
 
@@ -52,6 +53,15 @@ enum class [[clang::enum_extensibility(closed)]] gen_key_type {
     max_enum_value = rsa_4096,
 };
 
+inline opt<gen_key_type> read_key_type(rcomms& c)
+{
+    auto value = c.read_uint();
+    if (!value || *value > (uint32_t)gen_key_type::max_enum_value)
+        return {};
+
+    return (gen_key_type)*value;
+}
+
 opt<Key> generate_key(gen_key_type nr);
 
 } // namespace bb
@@ -0,0 +1,113 @@
+#include <mbedtls/pk.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cstr.hpp"
+#include "interface_error.hpp"
+#include "interface_key.hpp"
+#include "keygen_job.hpp"
+#include "random.hpp"
+#include "rcomms.hpp"
+#include "wcomms.hpp"
+
+// Step-wise gen_key for hosts that run the module on their own event loop.
+//
+// keygen_begin reads the key type from "input" and starts a job, replacing one
+// that's still running. keygen_step reads a time budget in milliseconds and
+// works on the job for about that long. Each step writes to "result" whether
+// the key is done, the progress in thousandths and the number of prime
+// candidates tested, followed by the key's PEM once it's done. keygen_cancel
+// drops the job.
+
+namespace {
+
+bb::KeygenJob job;
+
+} // namespace
+
+[[clang::export_name("keygen_begin")]]
+bb::interface_error keygen_begin()
+{
+    bb::reset_host_rng_calls();
+
+    auto cc = bb::rcomms::open("input");
+    if (!cc) {
+        fprintf(stderr, "Couldn't open input file.\n");
+        return bb::interface_error::read_input;
+    }
+
+    auto opt_key_type = read_key_type(*cc);
+    if (!opt_key_type) {
+        fprintf(stderr, "Couldn't read key type.\n");
+        return bb::interface_error::read_input;
+    }
+
+    if (!job.begin(*opt_key_type)) {
+        fprintf(stderr, "Can't generate this type of key.\n");
+        return bb::interface_error::generate_key;
+    }
+
+    return bb::interface_error::success;
+}
+
+[[clang::export_name("keygen_step")]]
+bb::interface_error keygen_step()
+{
+    auto cc = bb::rcomms::open("input");
+    if (!cc) {
+        fprintf(stderr, "Couldn't open input file.\n");
+        return bb::interface_error::read_input;
+    }
+
+    auto budget_ms = (*cc).read_uint();
+    if (!budget_ms) {
+        fprintf(stderr, "Couldn't read time budget.\n");
+        return bb::interface_error::read_input;
+    }
+
+    if (job.current_state() != bb::KeygenJob::state::running) {
+        fprintf(stderr, "No key generation in progress.\n");
+        return bb::interface_error::no_keygen_job;
+    }
+
+    if (!job.step(*budget_ms)) {
+        fprintf(stderr, "Couldn't generate key.\n");
+        return bb::interface_error::generate_key;
+    }
+
+    auto out_ = bb::wcomms::open("result");
+    if (!out_) {
+        fprintf(stderr, "Couldn't open result file.\n");
+        return bb::interface_error::open_file;
+    }
+    auto& out = *out_;
+
+    bool done = job.current_state() == bb::KeygenJob::state::done;
+    out.write_bool(done);
+    out.write_uint(job.progress());
+    out.write_uint(job.candidates());
+
+    if (done) {
+        auto pem = bb::cstr(10240 * 2 + 64);
+        auto err = mbedtls_pk_write_key_pem(&job.key(), (unsigned char*)pem.str, pem.len);
+        job.cancel();
+
+        if (err) {
+            fprintf(stderr, "Couldn't turn key DER into PEM.\n");
+            return bb::interface_error::write_key;
+        }
+
+        out.write_bytelen(pem.str, strlen(pem.str));
+    }
+
+    return out.good() ? bb::interface_error::success : bb::interface_error::write_key;
+}
+
+[[clang::export_name("keygen_cancel")]]
+bb::interface_error keygen_cancel()
+{
+    job.cancel();
+    return bb::interface_error::success;
+}
@@ -3,6 +3,9 @@
 
 #include <mbedtls/md.h>
 
+#include "opt.hpp"
+#include "rcomms.hpp"
+
 namespace bb {
 
 enum class [[clang::enum_extensibility(closed)]] md_type {
@@ -13,6 +16,15 @@ enum class [[clang::enum_extensibility(closed)]] md_type {
     max_enum_value = sha2_512,
 };
 
+inline opt<md_type> read_md_type(rcomms& c)
+{
+    auto value = c.read_uint();
+    if (!value || *value > (uint32_t)md_type::max_enum_value)
+        return {};
+
+    return (md_type)*value;
+}
+
 inline mbedtls_md_type_t get_md(md_type type)
 {
     switch (type) {
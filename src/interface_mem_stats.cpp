@@ -0,0 +1,55 @@
+#include "mem_stats.hpp"
+
+#if defined(BB_MEM_STATS)
+
+#include <stdio.h>
+
+#include "interface_error.hpp"
+#include "wcomms.hpp"
+
+// Allocation counters since the previous mem_stats call, written to the
+// "mem_stats" file: allocations, frees, allocated bytes, live bytes, peak live
+// bytes and the size of linear memory, then the number of histogram entries
+// (0 without BB_MEM_HISTOGRAM) and the counts, smallest size class first.
+//
+// Allocated bytes add up every allocation in the window and can pass 4 GiB,
+// so they're 64-bit: the low uint, then the high one. The live and linear
+// memory counts are 32-bit, which is all a wasm32 module can address.
+
+[[clang::export_name("mem_stats")]]
+bb::interface_error mem_stats()
+{
+    auto stats = bb::take_mem_stats();
+
+    auto out_ = bb::wcomms::open("mem_stats");
+    if (!out_) {
+        fprintf(stderr, "Couldn't open mem_stats file.\n");
+        return bb::interface_error::open_file;
+    }
+    auto& out = *out_;
+
+    out.write_uint(stats.allocations);
+    out.write_uint(stats.frees);
+    out.write_uint((uint32_t)stats.allocated_bytes);
+    out.write_uint((uint32_t)(stats.allocated_bytes >> 32));
+    out.write_uint((uint32_t)stats.live_bytes);
+    out.write_uint((uint32_t)stats.peak_live_bytes);
+
+#if defined(__wasm__)
+    out.write_uint((uint32_t)__builtin_wasm_memory_size(0) * 65536);
+#else
+    out.write_uint(0);
+#endif
+
+#if defined(BB_MEM_HISTOGRAM)
+    out.write_uint(bb::mem_size_classes);
+    for (auto count : stats.histogram)
+        out.write_uint(count);
+#else
+    out.write_uint(0);
+#endif
+
+    return out.good() ? bb::interface_error::success : bb::interface_error::write_mem_stats;
+}
+
+#endif
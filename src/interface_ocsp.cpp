@@ -0,0 +1,134 @@
+#include <mbedtls/pk.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cert.hpp"
+#include "cstr.hpp"
+#include "interface_error.hpp"
+#include "interface_key.hpp"
+#include "interface_md.hpp"
+#include "ocsp.hpp"
+#include "random.hpp"
+#include "rcomms.hpp"
+#include "wcomms.hpp"
+
+// Pre-signed OCSP responses for a list of serials. The CA certificate and key
+// come in through the "cert" and "key" files. The "result" file gets the
+// number of responses followed by each DER OCSPResponse as a byte string, in
+// input order.
+
+bb::opt<bb::Cert> read_cert();
+bb::opt<bb::Key> read_key();
+
+namespace {
+
+// Responses hashed and signed together
+const size_t batch_size = 64;
+
+bb::opt<bb::ocsp_status> read_ocsp_status(bb::rcomms& c)
+{
+    auto value = c.read_uint();
+    if (!value || *value > (uint32_t)bb::ocsp_status::max_enum_value)
+        return {};
+
+    return (bb::ocsp_status)*value;
+}
+
+} // namespace
+
+[[clang::export_name("ocsp_sign")]]
+bb::interface_error ocsp_sign()
+{
+    auto cc = bb::rcomms::open("input");
+    if (!cc) {
+        fprintf(stderr, "Couldn't open input file.\n");
+        return bb::interface_error::read_input;
+    }
+
+    auto& c = *cc;
+
+    auto opt_md_type = bb::read_md_type(c);
+    if (!opt_md_type) {
+        fprintf(stderr, "Couldn't read message digest type.\n");
+        return bb::interface_error::read_input;
+    }
+
+    bb::cstr this_update;
+    bb::cstr next_update;
+    uint32_t count;
+
+    if (!bb::cread(c, &this_update)
+        || !bb::cread(c, &next_update)
+        || !bb::cread(c, &count))
+    {
+        fprintf(stderr, "Couldn't read OCSP fields.\n");
+        return bb::interface_error::read_input;
+    }
+
+    auto opt_cert = read_cert();
+    if (!opt_cert) {
+        fprintf(stderr, "Couldn't get CA certificate.\n");
+        return bb::interface_error::read_cert;
+    }
+
+    auto opt_key = read_key();
+    if (!opt_key) {
+        fprintf(stderr, "Couldn't get CA key.\n");
+        return bb::interface_error::read_key;
+    }
+
+    auto& ca_cert = *opt_cert;
+    auto& ca_key = *opt_key;
+
+    if (mbedtls_pk_check_pair(&ca_cert.pk, &ca_key, mt_rng, nullptr) != 0) {
+        fprintf(stderr, "CA key doesn't belong to the CA certificate.\n");
+        return bb::interface_error::key_mismatch;
+    }
+
+    bb::OcspSigner signer;
+    auto err = signer.init(
+        &ca_cert, &ca_key,
+        bb::get_md(*opt_md_type),
+        this_update.str, this_update.len,
+        next_update.str, next_update.len);
+
+    if (err != bb::interface_error::success)
+        return err;
+
+    auto out_ = bb::wcomms::open("result");
+    if (!out_) {
+        fprintf(stderr, "Couldn't open result file.\n");
+        return bb::interface_error::open_file;
+    }
+    auto& out = *out_;
+
+    out.write_uint(count);
+
+    for (uint32_t i = 0; i != count; ++i) {
+        unsigned char serial[20];
+        char revocation_time[14];
+        uint32_t reason;
+
+        auto serial_len = c.read_bytelen(serial, sizeof(serial));
+        auto status = read_ocsp_status(c);
+        auto revocation_time_len = c.read_bytelen(revocation_time, sizeof(revocation_time));
+        if (!serial_len || !status || !revocation_time_len || !bb::cread(c, &reason)) {
+            fprintf(stderr, "Couldn't read serial %u.\n", i);
+            return bb::interface_error::read_input;
+        }
+
+        if (!signer.add(serial, *serial_len, *status, revocation_time, *revocation_time_len, reason)) {
+            fprintf(stderr, "Invalid serial or status %u.\n", i);
+            return bb::interface_error::read_input;
+        }
+
+        if (signer.pending_count() == batch_size) {
+            err = signer.flush(out);
+            if (err != bb::interface_error::success)
+                return err;
+        }
+    }
+
+    return signer.flush(out);
+}
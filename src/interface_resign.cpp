@@ -0,0 +1,136 @@
+#include <mbedtls/pk.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cert.hpp"
+#include "cert_io.hpp"
+#include "cstr.hpp"
+#include "interface_error.hpp"
+#include "interface_key.hpp"
+#include "interface_md.hpp"
+#include "random.hpp"
+#include "rcomms.hpp"
+#include "resign.hpp"
+#include "wcomms.hpp"
+
+// Re-signs every certificate in the "cert" file (PEM bundle or a single DER
+// certificate) with the CA in "issuer_cert" and "key". The input has the
+// message digest and the new notBefore and notAfter. The "result" file gets
+// the number of certificates followed by each new certificate as PEM, in
+// bundle order.
+
+bb::opt<bb::Cert> read_cert();
+bb::opt<bb::Key> read_key();
+
+namespace {
+
+// Certificates hashed and signed together
+const size_t batch_size = 64;
+
+bb::opt<bb::Cert> read_ca_cert()
+{
+    auto cc = bb::rcomms::open("issuer_cert");
+    if (!cc) {
+        fprintf(stderr, "Couldn't open issuer_cert file.\n");
+        return {};
+    }
+
+    bb::cstr data;
+    if (!bb::cread(*cc, &data)) {
+        fprintf(stderr, "Couldn't read issuer_cert file.\n");
+        return {};
+    }
+
+    return bb::parse_cert(static_cast<bb::cstr&&>(data));
+}
+
+} // namespace
+
+[[clang::export_name("resign")]]
+bb::interface_error resign()
+{
+    auto cc = bb::rcomms::open("input");
+    if (!cc) {
+        fprintf(stderr, "Couldn't open input file.\n");
+        return bb::interface_error::read_input;
+    }
+
+    auto& c = *cc;
+
+    auto opt_md_type = bb::read_md_type(c);
+    bb::cstr not_before;
+    bb::cstr not_after;
+    if (!opt_md_type || !bb::cread(c, &not_before) || !bb::cread(c, &not_after)) {
+        fprintf(stderr, "Couldn't read re-sign fields.\n");
+        return bb::interface_error::read_input;
+    }
+
+    auto opt_certs = read_cert();
+    if (!opt_certs) {
+        fprintf(stderr, "Couldn't get certificates.\n");
+        return bb::interface_error::read_cert;
+    }
+
+    auto opt_ca_cert = read_ca_cert();
+    if (!opt_ca_cert) {
+        fprintf(stderr, "Couldn't get CA certificate.\n");
+        return bb::interface_error::read_cert;
+    }
+
+    auto opt_key = read_key();
+    if (!opt_key) {
+        fprintf(stderr, "Couldn't get CA key.\n");
+        return bb::interface_error::read_key;
+    }
+
+    auto& ca_cert = *opt_ca_cert;
+    auto& ca_key = *opt_key;
+
+    if (mbedtls_pk_check_pair(&ca_cert.pk, &ca_key, mt_rng, nullptr) != 0) {
+        fprintf(stderr, "CA key doesn't belong to the CA certificate.\n");
+        return bb::interface_error::key_mismatch;
+    }
+
+    bb::Resigner resigner;
+    auto err = resigner.init(
+        &ca_cert, &ca_key,
+        bb::get_md(*opt_md_type),
+        not_before.str, not_before.len,
+        not_after.str, not_after.len);
+
+    if (err != bb::interface_error::success)
+        return err;
+
+    auto out_ = bb::wcomms::open("result");
+    if (!out_) {
+        fprintf(stderr, "Couldn't open result file.\n");
+        return bb::interface_error::open_file;
+    }
+    auto& out = *out_;
+
+    uint32_t count = 0;
+    for (mbedtls_x509_crt* cert = &*opt_certs; cert && cert->raw.p; cert = cert->next)
+        ++count;
+
+    out.write_uint(count);
+
+    for (mbedtls_x509_crt* cert = &*opt_certs; cert && cert->raw.p; cert = cert->next) {
+        if (!resigner.add(cert)) {
+            fprintf(stderr, "Couldn't encode certificate.\n");
+            return bb::interface_error::generate_cert;
+        }
+
+        if (resigner.pending_count() == batch_size) {
+            err = resigner.flush(out);
+            if (err != bb::interface_error::success)
+                return err;
+        }
+    }
+
+    err = resigner.flush(out);
+    if (err != bb::interface_error::success)
+        return err;
+
+    return out.good() ? bb::interface_error::success : bb::interface_error::write_cert;
+}
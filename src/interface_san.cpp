@@ -1,14 +1,28 @@
+#include <mbedtls/asn1.h>
 #include <mbedtls/x509_crt.h>
 
+#include <string.h>
+
+#include "der.hpp"
 #include "rcomms.hpp"
-#include "mbedtls/x509.h"
 #include "opt.hpp"
-#include "uniqptr.hpp"
+#include "sort.hpp"
 
 #include "interface_san.hpp"
 
 namespace {
 
+// Longer than any DNS name or mailbox, short enough that a bad length can't
+// make us allocate much.
+const uint32_t max_value_length = 1024;
+
+// Longest IPv6 text form is 45 characters
+const uint32_t max_ip_length = 63;
+
+// Only a guess to start from, the buffer grows past it if needed.
+const size_t reserve_per_name = 32;
+const size_t max_reserved_names = 1 << 16;
+
 bb::opt<bb::san_type> read_san_type(bb::rcomms& c)
 {
     auto value = c.read_uint();
@@ -18,62 +32,149 @@ bb::opt<bb::san_type> read_san_type(bb::rcomms& c)
     return (bb::san_type)*value;
 }
 
-int get_san_type(bb::san_type san_type)
+// GeneralName choice, all of them IMPLICIT and primitive
+unsigned char get_san_tag(bb::san_type san_type)
 {
     switch (san_type) {
     case bb::san_type::dns:
-        return MBEDTLS_X509_SAN_DNS_NAME;
+        return MBEDTLS_ASN1_CONTEXT_SPECIFIC | 2;
     case bb::san_type::ip:
-        return MBEDTLS_X509_SAN_IP_ADDRESS;
+        return MBEDTLS_ASN1_CONTEXT_SPECIFIC | 7;
     case bb::san_type::email:
-        return MBEDTLS_X509_SAN_RFC822_NAME;
+        return MBEDTLS_ASN1_CONTEXT_SPECIFIC | 1;
     }
 }
 
+// Size of a GeneralName this file wrote, header included.
+size_t tlv_size(const unsigned char* tlv)
+{
+    size_t len = tlv[1];
+    size_t header = 2;
+    if (len & 0x80) {
+        auto length_bytes = len & 0x7f;
+        len = 0;
+        for (size_t i = 0; i != length_bytes; ++i)
+            len = len << 8 | tlv[2 + i];
+        header += length_bytes;
+    }
+
+    return header + len;
 }
 
+struct Name {
+    uint32_t offset;
+    uint32_t size;
+};
+
+} // namespace
+
 namespace bb {
 
-opt<OwningSanList> read_san_list(bb::rcomms& c)
+void SanList::finish(bool sort)
 {
-    OwningSanList start;
-    mbedtls_x509_san_list** tail = &start.ptr;
+    if (sort && count > 1) {
+        vec<Name> names;
+        names.reserve(count);
+        for (size_t pos = header_space; pos != buffer.size;) {
+            auto size = tlv_size(buffer.data + pos);
+            names.push_back({(uint32_t)pos, (uint32_t)size});
+            pos += size;
+        }
+
+        auto data = buffer.data;
+        auto compare = [data](const Name& a, const Name& b) {
+            auto common = a.size < b.size ? a.size : b.size;
+            auto result = memcmp(data + a.offset, data + b.offset, common);
+            return result ? result : (int)a.size - (int)b.size;
+        };
+
+        bb::sort(names.data, names.size, [&](const Name& a, const Name& b) {
+            return compare(a, b) < 0;
+        });
+
+        vec<unsigned char> sorted;
+        sorted.reserve(buffer.size);
+        sorted.resize(header_space);
 
+        count = 0;
+        for (size_t i = 0; i != names.size; ++i) {
+            if (i && compare(names[i - 1], names[i]) == 0)
+                continue;
+
+            sorted.append(data + names[i].offset, names[i].size);
+            ++count;
+        }
+
+        buffer = static_cast<vec<unsigned char>&&>(sorted);
+    }
+
+    auto content_len = buffer.size - header_space;
+    der_offset = header_space - (der_tlv_size(content_len) - content_len);
+    der_header(
+        buffer.data + der_offset,
+        der_sequence,
+        content_len);
+}
+
+bool read_san_list(rcomms& c, SanList* out)
+{
     auto opt_count = c.read_uint();
     if (!opt_count)
-        return {};
+        return false;
 
-    for (auto count = *opt_count; count != 0; count--) {
-        auto current = new mbedtls_x509_san_list{};
-        *tail = current;
-        tail = &current->next;
+    auto count = *opt_count;
+    auto& buffer = out->buffer;
 
+    buffer.clear();
+    buffer.reserve(SanList::header_space
+        + (count < max_reserved_names ? count : max_reserved_names) * reserve_per_name);
+    buffer.resize(SanList::header_space);
+    out->count = count;
+
+    for (; count != 0; count--) {
         auto opt_type = read_san_type(c);
-        auto opt_value = c.read_string();
-        if (!opt_type || !opt_value)
-            return {};
+        if (!opt_type)
+            return false;
 
         auto type = *opt_type;
-        auto& value = *opt_value;
-
-        current->node.type = get_san_type(type);
+        auto tag = get_san_tag(type);
 
         if (type == bb::san_type::ip) {
-            auto parsed_ip = new unsigned char[16];
-            auto ip_length = mbedtls_x509_crt_parse_cn_inet_pton(value.str, parsed_ip);
-            if (ip_length == 0) {
-                delete[] parsed_ip;
-                return {};
-            }
-            current->node.san.unstructured_name.len = ip_length;
-            current->node.san.unstructured_name.p = parsed_ip;
+            char text[max_ip_length + 1];
+            auto text_len = c.read_bytelen(text, max_ip_length);
+            if (!text_len)
+                return false;
+            text[*text_len] = '\0';
+
+            unsigned char address[16];
+            auto address_len = mbedtls_x509_crt_parse_cn_inet_pton(text, address);
+            if (address_len == 0)
+                return false;
+
+            der_put_header(&buffer, tag, address_len);
+            buffer.append(address, address_len);
         } else {
-            current->node.san.unstructured_name.len = value.len;
-            current->node.san.unstructured_name.p = (unsigned char*)value.release();
+            auto opt_len = c.read_uint();
+            if (!opt_len || *opt_len > max_value_length)
+                return false;
+
+            auto len = *opt_len;
+            der_put_header(&buffer, tag, len);
+
+            // Read in place, no copy of the value exists elsewhere
+            auto pos = buffer.size;
+            buffer.resize(pos + len);
+            if (!c.read_exact(buffer.data + pos, len))
+                return false;
         }
     }
 
-    return start;
+    bool sort;
+    if (!cread(c, &sort))
+        return false;
+
+    out->finish(sort);
+    return true;
 }
 
 } // namespace bb
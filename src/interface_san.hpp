@@ -1,11 +1,10 @@
 #ifndef BB_INTERFACE_SAN_HPP
 #define BB_INTERFACE_SAN_HPP
 
-#include <mbedtls/x509_crt.h>
+#include <stddef.h>
 
 #include "rcomms.hpp"
-#include "opt.hpp"
-#include "uniqptr.hpp"
+#include "vec.hpp"
 
 namespace bb {
 
@@ -16,22 +15,32 @@ enum class [[clang::enum_extensibility(closed)]] san_type {
     max_enum_value = email,
 };
 
-struct OwningSanListDeleter {
-    void operator()(mbedtls_x509_san_list* san_list)
-    {
-        auto next = san_list->next;
+// The subjectAltName extension value (GeneralNames), encoded straight from
+// the input into a single buffer. Room for the SEQUENCE header is left at the
+// front and filled in once the length is known.
+class SanList {
+    static constexpr size_t header_space = 6;
 
-        delete san_list->node.san.unstructured_name.p;
-        delete san_list;
+    vec<unsigned char> buffer;
+    size_t count = 0;
+    size_t der_offset = header_space;
 
-        if (next)
-            (*this)(next);
-    }
-};
+    void finish(bool sort);
+
+public:
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
 
-using OwningSanList = uniqptr<mbedtls_x509_san_list, OwningSanListDeleter>;
+    const unsigned char* der() const { return buffer.data + der_offset; }
+    size_t der_size() const { return buffer.size - der_offset; }
+
+    friend bool read_san_list(rcomms& c, SanList* out);
+};
 
-opt<OwningSanList> read_san_list(rcomms& c);
+// Reads the SAN count, the (type, value) entries and a flag that sorts the
+// names by their encoding and drops exact duplicates. Otherwise names keep
+// their input order.
+bool read_san_list(rcomms& c, SanList* out);
 
 } // namespace bb
 
@@ -0,0 +1,220 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cert.hpp"
+#include "cert_io.hpp"
+#include "cstr.hpp"
+#include "endian.hpp"
+#include "interface_error.hpp"
+#include "interface_key.hpp"
+#include "issue.hpp"
+#include "rcomms.hpp"
+#include "spsc_ring.hpp"
+#include "wcomms.hpp"
+
+// Streaming mode: requests and results go through two rings in linear memory
+// (SpscRing) instead of files and an export call each, so the host can queue
+// more requests and collect results while the module is busy signing.
+//
+// stream_open reads the capacities of the request and result rings from
+// "input", powers of two of at least 4 KiB. A result has to fit in half of
+// its ring, 64 KiB is plenty for RSA-4096. For CA-signed requests the CA key
+// comes in through "key" and, optionally, its certificate through
+// "issuer_cert", read once here. The "result" file gets the addresses of the
+// request ring and the result ring. Opening again starts over with new rings.
+//
+// stream_serve answers requests in order until the host closes the request
+// ring. A request is what run() reads from "input". Its result starts with a
+// uint interface_error, on success followed by what run() writes to "cert",
+// and the rest of the record is the subject key as PEM, like signd's
+// responses. Without threads the module can't wait for the host, so
+// stream_serve returns once there's no request or no room for a result and
+// the host calls it again.
+
+bb::opt<bb::Key> parse_key(bb::rcomms& c);
+bool read_issuer_cert(bb::cstr* out);
+bool append_audit_log(const mbedtls_x509_crt* cert);
+
+namespace {
+
+struct Stream {
+    unsigned char* memory = nullptr;
+    bb::SpscRing requests;
+    bb::SpscRing results;
+
+    bb::Key ca_key;
+    bool has_ca_key = false;
+    bb::cstr ca_cert;
+    bool has_ca_cert = false;
+
+    bb::cstr der_buffer;
+};
+
+Stream stream;
+
+bool valid_capacity(uint32_t capacity)
+{
+    return capacity >= bb::SpscRing::min_capacity && (capacity & (capacity - 1)) == 0;
+}
+
+bb::interface_error issue_request(unsigned char* request, uint32_t request_len, bb::Key* subject_key, bb::Cert* cert)
+{
+    auto file = fmemopen(request, request_len, "rb");
+    if (!file)
+        return bb::interface_error::read_input;
+
+    bb::rcomms in{file};
+
+    bb::IssueRequest issue_request;
+    if (!bb::read_issue_request(in, &issue_request))
+        return bb::interface_error::read_input;
+
+    auto opt_key = bb::generate_key(issue_request.key_type);
+    if (!opt_key) {
+        fprintf(stderr, "Couldn't generate key.\n");
+        return bb::interface_error::generate_key;
+    }
+    *subject_key = static_cast<bb::Key&&>(*opt_key);
+
+    mbedtls_pk_context* authority_key = subject_key;
+    if (!issue_request.self_signed) {
+        if (!stream.has_ca_key) {
+            fprintf(stderr, "Request isn't self-signed and the stream has no CA key.\n");
+            return bb::interface_error::read_key;
+        }
+
+        authority_key = &stream.ca_key;
+        if (stream.has_ca_cert)
+            issue_request.issuer_cert = &stream.ca_cert;
+    }
+
+    auto err = bb::issue(issue_request, subject_key, authority_key, &stream.der_buffer, cert);
+    if (err != bb::interface_error::success)
+        return err;
+
+    if (!append_audit_log(cert))
+        return bb::interface_error::audit_log;
+
+    return bb::interface_error::success;
+}
+
+// Answers one request straight into space, space_len bytes of the result
+// ring. Returns the result's length. If the result doesn't fit only the
+// status is left.
+uint32_t serve_request(unsigned char* request, uint32_t request_len, unsigned char* space, uint32_t space_len)
+{
+    bb::Key subject_key;
+    bb::Cert cert;
+    auto status = issue_request(request, request_len, &subject_key, &cert);
+
+    if (status == bb::interface_error::success) {
+        if (auto file = fmemopen(space, space_len, "wb")) {
+            bb::wcomms out{file};
+            out.write_uint((uint32_t)status);
+
+            auto err = bb::write_cert(out, &cert);
+            bool written = err == bb::interface_error::success
+                && bb::write_key(file, &subject_key)
+                && out.good();
+
+            auto len = out.tell();
+            if (written && len > 0 && (uint32_t)len < space_len)
+                return (uint32_t)len;
+
+            fprintf(stderr, "Result doesn't fit in the result ring.\n");
+            status = err != bb::interface_error::success ? err : bb::interface_error::write_cert;
+        } else {
+            status = bb::interface_error::write_cert;
+        }
+    }
+
+    bb::store_le32(space, (uint32_t)status);
+    return 4;
+}
+
+} // namespace
+
+[[clang::export_name("stream_open")]]
+bb::interface_error stream_open()
+{
+    auto cc = bb::rcomms::open("input");
+    if (!cc) {
+        fprintf(stderr, "Couldn't open input file.\n");
+        return bb::interface_error::read_input;
+    }
+
+    uint32_t request_capacity;
+    uint32_t result_capacity;
+    if (!bb::cread(*cc, &request_capacity) || !bb::cread(*cc, &result_capacity)
+        || !valid_capacity(request_capacity) || !valid_capacity(result_capacity))
+    {
+        fprintf(stderr, "Couldn't read ring capacities.\n");
+        return bb::interface_error::read_input;
+    }
+
+    auto key_cc = bb::rcomms::open("key");
+    auto ca_key = key_cc ? parse_key(*key_cc) : bb::opt<bb::Key>{};
+    if (key_cc && !ca_key) {
+        fprintf(stderr, "Couldn't get CA key.\n");
+        return bb::interface_error::read_key;
+    }
+
+    auto size = 2 * bb::SpscRing::header_size + request_capacity + result_capacity;
+    auto memory = (unsigned char*)aligned_alloc(64, size);
+    if (!memory) {
+        fprintf(stderr, "Couldn't allocate rings.\n");
+        return bb::interface_error::open_file;
+    }
+
+    free(stream.memory);
+    stream.memory = memory;
+
+    auto result_memory = memory + bb::SpscRing::header_size + request_capacity;
+    bb::SpscRing::init(memory, request_capacity);
+    bb::SpscRing::init(result_memory, result_capacity);
+    stream.requests = bb::SpscRing{memory};
+    stream.results = bb::SpscRing{result_memory};
+
+    stream.has_ca_key = (bool)ca_key;
+    if (ca_key)
+        stream.ca_key = static_cast<bb::Key&&>(*ca_key);
+
+    stream.has_ca_cert = read_issuer_cert(&stream.ca_cert);
+
+    auto out_ = bb::wcomms::open("result");
+    if (!out_) {
+        fprintf(stderr, "Couldn't open result file.\n");
+        return bb::interface_error::open_file;
+    }
+    auto& out = *out_;
+
+    out.write_uint((uint32_t)(uintptr_t)memory);
+    out.write_uint((uint32_t)(uintptr_t)result_memory);
+    return out.good() ? bb::interface_error::success : bb::interface_error::open_file;
+}
+
+[[clang::export_name("stream_serve")]]
+bb::interface_error stream_serve()
+{
+    if (!stream.memory) {
+        fprintf(stderr, "No stream is open.\n");
+        return bb::interface_error::no_stream;
+    }
+
+    for (;;) {
+        unsigned char* request;
+        uint32_t request_len;
+        bool closed;
+        if (!stream.requests.wait_front(&request, &request_len, &closed))
+            return bb::interface_error::success;
+
+        auto space = stream.results.wait_reserve();
+        if (!space)
+            return bb::interface_error::success;
+
+        auto result_len = serve_request(request, request_len, space, stream.results.max_record());
+        stream.results.commit(result_len);
+        stream.requests.pop();
+    }
+}
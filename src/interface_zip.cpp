@@ -0,0 +1,93 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cstr.hpp"
+#include "interface_error.hpp"
+#include "rcomms.hpp"
+#include "zip_writer.hpp"
+
+// The archive is built over several calls so the host can hand over one entry
+// at a time and drop its copy right away. It's written to the "result" file.
+
+namespace {
+
+bb::ZipWriter zip;
+
+}
+
+[[clang::export_name("zip_begin")]]
+bb::interface_error zip_begin()
+{
+    auto cc = bb::rcomms::open("input");
+    if (!cc) {
+        fprintf(stderr, "Couldn't open input file.\n");
+        return bb::interface_error::read_input;
+    }
+
+    auto& c = *cc;
+
+    uint32_t dos_date;
+    uint32_t dos_time;
+    if (!bb::cread(c, &dos_date) || !bb::cread(c, &dos_time)) {
+        fprintf(stderr, "Couldn't read ZIP timestamp.\n");
+        return bb::interface_error::read_input;
+    }
+
+    auto opt_zip = bb::ZipWriter::open("result", dos_date, dos_time);
+    if (!opt_zip) {
+        fprintf(stderr, "Couldn't open result file.\n");
+        return bb::interface_error::open_file;
+    }
+
+    zip = static_cast<bb::ZipWriter&&>(*opt_zip);
+    return bb::interface_error::success;
+}
+
+[[clang::export_name("zip_add")]]
+bb::interface_error zip_add()
+{
+    if (!zip.is_open()) {
+        fprintf(stderr, "No ZIP archive in progress.\n");
+        return bb::interface_error::write_zip;
+    }
+
+    auto cc = bb::rcomms::open("input");
+    if (!cc) {
+        fprintf(stderr, "Couldn't open input file.\n");
+        return bb::interface_error::read_input;
+    }
+
+    auto& c = *cc;
+
+    bb::cstr name;
+    bb::cstr content;
+    uint32_t mode;
+    bool compress;
+
+    if (!bb::cread(c, &name)
+        || !bb::cread(c, &content)
+        || !bb::cread(c, &mode)
+        || !bb::cread(c, &compress))
+    {
+        fprintf(stderr, "Couldn't read ZIP entry.\n");
+        return bb::interface_error::read_input;
+    }
+
+    if (!zip.add(name, content.str, content.len, mode, compress)) {
+        fprintf(stderr, "Couldn't write ZIP entry.\n");
+        return bb::interface_error::write_zip;
+    }
+
+    return bb::interface_error::success;
+}
+
+[[clang::export_name("zip_end")]]
+bb::interface_error zip_end()
+{
+    if (!zip.is_open() || !zip.complete()) {
+        fprintf(stderr, "Couldn't complete ZIP archive.\n");
+        return bb::interface_error::write_zip;
+    }
+
+    return bb::interface_error::success;
+}
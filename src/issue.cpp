@@ -0,0 +1,231 @@
+#include <mbedtls/asn1.h>
+#include <mbedtls/base64.h>
+#include <mbedtls/error.h>
+#include <mbedtls/x509_crt.h>
+
+#include <stdio.h>
+
+#include "cert.hpp"
+#include "cert_ext.hpp"
+#include "cstr.hpp"
+#include "interface_error.hpp"
+#include "issuer_name.hpp"
+#include "random.hpp"
+#include "rcomms.hpp"
+#include "write_cert.hpp"
+
+#include "issue.hpp"
+
+namespace bb {
+
+bool read_issue_request(rcomms& c, IssueRequest* out)
+{
+    if (!cread(c, &out->issuer)) {
+        fprintf(stderr, "Couldn't read issuer string.\n");
+        return false;
+    }
+
+    if (!cread(c, &out->subject)) {
+        fprintf(stderr, "Couldn't read subject string.\n");
+        return false;
+    }
+
+    if (!cread(c, &out->is_ca)) {
+        fprintf(stderr, "Couldn't read is ca flag.\n");
+        return false;
+    }
+
+    if (!cread(c, &out->self_signed)) {
+        fprintf(stderr, "Couldn't read is self-signed flag.\n");
+        return false;
+    }
+
+    if (!cread(c, &out->akid)) {
+        fprintf(stderr, "Couldn't read AKID.\n");
+        return false;
+    }
+
+    if (!read_san_list(c, &out->san_list)) {
+        fprintf(stderr, "Couldn't read SAN list.\n");
+        return false;
+    }
+
+    auto opt_key_type = read_key_type(c);
+    if (!opt_key_type) {
+        fprintf(stderr, "Couldn't read key type.\n");
+        return false;
+    }
+    out->key_type = *opt_key_type;
+
+    auto opt_md_type = read_md_type(c);
+    if (!opt_md_type) {
+        fprintf(stderr, "Couldn't read message digest type.\n");
+        return false;
+    }
+    out->md = *opt_md_type;
+
+    if (!cread(c, &out->not_before)) {
+        fprintf(stderr, "Couldn't read notBefore string.\n");
+        return false;
+    }
+
+    if (!cread(c, &out->not_after)) {
+        fprintf(stderr, "Couldn't read notAfter string.\n");
+        return false;
+    }
+
+    if (!cread(c, &out->key_usage)) {
+        fprintf(stderr, "Couldn't read key usage.\n");
+        return false;
+    }
+
+    if (!cread(c, &out->ext_key_usage)) {
+        fprintf(stderr, "Couldn't read extended key usage.\n");
+        return false;
+    }
+
+    return true;
+}
+
+interface_error issue(
+    const IssueRequest& request,
+    mbedtls_pk_context* subject_key,
+    mbedtls_pk_context* authority_key,
+    cstr* der_buffer,
+    Cert* out)
+{
+    WriteCert cert;
+
+    mbedtls_x509write_crt_set_version(&cert, MBEDTLS_X509_CRT_VERSION_3);
+
+    unsigned char serial_number_bytes[16];
+    if (mt_rng(nullptr, serial_number_bytes, sizeof(serial_number_bytes))) {
+        fprintf(stderr, "Couldn't generate serial number.\n");
+        return interface_error::cert_set_serial;
+    }
+
+    // Skip leading 0 bytes, otherwise theres a 1/256 chance the cert is invalid
+    // because of a malformed INTEGER. (Confirmed by asn1parse)
+    auto sn_length = sizeof(serial_number_bytes);
+    auto serial_number = serial_number_bytes;
+    while (sn_length && serial_number[0] == '\0') { --sn_length; ++serial_number; }
+
+    if (mbedtls_x509write_crt_set_serial_raw(&cert, serial_number, sn_length)) {
+        fprintf(stderr, "Couldn't set serial number.\n");
+        return interface_error::cert_set_serial;
+    }
+
+    if (mbedtls_x509write_crt_set_validity(&cert, request.not_before.str, request.not_after.str)) {
+        fprintf(stderr, "Couldn't set validity range.\n");
+        return interface_error::cert_set_validity;
+    }
+
+    // A name list from the issuer cache is only borrowed, cert mustn't free it
+    struct BorrowedIssuer {
+        mbedtls_x509write_cert* cert = nullptr;
+        ~BorrowedIssuer()
+        {
+            if (cert)
+                cert->private_issuer = nullptr;
+        }
+    } borrowed_issuer;
+
+    mbedtls_asn1_named_data* issuer_names = nullptr;
+    if (request.issuer_cert)
+        issuer_names = bb::issuer_names(*request.issuer_cert);
+
+    if (issuer_names) {
+        cert.private_issuer = issuer_names;
+        borrowed_issuer.cert = &cert;
+    } else if (!request.issuer.empty()) {
+        if (mbedtls_x509write_crt_set_issuer_name(&cert, request.issuer.str)) {
+            fprintf(stderr, "Couldn't set issuer name.\n");
+            return interface_error::cert_set_issuer;
+        }
+    }
+
+    if (!request.subject.empty()) {
+        if (mbedtls_x509write_crt_set_subject_name(&cert, request.subject.str)) {
+            fprintf(stderr, "Couldn't set subject name.\n");
+            return interface_error::cert_set_subject;
+        }
+    }
+
+    if (set_basic_constraints(&cert, request.is_ca)) {
+        fprintf(stderr, "Couldn't set basic constraints.\n");
+        return interface_error::generate_cert;
+    }
+
+    if (request.key_usage) {
+        if (set_key_usage(&cert, request.key_usage)) {
+            fprintf(stderr, "Couldn't set key usage.\n");
+            return interface_error::cert_set_key_usage;
+        }
+    }
+
+    if (set_ext_key_usage(&cert, request.ext_key_usage)) {
+        fprintf(stderr, "Couldn't set extended key usage.\n");
+        return interface_error::cert_set_ext_key_usage;
+    }
+
+    mbedtls_x509write_crt_set_issuer_key(&cert, authority_key);
+    mbedtls_x509write_crt_set_subject_key(&cert, subject_key);
+
+    if (request.akid.len) {
+        if (set_akid(&cert, (unsigned char*)request.akid.str, request.akid.len)) {
+            fprintf(stderr, "Couldn't set authority key identifier.\n");
+            return interface_error::cert_set_akid;
+        }
+    }
+
+    if (mbedtls_x509write_crt_set_subject_key_identifier(&cert)) {
+        fprintf(stderr, "Couldn't set subject key identifier.\n");
+        return interface_error::cert_set_skid;
+    }
+
+    mbedtls_x509write_crt_set_md_alg(&cert, get_md(request.md));
+
+    if (!request.san_list.empty()) {
+        if (set_subject_alt_name(&cert, request.san_list)) {
+            fprintf(stderr, "Couldn't set SAN list.\n");
+            return interface_error::cert_set_san;
+        }
+    }
+
+    if (der_buffer->empty())
+        *der_buffer = cstr(8196);
+
+new_buffer_retry:
+    auto der_length = mbedtls_x509write_crt_der(
+        &cert,
+        (unsigned char*)der_buffer->str,
+        der_buffer->len,
+        mt_rng,
+        nullptr
+    );
+
+    if (der_length < 0) {
+        if (der_length == MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL
+         || der_length == MBEDTLS_ERR_ASN1_BUF_TOO_SMALL)
+        {
+            *der_buffer = cstr(der_buffer->len * 2);
+            goto new_buffer_retry;
+        }
+
+        fprintf(stderr, "Couldn't serialise certificate.\n");
+        fprintf(stderr, "Err (%d): [%s] %s\n", der_length, mbedtls_low_level_strerr(der_length), mbedtls_high_level_strerr(der_length));
+        return interface_error::generate_cert;
+    }
+
+    auto der = (unsigned char*)der_buffer->str + der_buffer->len - der_length;
+
+    auto parse_err = mbedtls_x509_crt_parse_der(out, der, der_length);
+    if (parse_err) {
+        fprintf(stderr, "Err (%d): [%s] %s\n", parse_err, mbedtls_low_level_strerr(parse_err), mbedtls_high_level_strerr(parse_err));
+        return interface_error::read_cert;
+    }
+
+    return interface_error::success;
+}
+
+} // namespace bb
@@ -0,0 +1,54 @@
+#ifndef BB_ISSUE_HPP
+#define BB_ISSUE_HPP
+
+#include <mbedtls/pk.h>
+
+#include "cert.hpp"
+#include "cstr.hpp"
+#include "interface_error.hpp"
+#include "interface_ext_key_usage.hpp"
+#include "interface_key.hpp"
+#include "interface_key_usage.hpp"
+#include "interface_md.hpp"
+#include "interface_san.hpp"
+#include "rcomms.hpp"
+
+namespace bb {
+
+// Everything the run export reads from its input file. The encoding is
+// produced by CertMaker.certificateFiles in the frontend.
+struct IssueRequest {
+    cstr issuer;
+    cstr subject;
+    bool is_ca = false;
+    bool self_signed = false;
+    cstr akid;
+    SanList san_list;
+    gen_key_type key_type{};
+    md_type md{};
+    cstr not_before;
+    cstr not_after;
+    bb::key_usage key_usage{};
+    bb::ext_key_usage ext_key_usage{};
+
+    // The CA certificate (PEM or DER) when the host has it, not part of the
+    // input. Its subject becomes the issuer instead of parsing issuer.
+    const cstr* issuer_cert = nullptr;
+};
+
+bool read_issue_request(rcomms& c, IssueRequest* out);
+
+// Builds and signs a certificate for subject_key. For self-signed requests
+// authority_key should be the subject key. der_buffer is scratch space for the
+// encoder, it grows when a certificate doesn't fit and can be reused between
+// calls.
+interface_error issue(
+    const IssueRequest& request,
+    mbedtls_pk_context* subject_key,
+    mbedtls_pk_context* authority_key,
+    cstr* der_buffer,
+    Cert* out);
+
+} // namespace bb
+
+#endif // Header guard
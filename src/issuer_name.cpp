@@ -0,0 +1,101 @@
+#include <mbedtls/asn1.h>
+#include <mbedtls/platform.h>
+#include <mbedtls/x509_crt.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cert.hpp"
+#include "cert_io.hpp"
+
+#include "issuer_name.hpp"
+
+namespace {
+
+// Plain data so it can be thread_local, like the DRBG in random.cpp.
+struct IssuerCache {
+    char* ca_cert;
+    size_t ca_cert_len;
+    mbedtls_asn1_named_data* names;
+
+    bool matches(const bb::cstr& data) const
+    {
+        return ca_cert
+            && ca_cert_len == data.len
+            && memcmp(ca_cert, data.str, data.len) == 0;
+    }
+
+    void clear()
+    {
+        delete[] ca_cert;
+        ca_cert = nullptr;
+        ca_cert_len = 0;
+        mbedtls_asn1_free_named_data_list(&names);
+    }
+};
+
+thread_local IssuerCache cache;
+
+bool copy_buf(mbedtls_asn1_buf* out, const mbedtls_asn1_buf& in)
+{
+    out->tag = in.tag;
+    out->len = in.len;
+    out->p = (unsigned char*)mbedtls_calloc(1, in.len ? in.len : 1);
+    if (!out->p)
+        return false;
+
+    memcpy(out->p, in.p, in.len);
+    return true;
+}
+
+// mbedtls_x509write_cert writes its name list back to front, so the copy is
+// built in reverse of the certificate's order.
+bool copy_reversed(const mbedtls_x509_name* name, mbedtls_asn1_named_data** out)
+{
+    for (; name; name = name->next) {
+        if (name->private_next_merged)
+            return false;
+
+        auto node = (mbedtls_asn1_named_data*)mbedtls_calloc(1, sizeof(mbedtls_asn1_named_data));
+        if (!node)
+            return false;
+
+        node->next = *out;
+        *out = node;
+
+        if (!copy_buf(&node->oid, name->oid) || !copy_buf(&node->val, name->val))
+            return false;
+    }
+
+    return true;
+}
+
+} // namespace
+
+namespace bb {
+
+mbedtls_asn1_named_data* issuer_names(const cstr& ca_cert)
+{
+    if (cache.matches(ca_cert))
+        return cache.names;
+
+    cache.clear();
+
+    auto opt_cert = parse_cert(ca_cert);
+    if (!opt_cert)
+        return nullptr;
+
+    if (!copy_reversed(&(*opt_cert).subject, &cache.names)) {
+        fprintf(stderr, "Can't copy the CA certificate's subject.\n");
+        mbedtls_asn1_free_named_data_list(&cache.names);
+        return nullptr;
+    }
+
+    cache.ca_cert = new char[ca_cert.len];
+    cache.ca_cert_len = ca_cert.len;
+    memcpy(cache.ca_cert, ca_cert.str, ca_cert.len);
+
+    return cache.names;
+}
+
+} // namespace bb
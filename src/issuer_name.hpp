@@ -0,0 +1,23 @@
+#ifndef BB_ISSUER_NAME_HPP
+#define BB_ISSUER_NAME_HPP
+
+#include <mbedtls/asn1.h>
+
+#include "cstr.hpp"
+
+namespace bb {
+
+// The issuer name for certificates signed by the CA in ca_cert (PEM or DER,
+// the first certificate is used), built from the CA's subject with each
+// attribute's string type kept, so the issuer field byte-matches the CA's
+// subject. The list is in the order mbedtls_x509write_cert expects.
+//
+// Cached per thread: while ca_cert stays the same the certificate isn't parsed
+// again. The list stays owned by the cache and is valid until the next call.
+// Returns nullptr when the certificate doesn't parse or its subject has
+// multi-valued RDNs, which Mbed TLS can't write back.
+mbedtls_asn1_named_data* issuer_names(const cstr& ca_cert);
+
+} // namespace bb
+
+#endif // Header guard
@@ -0,0 +1,248 @@
+#include <mbedtls/bignum.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/rsa.h>
+
+#include <time.h>
+
+#include "random.hpp"
+
+#include "keygen_job.hpp"
+
+namespace {
+
+const int rsa_exponent = 0x10001;
+
+uint64_t now_ms()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+#if defined(MBEDTLS_RSA_C)
+
+// Miller-Rabin rounds of mbedtls_mpi_gen_prime with
+// MBEDTLS_MPI_GEN_PRIME_FLAG_LOW_ERR, which mbedtls_rsa_gen_key uses for keys
+// above 1024 bits
+int prime_rounds(uint32_t bits)
+{
+    return bits >= 1450 ? 4
+        : bits >= 1150 ? 5
+        : bits >= 1000 ? 6
+        : bits >= 850 ? 7
+        : bits >= 750 ? 8
+        : bits >= 500 ? 13
+        : bits >= 250 ? 28
+        : bits >= 150 ? 40
+        : 51;
+}
+
+struct Mpi : mbedtls_mpi {
+    Mpi() { mbedtls_mpi_init(this); }
+    ~Mpi() { mbedtls_mpi_free(this); }
+
+    Mpi(const Mpi&) = delete;
+    Mpi& operator=(const Mpi&) = delete;
+};
+
+// e has to be invertible mod prime - 1
+bool usable_prime(const mbedtls_mpi* prime)
+{
+    Mpi e, h, g;
+    return mbedtls_mpi_lset(&e, rsa_exponent) == 0
+        && mbedtls_mpi_sub_int(&h, prime, 1) == 0
+        && mbedtls_mpi_gcd(&g, &e, &h) == 0
+        && mbedtls_mpi_cmp_int(&g, 1) == 0;
+}
+
+#endif
+
+} // namespace
+
+namespace bb {
+
+KeygenJob::KeygenJob()
+{
+    mbedtls_mpi_init(&p);
+    mbedtls_mpi_init(&candidate);
+}
+
+KeygenJob::~KeygenJob()
+{
+    mbedtls_mpi_free(&p);
+    mbedtls_mpi_free(&candidate);
+}
+
+bool KeygenJob::begin(gen_key_type new_type)
+{
+    cancel();
+
+    type = new_type;
+    switch (type) {
+    case gen_key_type::ec_p_256:
+    case gen_key_type::ec_p_384:
+        break;
+
+    case gen_key_type::rsa_2048:
+    case gen_key_type::rsa_4096:
+#if defined(MBEDTLS_RSA_C)
+        prime_bits = type == gen_key_type::rsa_2048 ? 1024 : 2048;
+        break;
+#else
+        // Like generate_key, the host has to use the sign_rsa module
+        return false;
+#endif
+    }
+
+    job_state = state::running;
+    return true;
+}
+
+bool KeygenJob::step(uint32_t budget_ms)
+{
+    if (job_state != state::running)
+        return false;
+
+    if (type == gen_key_type::ec_p_256 || type == gen_key_type::ec_p_384) {
+        auto opt_key = generate_key(type);
+        if (!opt_key) {
+            cancel();
+            return false;
+        }
+
+        result = static_cast<Key&&>(*opt_key);
+        job_state = state::done;
+        return true;
+    }
+
+    auto deadline = now_ms() + budget_ms;
+    do {
+        if (!step_rsa()) {
+            cancel();
+            return false;
+        }
+    } while (job_state == state::running && now_ms() < deadline);
+
+    return true;
+}
+
+void KeygenJob::cancel()
+{
+    mbedtls_mpi_free(&p);
+    mbedtls_mpi_free(&candidate);
+    mbedtls_mpi_init(&p);
+    mbedtls_mpi_init(&candidate);
+
+    result = Key();
+    job_state = state::idle;
+    prime_bits = 0;
+    have_p = false;
+    tested = 0;
+    tested_this_prime = 0;
+}
+
+uint32_t KeygenJob::progress() const
+{
+    if (job_state == state::done)
+        return 1000;
+
+    if (job_state == state::idle || !prime_bits)
+        return 0;
+
+    // About one in ln(2^bits) / 2 odd numbers is prime. Each prime is half
+    // way there after that many candidates.
+    auto expected = prime_bits * 347 / 1000;
+    auto prime_progress = 500 * tested_this_prime / (tested_this_prime + expected);
+    return (have_p ? 500 : 0) + prime_progress;
+}
+
+#if defined(MBEDTLS_RSA_C)
+
+// Tests a single candidate, a fresh random one each time like
+// mbedtls_mpi_gen_prime (FIPS 186-4 B.3.3)
+bool KeygenJob::step_rsa()
+{
+    // The top two bits make sure p * q has all the modulus' bits
+    bool drawn = mbedtls_mpi_fill_random(&candidate, prime_bits / 8, mt_rng, nullptr) == 0
+        && mbedtls_mpi_set_bit(&candidate, prime_bits - 1, 1) == 0
+        && mbedtls_mpi_set_bit(&candidate, prime_bits - 2, 1) == 0
+        && mbedtls_mpi_set_bit(&candidate, 0, 1) == 0;
+
+    if (!drawn)
+        return false;
+
+    ++tested;
+    ++tested_this_prime;
+
+    auto err = mbedtls_mpi_is_prime_ext(&candidate, prime_rounds(prime_bits), mt_rng, nullptr);
+    if (err == MBEDTLS_ERR_MPI_NOT_ACCEPTABLE)
+        return true;
+
+    if (err)
+        return false;
+
+    if (!usable_prime(&candidate))
+        return true;
+
+    if (!have_p) {
+        mbedtls_mpi_swap(&p, &candidate);
+        have_p = true;
+        tested_this_prime = 0;
+        return true;
+    }
+
+    return finish_rsa();
+}
+
+// Same checks as mbedtls_rsa_gen_key. q is searched again if one fails.
+bool KeygenJob::finish_rsa()
+{
+    Mpi difference;
+    if (mbedtls_mpi_sub_mpi(&difference, &p, &candidate))
+        return false;
+
+    if (mbedtls_mpi_bitlen(&difference) <= prime_bits - 99)
+        return true;
+
+    // Mbed TLS keeps the larger prime in P
+    auto larger = mbedtls_mpi_cmp_mpi(&p, &candidate) > 0 ? &p : &candidate;
+    auto smaller = larger == &p ? &candidate : &p;
+
+    Key key;
+    Mpi e, d;
+    bool complete = mbedtls_pk_setup(&key, mbedtls_pk_info_from_type(MBEDTLS_PK_RSA)) == 0
+        && mbedtls_mpi_lset(&e, rsa_exponent) == 0
+        && mbedtls_rsa_import(mbedtls_pk_rsa(key), nullptr, larger, smaller, nullptr, &e) == 0
+        && mbedtls_rsa_complete(mbedtls_pk_rsa(key)) == 0
+        && mbedtls_rsa_export(mbedtls_pk_rsa(key), nullptr, nullptr, nullptr, &d, nullptr) == 0;
+
+    if (!complete)
+        return false;
+
+    // d has to be larger than 2^(nbits / 2)
+    if (mbedtls_mpi_bitlen(&d) <= prime_bits)
+        return true;
+
+    if (mbedtls_rsa_check_privkey(mbedtls_pk_rsa(key)))
+        return false;
+
+    result = static_cast<Key&&>(key);
+    job_state = state::done;
+    return true;
+}
+
+#else
+
+bool KeygenJob::step_rsa()
+{
+    return false;
+}
+
+bool KeygenJob::finish_rsa()
+{
+    return false;
+}
+
+#endif
+
+} // namespace bb
@@ -0,0 +1,77 @@
+#ifndef BB_KEYGEN_JOB_HPP
+#define BB_KEYGEN_JOB_HPP
+
+#include <stdint.h>
+
+#include <mbedtls/bignum.h>
+
+#include "interface_key.hpp"
+
+namespace bb {
+
+// Key generation in bounded steps, so a host can run it from its own event
+// loop, show progress and drop it when the user picks something else.
+//
+// EC keys take a single step. For RSA the search for p and q is done here
+// instead of in mbedtls_rsa_gen_key, the same way: random odd candidates with
+// the top bits set, a new one for every test, until one passes the
+// Miller-Rabin rounds Mbed TLS would use. p is kept between steps.
+class KeygenJob {
+public:
+    enum class state {
+        idle,
+        running,
+        done,
+    };
+
+    KeygenJob();
+    ~KeygenJob();
+
+    KeygenJob(const KeygenJob&) = delete;
+    KeygenJob& operator=(const KeygenJob&) = delete;
+
+    // Starts over with a new key, dropping the current job if there is one.
+    bool begin(gen_key_type type);
+
+    // Tests candidates until budget_ms have passed. One candidate is always
+    // tested, so a step can take a little longer than the budget. Returns
+    // false if generation failed, the job is dropped then.
+    bool step(uint32_t budget_ms);
+
+    void cancel();
+
+    state current_state() const { return job_state; }
+
+    // Estimate in thousandths. How many candidates a prime takes varies a
+    // lot, the estimate only approaches 1000 until the key is done.
+    uint32_t progress() const;
+
+    // Candidates tested so far, over both primes.
+    uint32_t candidates() const { return tested; }
+
+    // Valid once done.
+    Key& key() { return result; }
+
+private:
+    bool step_rsa();
+    bool finish_rsa();
+
+    state job_state = state::idle;
+    gen_key_type type = gen_key_type::ec_p_256;
+    Key result;
+
+    // Bits of each prime, half the modulus
+    uint32_t prime_bits = 0;
+
+    // p once found, then the q candidate
+    mbedtls_mpi p;
+    mbedtls_mpi candidate;
+    bool have_p = false;
+
+    uint32_t tested = 0;
+    uint32_t tested_this_prime = 0;
+};
+
+} // namespace bb
+
+#endif // Header guard
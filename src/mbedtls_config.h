@@ -20,16 +20,19 @@
 #define MBEDTLS_PK_PARSE_EC_EXTENDED
 #define MBEDTLS_PK_PARSE_EC_COMPRESSED
 
-#define MBEDTLS_RSA_C
 #define MBEDTLS_ECDSA_C
-#define MBEDTLS_GENPRIME
 #define MBEDTLS_ECP_C
 #define MBEDTLS_ECP_DP_SECP384R1_ENABLED
 #define MBEDTLS_ECP_DP_SECP256R1_ENABLED
 #define MBEDTLS_ECP_NIST_OPTIM
 
+// Only in the sign_rsa module, see src/CMakeLists.txt
+#ifndef BB_NO_RSA
+#define MBEDTLS_RSA_C
+#define MBEDTLS_GENPRIME
 #define MBEDTLS_PKCS1_V15
 #define MBEDTLS_PKCS1_V21
+#endif
 
 #define MBEDTLS_MD_C
 #define MBEDTLS_SHA1_C
@@ -38,7 +41,28 @@
 #define MBEDTLS_SHA384_C
 #define MBEDTLS_SHA512_C
 
+// SHA-256 instructions when the CPU has them, checked at run time. Mbed TLS
+// only accelerates SHA-256 this way on Arm.
+#if defined(__aarch64__)
+#define MBEDTLS_SHA256_USE_ARMV8_A_CRYPTO_IF_PRESENT
+#endif
+
+#define MBEDTLS_HMAC_DRBG_C
+
+// The native tools issue certificates from several threads at once, and so does
+// the threaded module
+#if !defined(__wasm__) || defined(BB_THREADS)
+#define MBEDTLS_THREADING_C
+#define MBEDTLS_THREADING_PTHREAD
+#endif
+
 #define MBEDTLS_PLATFORM_C
+
+// Allocations are counted by src/mem_stats.cpp, which installs its calloc/free
+#if defined(BB_MEM_STATS)
+#define MBEDTLS_PLATFORM_MEMORY
+#endif
+
 #define MBEDTLS_BIGNUM_C
 #define MBEDTLS_HAVE_ASM
 #define MBEDTLS_ERROR_C
@@ -0,0 +1,115 @@
+#include "mem_stats.hpp"
+
+#if defined(BB_MEM_STATS)
+
+#include <mbedtls/platform.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+// Keeps the block behind it at malloc's alignment
+struct alignas(16) Header {
+    size_t size;
+};
+
+bb::MemStats stats;
+
+#if defined(BB_MEM_HISTOGRAM)
+
+int size_class(size_t size)
+{
+    int index = 0;
+    for (size_t limit = 16; index != bb::mem_size_classes - 1 && size > limit; limit *= 2)
+        ++index;
+
+    return index;
+}
+
+#endif
+
+void* track(Header* header, size_t size)
+{
+    if (!header)
+        return nullptr;
+
+    header->size = size;
+
+    __atomic_add_fetch(&stats.allocations, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats.allocated_bytes, size, __ATOMIC_RELAXED);
+    auto live = __atomic_add_fetch(&stats.live_bytes, size, __ATOMIC_RELAXED);
+
+    auto peak = __atomic_load_n(&stats.peak_live_bytes, __ATOMIC_RELAXED);
+    while (live > peak
+        && !__atomic_compare_exchange_n(&stats.peak_live_bytes, &peak, live, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+
+#if defined(BB_MEM_HISTOGRAM)
+    __atomic_add_fetch(&stats.histogram[size_class(size)], 1, __ATOMIC_RELAXED);
+#endif
+
+    return header + 1;
+}
+
+// Before anything else is constructed, so no block Mbed TLS frees came from
+// plain calloc
+[[gnu::constructor(101)]]
+void install()
+{
+    mbedtls_platform_set_calloc_free(bb::tracked_calloc, bb::tracked_free);
+}
+
+} // namespace
+
+namespace bb {
+
+void* tracked_malloc(size_t size)
+{
+    if (size > SIZE_MAX - sizeof(Header))
+        return nullptr;
+
+    return track((Header*)malloc(sizeof(Header) + size), size);
+}
+
+void* tracked_calloc(size_t count, size_t size)
+{
+    if (size && count > (SIZE_MAX - sizeof(Header)) / size)
+        return nullptr;
+
+    auto bytes = count * size;
+    return track((Header*)calloc(1, sizeof(Header) + bytes), bytes);
+}
+
+void tracked_free(void* ptr)
+{
+    if (!ptr)
+        return;
+
+    auto header = (Header*)ptr - 1;
+    __atomic_add_fetch(&stats.frees, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&stats.live_bytes, header->size, __ATOMIC_RELAXED);
+    free(header);
+}
+
+// Not atomic as a whole: allocations made by other threads while this runs
+// may land in either window.
+MemStats take_mem_stats()
+{
+    MemStats window;
+    window.allocations = __atomic_exchange_n(&stats.allocations, 0, __ATOMIC_RELAXED);
+    window.frees = __atomic_exchange_n(&stats.frees, 0, __ATOMIC_RELAXED);
+    window.allocated_bytes = __atomic_exchange_n(&stats.allocated_bytes, 0, __ATOMIC_RELAXED);
+    window.live_bytes = __atomic_load_n(&stats.live_bytes, __ATOMIC_RELAXED);
+    window.peak_live_bytes = __atomic_exchange_n(&stats.peak_live_bytes, window.live_bytes, __ATOMIC_RELAXED);
+
+    for (int i = 0; i != mem_size_classes; ++i)
+        window.histogram[i] = __atomic_exchange_n(&stats.histogram[i], 0, __ATOMIC_RELAXED);
+
+    return window;
+}
+
+} // namespace bb
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef BB_MEM_STATS_HPP
+#define BB_MEM_STATS_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Allocation profiling, built with BB_MEM_STATS=ON. operator new/delete (see
+// new.cpp) and Mbed TLS' calloc/free go through the tracked functions below,
+// which keep a size header in front of every block so frees can be accounted
+// for. Without BB_MEM_STATS none of this exists and allocations go straight to
+// malloc.
+
+#if defined(BB_MEM_STATS)
+
+namespace bb {
+
+// Powers of two from 16 bytes up to 1 MiB, then everything larger
+const int mem_size_classes = 18;
+
+struct MemStats {
+    uint32_t allocations;
+    uint32_t frees;
+    uint64_t allocated_bytes;
+    uint64_t live_bytes;
+    uint64_t peak_live_bytes;
+
+    // Allocations per size class, only counted with BB_MEM_HISTOGRAM
+    uint32_t histogram[mem_size_classes];
+};
+
+void* tracked_malloc(size_t size);
+void* tracked_calloc(size_t count, size_t size);
+void tracked_free(void* ptr);
+
+// The counters since the previous call, which starts a new window: counts and
+// the histogram go back to zero and the peak to what's live right now. The
+// host takes a window after every export, giving per-export numbers.
+MemStats take_mem_stats();
+
+} // namespace bb
+
+#endif
+
+#endif // Header guard
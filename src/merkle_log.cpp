@@ -0,0 +1,330 @@
+#include <mbedtls/sha256.h>
+
+#include <string.h>
+
+#include "crc32.hpp"
+#include "endian.hpp"
+
+#include "merkle_log.hpp"
+
+namespace {
+
+const char frontier_magic[4] { 'B', 'B', 'M', 'T' };
+
+// Magic, tree size, hashes, CRC-32
+const size_t frontier_max_size = 4 + 8 + 64 * bb::merkle_hash_size + 4;
+
+unsigned popcount(uint64_t value)
+{
+    return __builtin_popcountll(value);
+}
+
+// Nodes stored for a tree of size leaves
+uint64_t node_count(uint64_t size)
+{
+    return 2 * size - popcount(size);
+}
+
+// Position in the nodes file of the root of the complete subtree with 2^level
+// leaves starting at start. It's written right after its last leaf and the
+// level parents that leaf completes.
+uint64_t subtree_position(uint64_t start, unsigned level)
+{
+    auto last = start + ((uint64_t)1 << level) - 1;
+    return node_count(last) + level;
+}
+
+// Largest power of two below size, size > 1
+uint64_t split_point(uint64_t size)
+{
+    return (uint64_t)1 << (63 - __builtin_clzll(size - 1));
+}
+
+} // namespace
+
+namespace bb {
+
+void merkle_leaf_hash(const void* leaf, size_t len, unsigned char* out)
+{
+    const unsigned char prefix = 0;
+
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    mbedtls_sha256_update(&ctx, &prefix, 1);
+    mbedtls_sha256_update(&ctx, (const unsigned char*)leaf, len);
+    mbedtls_sha256_finish(&ctx, out);
+    mbedtls_sha256_free(&ctx);
+}
+
+void merkle_node_hash(const unsigned char* left, const unsigned char* right, unsigned char* out)
+{
+    unsigned char data[1 + 2 * merkle_hash_size];
+    data[0] = 1;
+    memcpy(data + 1, left, merkle_hash_size);
+    memcpy(data + 1 + merkle_hash_size, right, merkle_hash_size);
+    mbedtls_sha256(data, sizeof(data), out, 0);
+}
+
+MerkleLog::MerkleLog(MerkleLog&& other)
+    : frontier_file{other.frontier_file}
+    , nodes_file{other.nodes_file}
+    , tree_size{other.tree_size}
+    , frontier_count{other.frontier_count}
+{
+    memcpy(frontier, other.frontier, frontier_count * merkle_hash_size);
+    other.frontier_file = nullptr;
+    other.nodes_file = nullptr;
+}
+
+MerkleLog::~MerkleLog()
+{
+    if (frontier_file)
+        fclose(frontier_file);
+
+    if (nodes_file)
+        fclose(nodes_file);
+}
+
+opt<MerkleLog> MerkleLog::open(const char* frontier_path, const char* nodes_path)
+{
+    MerkleLog log;
+
+    log.frontier_file = fopen(frontier_path, "r+b");
+    if (!log.frontier_file)
+        return {};
+
+    log.nodes_file = fopen(nodes_path, "r+b");
+    if (!log.nodes_file)
+        log.nodes_file = fopen(nodes_path, "w+b");
+
+    if (!log.nodes_file)
+        return {};
+
+    unsigned char data[frontier_max_size];
+    auto len = fread(data, 1, sizeof(data), log.frontier_file);
+    if (len == 0)
+        return static_cast<MerkleLog&&>(log);
+
+    bool valid = len >= 4 + 8 + 4 && memcmp(data, frontier_magic, sizeof(frontier_magic)) == 0;
+    if (valid) {
+        log.tree_size = load_le64(data + 4);
+        log.frontier_count = popcount(log.tree_size);
+
+        auto hashes_len = log.frontier_count * merkle_hash_size;
+        valid = len >= 4 + 8 + hashes_len + 4
+            && load_le32(data + 4 + 8 + hashes_len) == crc32(0, data, 4 + 8 + hashes_len);
+
+        if (valid)
+            memcpy(log.frontier, data + 4 + 8, hashes_len);
+    }
+
+    if (!valid && !log.rebuild_frontier())
+        return {};
+
+    // The nodes have to be there for the frontier's size
+    if (fseeko(log.nodes_file, 0, SEEK_END) != 0)
+        return {};
+
+    auto nodes_size = ftello(log.nodes_file);
+    if (nodes_size < 0 || (uint64_t)nodes_size / merkle_hash_size < node_count(log.tree_size))
+        return {};
+
+    return static_cast<MerkleLog&&>(log);
+}
+
+bool MerkleLog::read_node(uint64_t position, unsigned char* out) const
+{
+    return fseeko(nodes_file, (off_t)(position * merkle_hash_size), SEEK_SET) == 0
+        && fread(out, 1, merkle_hash_size, nodes_file) == merkle_hash_size;
+}
+
+bool MerkleLog::write_node(uint64_t position, const unsigned char* hash)
+{
+    return fseeko(nodes_file, (off_t)(position * merkle_hash_size), SEEK_SET) == 0
+        && fwrite(hash, 1, merkle_hash_size, nodes_file) == merkle_hash_size;
+}
+
+bool MerkleLog::write_frontier()
+{
+    unsigned char data[frontier_max_size];
+    memcpy(data, frontier_magic, sizeof(frontier_magic));
+    store_le64(data + 4, tree_size);
+
+    auto hashes_len = frontier_count * merkle_hash_size;
+    memcpy(data + 4 + 8, frontier, hashes_len);
+    store_le32(data + 4 + 8 + hashes_len, crc32(0, data, 4 + 8 + hashes_len));
+
+    auto len = 4 + 8 + hashes_len + 4;
+    return fseek(frontier_file, 0, SEEK_SET) == 0
+        && fwrite(data, 1, len, frontier_file) == len
+        && fflush(frontier_file) == 0;
+}
+
+// The largest tree the nodes file holds completely, and its subtree roots
+bool MerkleLog::rebuild_frontier()
+{
+    if (fseeko(nodes_file, 0, SEEK_END) != 0)
+        return false;
+
+    auto nodes_size = ftello(nodes_file);
+    if (nodes_size < 0)
+        return false;
+
+    // node_count grows with the size, so search for the last size that fits
+    uint64_t stored = nodes_size / merkle_hash_size;
+    uint64_t low = 0;
+    uint64_t high = stored;
+    while (low < high) {
+        auto middle = low + (high - low + 1) / 2;
+        if (node_count(middle) <= stored)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+
+    tree_size = low;
+    frontier_count = 0;
+
+    uint64_t start = 0;
+    for (int level = 63; level >= 0; --level) {
+        if (!(tree_size >> level & 1))
+            continue;
+
+        if (!read_node(subtree_position(start, level), frontier[frontier_count++]))
+            return false;
+
+        start += (uint64_t)1 << level;
+    }
+
+    return write_frontier();
+}
+
+bool MerkleLog::append(const void* leaf, size_t len)
+{
+    unsigned char hash[merkle_hash_size];
+    merkle_leaf_hash(leaf, len, hash);
+
+    auto position = node_count(tree_size);
+    if (!write_node(position, hash))
+        return false;
+
+    // Every trailing one bit of the old size is a subtree of the same size
+    // as the one being carried, waiting for its right half
+    auto count = frontier_count;
+    for (auto carry = tree_size; carry & 1; carry >>= 1) {
+        merkle_node_hash(frontier[--count], hash, hash);
+        if (!write_node(++position, hash))
+            return false;
+    }
+
+    if (fflush(nodes_file) != 0)
+        return false;
+
+    memcpy(frontier[count], hash, merkle_hash_size);
+    frontier_count = count + 1;
+    ++tree_size;
+
+    return write_frontier();
+}
+
+void MerkleLog::root(unsigned char* out) const
+{
+    if (!frontier_count) {
+        mbedtls_sha256(nullptr, 0, out, 0);
+        return;
+    }
+
+    // Right to left, the smallest subtree is the rightmost
+    memcpy(out, frontier[frontier_count - 1], merkle_hash_size);
+    for (auto i = frontier_count - 1; i-- != 0;)
+        merkle_node_hash(frontier[i], out, out);
+}
+
+// MTH(D[start:start + size]). Proofs only ask for ranges that start at a
+// multiple of the largest power of two that fits in them, so this comes down
+// to a few complete subtrees.
+bool MerkleLog::subtree_hash(uint64_t start, uint64_t size, unsigned char* out) const
+{
+    if ((size & (size - 1)) == 0)
+        return read_node(subtree_position(start, __builtin_ctzll(size)), out);
+
+    auto k = split_point(size);
+    unsigned char left[merkle_hash_size];
+    if (!subtree_hash(start, k, left) || !subtree_hash(start + k, size - k, out))
+        return false;
+
+    merkle_node_hash(left, out, out);
+    return true;
+}
+
+// PATH(m, D[n]) from RFC 6962 section 2.1.1
+bool MerkleLog::inclusion_path(uint64_t index, uint64_t start, uint64_t size, vec<unsigned char>* out) const
+{
+    if (size == 1)
+        return true;
+
+    auto k = split_point(size);
+    unsigned char sibling[merkle_hash_size];
+    if (index < k) {
+        if (!inclusion_path(index, start, k, out) || !subtree_hash(start + k, size - k, sibling))
+            return false;
+    } else {
+        if (!inclusion_path(index - k, start + k, size - k, out) || !subtree_hash(start, k, sibling))
+            return false;
+    }
+
+    out->append(sibling, merkle_hash_size);
+    return true;
+}
+
+// SUBPROOF(m, D[n], b) from RFC 6962 section 2.1.2
+bool MerkleLog::consistency_subproof(uint64_t first, uint64_t start, uint64_t size, bool complete, vec<unsigned char>* out) const
+{
+    unsigned char hash[merkle_hash_size];
+    if (first == size) {
+        if (complete)
+            return true;
+
+        if (!subtree_hash(start, size, hash))
+            return false;
+
+        out->append(hash, merkle_hash_size);
+        return true;
+    }
+
+    auto k = split_point(size);
+    if (first <= k) {
+        if (!consistency_subproof(first, start, k, complete, out) || !subtree_hash(start + k, size - k, hash))
+            return false;
+    } else {
+        if (!consistency_subproof(first - k, start + k, size - k, false, out) || !subtree_hash(start, k, hash))
+            return false;
+    }
+
+    out->append(hash, merkle_hash_size);
+    return true;
+}
+
+bool MerkleLog::inclusion_proof(uint64_t index, uint64_t size, vec<unsigned char>* out) const
+{
+    out->clear();
+    if (index >= size || size > tree_size)
+        return false;
+
+    return inclusion_path(index, 0, size, out);
+}
+
+bool MerkleLog::consistency_proof(uint64_t first, uint64_t second, vec<unsigned char>* out) const
+{
+    out->clear();
+    if (first == 0 || first > second || second > tree_size)
+        return false;
+
+    if (first == second)
+        return true;
+
+    return consistency_subproof(first, 0, second, true, out);
+}
+
+} // namespace bb
@@ -0,0 +1,93 @@
+#ifndef BB_MERKLE_LOG_HPP
+#define BB_MERKLE_LOG_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "opt.hpp"
+#include "vec.hpp"
+
+namespace bb {
+
+const size_t merkle_hash_size = 32;
+
+// Append-only Merkle tree with the RFC 6962 (Certificate Transparency) hashes:
+// SHA-256(0x00 || leaf) for leaves, SHA-256(0x01 || left || right) for nodes.
+//
+// Two files:
+//
+//   frontier  The tree size and the root of each complete subtree the tree
+//             is made of (one per set bit of the size), from the largest to
+//             the smallest, followed by a CRC-32. At most 2 KiB, rewritten in
+//             place on every append. Its tree size is the one that counts.
+//   nodes     Every node of every complete subtree, 32 bytes each, in
+//             post-order: a leaf is followed by the parents it completes.
+//             After n leaves there are 2n - popcount(n) of them.
+//
+// An append hashes the leaf, folds it into the frontier, which completes one
+// parent per trailing one bit of the old size, and writes those hashes to the
+// end of nodes: O(log n) hashes and writes, no matter how large the tree is.
+// Proofs read the complete subtrees they need from nodes. Those never change
+// once written, so proofs can be made for any earlier tree size.
+//
+// If the frontier doesn't check out it's rebuilt from the nodes that are
+// there. Nodes past the frontier's size are left over from an append that
+// didn't finish and get overwritten.
+class MerkleLog {
+    FILE* frontier_file = nullptr;
+    FILE* nodes_file = nullptr;
+
+    uint64_t tree_size = 0;
+
+    // Roots of the complete subtrees, largest first
+    unsigned char frontier[64][merkle_hash_size];
+    unsigned frontier_count = 0;
+
+    bool read_node(uint64_t position, unsigned char* out) const;
+    bool write_node(uint64_t position, const unsigned char* hash);
+    bool write_frontier();
+    bool rebuild_frontier();
+
+    bool subtree_hash(uint64_t start, uint64_t size, unsigned char* out) const;
+    bool inclusion_path(uint64_t index, uint64_t start, uint64_t size, vec<unsigned char>* out) const;
+    bool consistency_subproof(uint64_t first, uint64_t start, uint64_t size, bool complete, vec<unsigned char>* out) const;
+
+public:
+    MerkleLog() = default;
+    MerkleLog(MerkleLog&& other);
+    ~MerkleLog();
+
+    MerkleLog(const MerkleLog&) = delete;
+    MerkleLog& operator=(const MerkleLog&) = delete;
+
+    // Opens the log, which is empty if the frontier file is. The nodes file
+    // is created when missing.
+    [[nodiscard]]
+    static opt<MerkleLog> open(const char* frontier_path, const char* nodes_path);
+
+    // Adds a leaf, both files are flushed before it returns.
+    bool append(const void* leaf, size_t len);
+
+    uint64_t size() const { return tree_size; }
+
+    // Merkle Tree Hash of the current tree.
+    void root(unsigned char* out) const;
+
+    // Audit path for leaf index in the tree of tree_size leaves, the hashes
+    // back to back, lowest level first.
+    bool inclusion_proof(uint64_t index, uint64_t tree_size, vec<unsigned char>* out) const;
+
+    // Proof that the tree of first leaves is a prefix of the one of second.
+    bool consistency_proof(uint64_t first, uint64_t second, vec<unsigned char>* out) const;
+};
+
+// SHA-256(0x00 || leaf)
+void merkle_leaf_hash(const void* leaf, size_t len, unsigned char* out);
+
+// SHA-256(0x01 || left || right)
+void merkle_node_hash(const unsigned char* left, const unsigned char* right, unsigned char* out);
+
+} // namespace bb
+
+#endif // Header guard
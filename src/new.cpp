@@ -1,4 +1,14 @@
-#if !__has_include(<new>)
+#include "mem_stats.hpp"
+
+#if defined(BB_MEM_STATS)
+
+// Replaces the standard library's versions when there is one
+void* operator new(size_t size) { return bb::tracked_malloc(size); }
+void operator delete(void* ptr) noexcept { return bb::tracked_free(ptr); }
+void* operator new[](size_t size) { return bb::tracked_malloc(size); }
+void operator delete[](void* ptr) noexcept { return bb::tracked_free(ptr); }
+
+#elif !__has_include(<new>)
 
 #include <stdlib.h>
 
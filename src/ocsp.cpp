@@ -0,0 +1,282 @@
+#include <mbedtls/asn1.h>
+#include <mbedtls/ecp.h>
+#include <mbedtls/md.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/sha1.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "der.hpp"
+#include "random.hpp"
+
+#include "ocsp.hpp"
+
+namespace {
+
+
+// RFC 5280 section 4.1.2.2
+const size_t max_serial_length = 20;
+
+// AlgorithmIdentifier for SHA-1, the CertID hash every client understands
+const unsigned char sha1_algorithm[] {
+    0x30, 0x09, 0x06, 0x05, 0x2b, 0x0e, 0x03, 0x02, 0x1a, 0x05, 0x00,
+};
+
+// id-pkix-ocsp-basic
+const unsigned char ocsp_basic_oid[] {
+    0x06, 0x09, 0x2b, 0x06, 0x01, 0x05, 0x05, 0x07, 0x30, 0x01, 0x01,
+};
+
+// OCSPResponseStatus successful
+const unsigned char response_successful[] { MBEDTLS_ASN1_ENUMERATED, 1, 0 };
+
+// The subjectPublicKey bits of a SubjectPublicKeyInfo
+bool public_key_bits(const mbedtls_x509_buf& spki, const unsigned char** bits, size_t* bits_len)
+{
+    auto p = spki.p;
+    auto end = spki.p + spki.len;
+    size_t len;
+
+    if (mbedtls_asn1_get_tag(&p, end, &len, bb::der_sequence))
+        return false;
+
+    if (mbedtls_asn1_get_tag(&p, end, &len, bb::der_sequence))
+        return false;
+    p += len;
+
+    if (mbedtls_asn1_get_bitstring_null(&p, end, &len))
+        return false;
+
+    *bits = p;
+    *bits_len = len;
+    return true;
+}
+
+} // namespace
+
+namespace bb {
+
+interface_error OcspSigner::init(
+    const mbedtls_x509_crt* issuer,
+    mbedtls_pk_context* key,
+    mbedtls_md_type_t md,
+    const char* this_update_str,
+    size_t this_update_str_len,
+    const char* next_update_str,
+    size_t next_update_str_len)
+{
+    this->key = key;
+    this->md = md;
+
+    sig_alg_len = der_signature_algorithm(sig_alg, key, md);
+    if (!sig_alg_len) {
+        fprintf(stderr, "No signature algorithm for this key and digest.\n");
+        return interface_error::generate_ocsp;
+    }
+
+    const unsigned char* key_bits;
+    size_t key_bits_len;
+    if (!public_key_bits(issuer->pk_raw, &key_bits, &key_bits_len)) {
+        fprintf(stderr, "Couldn't find the issuer's public key.\n");
+        return interface_error::cert_info;
+    }
+
+    unsigned char name_hash[20];
+    unsigned char key_hash[20];
+    if (mbedtls_sha1(issuer->subject_raw.p, issuer->subject_raw.len, name_hash)
+        || mbedtls_sha1(key_bits, key_bits_len, key_hash))
+    {
+        return interface_error::generate_ocsp;
+    }
+
+    if (!der_generalized_time(this_update, this_update_str, this_update_str_len)) {
+        fprintf(stderr, "Invalid thisUpdate.\n");
+        return interface_error::read_input;
+    }
+
+    next_update_len = 0;
+    if (next_update_str_len) {
+        next_update[0] = der_context(0);
+        next_update[1] = 17;
+        if (!der_generalized_time(next_update + 2, next_update_str, next_update_str_len)) {
+            fprintf(stderr, "Invalid nextUpdate.\n");
+            return interface_error::read_input;
+        }
+        next_update_len = sizeof(next_update);
+    }
+
+    // responderID byKey, then producedAt
+    auto pos = der_header(responder, der_context(2), 22);
+    pos += der_header(responder + pos, MBEDTLS_ASN1_OCTET_STRING, 20);
+    memcpy(responder + pos, key_hash, 20);
+    memcpy(responder + pos + 20, this_update, sizeof(this_update));
+
+    pos = 0;
+    memcpy(cert_id_prefix, sha1_algorithm, sizeof(sha1_algorithm));
+    pos += sizeof(sha1_algorithm);
+    pos += der_header(cert_id_prefix + pos, MBEDTLS_ASN1_OCTET_STRING, 20);
+    memcpy(cert_id_prefix + pos, name_hash, 20);
+    pos += 20;
+    pos += der_header(cert_id_prefix + pos, MBEDTLS_ASN1_OCTET_STRING, 20);
+    memcpy(cert_id_prefix + pos, key_hash, 20);
+
+    batch.clear();
+    pending.clear();
+
+    return interface_error::success;
+}
+
+bool OcspSigner::add(
+    const unsigned char* serial,
+    size_t serial_len,
+    ocsp_status status,
+    const char* revocation_time,
+    size_t revocation_time_len,
+    uint32_t reason)
+{
+    if (serial_len == 0 || serial_len > max_serial_length)
+        return false;
+
+    unsigned char serial_der[max_serial_length + 3];
+    auto serial_der_len = der_unsigned_integer(serial_der, serial, serial_len);
+
+    // CertStatus
+    unsigned char cert_status[2 + 17 + 5];
+    size_t cert_status_len = 2;
+
+    switch (status) {
+    case ocsp_status::good:
+        cert_status[0] = MBEDTLS_ASN1_CONTEXT_SPECIFIC | 0;
+        cert_status[1] = 0;
+        break;
+    case ocsp_status::unknown:
+        cert_status[0] = MBEDTLS_ASN1_CONTEXT_SPECIFIC | 2;
+        cert_status[1] = 0;
+        break;
+    case ocsp_status::revoked:
+        // CRLReason, 7 is unused
+        if (reason > 10 || reason == 7)
+            return false;
+
+        if (!der_generalized_time(cert_status + 2, revocation_time, revocation_time_len))
+            return false;
+        cert_status_len += 17;
+
+        if (reason) {
+            const unsigned char revocation_reason[] {
+                der_context(0), 3,
+                    MBEDTLS_ASN1_ENUMERATED, 1, (unsigned char)reason,
+            };
+            memcpy(cert_status + cert_status_len, revocation_reason, sizeof(revocation_reason));
+            cert_status_len += sizeof(revocation_reason);
+        }
+
+        cert_status[0] = der_context(1);
+        cert_status[1] = (unsigned char)(cert_status_len - 2);
+        break;
+    }
+
+    auto cert_id_len = sizeof(cert_id_prefix) + serial_der_len;
+    auto single_len = der_tlv_size(cert_id_len) + cert_status_len + sizeof(this_update) + next_update_len;
+    auto responses_len = der_tlv_size(single_len);
+    auto response_data_len = sizeof(responder) + der_tlv_size(responses_len);
+
+    Pending entry;
+    entry.offset = batch.size;
+
+    der_put_header(&batch, der_sequence, response_data_len);
+    batch.append(responder, sizeof(responder));
+    der_put_header(&batch, der_sequence, responses_len);
+    der_put_header(&batch, der_sequence, single_len);
+    der_put_header(&batch, der_sequence, cert_id_len);
+    batch.append(cert_id_prefix, sizeof(cert_id_prefix));
+    batch.append(serial_der, serial_der_len);
+    batch.append(cert_status, cert_status_len);
+    batch.append(this_update, sizeof(this_update));
+    batch.append(next_update, next_update_len);
+
+    entry.length = batch.size - entry.offset;
+    pending.push_back(entry);
+
+    return true;
+}
+
+interface_error OcspSigner::flush(wcomms& out)
+{
+    auto md_info = mbedtls_md_info_from_type(md);
+    auto hash_len = mbedtls_md_get_size(md_info);
+
+    // Hash the whole batch first, then sign it
+    hashes.resize(pending.size * hash_len);
+    for (size_t i = 0; i != pending.size; ++i) {
+        auto& entry = pending[i];
+        if (mbedtls_md(md_info, batch.data + entry.offset, entry.length, hashes.data + i * hash_len))
+            return interface_error::generate_ocsp;
+    }
+
+    signatures.resize(pending.size * MBEDTLS_PK_SIGNATURE_MAX_SIZE);
+    signature_lens.resize(pending.size);
+
+    bool failed = false;
+    if (mbedtls_pk_can_do(key, MBEDTLS_PK_ECDSA)) {
+        failed = !ecdsa.sign(
+            mbedtls_pk_ec(*key),
+            hashes.data, hash_len, pending.size,
+            signatures.data, MBEDTLS_PK_SIGNATURE_MAX_SIZE, signature_lens.data);
+    } else {
+        parallel_for(pending.size, [&](size_t i, unsigned) {
+            auto err = mbedtls_pk_sign(
+                key, md,
+                hashes.data + i * hash_len, hash_len,
+                signatures.data + i * MBEDTLS_PK_SIGNATURE_MAX_SIZE, MBEDTLS_PK_SIGNATURE_MAX_SIZE, &signature_lens[i],
+                mt_rng, nullptr);
+
+            if (err)
+                __atomic_store_n(&failed, true, __ATOMIC_RELAXED);
+        });
+    }
+
+    if (failed) {
+        fprintf(stderr, "Couldn't sign OCSP response.\n");
+        return interface_error::generate_ocsp;
+    }
+
+    for (size_t i = 0; i != pending.size; ++i) {
+        auto& entry = pending[i];
+        auto signature = signatures.data + i * MBEDTLS_PK_SIGNATURE_MAX_SIZE;
+        auto signature_len = signature_lens[i];
+
+        auto signature_value_len = signature_len + 1;
+        auto basic_len = entry.length + sig_alg_len + der_tlv_size(signature_value_len);
+        auto octets_len = der_tlv_size(basic_len);
+        auto response_bytes_len = sizeof(ocsp_basic_oid) + der_tlv_size(octets_len);
+        auto explicit_len = der_tlv_size(response_bytes_len);
+        auto response_len = sizeof(response_successful) + der_tlv_size(explicit_len);
+
+        // OCSPResponse, responseBytes and BasicOCSPResponse around the signed
+        // ResponseData
+        response.clear();
+        der_put_header(&response, der_sequence, response_len);
+        response.append(response_successful, sizeof(response_successful));
+        der_put_header(&response, der_context(0), explicit_len);
+        der_put_header(&response, der_sequence, response_bytes_len);
+        response.append(ocsp_basic_oid, sizeof(ocsp_basic_oid));
+        der_put_header(&response, MBEDTLS_ASN1_OCTET_STRING, octets_len);
+        der_put_header(&response, der_sequence, basic_len);
+        response.append(batch.data + entry.offset, entry.length);
+        response.append(sig_alg, sig_alg_len);
+        der_put_header(&response, MBEDTLS_ASN1_BIT_STRING, signature_value_len);
+        response.push_back(0); // No unused bits
+        response.append(signature, signature_len);
+
+        out.write_bytelen(response.data, response.size);
+    }
+
+    batch.clear();
+    pending.clear();
+
+    return interface_error::success;
+}
+
+} // namespace bb
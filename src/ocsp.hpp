@@ -0,0 +1,96 @@
+#ifndef BB_OCSP_HPP
+#define BB_OCSP_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <mbedtls/md.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/x509_crt.h>
+
+#include "ecdsa_batch.hpp"
+#include "interface_error.hpp"
+#include "vec.hpp"
+#include "wcomms.hpp"
+
+namespace bb {
+
+enum class [[clang::enum_extensibility(closed)]] ocsp_status {
+    good,
+    revoked,
+    unknown,
+    max_enum_value = unknown,
+};
+
+// Pre-signs OCSP responses (RFC 6960), signed directly by the CA and
+// identifying it by key hash.
+//
+// Everything that is the same for every response (responder ID, times, the
+// issuer hashes in CertID, signature algorithm) is encoded once in init. Each
+// add only encodes the serial and status and the lengths around them. Responses
+// are collected into a batch; flush hashes the whole batch, then signs it in
+// one go. ECDSA keys skip the PK layer and sign the whole batch with
+// EcdsaBatch, other keys are signed one by one over the scheduler's threads.
+class OcspSigner {
+    struct Pending {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    mbedtls_pk_context* key = nullptr;
+    mbedtls_md_type_t md = MBEDTLS_MD_NONE;
+
+    unsigned char sig_alg[32];
+    size_t sig_alg_len = 0;
+
+    // byKey [2] EXPLICIT OCTET STRING followed by producedAt
+    unsigned char responder[24 + 17];
+
+    // CertID hashAlgorithm, issuerNameHash, issuerKeyHash
+    unsigned char cert_id_prefix[55];
+
+    unsigned char this_update[17];
+    unsigned char next_update[19];
+    size_t next_update_len = 0;
+
+    vec<unsigned char> batch;
+    vec<Pending> pending;
+    vec<unsigned char> hashes;
+    vec<unsigned char> signatures;
+    vec<size_t> signature_lens;
+    vec<unsigned char> response;
+
+    EcdsaBatch ecdsa;
+
+public:
+    // Times are YYYYMMDDhhmmss, next_update may be empty. producedAt is set to
+    // this_update.
+    interface_error init(
+        const mbedtls_x509_crt* issuer,
+        mbedtls_pk_context* key,
+        mbedtls_md_type_t md,
+        const char* this_update,
+        size_t this_update_len,
+        const char* next_update,
+        size_t next_update_len);
+
+    // revocation_time and reason are only used for revoked serials. A reason
+    // of 0 (unspecified) is left out.
+    bool add(
+        const unsigned char* serial,
+        size_t serial_len,
+        ocsp_status status,
+        const char* revocation_time,
+        size_t revocation_time_len,
+        uint32_t reason);
+
+    size_t pending_count() const { return pending.size; }
+
+    // Signs everything added since the last flush and writes each OCSPResponse
+    // to out as a byte string.
+    interface_error flush(wcomms& out);
+};
+
+} // namespace bb
+
+#endif // Header guard
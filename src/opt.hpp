@@ -26,6 +26,7 @@ struct opt {
             return;
 
         new (&data) T{static_cast<T&&>(other.data)};
+        has_value = true;
         other.reset();
     }
 
@@ -35,6 +36,7 @@ struct opt {
             return;
 
         new (&data) T{other.data};
+        has_value = true;
         other.reset();
     }
 
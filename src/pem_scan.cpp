@@ -0,0 +1,185 @@
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+#include "pem_scan.hpp"
+
+namespace {
+
+const char begin_marker[] = "-----BEGIN ";
+const char end_marker[] = "-----END ";
+const size_t dashes = 5;
+
+// Start of the next run of five dashes, or end
+const char* find_dashes(const char* p, const char* end)
+{
+#if defined(__wasm_simd128__)
+    // A lane is set when it and the four bytes after it are all dashes
+    auto dash = wasm_i8x16_splat('-');
+    while (end - p >= 16 + 4) {
+        auto run = wasm_i8x16_eq(wasm_v128_load(p), dash);
+        for (size_t i = 1; i != dashes; ++i)
+            run = wasm_v128_and(run, wasm_i8x16_eq(wasm_v128_load(p + i), dash));
+
+        if (auto mask = wasm_i8x16_bitmask(run))
+            return p + __builtin_ctz(mask);
+
+        p += 16;
+    }
+#endif
+
+    while ((size_t)(end - p) >= dashes) {
+        p = (const char*)memchr(p, '-', end - p - (dashes - 1));
+        if (!p)
+            return end;
+
+        if (memcmp(p, "-----", dashes) == 0)
+            return p;
+
+        ++p;
+    }
+
+    return end;
+}
+
+bool starts_with(const char* p, const char* end, const char* prefix, size_t prefix_len)
+{
+    return (size_t)(end - p) >= prefix_len && memcmp(p, prefix, prefix_len) == 0;
+}
+
+// Past the line break that ends an armour line, or nullptr
+const char* line_end(const char* p, const char* end)
+{
+    if (p != end && *p == '\r')
+        ++p;
+
+    if (p == end || *p != '\n')
+        return nullptr;
+
+    return p + 1;
+}
+
+// 0-63 for base64 characters, whitespace and padding marked separately
+const unsigned char invalid = 0xff;
+const unsigned char space = 0xfe;
+const unsigned char padding = 0xfd;
+
+struct Base64Table {
+    unsigned char values[256];
+
+    constexpr Base64Table()
+        : values{}
+    {
+        for (auto& v : values)
+            v = invalid;
+
+        const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        for (int i = 0; i != 64; ++i)
+            values[(unsigned char)alphabet[i]] = (unsigned char)i;
+
+        values[(unsigned char)' '] = space;
+        values[(unsigned char)'\t'] = space;
+        values[(unsigned char)'\r'] = space;
+        values[(unsigned char)'\n'] = space;
+        values[(unsigned char)'='] = padding;
+    }
+};
+
+constexpr Base64Table base64_table;
+
+} // namespace
+
+namespace bb {
+
+bool find_pem_blocks(const char* text, size_t len, const char* label, vec<PemBlock>* out)
+{
+    auto label_len = strlen(label);
+    auto end = text + len;
+    bool armour = false;
+
+    for (auto p = find_dashes(text, end); p != end; p = find_dashes(p, end)) {
+        if (!starts_with(p, end, begin_marker, sizeof(begin_marker) - 1)) {
+            p += dashes;
+            continue;
+        }
+
+        armour = true;
+        p += sizeof(begin_marker) - 1;
+
+        // "<label>-----" and a line break
+        bool wanted = starts_with(p, end, label, label_len)
+            && starts_with(p + label_len, end, "-----", dashes);
+
+        if (!wanted)
+            continue;
+
+        auto body = line_end(p + label_len + dashes, end);
+        if (!body)
+            continue;
+
+        auto footer = find_dashes(body, end);
+        if (footer == end)
+            break;
+
+        if (starts_with(footer, end, end_marker, sizeof(end_marker) - 1)) {
+            PemBlock block;
+            block.begin = body - text;
+            block.end = footer - text;
+            out->push_back(block);
+        }
+
+        p = footer + dashes;
+    }
+
+    return armour;
+}
+
+size_t base64_decode_in_place(char* data, size_t len)
+{
+    auto in = (const unsigned char*)data;
+    auto out = (unsigned char*)data;
+
+    uint32_t bits = 0;
+    int count = 0;
+    int pad = 0;
+
+    for (size_t i = 0; i != len; ++i) {
+        auto value = base64_table.values[in[i]];
+        if (value == space)
+            continue;
+
+        if (value == invalid)
+            return 0;
+
+        if (value == padding) {
+            ++pad;
+            value = 0;
+        } else if (pad) {
+            return 0; // Data after padding
+        }
+
+        bits = bits << 6 | value;
+        if (++count != 4)
+            continue;
+
+        // Writes trail the reads by at least one byte per group
+        *out++ = (unsigned char)(bits >> 16);
+        if (pad < 2)
+            *out++ = (unsigned char)(bits >> 8);
+        if (pad < 1)
+            *out++ = (unsigned char)bits;
+
+        bits = 0;
+        count = 0;
+    }
+
+    if (count || pad > 2)
+        return 0;
+
+    return out - (unsigned char*)data;
+}
+
+} // namespace bb
@@ -0,0 +1,29 @@
+#ifndef BB_PEM_SCAN_HPP
+#define BB_PEM_SCAN_HPP
+
+#include <stddef.h>
+
+#include "vec.hpp"
+
+namespace bb {
+
+// The base64 between a BEGIN and END line, as offsets into the scanned text.
+struct PemBlock {
+    size_t begin;
+    size_t end;
+};
+
+// Finds every "-----BEGIN <label>-----" block in text. Blocks with other labels
+// are skipped, like mbedtls_x509_crt_parse does. Returns whether text has any
+// PEM armour at all, so DER input can be told apart. Built with wasm SIMD, the
+// search for the dashes looks at 16 bytes at a time.
+bool find_pem_blocks(const char* text, size_t len, const char* label, vec<PemBlock>* out);
+
+// Decodes base64 to the start of data, skipping line breaks and other
+// whitespace. The output is always shorter than the input so this works in
+// place. Returns the number of bytes written, 0 for invalid base64.
+size_t base64_decode_in_place(char* data, size_t len);
+
+} // namespace bb
+
+#endif // Header guard
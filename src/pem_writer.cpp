@@ -0,0 +1,54 @@
+#include <mbedtls/base64.h>
+
+#include <string.h>
+
+#include "pem_writer.hpp"
+
+namespace bb {
+
+PemWriter::PemWriter(FILE* file, const char* label)
+    : file{file}
+    , label{label}
+{
+    fprintf(file, "-----BEGIN %s-----\n", label);
+}
+
+void PemWriter::flush_chunk()
+{
+    unsigned char line[65];
+    size_t line_len;
+    mbedtls_base64_encode(line, sizeof(line), &line_len, chunk, chunk_len);
+
+    line[line_len] = '\n';
+    fwrite(line, 1, line_len + 1, file);
+    chunk_len = 0;
+}
+
+void PemWriter::write(const void* data, size_t len)
+{
+    auto bytes = static_cast<const unsigned char*>(data);
+    while (len) {
+        auto n = sizeof(chunk) - chunk_len;
+        if (n > len)
+            n = len;
+
+        memcpy(chunk + chunk_len, bytes, n);
+        chunk_len += n;
+        bytes += n;
+        len -= n;
+
+        if (chunk_len == sizeof(chunk))
+            flush_chunk();
+    }
+}
+
+bool PemWriter::finish()
+{
+    if (chunk_len)
+        flush_chunk();
+
+    fprintf(file, "-----END %s-----\n", label);
+    return fflush(file) == 0 && !ferror(file);
+}
+
+} // namespace bb
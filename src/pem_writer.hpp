@@ -0,0 +1,29 @@
+#ifndef BB_PEM_WRITER_HPP
+#define BB_PEM_WRITER_HPP
+
+#include <stddef.h>
+#include <stdio.h>
+
+namespace bb {
+
+// Writes PEM to a file as the DER comes in, for output too big to hold twice.
+class PemWriter {
+    FILE* file;
+    const char* label;
+    unsigned char chunk[48]; // One 64 character line
+    size_t chunk_len = 0;
+
+    void flush_chunk();
+
+public:
+    PemWriter(FILE* file, const char* label);
+
+    void write(const void* data, size_t len);
+
+    // Writes the last line and the END line. Returns false if any write failed.
+    bool finish();
+};
+
+} // namespace bb
+
+#endif // Header guard
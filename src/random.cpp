@@ -0,0 +1,117 @@
+#include <mbedtls/hmac_drbg.h>
+#include <mbedtls/md.h>
+
+#include <stdio.h>
+
+#if !defined(__wasm__)
+#include <stdlib.h>
+#include <unistd.h>
+#endif
+
+#include "random.hpp"
+
+namespace {
+
+// Requests served before the DRBG pulls fresh entropy from the host.
+const int reseed_interval = 1024;
+
+// Plain data so it can be thread_local on every target: the native daemon
+// gives each worker its own DRBG, the wasm module just has the one.
+struct Drbg {
+    mbedtls_hmac_drbg_context ctx;
+    bool seeded;
+    uint32_t host_calls;
+
+    bool seed()
+    {
+        if (seeded)
+            return true;
+
+        mbedtls_hmac_drbg_init(&ctx);
+
+        auto md_info = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+        if (mbedtls_hmac_drbg_seed(&ctx, md_info, host_entropy, this, nullptr, 0)) {
+            mbedtls_hmac_drbg_free(&ctx);
+            return false;
+        }
+
+        mbedtls_hmac_drbg_set_reseed_interval(&ctx, reseed_interval);
+        seeded = true;
+        return true;
+    }
+
+    static int host_entropy(void* self, unsigned char* data, size_t data_len)
+    {
+        ++static_cast<Drbg*>(self)->host_calls;
+        fill_random(data, data_len);
+        return 0;
+    }
+};
+
+// Seeded lazily rather than in a constructor so a pre-initialised snapshot of
+// the module never contains DRBG state.
+thread_local Drbg drbg;
+
+} // namespace
+
+#if !defined(__wasm__)
+
+void fill_random(void* data, size_t data_len)
+{
+    auto bytes = (unsigned char*)data;
+    while (data_len) {
+        // getentropy hands out at most 256 bytes per call
+        auto chunk = data_len < 256 ? data_len : 256;
+        if (getentropy(bytes, chunk) != 0) {
+            fprintf(stderr, "getentropy failed.\n");
+            abort();
+        }
+
+        bytes += chunk;
+        data_len -= chunk;
+    }
+}
+
+#endif
+
+int mt_rng(void*, unsigned char* data, size_t data_len)
+{
+    if (!drbg.seed())
+        return MBEDTLS_ERR_HMAC_DRBG_ENTROPY_SOURCE_FAILED;
+
+    while (data_len) {
+        auto chunk = data_len < MBEDTLS_HMAC_DRBG_MAX_REQUEST
+            ? data_len
+            : MBEDTLS_HMAC_DRBG_MAX_REQUEST;
+
+        if (auto err = mbedtls_hmac_drbg_random(&drbg.ctx, data, chunk))
+            return err;
+
+        data += chunk;
+        data_len -= chunk;
+    }
+
+    return 0;
+}
+
+namespace bb {
+
+uint32_t host_rng_calls()
+{
+    return drbg.host_calls;
+}
+
+void reset_host_rng_calls()
+{
+    drbg.host_calls = 0;
+}
+
+void free_thread_rng()
+{
+    if (drbg.seeded) {
+        mbedtls_hmac_drbg_free(&drbg.ctx);
+        drbg.seeded = false;
+    }
+}
+
+} // namespace bb
@@ -2,14 +2,27 @@
 #define BB_RANDOM_HPP
 
 #include <stddef.h>
+#include <stdint.h>
 
+// Provided by the host in the wasm module, getentropy natively.
 [[using clang: import_module("crypto"), import_name("fill_random")]]
 void fill_random(void* data, size_t data_len);
 
-inline int mt_rng(void*, unsigned char* data, size_t data_len)
-{
-    fill_random(data, data_len);
-    return 0;
-}
+// Random bytes from the in-module DRBG. The DRBG is seeded from fill_random on
+// first use and reseeds itself periodically, so the host is only called a
+// handful of times instead of once per request.
+int mt_rng(void*, unsigned char* data, size_t data_len);
+
+namespace bb {
+
+// Number of fill_random calls since the last reset.
+uint32_t host_rng_calls();
+void reset_host_rng_calls();
+
+// The DRBG is per thread. Threads other than the main one call this before
+// exiting to release its state.
+void free_thread_rng();
+
+} // namespace bb
 
 #endif // Header guard
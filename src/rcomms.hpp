@@ -16,6 +16,12 @@ class rcomms {
 public:
     rcomms() = default;
 
+    // Takes ownership of the stream, e.g. one made by fmemopen.
+    explicit rcomms(FILE* f)
+        : file{f}
+    {
+    }
+
     rcomms(rcomms&& other)
         : file{other.file}
     {
@@ -61,6 +67,27 @@ public:
             | (uint32_t)buf[3] << 24;
     }
 
+    // Reads a length prefixed value into out without allocating. Fails when
+    // it's longer than capacity.
+    opt<uint32_t> read_bytelen(void* out, uint32_t capacity)
+    {
+        auto length = read_uint();
+        if (!length || *length > capacity)
+            return {};
+
+        if (fread(out, 1, *length, file) != *length)
+            return {};
+
+        return *length;
+    }
+
+    // Raw bytes without a length prefix, for callers that read the length
+    // themselves.
+    bool read_exact(void* out, size_t len)
+    {
+        return fread(out, 1, len, file) == len;
+    }
+
     opt<cstr> read_string()
     {
         auto length = read_uint();
@@ -0,0 +1,261 @@
+#include <mbedtls/asn1.h>
+#include <mbedtls/error.h>
+#include <mbedtls/md.h>
+#include <mbedtls/pem.h>
+#include <mbedtls/pk.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "der.hpp"
+#include "random.hpp"
+#include "scheduler.hpp"
+
+#include "resign.hpp"
+
+namespace {
+
+
+// id-ce-authorityKeyIdentifier
+const unsigned char akid_oid[] { 0x55, 0x1d, 0x23 };
+
+// version [0] EXPLICIT v3
+const unsigned char version_v3[] {
+    bb::der_context(0), 3, MBEDTLS_ASN1_INTEGER, 1, 2,
+};
+
+const size_t serial_size = 16;
+
+// Calls keep(extension, length) for every Extension in the certificate except
+// the authority key identifier, in order. v3_ext is the Extensions SEQUENCE,
+// the [3] around it is skipped if present.
+template<typename Keep>
+bool for_each_kept_extension(const mbedtls_x509_buf& v3_ext, Keep&& keep)
+{
+    if (!v3_ext.len)
+        return true;
+
+    auto p = v3_ext.p;
+    auto end = v3_ext.p + v3_ext.len;
+    size_t len;
+
+    if (*p == bb::der_context(3) && mbedtls_asn1_get_tag(&p, end, &len, bb::der_context(3)))
+        return false;
+
+    if (mbedtls_asn1_get_tag(&p, end, &len, bb::der_sequence))
+        return false;
+    end = p + len;
+
+    while (p != end) {
+        auto extension = p;
+        if (mbedtls_asn1_get_tag(&p, end, &len, bb::der_sequence))
+            return false;
+        auto extension_end = p + len;
+
+        size_t oid_len;
+        if (mbedtls_asn1_get_tag(&p, extension_end, &oid_len, MBEDTLS_ASN1_OID))
+            return false;
+
+        bool is_akid = oid_len == sizeof(akid_oid) && memcmp(p, akid_oid, sizeof(akid_oid)) == 0;
+        if (!is_akid)
+            keep(extension, (size_t)(extension_end - extension));
+
+        p = extension_end;
+    }
+
+    return true;
+}
+
+} // namespace
+
+namespace bb {
+
+interface_error Resigner::init(
+    const mbedtls_x509_crt* issuer,
+    mbedtls_pk_context* key,
+    mbedtls_md_type_t md,
+    const char* not_before,
+    size_t not_before_len,
+    const char* not_after,
+    size_t not_after_len)
+{
+    this->issuer = issuer;
+    this->key = key;
+    this->md = md;
+
+    sig_alg_len = der_signature_algorithm(sig_alg, key, md);
+    if (!sig_alg_len) {
+        fprintf(stderr, "No signature algorithm for this key and digest.\n");
+        return interface_error::generate_cert;
+    }
+
+    unsigned char times[2 * 17];
+    auto not_before_der_len = der_time(times, not_before, not_before_len);
+    auto not_after_der_len = not_before_der_len ? der_time(times + not_before_der_len, not_after, not_after_len) : 0;
+    if (!not_after_der_len) {
+        fprintf(stderr, "Invalid validity range.\n");
+        return interface_error::cert_set_validity;
+    }
+
+    auto times_len = not_before_der_len + not_after_der_len;
+    validity_len = der_header(validity, der_sequence, times_len);
+    memcpy(validity + validity_len, times, times_len);
+    validity_len += times_len;
+
+    // Same keyIdentifier-only form as set_akid
+    auto& skid = issuer->subject_key_id;
+    akid.clear();
+    if (skid.len) {
+        auto keyid_len = der_tlv_size(skid.len);
+        auto value_len = der_tlv_size(keyid_len);
+        der_put_header(&akid, der_sequence, der_tlv_size(sizeof(akid_oid)) + der_tlv_size(value_len));
+        der_put_header(&akid, MBEDTLS_ASN1_OID, sizeof(akid_oid));
+        akid.append(akid_oid, sizeof(akid_oid));
+        der_put_header(&akid, MBEDTLS_ASN1_OCTET_STRING, value_len);
+        der_put_header(&akid, der_sequence, keyid_len);
+        der_put_header(&akid, MBEDTLS_ASN1_CONTEXT_SPECIFIC | 0, skid.len);
+        akid.append(skid.p, skid.len);
+    }
+
+    batch.clear();
+    pending.clear();
+
+    return interface_error::success;
+}
+
+bool Resigner::add(const mbedtls_x509_crt* cert)
+{
+    unsigned char serial[serial_size];
+    if (mt_rng(nullptr, serial, sizeof(serial)))
+        return false;
+
+    unsigned char serial_der[serial_size + 3];
+    auto serial_der_len = der_unsigned_integer(serial_der, serial, sizeof(serial));
+
+    size_t kept_len = 0;
+    if (!for_each_kept_extension(cert->v3_ext, [&](const unsigned char*, size_t len) { kept_len += len; }))
+        return false;
+
+    // Without any extension the certificate becomes v1, like it must have been
+    auto extensions_len = kept_len + akid.size;
+    auto version_len = extensions_len ? sizeof(version_v3) : 0;
+    auto extensions_field_len = extensions_len ? der_tlv_size(der_tlv_size(extensions_len)) : 0;
+
+    auto tbs_len = version_len
+        + serial_der_len
+        + sig_alg_len
+        + issuer->subject_raw.len
+        + validity_len
+        + cert->subject_raw.len
+        + cert->pk_raw.len
+        + extensions_field_len;
+
+    Pending entry;
+    entry.offset = batch.size;
+
+    der_put_header(&batch, der_sequence, tbs_len);
+    batch.append(version_v3, version_len);
+    batch.append(serial_der, serial_der_len);
+    batch.append(sig_alg, sig_alg_len);
+    batch.append(issuer->subject_raw.p, issuer->subject_raw.len);
+    batch.append(validity, validity_len);
+    batch.append(cert->subject_raw.p, cert->subject_raw.len);
+    batch.append(cert->pk_raw.p, cert->pk_raw.len);
+
+    if (extensions_len) {
+        der_put_header(&batch, der_context(3), der_tlv_size(extensions_len));
+        der_put_header(&batch, der_sequence, extensions_len);
+        for_each_kept_extension(cert->v3_ext, [&](const unsigned char* p, size_t len) { batch.append(p, len); });
+        batch.append(akid.data, akid.size);
+    }
+
+    entry.length = batch.size - entry.offset;
+    pending.push_back(entry);
+
+    return true;
+}
+
+interface_error Resigner::flush(wcomms& out)
+{
+    auto md_info = mbedtls_md_info_from_type(md);
+    auto hash_len = mbedtls_md_get_size(md_info);
+
+    hashes.resize(pending.size * hash_len);
+    signatures.resize(pending.size * MBEDTLS_PK_SIGNATURE_MAX_SIZE);
+    signature_lens.resize(pending.size);
+
+    bool failed = false;
+    parallel_for(pending.size, [&](size_t i, unsigned) {
+        auto& entry = pending[i];
+        if (mbedtls_md(md_info, batch.data + entry.offset, entry.length, hashes.data + i * hash_len))
+            __atomic_store_n(&failed, true, __ATOMIC_RELAXED);
+    });
+
+    if (failed) {
+        fprintf(stderr, "Couldn't hash certificate.\n");
+        return interface_error::generate_cert;
+    }
+
+    if (mbedtls_pk_can_do(key, MBEDTLS_PK_ECDSA)) {
+        failed = !ecdsa.sign(
+            mbedtls_pk_ec(*key),
+            hashes.data, hash_len, pending.size,
+            signatures.data, MBEDTLS_PK_SIGNATURE_MAX_SIZE, signature_lens.data);
+    } else {
+        parallel_for(pending.size, [&](size_t i, unsigned) {
+            auto err = mbedtls_pk_sign(
+                key, md,
+                hashes.data + i * hash_len, hash_len,
+                signatures.data + i * MBEDTLS_PK_SIGNATURE_MAX_SIZE, MBEDTLS_PK_SIGNATURE_MAX_SIZE, &signature_lens[i],
+                mt_rng, nullptr);
+
+            if (err)
+                __atomic_store_n(&failed, true, __ATOMIC_RELAXED);
+        });
+    }
+
+    if (failed) {
+        fprintf(stderr, "Couldn't sign certificate.\n");
+        return interface_error::generate_cert;
+    }
+
+    for (size_t i = 0; i != pending.size; ++i) {
+        auto& entry = pending[i];
+        auto signature = signatures.data + i * MBEDTLS_PK_SIGNATURE_MAX_SIZE;
+        auto signature_len = signature_lens[i];
+
+        der.clear();
+        der_put_header(&der, der_sequence, entry.length + sig_alg_len + der_tlv_size(signature_len + 1));
+        der.append(batch.data + entry.offset, entry.length);
+        der.append(sig_alg, sig_alg_len);
+        der_put_header(&der, MBEDTLS_ASN1_BIT_STRING, signature_len + 1);
+        der.push_back(0); // No unused bits
+        der.append(signature, signature_len);
+
+        // Base64 plus a newline per 64 characters and the BEGIN/END lines
+        auto pem_size = (der.size + 2) / 3 * 4 * 65 / 64 + 64;
+        if (pem.len < pem_size)
+            pem = cstr(pem_size * 2);
+
+        size_t pem_len;
+        auto err = mbedtls_pem_write_buffer(
+            "-----BEGIN CERTIFICATE-----\n",
+            "-----END CERTIFICATE-----\n",
+            der.data, der.size,
+            (unsigned char*)pem.str, pem.len, &pem_len);
+
+        if (err) {
+            fprintf(stderr, "Couldn't turn cert DER into PEM.\n");
+            return interface_error::convert_pem;
+        }
+
+        out.write_bytelen(pem.str, pem_len - 1); // Without the null byte
+    }
+
+    batch.clear();
+    pending.clear();
+
+    return interface_error::success;
+}
+
+} // namespace bb
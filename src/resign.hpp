@@ -0,0 +1,82 @@
+#ifndef BB_RESIGN_HPP
+#define BB_RESIGN_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <mbedtls/md.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/x509_crt.h>
+
+#include "cstr.hpp"
+#include "ecdsa_batch.hpp"
+#include "interface_error.hpp"
+#include "vec.hpp"
+#include "wcomms.hpp"
+
+namespace bb {
+
+// Re-issues existing certificates under another (or the same, renewed) CA.
+//
+// The subject, public key and extensions are copied from each certificate's
+// DER as they are. Only the serial (fresh and random), the issuer (the CA's
+// subject DER), the validity, the signature algorithm and the authority key
+// identifier change. Certificates are collected into a batch like in
+// OcspSigner; flush hashes the batch over the scheduler's threads and signs
+// it, with EcdsaBatch for ECDSA keys.
+class Resigner {
+    struct Pending {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    const mbedtls_x509_crt* issuer = nullptr;
+    mbedtls_pk_context* key = nullptr;
+    mbedtls_md_type_t md = MBEDTLS_MD_NONE;
+
+    unsigned char sig_alg[32];
+    size_t sig_alg_len = 0;
+
+    // Validity SEQUENCE
+    unsigned char validity[2 + 2 * 17];
+    size_t validity_len = 0;
+
+    // Complete authorityKeyIdentifier extension, empty when the CA has no
+    // subject key identifier
+    vec<unsigned char> akid;
+
+    vec<unsigned char> batch;
+    vec<Pending> pending;
+    vec<unsigned char> hashes;
+    vec<unsigned char> signatures;
+    vec<size_t> signature_lens;
+    vec<unsigned char> der;
+    cstr pem;
+
+    EcdsaBatch ecdsa;
+
+public:
+    // issuer and key have to stay alive while the Resigner is used. Times are
+    // YYYYMMDDhhmmss.
+    interface_error init(
+        const mbedtls_x509_crt* issuer,
+        mbedtls_pk_context* key,
+        mbedtls_md_type_t md,
+        const char* not_before,
+        size_t not_before_len,
+        const char* not_after,
+        size_t not_after_len);
+
+    // Encodes the new TBSCertificate for cert.
+    bool add(const mbedtls_x509_crt* cert);
+
+    size_t pending_count() const { return pending.size; }
+
+    // Signs everything added since the last flush and writes each certificate
+    // to out as a PEM string.
+    interface_error flush(wcomms& out);
+};
+
+} // namespace bb
+
+#endif // Header guard
@@ -0,0 +1,252 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "scheduler.hpp"
+
+#if defined(__wasm__) && !defined(BB_THREADS)
+
+namespace bb {
+
+unsigned thread_count()
+{
+    return 1;
+}
+
+void set_thread_count(unsigned)
+{
+}
+
+void parallel_for(size_t count, void (*fn)(void* ctx, size_t index, unsigned worker), void* ctx)
+{
+    for (size_t i = 0; i != count; ++i)
+        fn(ctx, i, 0);
+}
+
+} // namespace bb
+
+#else
+
+#include <pthread.h>
+
+namespace {
+
+// Key generation and signing go deep into Mbed TLS' bignum code
+const size_t thread_stack_size = 256 * 1024;
+
+// The indices a worker has left: begin in the low half, end in the high half.
+// The owner takes from the front, thieves split off the back half, both with
+// a compare-and-swap on the whole range.
+struct alignas(64) Range {
+    uint64_t value;
+};
+
+uint64_t make_range(uint32_t begin, uint32_t end)
+{
+    return (uint64_t)end << 32 | begin;
+}
+
+uint32_t range_begin(uint64_t range) { return (uint32_t)range; }
+uint32_t range_end(uint64_t range) { return (uint32_t)(range >> 32); }
+
+struct Pool {
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t start = PTHREAD_COND_INITIALIZER;
+    pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+
+    unsigned threads = 1; // Including the thread that calls parallel_for
+    unsigned started = 1;
+
+    // The current job. Only changed while no pool thread is in run_job.
+    uint64_t generation = 0;
+    bool open = false;
+    unsigned job_threads = 1;
+    unsigned active = 0; // Pool threads in run_job
+    size_t remaining = 0; // Indices not yet done
+    void (*fn)(void*, size_t, unsigned) = nullptr;
+    void* ctx = nullptr;
+
+    Range ranges[bb::max_threads];
+};
+
+Pool pool;
+
+bool take(unsigned worker, uint32_t* index)
+{
+    auto& own = pool.ranges[worker].value;
+    auto range = __atomic_load_n(&own, __ATOMIC_ACQUIRE);
+
+    for (;;) {
+        auto begin = range_begin(range);
+        auto end = range_end(range);
+        if (begin >= end)
+            return false;
+
+        if (__atomic_compare_exchange_n(&own, &range, make_range(begin + 1, end), true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            *index = begin;
+            return true;
+        }
+    }
+}
+
+// Moves the back half of another worker's range into ours, rounded up so a
+// single remaining index can be taken too: its owner may be a thread that
+// hasn't started yet. The owner's take() races on the same word, so only one
+// of them gets it.
+bool steal(unsigned worker)
+{
+    auto threads = pool.job_threads;
+    for (unsigned i = 1; i != threads; ++i) {
+        auto victim = (worker + i) % threads;
+        auto& theirs = pool.ranges[victim].value;
+        auto range = __atomic_load_n(&theirs, __ATOMIC_ACQUIRE);
+
+        for (;;) {
+            auto begin = range_begin(range);
+            auto end = range_end(range);
+            if (begin >= end)
+                break;
+
+            auto middle = begin + (end - begin) / 2;
+            if (__atomic_compare_exchange_n(&theirs, &range, make_range(begin, middle), true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                // Ours is empty, nobody else touches an empty range
+                __atomic_store_n(&pool.ranges[worker].value, make_range(middle, end), __ATOMIC_RELEASE);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void run_job(unsigned worker)
+{
+    for (;;) {
+        uint32_t index;
+        while (take(worker, &index)) {
+            pool.fn(pool.ctx, index, worker);
+
+            if (__atomic_sub_fetch(&pool.remaining, 1, __ATOMIC_ACQ_REL) == 0) {
+                pthread_mutex_lock(&pool.mutex);
+                pthread_cond_signal(&pool.done);
+                pthread_mutex_unlock(&pool.mutex);
+            }
+        }
+
+        if (!steal(worker))
+            return;
+    }
+}
+
+// Pool threads join a job only while it's open. Completion is counted in
+// indices rather than threads, so a job never waits for a thread that hasn't
+// got going yet: in the browser a new thread is a Worker that may only start
+// once the thread that spawned it returns to its event loop.
+void* thread_main(void* arg)
+{
+    auto worker = (unsigned)(uintptr_t)arg;
+    uint64_t seen = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&pool.mutex);
+        while (pool.generation == seen)
+            pthread_cond_wait(&pool.start, &pool.mutex);
+        seen = pool.generation;
+
+        bool join = pool.open && worker < pool.job_threads;
+        if (join)
+            ++pool.active;
+        pthread_mutex_unlock(&pool.mutex);
+
+        if (!join)
+            continue;
+
+        run_job(worker);
+
+        pthread_mutex_lock(&pool.mutex);
+        if (--pool.active == 0)
+            pthread_cond_signal(&pool.done);
+        pthread_mutex_unlock(&pool.mutex);
+    }
+
+    return nullptr;
+}
+
+} // namespace
+
+namespace bb {
+
+unsigned thread_count()
+{
+    return pool.threads;
+}
+
+void set_thread_count(unsigned count)
+{
+    if (count < 1)
+        count = 1;
+    if (count > max_threads)
+        count = max_threads;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, thread_stack_size);
+
+    while (pool.started < count) {
+        pthread_t thread;
+        if (pthread_create(&thread, &attr, thread_main, (void*)(uintptr_t)pool.started) != 0) {
+            fprintf(stderr, "Couldn't start thread, using %u.\n", pool.started);
+            break;
+        }
+
+        pthread_detach(thread);
+        ++pool.started;
+    }
+
+    pthread_attr_destroy(&attr);
+    pool.threads = count < pool.started ? count : pool.started;
+}
+
+void parallel_for(size_t count, void (*fn)(void* ctx, size_t index, unsigned worker), void* ctx)
+{
+    auto threads = pool.threads < count ? pool.threads : (unsigned)count;
+    if (threads <= 1 || count > UINT32_MAX) {
+        for (size_t i = 0; i != count; ++i)
+            fn(ctx, i, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&pool.mutex);
+    for (unsigned w = 0; w != threads; ++w) {
+        auto begin = (uint32_t)(count * w / threads);
+        auto end = (uint32_t)(count * (w + 1) / threads);
+        pool.ranges[w].value = make_range(begin, end);
+    }
+
+    pool.fn = fn;
+    pool.ctx = ctx;
+    pool.job_threads = threads;
+    pool.remaining = count;
+    pool.open = true;
+    ++pool.generation;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.mutex);
+
+    // The calling thread steals like any other, so it finishes the job by
+    // itself if no pool thread turns up
+    run_job(0);
+
+    pthread_mutex_lock(&pool.mutex);
+    while (__atomic_load_n(&pool.remaining, __ATOMIC_ACQUIRE))
+        pthread_cond_wait(&pool.done, &pool.mutex);
+
+    // Threads still stealing from the empty ranges leave before the next job
+    // resets them
+    pool.open = false;
+    while (pool.active)
+        pthread_cond_wait(&pool.done, &pool.mutex);
+    pthread_mutex_unlock(&pool.mutex);
+}
+
+} // namespace bb
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef BB_SCHEDULER_HPP
+#define BB_SCHEDULER_HPP
+
+#include <stddef.h>
+
+namespace bb {
+
+// Spreads independent work over a small pool of threads. Each thread starts
+// with an even share of the indices and, once it runs out, steals half of
+// what another thread has left, so uneven items (an RSA key next to an EC
+// one) don't leave threads idle.
+//
+// Builds without threads (the regular wasm module) run everything on the
+// calling thread.
+
+const unsigned max_threads = 64;
+
+// Threads parallel_for uses, the calling thread included. Starts at 1.
+unsigned thread_count();
+
+// Starts pool threads as needed, they're never stopped. Clamped to
+// [1, max_threads], and to 1 without thread support.
+void set_thread_count(unsigned count);
+
+// Calls fn(ctx, index, worker) for every index in [0, count) and returns once
+// all calls are done. worker is below thread_count() and no two calls running
+// at the same time share it, use it to pick per-thread scratch space. fn
+// mustn't call parallel_for itself.
+void parallel_for(size_t count, void (*fn)(void* ctx, size_t index, unsigned worker), void* ctx);
+
+template<typename F>
+void parallel_for(size_t count, const F& f)
+{
+    parallel_for(
+        count,
+        [](void* ctx, size_t index, unsigned worker) {
+            (*static_cast<const F*>(ctx))(index, worker);
+        },
+        (void*)&f);
+}
+
+} // namespace bb
+
+#endif // Header guard
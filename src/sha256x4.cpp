@@ -0,0 +1,236 @@
+#include <mbedtls/sha256.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+#include "sha256x4.hpp"
+
+#if defined(__wasm_simd128__)
+
+namespace {
+
+const int lanes = 4;
+
+const uint32_t initial_state[8] {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+const uint32_t round_constants[64] {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+// One message being fed to a lane, block by block with the padding made up
+// on the fly.
+struct Lane {
+    const unsigned char* data;
+    size_t len;
+    size_t block;
+    size_t block_count;
+    size_t message; // Index into the output, or SIZE_MAX when idle
+};
+
+void start(Lane* lane, const unsigned char* data, size_t len, size_t message)
+{
+    lane->data = data;
+    lane->len = len;
+    lane->block = 0;
+    lane->block_count = (len + 8) / 64 + 1; // Room for 0x80 and the bit length
+    lane->message = message;
+}
+
+void next_block(Lane* lane, unsigned char* out)
+{
+    auto offset = lane->block * 64;
+    ++lane->block;
+
+    if (offset + 64 <= lane->len) {
+        memcpy(out, lane->data + offset, 64);
+        return;
+    }
+
+    size_t copied = 0;
+    if (offset < lane->len) {
+        copied = lane->len - offset;
+        memcpy(out, lane->data + offset, copied);
+    }
+
+    memset(out + copied, 0, 64 - copied);
+    if (offset <= lane->len)
+        out[lane->len - offset] = 0x80;
+
+    if (lane->block == lane->block_count) {
+        uint64_t bits = (uint64_t)lane->len * 8;
+        for (int i = 0; i != 8; ++i)
+            out[63 - i] = (unsigned char)(bits >> (8 * i));
+    }
+}
+
+uint32_t load_be32(const unsigned char* p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+void store_be32(unsigned char* p, uint32_t v)
+{
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+inline v128_t rotr(v128_t x, int n)
+{
+    return wasm_v128_or(wasm_u32x4_shr(x, n), wasm_i32x4_shl(x, 32 - n));
+}
+
+// state holds word i of every lane in state[i], blocks one 64 byte block per
+// lane.
+void compress(v128_t* state, const unsigned char (*blocks)[64])
+{
+    v128_t w[16];
+    for (int i = 0; i != 16; ++i) {
+        w[i] = wasm_i32x4_make(
+            load_be32(blocks[0] + 4 * i),
+            load_be32(blocks[1] + 4 * i),
+            load_be32(blocks[2] + 4 * i),
+            load_be32(blocks[3] + 4 * i));
+    }
+
+    auto a = state[0], b = state[1], c = state[2], d = state[3];
+    auto e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int t = 0; t != 64; ++t) {
+        v128_t wt;
+        if (t < 16) {
+            wt = w[t];
+        } else {
+            auto w15 = w[(t - 15) & 15];
+            auto w2 = w[(t - 2) & 15];
+            auto s0 = wasm_v128_xor(wasm_v128_xor(rotr(w15, 7), rotr(w15, 18)), wasm_u32x4_shr(w15, 3));
+            auto s1 = wasm_v128_xor(wasm_v128_xor(rotr(w2, 17), rotr(w2, 19)), wasm_u32x4_shr(w2, 10));
+            wt = wasm_i32x4_add(wasm_i32x4_add(w[t & 15], s0), wasm_i32x4_add(w[(t - 7) & 15], s1));
+            w[t & 15] = wt;
+        }
+
+        auto s1 = wasm_v128_xor(wasm_v128_xor(rotr(e, 6), rotr(e, 11)), rotr(e, 25));
+        auto ch = wasm_v128_xor(wasm_v128_and(e, f), wasm_v128_andnot(g, e));
+        auto t1 = wasm_i32x4_add(
+            wasm_i32x4_add(h, s1),
+            wasm_i32x4_add(wasm_i32x4_add(ch, wasm_i32x4_splat(round_constants[t])), wt));
+
+        auto s0 = wasm_v128_xor(wasm_v128_xor(rotr(a, 2), rotr(a, 13)), rotr(a, 22));
+        auto maj = wasm_v128_or(wasm_v128_and(a, b), wasm_v128_and(c, wasm_v128_or(a, b)));
+        auto t2 = wasm_i32x4_add(s0, maj);
+
+        h = g;
+        g = f;
+        f = e;
+        e = wasm_i32x4_add(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = wasm_i32x4_add(t1, t2);
+    }
+
+    state[0] = wasm_i32x4_add(state[0], a);
+    state[1] = wasm_i32x4_add(state[1], b);
+    state[2] = wasm_i32x4_add(state[2], c);
+    state[3] = wasm_i32x4_add(state[3], d);
+    state[4] = wasm_i32x4_add(state[4], e);
+    state[5] = wasm_i32x4_add(state[5], f);
+    state[6] = wasm_i32x4_add(state[6], g);
+    state[7] = wasm_i32x4_add(state[7], h);
+}
+
+} // namespace
+
+namespace bb {
+
+void sha256_many(const unsigned char* const* data, const size_t* lens, size_t count, unsigned char* hashes)
+{
+    Lane lane[lanes];
+    alignas(16) uint32_t words[8][lanes];
+    unsigned char blocks[lanes][64];
+
+    size_t next = 0;
+    size_t active = 0;
+    for (int l = 0; l != lanes; ++l) {
+        for (int i = 0; i != 8; ++i)
+            words[i][l] = initial_state[i];
+
+        if (next != count) {
+            start(&lane[l], data[next], lens[next], next);
+            ++next;
+            ++active;
+        } else {
+            lane[l].message = SIZE_MAX;
+        }
+    }
+
+    v128_t state[8];
+    while (active) {
+        for (int l = 0; l != lanes; ++l) {
+            if (lane[l].message != SIZE_MAX)
+                next_block(&lane[l], blocks[l]);
+            else
+                memset(blocks[l], 0, 64); // Idle lane, result unused
+        }
+
+        for (int i = 0; i != 8; ++i)
+            state[i] = wasm_v128_load(words[i]);
+
+        compress(state, blocks);
+
+        for (int i = 0; i != 8; ++i)
+            wasm_v128_store(words[i], state[i]);
+
+        // Finished lanes hand out their digest and take the next message
+        for (int l = 0; l != lanes; ++l) {
+            auto& current = lane[l];
+            if (current.message == SIZE_MAX || current.block != current.block_count)
+                continue;
+
+            auto out = hashes + current.message * 32;
+            for (int i = 0; i != 8; ++i) {
+                store_be32(out + 4 * i, words[i][l]);
+                words[i][l] = initial_state[i];
+            }
+
+            if (next != count) {
+                start(&current, data[next], lens[next], next);
+                ++next;
+            } else {
+                current.message = SIZE_MAX;
+                --active;
+            }
+        }
+    }
+}
+
+} // namespace bb
+
+#else
+
+namespace bb {
+
+void sha256_many(const unsigned char* const* data, const size_t* lens, size_t count, unsigned char* hashes)
+{
+    for (size_t i = 0; i != count; ++i)
+        mbedtls_sha256(data[i], lens[i], hashes + i * 32, 0);
+}
+
+} // namespace bb
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef BB_SHA256X4_HPP
+#define BB_SHA256X4_HPP
+
+#include <stddef.h>
+
+namespace bb {
+
+// SHA-256 of count messages, hashes gets count * 32 bytes. Built with wasm
+// SIMD, four messages go through the compression function at once, one per
+// 32-bit lane, and a lane picks up the next message as soon as its current one
+// is done, so messages of different lengths keep every lane busy. Otherwise
+// it's mbedtls_sha256 per message, which uses the CPU's SHA instructions where
+// Mbed TLS supports them.
+void sha256_many(const unsigned char* const* data, const size_t* lens, size_t count, unsigned char* hashes);
+
+} // namespace bb
+
+#endif // Header guard
@@ -0,0 +1,65 @@
+#ifndef BB_SORT_HPP
+#define BB_SORT_HPP
+
+#include <stddef.h>
+
+namespace bb {
+
+namespace detail {
+
+template<typename T, typename Less>
+void sift_down(T* data, size_t root, size_t size, Less& less)
+{
+    for (;;) {
+        auto child = root * 2 + 1;
+        if (child >= size)
+            return;
+
+        if (child + 1 < size && less(data[child], data[child + 1]))
+            ++child;
+
+        if (!less(data[root], data[child]))
+            return;
+
+        T tmp = static_cast<T&&>(data[root]);
+        data[root] = static_cast<T&&>(data[child]);
+        data[child] = static_cast<T&&>(tmp);
+        root = child;
+    }
+}
+
+} // namespace detail
+
+// Heapsort: in place, no allocations and O(n log n) worst case, which matters
+// more here than stability. Sorts so that less(data[i + 1], data[i]) is false.
+template<typename T, typename Less>
+void sort(T* data, size_t size, Less less)
+{
+    if (size < 2)
+        return;
+
+    for (auto i = size / 2; i-- != 0;)
+        detail::sift_down(data, i, size, less);
+
+    for (auto end = size - 1; end != 0; --end) {
+        T tmp = static_cast<T&&>(data[0]);
+        data[0] = static_cast<T&&>(data[end]);
+        data[end] = static_cast<T&&>(tmp);
+        detail::sift_down(data, 0, end, less);
+    }
+}
+
+template<typename T, typename Less>
+bool is_sorted(const T* data, size_t size, Less less)
+{
+    for (size_t i = 1; i < size; ++i) {
+        if (less(data[i], data[i - 1]))
+            return false;
+    }
+
+    return true;
+}
+
+} // namespace bb
+
+#endif // Header guard
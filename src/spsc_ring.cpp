@@ -0,0 +1,185 @@
+#include <string.h>
+
+#if defined(__wasm__)
+#elif defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <sched.h>
+#endif
+
+#include "endian.hpp"
+#include "spsc_ring.hpp"
+
+namespace {
+
+uint32_t padded(uint32_t len)
+{
+    return (len + 3) & ~(uint32_t)3;
+}
+
+// Sleeps while *word is value, or until a notify. May return early.
+void wait_while(uint32_t* word, uint32_t value)
+{
+#if defined(__wasm__) && defined(BB_THREADS)
+    __builtin_wasm_memory_atomic_wait32((int*)word, (int)value, -1);
+#elif defined(__wasm__)
+    (void)word;
+    (void)value;
+#elif defined(__linux__)
+    syscall(SYS_futex, word, FUTEX_WAIT, value, nullptr, nullptr, 0);
+#else
+    (void)word;
+    (void)value;
+    sched_yield();
+#endif
+}
+
+void notify(uint32_t* word)
+{
+#if defined(__wasm__) && defined(BB_THREADS)
+    __builtin_wasm_memory_atomic_notify((int*)word, 1);
+#elif defined(__wasm__)
+    (void)word;
+#elif defined(__linux__)
+    syscall(SYS_futex, word, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#else
+    (void)word;
+#endif
+}
+
+} // namespace
+
+namespace bb {
+
+#if defined(__wasm__) && !defined(BB_THREADS)
+const bool SpscRing::can_wait = false;
+#else
+const bool SpscRing::can_wait = true;
+#endif
+
+void SpscRing::init(unsigned char* memory, uint32_t capacity)
+{
+    memset(memory, 0, header_size);
+    store_le32(memory + 4, capacity);
+}
+
+bool SpscRing::front(unsigned char** record, uint32_t* len, bool* closed)
+{
+    auto mask = capacity() - 1;
+    *closed = false;
+
+    for (;;) {
+        auto head = __atomic_load_n(head_word(), __ATOMIC_RELAXED);
+        auto tail = __atomic_load_n(tail_word(), __ATOMIC_ACQUIRE);
+        if (head == tail)
+            return false;
+
+        auto offset = head & mask;
+        auto record_len = load_le32(data() + offset);
+
+        if (record_len == end_marker) {
+            *closed = true;
+            return false;
+        }
+
+        if (record_len == skip_marker) {
+            __atomic_store_n(head_word(), head + (capacity() - offset), __ATOMIC_RELEASE);
+            notify(head_word());
+            continue;
+        }
+
+        // A record running past the end means the producer is broken, treat
+        // it like the end
+        if (record_len > capacity() - offset - 4) {
+            *closed = true;
+            return false;
+        }
+
+        *record = data() + offset + 4;
+        *len = record_len;
+        front_size = 4 + padded(record_len);
+        return true;
+    }
+}
+
+void SpscRing::pop()
+{
+    auto head = __atomic_load_n(head_word(), __ATOMIC_RELAXED);
+    __atomic_store_n(head_word(), head + front_size, __ATOMIC_RELEASE);
+    notify(head_word());
+}
+
+bool SpscRing::wait_front(unsigned char** record, uint32_t* len, bool* closed)
+{
+    for (;;) {
+        auto tail = __atomic_load_n(tail_word(), __ATOMIC_ACQUIRE);
+        if (front(record, len, closed))
+            return true;
+
+        if (*closed || !can_wait)
+            return false;
+
+        wait_while(tail_word(), tail);
+    }
+}
+
+unsigned char* SpscRing::reserve()
+{
+    auto mask = capacity() - 1;
+    auto tail = __atomic_load_n(tail_word(), __ATOMIC_RELAXED);
+    auto head = __atomic_load_n(head_word(), __ATOMIC_ACQUIRE);
+
+    auto offset = tail & mask;
+    auto needed = 4 + max_record();
+    auto skip = capacity() - offset < needed ? capacity() - offset : 0;
+    if (capacity() - (tail - head) < skip + needed)
+        return nullptr;
+
+    reserve_skip = skip;
+    return data() + ((tail + skip) & mask) + 4;
+}
+
+void SpscRing::commit(uint32_t len)
+{
+    auto mask = capacity() - 1;
+    auto tail = __atomic_load_n(tail_word(), __ATOMIC_RELAXED);
+
+    if (reserve_skip)
+        store_le32(data() + (tail & mask), skip_marker);
+
+    store_le32(data() + ((tail + reserve_skip) & mask), len);
+    __atomic_store_n(tail_word(), tail + reserve_skip + 4 + padded(len), __ATOMIC_RELEASE);
+    notify(tail_word());
+}
+
+unsigned char* SpscRing::wait_reserve()
+{
+    for (;;) {
+        auto head = __atomic_load_n(head_word(), __ATOMIC_ACQUIRE);
+        if (auto space = reserve())
+            return space;
+
+        if (!can_wait)
+            return nullptr;
+
+        wait_while(head_word(), head);
+    }
+}
+
+bool SpscRing::close()
+{
+    auto mask = capacity() - 1;
+    auto tail = __atomic_load_n(tail_word(), __ATOMIC_RELAXED);
+    auto head = __atomic_load_n(head_word(), __ATOMIC_ACQUIRE);
+    if (capacity() - (tail - head) < 4)
+        return false;
+
+    store_le32(data() + (tail & mask), end_marker);
+    __atomic_store_n(tail_word(), tail + 4, __ATOMIC_RELEASE);
+    notify(tail_word());
+    return true;
+}
+
+} // namespace bb
@@ -0,0 +1,86 @@
+#ifndef BB_SPSC_RING_HPP
+#define BB_SPSC_RING_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace bb {
+
+// Single-producer, single-consumer ring of records in memory that's shared
+// with the other side, the host or another thread. Layout, little-endian
+// uint32s:
+//
+//   0    head      consumer's position, bytes consumed so far
+//   4    capacity  size of the data area, a power of two
+//   64   tail      producer's position, bytes produced so far
+//   128  data
+//
+// A record is a uint32 length and that many bytes, padded to a multiple of
+// four, in the same framing rcomms and wcomms use. Records never wrap: when
+// one doesn't fit before the end of the data area, the producer writes
+// skip_marker there and continues at the start. A record and its length take
+// at most half the data area, so one always fits in an empty ring, wherever
+// the positions are. end_marker in place of a length closes the ring.
+//
+// Positions only grow, wrapping at 2^32. Each side stores its own with
+// release order once it's done with the data, loads the other's with acquire
+// order, and then notifies waiters on the position it changed. The host
+// waits with Atomics.wait on the same words, see frontend/spsc_ring.ts.
+class SpscRing {
+    unsigned char* memory = nullptr;
+
+    // Set by front for pop, and by reserve for commit
+    uint32_t front_size = 0;
+    uint32_t reserve_skip = 0;
+
+    uint32_t* head_word() const { return (uint32_t*)memory; }
+    uint32_t* tail_word() const { return (uint32_t*)(memory + 64); }
+    unsigned char* data() const { return memory + header_size; }
+
+public:
+    static const size_t header_size = 128;
+    static const uint32_t min_capacity = 4096;
+    static const uint32_t skip_marker = 0xffffffff;
+    static const uint32_t end_marker = 0xfffffffe;
+
+    // Whether wait_front and wait_reserve can block. Builds without threads
+    // have nothing to wait for: the other side can't run until they return.
+    static const bool can_wait;
+
+    // Sets up an empty ring in header_size + capacity bytes, aligned to 64.
+    static void init(unsigned char* memory, uint32_t capacity);
+
+    SpscRing() = default;
+    explicit SpscRing(unsigned char* memory)
+        : memory{memory}
+    {
+    }
+
+    uint32_t capacity() const { return *(const uint32_t*)(memory + 4); }
+    uint32_t max_record() const { return capacity() / 2 - 4; }
+
+    // Consumer. The next record, which stays valid, and writable, until pop.
+    // False if the ring is empty, or closed: then closed is set.
+    bool front(unsigned char** record, uint32_t* len, bool* closed);
+    void pop();
+
+    // Like front, but waits for the producer while the ring is empty.
+    bool wait_front(unsigned char** record, uint32_t* len, bool* closed);
+
+    // Producer. Room for a record of up to max_record() bytes, nullptr if
+    // the consumer hasn't freed that much yet. commit publishes the first len
+    // bytes of it.
+    unsigned char* reserve();
+    void commit(uint32_t len);
+
+    // Like reserve, but waits for the consumer.
+    unsigned char* wait_reserve();
+
+    // Ends the ring once the consumer has read everything before it. Needs
+    // room for a length, like a record.
+    bool close();
+};
+
+} // namespace bb
+
+#endif // Header guard
@@ -0,0 +1,168 @@
+#ifndef BB_VEC_HPP
+#define BB_VEC_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "new.hpp" // IWYU pragma: keep
+
+namespace bb {
+
+template<typename T>
+struct vec {
+    T* data = nullptr;
+    size_t size = 0;
+    size_t capacity = 0;
+
+    vec() = default;
+
+    vec(vec&& other) noexcept
+        : data{other.data}
+        , size{other.size}
+        , capacity{other.capacity}
+    {
+        other.data = nullptr;
+        other.size = 0;
+        other.capacity = 0;
+    }
+
+    vec& operator=(vec&& other) noexcept
+    {
+        if (this == &other)
+            return *this;
+
+        reset();
+
+        data = other.data;
+        size = other.size;
+        capacity = other.capacity;
+
+        other.data = nullptr;
+        other.size = 0;
+        other.capacity = 0;
+
+        return *this;
+    }
+
+    vec(const vec& other) = delete;
+    vec& operator=(const vec& other) = delete;
+
+    ~vec()
+    {
+        reset();
+    }
+
+    void clear() noexcept
+    {
+        for (size_t i = 0; i != size; ++i)
+            data[i].~T();
+
+        size = 0;
+    }
+
+    void reset() noexcept
+    {
+        clear();
+        ::operator delete(data);
+        data = nullptr;
+        capacity = 0;
+    }
+
+    // Most elements the byte size can be computed for
+    static constexpr size_t max_size = SIZE_MAX / sizeof(T);
+
+    // Sizes past max_size and failed allocations abort, the elements would be
+    // written past the end of the block otherwise.
+    void reserve(size_t new_capacity)
+    {
+        if (new_capacity <= capacity)
+            return;
+
+        if (new_capacity > max_size)
+            abort();
+
+        auto fresh = static_cast<T*>(::operator new(new_capacity * sizeof(T)));
+        if (!fresh)
+            abort();
+
+        for (size_t i = 0; i != size; ++i) {
+            new (&fresh[i]) T{static_cast<T&&>(data[i])};
+            data[i].~T();
+        }
+
+        ::operator delete(data);
+        data = fresh;
+        capacity = new_capacity;
+    }
+
+    // Grows or shrinks to new_size; new elements are value-initialised.
+    void resize(size_t new_size)
+    {
+        if (new_size > capacity)
+            reserve(grown(new_size));
+
+        for (size_t i = new_size; i < size; ++i)
+            data[i].~T();
+
+        for (size_t i = size; i < new_size; ++i)
+            new (&data[i]) T{};
+
+        size = new_size;
+    }
+
+    T& push_back(T value)
+    {
+        if (size == capacity)
+            reserve(capacity ? grown(capacity + 1) : 8);
+
+        new (&data[size]) T{static_cast<T&&>(value)};
+        return data[size++];
+    }
+
+    void append(const T* items, size_t count)
+    {
+        if (count > max_size - size)
+            abort();
+
+        if (size + count > capacity)
+            reserve(grown(size + count));
+
+        for (size_t i = 0; i != count; ++i)
+            new (&data[size + i]) T{items[i]};
+
+        size += count;
+    }
+
+    // Double the capacity, or more if needed, without going past max_size
+    size_t grown(size_t needed) const noexcept
+    {
+        auto doubled = capacity > max_size / 2 ? max_size : capacity * 2;
+        return needed > doubled ? needed : doubled;
+    }
+
+    [[nodiscard]]
+    bool empty() const noexcept
+    {
+        return size == 0;
+    }
+
+    T& operator[](size_t index) noexcept
+    {
+        return data[index];
+    }
+
+    const T& operator[](size_t index) const noexcept
+    {
+        return data[index];
+    }
+
+    T* begin() noexcept { return data; }
+    T* end() noexcept { return data + size; }
+    const T* begin() const noexcept { return data; }
+    const T* end() const noexcept { return data + size; }
+};
+
+} // namespace bb
+
+#endif // Header guard
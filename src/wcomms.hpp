@@ -15,6 +15,12 @@ class wcomms {
 public:
     wcomms() = default;
 
+    // Takes ownership of the stream, e.g. one made by fmemopen.
+    explicit wcomms(FILE* f)
+        : file{f}
+    {
+    }
+
     wcomms(wcomms&& other)
         : file{other.file}
     {
@@ -61,11 +67,28 @@ public:
         return write_bytelen(str.str, str.len);
     }
 
-    void write_bytelen(void* data, uint32_t len)
+    void write_bytelen(const void* data, uint32_t len)
     {
         write_uint(len);
         fwrite(data, 1, len, file);
     }
+
+    // No length prefix, for a value written in pieces after its length.
+    void write_exact(const void* data, size_t len)
+    {
+        fwrite(data, 1, len, file);
+    }
+
+    // Flushes and reports whether every write so far made it into the stream.
+    bool good()
+    {
+        return fflush(file) == 0 && !ferror(file);
+    }
+
+    long tell()
+    {
+        return ftell(file);
+    }
 };
 
 } // namespace bb
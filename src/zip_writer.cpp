@@ -0,0 +1,152 @@
+#include "crc32.hpp"
+
+#include "zip_writer.hpp"
+
+namespace {
+
+const uint16_t method_store = 0;
+const uint16_t method_deflate = 8;
+
+// UNIX, ZIP specification 3.0
+const uint16_t version_made = 3 << 8 | 30;
+
+struct LeBuffer {
+    unsigned char data[64];
+    size_t len = 0;
+
+    void u16(uint16_t value)
+    {
+        data[len++] = (unsigned char)value;
+        data[len++] = (unsigned char)(value >> 8);
+    }
+
+    void u32(uint32_t value)
+    {
+        u16((uint16_t)value);
+        u16((uint16_t)(value >> 16));
+    }
+};
+
+uint16_t version_needed(uint16_t method)
+{
+    return method == method_deflate ? 20 : 10;
+}
+
+} // namespace
+
+namespace bb {
+
+bool ZipWriter::add(const cstr& name, const void* data, size_t len, uint32_t mode, bool compress)
+{
+    // No ZIP64 support, all sizes and offsets have to fit in 32 bits.
+    if (len > 0xffffffffu || name.len > 0xffff || entries.size == 0xffff)
+        return false;
+
+    auto method = method_store;
+    auto content = static_cast<const unsigned char*>(data);
+    size_t content_len = len;
+
+    if (compress && len) {
+        scratch.clear();
+        deflater.compress(data, len, &scratch);
+
+        // Stored is better for incompressible data
+        if (scratch.size < len) {
+            method = method_deflate;
+            content = scratch.data;
+            content_len = scratch.size;
+        }
+    }
+
+    if ((uint64_t)offset + 30 + name.len + content_len > 0xffffffffu)
+        return false;
+
+    Entry entry{
+        name,
+        method,
+        crc32(0, data, len),
+        (uint32_t)content_len,
+        (uint32_t)len,
+        mode,
+        offset,
+    };
+
+    LeBuffer header;
+    header.u32(0x04034b50);
+    header.u16(version_needed(method));
+    header.u16(0); // General purpose flags
+    header.u16(method);
+    header.u16(dos_time);
+    header.u16(dos_date);
+    header.u32(entry.crc);
+    header.u32(entry.compressed_size);
+    header.u32(entry.size);
+    header.u16((uint16_t)name.len);
+    header.u16(0); // Extra field length
+
+    if (fwrite(header.data, 1, header.len, file) != header.len
+        || fwrite(name.str, 1, name.len, file) != name.len
+        || fwrite(content, 1, content_len, file) != content_len)
+    {
+        return false;
+    }
+
+    offset += header.len + name.len + content_len;
+    entries.push_back(static_cast<Entry&&>(entry));
+
+    return true;
+}
+
+bool ZipWriter::complete()
+{
+    auto directory_offset = offset;
+    uint32_t directory_size = 0;
+
+    for (auto& entry : entries) {
+        LeBuffer header;
+        header.u32(0x02014b50);
+        header.u16(version_made);
+        header.u16(version_needed(entry.method));
+        header.u16(0); // General purpose flags
+        header.u16(entry.method);
+        header.u16(dos_time);
+        header.u16(dos_date);
+        header.u32(entry.crc);
+        header.u32(entry.compressed_size);
+        header.u32(entry.size);
+        header.u16((uint16_t)entry.name.len);
+        header.u16(0); // Extra field length
+        header.u16(0); // File comment length
+        header.u16(0); // Disk number
+        header.u16(0); // Internal file attributes
+        header.u32(entry.mode); // External file attributes
+        header.u32(entry.offset);
+
+        if (fwrite(header.data, 1, header.len, file) != header.len
+            || fwrite(entry.name.str, 1, entry.name.len, file) != entry.name.len)
+        {
+            return false;
+        }
+
+        directory_size += header.len + entry.name.len;
+    }
+
+    LeBuffer end;
+    end.u32(0x06054b50);
+    end.u16(0); // Disk number
+    end.u16(0); // Central directory disk start
+    end.u16((uint16_t)entries.size); // On disk
+    end.u16((uint16_t)entries.size); // Total
+    end.u32(directory_size);
+    end.u32(directory_offset);
+    end.u16(0); // Comment length
+
+    if (fwrite(end.data, 1, end.len, file) != end.len)
+        return false;
+
+    auto f = file;
+    file = nullptr;
+    return fclose(f) == 0;
+}
+
+} // namespace bb
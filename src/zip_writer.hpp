@@ -0,0 +1,117 @@
+#ifndef BB_ZIP_WRITER_HPP
+#define BB_ZIP_WRITER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cstr.hpp"
+#include "deflate.hpp"
+#include "opt.hpp"
+#include "vec.hpp"
+
+namespace bb {
+
+// Streaming ZIP archive writer. Each entry's local header and data are written
+// as soon as it's added, only the (small) central directory records are kept
+// until complete() writes them out.
+class ZipWriter {
+    struct Entry {
+        cstr name;
+        uint16_t method;
+        uint32_t crc;
+        uint32_t compressed_size;
+        uint32_t size;
+        uint32_t mode;
+        uint32_t offset;
+    };
+
+    FILE* file = nullptr;
+    uint16_t dos_date = 0;
+    uint16_t dos_time = 0;
+    uint32_t offset = 0;
+    vec<Entry> entries;
+    vec<unsigned char> scratch;
+    Deflater deflater;
+
+public:
+    // Unix regular file with 0644 permissions, as stored in the external
+    // attributes field.
+    static const uint32_t default_mode = 0100644u << 16;
+
+    ZipWriter() = default;
+
+    ZipWriter(ZipWriter&& other)
+        : file{other.file}
+        , dos_date{other.dos_date}
+        , dos_time{other.dos_time}
+        , offset{other.offset}
+        , entries{static_cast<vec<Entry>&&>(other.entries)}
+        , scratch{static_cast<vec<unsigned char>&&>(other.scratch)}
+        , deflater{static_cast<Deflater&&>(other.deflater)}
+    {
+        other.file = nullptr;
+    }
+
+    ZipWriter& operator=(ZipWriter&& other)
+    {
+        if (this == &other)
+            return *this;
+
+        if (file)
+            fclose(file);
+
+        file = other.file;
+        dos_date = other.dos_date;
+        dos_time = other.dos_time;
+        offset = other.offset;
+        entries = static_cast<vec<Entry>&&>(other.entries);
+        scratch = static_cast<vec<unsigned char>&&>(other.scratch);
+        deflater = static_cast<Deflater&&>(other.deflater);
+
+        other.file = nullptr;
+        return *this;
+    }
+
+    ZipWriter(const ZipWriter& other) = delete;
+    ZipWriter& operator=(const ZipWriter& other) = delete;
+
+    ~ZipWriter()
+    {
+        if (file)
+            fclose(file);
+    }
+
+    // Takes ownership of file. All entries get the given MS-DOS timestamp.
+    ZipWriter(FILE* f, uint16_t date, uint16_t time)
+        : file{f}
+        , dos_date{date}
+        , dos_time{time}
+    {
+    }
+
+    [[nodiscard]]
+    static opt<ZipWriter> open(const char* path, uint16_t date, uint16_t time)
+    {
+        auto f = fopen(path, "wb");
+        if (!f)
+            return {};
+
+        return ZipWriter{f, date, time};
+    }
+
+    [[nodiscard]]
+    bool is_open() const noexcept
+    {
+        return file != nullptr;
+    }
+
+    bool add(const cstr& name, const void* data, size_t len, uint32_t mode = default_mode, bool compress = true);
+
+    // Writes the central directory and closes the file.
+    bool complete();
+};
+
+} // namespace bb
+
+#endif // Header guard
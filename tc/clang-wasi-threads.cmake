@@ -0,0 +1,6 @@
+# Threaded module: wasi-threads, shared memory and atomics. The sysroot needs
+# the wasm32-wasip1-threads libc (wasi-sdk ships it).
+set(TC_TRIPLE wasm32-wasip1-threads)
+set(BB_WASI_THREADS ON CACHE BOOL "" FORCE)
+
+include(${CMAKE_CURRENT_LIST_DIR}/clang-wasi.cmake)
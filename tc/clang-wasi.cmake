@@ -1,7 +1,9 @@
 set(CMAKE_SYSTEM_NAME wasi)
 set(CMAKE_SYSTEM_PROCESSOR wasm32)
 
-set(TC_TRIPLE wasm32-unknown-wasi)
+if (NOT TC_TRIPLE)
+    set(TC_TRIPLE wasm32-unknown-wasi)
+endif()
 set(CMAKE_C_COMPILER_TARGET ${TC_TRIPLE})
 set(CMAKE_CXX_COMPILER_TARGET ${TC_TRIPLE})
 
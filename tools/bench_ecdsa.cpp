@@ -0,0 +1,151 @@
+// Times ECDSA signing of many hashes with one key.
+//
+//   bench_ecdsa [--iterations N]
+//
+// For P-256 and P-384 and batches of 1 to 256 hashes, compares a
+// mbedtls_ecdsa_sign call per hash against EcdsaBatch, which shares the nonce
+// inversion over the batch. Runs on a single thread; every signature of the
+// last batch is checked with mbedtls_pk_verify.
+
+#include <mbedtls/ecdsa.h>
+#include <mbedtls/md.h>
+#include <mbedtls/pk.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ecdsa_batch.hpp"
+#include "interface_key.hpp"
+#include "random.hpp"
+#include "vec.hpp"
+
+namespace {
+
+double now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+struct Mpi : mbedtls_mpi {
+    Mpi() { mbedtls_mpi_init(this); }
+    ~Mpi() { mbedtls_mpi_free(this); }
+
+    Mpi(const Mpi&) = delete;
+    Mpi& operator=(const Mpi&) = delete;
+};
+
+double one_by_one(mbedtls_ecp_keypair* ec, const bb::vec<unsigned char>& hashes, size_t hash_len, size_t count, long iterations)
+{
+    Mpi r, s;
+
+    auto start = now_ns();
+    for (long i = 0; i != iterations; ++i) {
+        for (size_t j = 0; j != count; ++j) {
+            auto hash = hashes.data + j * hash_len;
+            if (mbedtls_ecdsa_sign(&ec->private_grp, &r, &s, &ec->private_d, hash, hash_len, mt_rng, nullptr)) {
+                fprintf(stderr, "Signing failed.\n");
+                exit(1);
+            }
+        }
+    }
+    auto elapsed = now_ns() - start;
+
+    return elapsed / iterations / count;
+}
+
+double batched(mbedtls_pk_context* key, mbedtls_md_type_t md, const bb::vec<unsigned char>& hashes, size_t hash_len, size_t count, long iterations)
+{
+    bb::EcdsaBatch batch;
+    bb::vec<unsigned char> signatures;
+    bb::vec<size_t> signature_lens;
+    signatures.resize(count * MBEDTLS_ECDSA_MAX_LEN);
+    signature_lens.resize(count);
+
+    auto start = now_ns();
+    for (long i = 0; i != iterations; ++i) {
+        auto ok = batch.sign(
+            mbedtls_pk_ec(*key),
+            hashes.data, hash_len, count,
+            signatures.data, MBEDTLS_ECDSA_MAX_LEN, signature_lens.data);
+
+        if (!ok) {
+            fprintf(stderr, "Signing failed.\n");
+            exit(1);
+        }
+    }
+    auto elapsed = now_ns() - start;
+
+    for (size_t j = 0; j != count; ++j) {
+        auto err = mbedtls_pk_verify(
+            key, md,
+            hashes.data + j * hash_len, hash_len,
+            signatures.data + j * MBEDTLS_ECDSA_MAX_LEN, signature_lens[j]);
+
+        if (err) {
+            fprintf(stderr, "Signature %zu doesn't verify.\n", j);
+            exit(1);
+        }
+    }
+
+    return elapsed / iterations / count;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    long iterations = 20;
+    if (argc == 3 && strcmp(argv[1], "--iterations") == 0) {
+        iterations = strtol(argv[2], nullptr, 10);
+    } else if (argc != 1) {
+        fprintf(stderr, "Usage: bench_ecdsa [--iterations N]\n");
+        return 2;
+    }
+
+    if (iterations < 1)
+        iterations = 1;
+
+    struct Curve {
+        const char* name;
+        bb::gen_key_type type;
+        mbedtls_md_type_t md;
+    };
+
+    const Curve curves[] {
+        {"P-256", bb::gen_key_type::ec_p_256, MBEDTLS_MD_SHA256},
+        {"P-384", bb::gen_key_type::ec_p_384, MBEDTLS_MD_SHA384},
+    };
+
+    const size_t counts[] {1, 16, 64, 256};
+
+    printf("%6s %8s %14s %14s %9s\n", "curve", "batch", "single us", "batched us", "speedup");
+
+    for (auto& curve : curves) {
+        auto key = bb::generate_key(curve.type);
+        if (!key) {
+            fprintf(stderr, "Couldn't generate key.\n");
+            return 1;
+        }
+
+        auto hash_len = mbedtls_md_get_size(mbedtls_md_info_from_type(curve.md));
+        bb::vec<unsigned char> hashes;
+        hashes.resize(counts[3] * hash_len);
+        for (size_t i = 0; i != hashes.size; ++i)
+            hashes[i] = (unsigned char)(i * 131 + 7);
+
+        auto ec = mbedtls_pk_ec(*key);
+        for (auto count : counts) {
+            auto single_ns = one_by_one(ec, hashes, hash_len, count, iterations);
+            auto batched_ns = batched(&*key, curve.md, hashes, hash_len, count, iterations);
+
+            printf("%6s %8zu %14.1f %14.1f %8.2fx\n",
+                curve.name, count, single_ns / 1e3, batched_ns / 1e3, single_ns / batched_ns);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+// Times appends to the issuance log's Merkle tree as it grows.
+//
+//   bench_merkle [--entries N] [--dir PATH]
+//
+// Appends N (default 10,000,000) 1 KiB leaves to a new log in PATH (default
+// the current directory), printing the average append time per million
+// entries, then times an inclusion and a consistency proof at full size. The
+// nodes file takes 64 bytes per entry.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "merkle_log.hpp"
+#include "vec.hpp"
+
+namespace {
+
+double now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    long entries = 10000000;
+    const char* dir = ".";
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--entries") == 0 && i + 1 < argc) {
+            entries = strtol(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+            dir = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: bench_merkle [--entries N] [--dir PATH]\n");
+            return 2;
+        }
+    }
+
+    if (entries < 2)
+        entries = 2;
+
+    char frontier_path[4096];
+    char nodes_path[4096];
+    snprintf(frontier_path, sizeof(frontier_path), "%s/bench_merkle.log", dir);
+    snprintf(nodes_path, sizeof(nodes_path), "%s/bench_merkle.log_nodes", dir);
+
+    auto frontier = fopen(frontier_path, "wb");
+    auto nodes = fopen(nodes_path, "wb");
+    if (!frontier || !nodes) {
+        fprintf(stderr, "Couldn't create log files in %s.\n", dir);
+        return 1;
+    }
+    fclose(frontier);
+    fclose(nodes);
+
+    auto opt_log = bb::MerkleLog::open(frontier_path, nodes_path);
+    if (!opt_log) {
+        fprintf(stderr, "Couldn't open log.\n");
+        return 1;
+    }
+    auto& log = *opt_log;
+
+    // About the size of a certificate
+    unsigned char leaf[1024];
+    for (size_t i = 0; i != sizeof(leaf); ++i)
+        leaf[i] = (unsigned char)(i * 131 + 7);
+
+    printf("%12s %14s\n", "entries", "append us");
+
+    const long step = 1000000;
+    for (long done = 0; done < entries;) {
+        auto count = entries - done < step ? entries - done : step;
+
+        auto start = now_ns();
+        for (long i = 0; i != count; ++i) {
+            memcpy(leaf, &done, sizeof(done));
+            ++done;
+            if (!log.append(leaf, sizeof(leaf))) {
+                fprintf(stderr, "Append failed.\n");
+                return 1;
+            }
+        }
+        auto elapsed = now_ns() - start;
+
+        printf("%12ld %14.2f\n", done, elapsed / count / 1e3);
+    }
+
+    bb::vec<unsigned char> proof;
+
+    auto start = now_ns();
+    if (!log.inclusion_proof(entries / 3, entries, &proof)) {
+        fprintf(stderr, "Inclusion proof failed.\n");
+        return 1;
+    }
+    printf("\ninclusion proof:   %zu hashes, %.1f us\n", proof.size / bb::merkle_hash_size, (now_ns() - start) / 1e3);
+
+    start = now_ns();
+    if (!log.consistency_proof(entries / 3, entries, &proof)) {
+        fprintf(stderr, "Consistency proof failed.\n");
+        return 1;
+    }
+    printf("consistency proof: %zu hashes, %.1f us\n", proof.size / bb::merkle_hash_size, (now_ns() - start) / 1e3);
+
+    remove(frontier_path);
+    remove(nodes_path);
+    return 0;
+}
@@ -0,0 +1,88 @@
+// Prints the SHA-256 and SHA-1 fingerprint of every certificate in PEM bundles
+// or DER files.
+//
+//   fingerprints FILE...
+//
+// One line per certificate: SHA-256, SHA-1, file name and the certificate's
+// position in the file.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cert_io.hpp"
+#include "cstr.hpp"
+#include "fingerprint.hpp"
+#include "vec.hpp"
+
+namespace {
+
+bool read_file(const char* path, bb::cstr* out)
+{
+    auto file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    bb::vec<char> data;
+    char chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) != 0)
+        data.append(chunk, n);
+
+    bool ok = !ferror(file);
+    fclose(file);
+
+    *out = bb::cstr(data.size);
+    memcpy(out->str, data.data, data.size);
+    return ok;
+}
+
+void print_hex(const unsigned char* data, size_t len)
+{
+    static const char digits[] = "0123456789abcdef";
+
+    char text[2 * bb::sha256_size];
+    for (size_t i = 0; i != len; ++i) {
+        text[2 * i] = digits[data[i] >> 4];
+        text[2 * i + 1] = digits[data[i] & 15];
+    }
+
+    fwrite(text, 1, 2 * len, stdout);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: fingerprints FILE...\n");
+        return 2;
+    }
+
+    int status = 0;
+    bb::Fingerprints fingerprints;
+
+    for (int i = 1; i < argc; ++i) {
+        bb::cstr data;
+        if (!read_file(argv[i], &data)) {
+            fprintf(stderr, "Couldn't read %s.\n", argv[i]);
+            status = 1;
+            continue;
+        }
+
+        auto opt_chain = bb::parse_cert(static_cast<bb::cstr&&>(data));
+        if (!opt_chain || !bb::fingerprint_chain(&*opt_chain, &fingerprints)) {
+            fprintf(stderr, "No certificates in %s.\n", argv[i]);
+            status = 1;
+            continue;
+        }
+
+        for (size_t c = 0; c != fingerprints.count; ++c) {
+            print_hex(fingerprints.sha256.data + c * bb::sha256_size, bb::sha256_size);
+            putchar(' ');
+            print_hex(fingerprints.sha1.data + c * bb::sha1_size, bb::sha1_size);
+            printf(" %s#%zu\n", argv[i], c);
+        }
+    }
+
+    return status;
+}
@@ -0,0 +1,694 @@
+#include <mbedtls/sha256.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "crc32.hpp"
+
+#include "ledger.hpp"
+
+namespace bb {
+
+struct Ledger::IndexHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t clean;
+    uint64_t record_count;
+    uint64_t slots;
+    uint64_t bloom_bits;
+    uint64_t reserved[3];
+};
+
+struct Ledger::Slot {
+    uint32_t tag; // Top half of the key's hash
+    uint32_t record; // Index + 1, 0 for an empty slot
+};
+
+} // namespace bb
+
+namespace {
+
+const uint64_t index_magic = 0x5845444e49474c42; // "BLGINDEX"
+const uint32_t index_version = 1;
+
+// The records file is mapped once with room to grow into. Pages past the end
+// of the file are never touched.
+const size_t records_reserve = (size_t)1 << 36;
+
+const int bloom_hashes = 7;
+
+// Rebuild the index at 70% load
+bool index_full(uint64_t records, uint64_t slots)
+{
+    return records * 10 >= slots * 7;
+}
+
+uint64_t slots_for(uint64_t records)
+{
+    uint64_t slots = 1024;
+    while (index_full(records, slots))
+        slots *= 2;
+    return slots;
+}
+
+// FNV-1a with a final mix. Serials are random and SKIDs are hashes already,
+// this only has to spread them over the table.
+uint64_t hash_key(const unsigned char* key, size_t len, uint64_t seed)
+{
+    uint64_t h = 0xcbf29ce484222325 ^ seed;
+    for (size_t i = 0; i != len; ++i) {
+        h ^= key[i];
+        h *= 0x100000001b3;
+    }
+
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111eb;
+    h ^= h >> 31;
+    return h;
+}
+
+const uint64_t serial_seed = 1;
+const uint64_t skid_seed = 2;
+
+void strip_zeros(const unsigned char** serial, size_t* len)
+{
+    while (*len > 1 && (*serial)[0] == 0) {
+        ++*serial;
+        --*len;
+    }
+}
+
+uint32_t record_crc(const bb::LedgerRecord& record)
+{
+    return bb::crc32(0, &record, offsetof(bb::LedgerRecord, crc));
+}
+
+int64_t days_from_civil(int64_t y, unsigned m, unsigned d)
+{
+    y -= m <= 2;
+    auto era = (y >= 0 ? y : y - 399) / 400;
+    auto yoe = (unsigned)(y - era * 400);
+    auto doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    auto doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int64_t)doe - 719468;
+}
+
+int64_t unix_time(const mbedtls_x509_time& t)
+{
+    return days_from_civil(t.year, t.mon, t.day) * 86400 + t.hour * 3600 + t.min * 60 + t.sec;
+}
+
+bool write_all(int fd, const void* data, size_t len, uint64_t offset)
+{
+    auto bytes = static_cast<const unsigned char*>(data);
+    while (len) {
+        auto n = pwrite(fd, bytes, len, offset);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        bytes += n;
+        len -= n;
+        offset += n;
+    }
+
+    return true;
+}
+
+bool read_all(int fd, void* data, size_t len, uint64_t offset)
+{
+    auto bytes = static_cast<unsigned char*>(data);
+    while (len) {
+        auto n = pread(fd, bytes, len, offset);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            return false;
+        }
+
+        bytes += n;
+        len -= n;
+        offset += n;
+    }
+
+    return true;
+}
+
+char* path_with_suffix(const char* path, const char* suffix)
+{
+    auto path_len = strlen(path);
+    auto suffix_len = strlen(suffix);
+
+    auto result = new char[path_len + suffix_len + 1];
+    memcpy(result, path, path_len);
+    memcpy(result + path_len, suffix, suffix_len + 1);
+    return result;
+}
+
+int open_file(const char* path, const char* suffix, int flags)
+{
+    auto full_path = path_with_suffix(path, suffix);
+    auto fd = ::open(full_path, flags | O_CLOEXEC, 0644);
+    if (fd < 0)
+        perror(full_path);
+
+    delete[] full_path;
+    return fd;
+}
+
+} // namespace
+
+namespace bb {
+
+Ledger::IndexHeader* Ledger::header() const
+{
+    return static_cast<IndexHeader*>(index_map);
+}
+
+Ledger::Slot* Ledger::serial_slots() const
+{
+    return reinterpret_cast<Slot*>(header() + 1);
+}
+
+Ledger::Slot* Ledger::skid_slots() const
+{
+    return serial_slots() + header()->slots;
+}
+
+unsigned char* Ledger::bloom() const
+{
+    return reinterpret_cast<unsigned char*>(skid_slots() + header()->slots);
+}
+
+Ledger::Ledger(Ledger&& other)
+    : der_fd{other.der_fd}
+    , records_fd{other.records_fd}
+    , index_fd{other.index_fd}
+    , records{other.records}
+    , record_count{other.record_count}
+    , der_size{other.der_size}
+    , index_map{other.index_map}
+    , index_size{other.index_size}
+    , sync{other.sync}
+    , read_only{other.read_only}
+    , index_path{other.index_path}
+{
+    other.der_fd = -1;
+    other.records_fd = -1;
+    other.index_fd = -1;
+    other.records = nullptr;
+    other.index_map = nullptr;
+    other.index_path = nullptr;
+}
+
+Ledger::~Ledger()
+{
+    if (index_map && !read_only) {
+        // Everything written, then mark it so the next open can skip a rebuild
+        msync(index_map, index_size, MS_SYNC);
+        header()->clean = 1;
+        msync(index_map, sizeof(IndexHeader), MS_SYNC);
+    }
+
+    unmap_index();
+
+    if (records)
+        munmap((void*)records, records_reserve);
+
+    if (der_fd >= 0)
+        close(der_fd);
+    if (records_fd >= 0)
+        close(records_fd);
+
+    delete[] index_path;
+}
+
+opt<Ledger> Ledger::open(const char* path, bool sync)
+{
+    Ledger ledger;
+    ledger.sync = sync;
+    ledger.index_path = path_with_suffix(path, ".index");
+
+    ledger.der_fd = open_file(path, ".der", O_RDWR | O_CREAT);
+    ledger.records_fd = open_file(path, ".records", O_RDWR | O_CREAT);
+    if (ledger.der_fd < 0 || ledger.records_fd < 0)
+        return {};
+
+    // Held until the records file is closed. Readers only hold it briefly.
+    if (flock(ledger.records_fd, LOCK_EX | LOCK_NB) != 0) {
+        fprintf(stderr, "Waiting for other users of the ledger.\n");
+        if (flock(ledger.records_fd, LOCK_EX) != 0) {
+            perror("flock");
+            return {};
+        }
+    }
+
+    auto map = mmap(nullptr, records_reserve, PROT_READ, MAP_SHARED, ledger.records_fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return {};
+    }
+    ledger.records = static_cast<const LedgerRecord*>(map);
+
+    if (!ledger.recover())
+        return {};
+
+    return static_cast<Ledger&&>(ledger);
+}
+
+opt<Ledger> Ledger::open_read_only(const char* path)
+{
+    Ledger ledger;
+    ledger.read_only = true;
+    ledger.index_path = path_with_suffix(path, ".index");
+
+    ledger.der_fd = open_file(path, ".der", O_RDONLY);
+    ledger.records_fd = open_file(path, ".records", O_RDONLY);
+    if (ledger.der_fd < 0 || ledger.records_fd < 0)
+        return {};
+
+    // Without the lock a writer is running: its index isn't marked clean and
+    // changes under us, and its last record may be half written.
+    bool writer_running = false;
+    if (flock(ledger.records_fd, LOCK_SH | LOCK_NB) != 0) {
+        if (errno != EWOULDBLOCK) {
+            perror("flock");
+            return {};
+        }
+        writer_running = true;
+    }
+
+    struct stat st;
+    if (fstat(ledger.der_fd, &st) != 0)
+        return {};
+    ledger.der_size = st.st_size;
+
+    if (fstat(ledger.records_fd, &st) != 0)
+        return {};
+    uint64_t available = st.st_size / sizeof(LedgerRecord);
+
+    if (available) {
+        auto map = mmap(nullptr, records_reserve, PROT_READ, MAP_SHARED, ledger.records_fd, 0);
+        if (map == MAP_FAILED) {
+            perror("mmap");
+            return {};
+        }
+        ledger.records = static_cast<const LedgerRecord*>(map);
+    }
+
+    ledger.count_valid_records(available);
+    if (!writer_running)
+        ledger.use_index_read_only(ledger.record_count);
+
+    return static_cast<Ledger&&>(ledger);
+}
+
+// Advances record_count over the valid records up to available. False if it
+// stopped at a damaged one.
+bool Ledger::count_valid_records(uint64_t available)
+{
+    while (record_count != available) {
+        auto& record = records[record_count];
+        bool valid = record.crc == record_crc(record)
+            && record.serial_len && record.serial_len <= sizeof(record.serial)
+            && record.skid_len <= sizeof(record.skid)
+            && record.der_offset + record.der_len <= der_size;
+
+        if (!valid)
+            return false;
+
+        ++record_count;
+    }
+
+    return true;
+}
+
+// Maps the index if it was closed cleanly and covers exactly these records.
+// Lookups scan the records otherwise.
+bool Ledger::use_index_read_only(uint64_t records)
+{
+    auto fd = ::open(index_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(IndexHeader)) {
+        close(fd);
+        return false;
+    }
+
+    // Closes fd if it fails
+    if (!map_index(fd, st.st_size))
+        return false;
+
+    auto h = header();
+    auto expected_size = sizeof(IndexHeader) + h->slots * 2 * sizeof(Slot) + h->bloom_bits / 8;
+    bool usable = h->magic == index_magic
+        && h->version == index_version
+        && h->clean
+        && h->record_count == records
+        && expected_size == index_size;
+
+    if (!usable)
+        unmap_index();
+
+    return usable;
+}
+
+bool Ledger::recover()
+{
+    struct stat st;
+    if (fstat(der_fd, &st) != 0)
+        return false;
+    der_size = st.st_size;
+
+    if (fstat(records_fd, &st) != 0)
+        return false;
+
+    // Half a record is what's left of an interrupted append
+    uint64_t available = st.st_size / sizeof(LedgerRecord);
+    if (available * sizeof(LedgerRecord) != (uint64_t)st.st_size) {
+        if (ftruncate(records_fd, available * sizeof(LedgerRecord)) != 0)
+            return false;
+    }
+
+    // Records the existing index already covers were checked when they were
+    // added to it.
+    uint64_t indexed = 0;
+
+    auto fd = ::open(index_path, O_RDWR | O_CLOEXEC);
+    if (fd >= 0 && fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(IndexHeader) && map_index(fd, st.st_size)) {
+        auto h = header();
+        auto expected_size = sizeof(IndexHeader) + h->slots * 2 * sizeof(Slot) + h->bloom_bits / 8;
+
+        bool usable = h->magic == index_magic
+            && h->version == index_version
+            && h->clean
+            && h->record_count <= available
+            && expected_size == index_size;
+
+        if (usable)
+            indexed = h->record_count;
+        else
+            unmap_index();
+    } else if (fd >= 0) {
+        close(fd);
+    }
+
+    record_count = indexed;
+    if (!count_valid_records(available)) {
+        fprintf(stderr, "Dropping %llu ledger records after a damaged one.\n",
+            (unsigned long long)(available - record_count));
+        if (ftruncate(records_fd, record_count * sizeof(LedgerRecord)) != 0)
+            return false;
+    }
+
+    // DER without a record is from an append that didn't finish
+    uint64_t der_end = 0;
+    if (record_count) {
+        auto& last = records[record_count - 1];
+        der_end = last.der_offset + last.der_len;
+    }
+    if (der_end != der_size) {
+        if (ftruncate(der_fd, der_end) != 0)
+            return false;
+        der_size = der_end;
+    }
+
+    if (!index_map || index_full(record_count, header()->slots))
+        return build_index(slots_for(record_count));
+
+    for (auto i = indexed; i != record_count; ++i)
+        insert(i);
+    header()->record_count = record_count;
+
+    // Until it's closed, a crash leaves the index to be rebuilt.
+    header()->clean = 0;
+    return msync(index_map, sizeof(IndexHeader), MS_SYNC) == 0;
+}
+
+bool Ledger::map_index(int fd, size_t size)
+{
+    auto prot = read_only ? PROT_READ : PROT_READ | PROT_WRITE;
+    auto map = mmap(nullptr, size, prot, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+
+    index_fd = fd;
+    index_map = map;
+    index_size = size;
+    return true;
+}
+
+void Ledger::unmap_index()
+{
+    if (index_map)
+        munmap(index_map, index_size);
+    if (index_fd >= 0)
+        close(index_fd);
+
+    index_map = nullptr;
+    index_size = 0;
+    index_fd = -1;
+}
+
+bool Ledger::build_index(uint64_t slots)
+{
+    unmap_index();
+
+    auto bloom_bits = slots * 8;
+    auto size = sizeof(IndexHeader) + slots * 2 * sizeof(Slot) + bloom_bits / 8;
+
+    // Built next to the old one and renamed over it
+    auto tmp_path = path_with_suffix(index_path, ".tmp");
+    auto fd = ::open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 || ftruncate(fd, size) != 0 || !map_index(fd, size)) {
+        perror(tmp_path);
+        delete[] tmp_path;
+        return false;
+    }
+
+    auto h = header();
+    h->magic = index_magic;
+    h->version = index_version;
+    h->clean = 0;
+    h->slots = slots;
+    h->bloom_bits = bloom_bits;
+
+    for (uint64_t i = 0; i != record_count; ++i)
+        insert(i);
+    h->record_count = record_count;
+
+    bool ok = msync(index_map, index_size, MS_SYNC) == 0
+        && rename(tmp_path, index_path) == 0;
+
+    delete[] tmp_path;
+    return ok;
+}
+
+void Ledger::insert(uint64_t index)
+{
+    auto& record = records[index];
+    auto mask = header()->slots - 1;
+
+    auto serial_hash = hash_key(record.serial, record.serial_len, serial_seed);
+    auto skid_hash = hash_key(record.skid, record.skid_len, skid_seed);
+
+    auto place = [&](Slot* slots, uint64_t hash) {
+        auto i = hash & mask;
+        while (slots[i].record)
+            i = (i + 1) & mask;
+
+        slots[i].tag = (uint32_t)(hash >> 32);
+        slots[i].record = (uint32_t)(index + 1);
+    };
+
+    place(serial_slots(), serial_hash);
+    if (record.skid_len)
+        place(skid_slots(), skid_hash);
+
+    // Double hashing from the two halves of the serial's hash
+    auto bits = bloom();
+    auto bloom_bits = header()->bloom_bits;
+    auto h1 = (uint32_t)serial_hash;
+    auto h2 = (uint32_t)(serial_hash >> 32) | 1;
+    for (int k = 0; k != bloom_hashes; ++k) {
+        auto bit = (h1 + (uint64_t)k * h2) % bloom_bits;
+        bits[bit / 8] |= (unsigned char)(1 << (bit % 8));
+    }
+}
+
+bool Ledger::bloom_may_contain(uint64_t hash) const
+{
+    auto bits = bloom();
+    auto bloom_bits = header()->bloom_bits;
+    auto h1 = (uint32_t)hash;
+    auto h2 = (uint32_t)(hash >> 32) | 1;
+    for (int k = 0; k != bloom_hashes; ++k) {
+        auto bit = (h1 + (uint64_t)k * h2) % bloom_bits;
+        if (!(bits[bit / 8] & (1 << (bit % 8))))
+            return false;
+    }
+
+    return true;
+}
+
+const LedgerRecord* Ledger::find(const Slot* slots, uint64_t hash, const unsigned char* key, size_t key_len, bool by_serial) const
+{
+    auto mask = header()->slots - 1;
+    auto tag = (uint32_t)(hash >> 32);
+
+    for (auto i = hash & mask; slots[i].record; i = (i + 1) & mask) {
+        if (slots[i].tag != tag)
+            continue;
+
+        auto& record = records[slots[i].record - 1];
+        auto record_key = by_serial ? record.serial : record.skid;
+        auto record_key_len = by_serial ? record.serial_len : record.skid_len;
+        if (record_key_len == key_len && memcmp(record_key, key, key_len) == 0)
+            return &record;
+    }
+
+    return nullptr;
+}
+
+// For read-only ledgers without a usable index
+const LedgerRecord* Ledger::scan(const unsigned char* key, size_t key_len, bool by_serial) const
+{
+    for (uint64_t i = 0; i != record_count; ++i) {
+        auto& record = records[i];
+        auto record_key = by_serial ? record.serial : record.skid;
+        auto record_key_len = by_serial ? record.serial_len : record.skid_len;
+        if (record_key_len == key_len && memcmp(record_key, key, key_len) == 0)
+            return &record;
+    }
+
+    return nullptr;
+}
+
+bool Ledger::contains_serial(const unsigned char* serial, size_t len) const
+{
+    strip_zeros(&serial, &len);
+    if (len > sizeof(LedgerRecord::serial))
+        return false;
+
+    if (!index_map)
+        return scan(serial, len, true);
+
+    auto hash = hash_key(serial, len, serial_seed);
+    return bloom_may_contain(hash) && find(serial_slots(), hash, serial, len, true);
+}
+
+const LedgerRecord* Ledger::find_serial(const unsigned char* serial, size_t len) const
+{
+    strip_zeros(&serial, &len);
+    if (len > sizeof(LedgerRecord::serial))
+        return nullptr;
+
+    if (!index_map)
+        return scan(serial, len, true);
+
+    auto hash = hash_key(serial, len, serial_seed);
+    if (!bloom_may_contain(hash))
+        return nullptr;
+
+    return find(serial_slots(), hash, serial, len, true);
+}
+
+const LedgerRecord* Ledger::find_skid(const unsigned char* skid, size_t len) const
+{
+    if (len > sizeof(LedgerRecord::skid))
+        len = sizeof(LedgerRecord::skid);
+
+    if (!index_map)
+        return scan(skid, len, false);
+
+    return find(skid_slots(), hash_key(skid, len, skid_seed), skid, len, false);
+}
+
+ledger_append Ledger::append(const mbedtls_x509_crt* cert)
+{
+    const unsigned char* serial = cert->serial.p;
+    size_t serial_len = cert->serial.len;
+    strip_zeros(&serial, &serial_len);
+
+    if (serial_len > sizeof(LedgerRecord::serial) || cert->raw.len > UINT32_MAX) {
+        fprintf(stderr, "Certificate doesn't fit in a ledger record.\n");
+        return ledger_append::io_error;
+    }
+
+    if (read_only)
+        return ledger_append::io_error;
+
+    if (contains_serial(serial, serial_len))
+        return ledger_append::duplicate_serial;
+
+    if (record_count == UINT32_MAX)
+        return ledger_append::io_error;
+
+    if (index_full(record_count + 1, header()->slots)) {
+        if (!build_index(header()->slots * 2))
+            return ledger_append::io_error;
+    }
+
+    // DER first, so a record on disk always points at complete data
+    if (!write_all(der_fd, cert->raw.p, cert->raw.len, der_size))
+        return ledger_append::io_error;
+    if (sync && fdatasync(der_fd) != 0)
+        return ledger_append::io_error;
+
+    LedgerRecord record{};
+    memcpy(record.serial, serial, serial_len);
+    record.serial_len = serial_len;
+
+    record.skid_len = cert->subject_key_id.len < sizeof(record.skid)
+        ? cert->subject_key_id.len
+        : sizeof(record.skid);
+    memcpy(record.skid, cert->subject_key_id.p, record.skid_len);
+
+    unsigned char subject_sha256[32];
+    mbedtls_sha256(cert->subject_raw.p, cert->subject_raw.len, subject_sha256, 0);
+    memcpy(&record.subject_hash, subject_sha256, sizeof(record.subject_hash));
+
+    record.not_after = unix_time(cert->valid_to);
+    record.der_offset = der_size;
+    record.der_len = cert->raw.len;
+    record.der_crc = crc32(0, cert->raw.p, cert->raw.len);
+    record.crc = record_crc(record);
+
+    if (!write_all(records_fd, &record, sizeof(record), record_count * sizeof(LedgerRecord)))
+        return ledger_append::io_error;
+    if (sync && fdatasync(records_fd) != 0)
+        return ledger_append::io_error;
+
+    der_size += cert->raw.len;
+    insert(record_count);
+    ++record_count;
+    header()->record_count = record_count;
+
+    return ledger_append::ok;
+}
+
+bool Ledger::read_der(const LedgerRecord& record, vec<unsigned char>* out) const
+{
+    out->resize(record.der_len);
+    if (!read_all(der_fd, out->data, record.der_len, record.der_offset))
+        return false;
+
+    return crc32(0, out->data, out->size) == record.der_crc;
+}
+
+} // namespace bb
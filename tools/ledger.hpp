@@ -0,0 +1,124 @@
+#ifndef BB_TOOLS_LEDGER_HPP
+#define BB_TOOLS_LEDGER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <mbedtls/x509_crt.h>
+
+#include "opt.hpp"
+#include "vec.hpp"
+
+namespace bb {
+
+// One issued certificate. Stored as is in host byte order, the ledger is only
+// read on the machine that writes it.
+struct LedgerRecord {
+    unsigned char serial[20]; // Without leading zero bytes
+    unsigned char skid[20];
+    uint8_t serial_len;
+    uint8_t skid_len;
+    uint16_t reserved;
+    uint32_t der_len;
+    uint64_t subject_hash; // First 8 bytes of SHA-256 over the subject DN DER
+    int64_t not_after; // Unix time
+    uint64_t der_offset;
+    uint32_t der_crc;
+    uint32_t crc; // Of everything above
+};
+
+static_assert(sizeof(LedgerRecord) == 80);
+
+enum class ledger_append {
+    ok,
+    duplicate_serial,
+    io_error,
+};
+
+// Append-only record of issued certificates, three files next to each other:
+//
+//   PATH.der      Certificate DER, appended.
+//   PATH.records  Fixed size LedgerRecords, appended after the DER they point
+//                 at is on disk. Both are checksummed, a torn record at the
+//                 end is dropped when the ledger is opened.
+//   PATH.index    Open-addressing hash tables by serial and by SKID, and a
+//                 bloom filter of serials. Derived from the records and
+//                 rebuilt from them whenever it's missing, behind, or wasn't
+//                 closed cleanly.
+//
+// Records and index are memory mapped, a lookup is a hash probe or two and a
+// read from the record map. Not thread-safe.
+//
+// A writer holds an exclusive flock on PATH.records for as long as it's open,
+// readers a shared one. A reader that finds a writer at work doesn't wait or
+// touch anything: it ignores the index and scans the records that were
+// complete when it opened.
+class Ledger {
+    struct IndexHeader;
+    struct Slot;
+
+    int der_fd = -1;
+    int records_fd = -1;
+    int index_fd = -1;
+
+    const LedgerRecord* records = nullptr;
+    uint64_t record_count = 0;
+    uint64_t der_size = 0;
+
+    void* index_map = nullptr;
+    size_t index_size = 0;
+
+    bool sync = true;
+    bool read_only = false;
+    char* index_path = nullptr;
+
+    IndexHeader* header() const;
+    Slot* serial_slots() const;
+    Slot* skid_slots() const;
+    unsigned char* bloom() const;
+
+    bool recover();
+    bool count_valid_records(uint64_t available);
+    bool use_index_read_only(uint64_t records);
+    bool build_index(uint64_t slots);
+    bool map_index(int fd, size_t size);
+    void unmap_index();
+    void insert(uint64_t record);
+    bool bloom_may_contain(uint64_t hash) const;
+    const LedgerRecord* find(const Slot* slots, uint64_t hash, const unsigned char* key, size_t key_len, bool by_serial) const;
+    const LedgerRecord* scan(const unsigned char* key, size_t key_len, bool by_serial) const;
+
+public:
+    Ledger() = default;
+    Ledger(Ledger&& other);
+    ~Ledger();
+
+    Ledger(const Ledger&) = delete;
+    Ledger& operator=(const Ledger&) = delete;
+
+    // Opens or creates the ledger at path. With sync the DER and record are
+    // flushed to disk before append returns.
+    [[nodiscard]]
+    static opt<Ledger> open(const char* path, bool sync = true);
+
+    // Opens an existing ledger for lookups only. Never truncates, rebuilds or
+    // locks out a writer that's running.
+    [[nodiscard]]
+    static opt<Ledger> open_read_only(const char* path);
+
+    // Not for ledgers opened read-only.
+    ledger_append append(const mbedtls_x509_crt* cert);
+
+    // Serial as big-endian bytes, leading zeros are ignored.
+    bool contains_serial(const unsigned char* serial, size_t len) const;
+    const LedgerRecord* find_serial(const unsigned char* serial, size_t len) const;
+    const LedgerRecord* find_skid(const unsigned char* skid, size_t len) const;
+
+    bool read_der(const LedgerRecord& record, vec<unsigned char>* out) const;
+
+    uint64_t size() const { return record_count; }
+};
+
+} // namespace bb
+
+#endif // Header guard
@@ -0,0 +1,126 @@
+// Looks up a certificate in a signd ledger.
+//
+//   ledger_query PATH (--serial HEX | --skid HEX)
+//
+// Prints the record and the certificate as PEM. Exits with 1 when nothing
+// matches.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "ledger.hpp"
+#include "pem_writer.hpp"
+#include "vec.hpp"
+
+namespace {
+
+int hex_digit(char ch)
+{
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F')
+        return ch - 'A' + 10;
+    return -1;
+}
+
+// Colons between bytes are allowed, like openssl prints them.
+bool parse_hex(const char* hex, bb::vec<unsigned char>* out)
+{
+    int high = -1;
+    for (; *hex; ++hex) {
+        if (*hex == ':')
+            continue;
+
+        auto digit = hex_digit(*hex);
+        if (digit < 0)
+            return false;
+
+        if (high < 0) {
+            high = digit;
+        } else {
+            out->push_back((unsigned char)(high << 4 | digit));
+            high = -1;
+        }
+    }
+
+    return high < 0 && out->size;
+}
+
+void print_hex(const char* label, const unsigned char* data, size_t len)
+{
+    printf("%s", label);
+    for (size_t i = 0; i != len; ++i)
+        printf(i ? ":%02x" : "%02x", data[i]);
+    printf("\n");
+}
+
+void usage()
+{
+    fprintf(stderr, "Usage: ledger_query PATH (--serial HEX | --skid HEX)\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc != 4) {
+        usage();
+        return 2;
+    }
+
+    bool by_serial = strcmp(argv[2], "--serial") == 0;
+    if (!by_serial && strcmp(argv[2], "--skid") != 0) {
+        usage();
+        return 2;
+    }
+
+    bb::vec<unsigned char> key;
+    if (!parse_hex(argv[3], &key)) {
+        fprintf(stderr, "Invalid hex.\n");
+        return 2;
+    }
+
+    // Safe next to a running signd, nothing is written
+    auto opt_ledger = bb::Ledger::open_read_only(argv[1]);
+    if (!opt_ledger) {
+        fprintf(stderr, "Couldn't open ledger %s.\n", argv[1]);
+        return 2;
+    }
+    auto& ledger = *opt_ledger;
+
+    auto record = by_serial
+        ? ledger.find_serial(key.data, key.size)
+        : ledger.find_skid(key.data, key.size);
+
+    if (!record) {
+        fprintf(stderr, "Not in the ledger.\n");
+        return 1;
+    }
+
+    char not_after[32];
+    time_t t = record->not_after;
+    tm tm;
+    strftime(not_after, sizeof(not_after), "%Y-%m-%d %H:%M:%S UTC", gmtime_r(&t, &tm));
+
+    print_hex("Serial:       ", record->serial, record->serial_len);
+    print_hex("SKID:         ", record->skid, record->skid_len);
+    printf("Subject hash: %016" PRIx64 "\n", record->subject_hash);
+    printf("Not after:    %s\n", not_after);
+    printf("DER offset:   %" PRIu64 "\n", record->der_offset);
+
+    bb::vec<unsigned char> der;
+    if (!ledger.read_der(*record, &der)) {
+        fprintf(stderr, "Certificate DER is damaged.\n");
+        return 2;
+    }
+
+    bb::PemWriter pem{stdout, "CERTIFICATE"};
+    pem.write(der.data, der.size);
+    pem.finish();
+
+    return 0;
+}
@@ -0,0 +1,775 @@
+// Replays a mix of requests against the issuance core and reports latency per
+// request class.
+//
+//   loadgen [--requests N] [--seed N] [--mix LIST] [--keys LIST] [--sans LIST]
+//           [--ca-signed PERCENT] [--record FILE [--no-run]] [--replay FILE]
+//           [--clients N] [--rate PER_SECOND]
+//
+// A workload is a list of calls as the module gets them: the operation (run,
+// cert_info or cert_key_info) and its "input", "cert", "key" and "issuer_cert"
+// files in the rcomms encoding. Generated workloads draw from weighted lists
+// written NAME=WEIGHT,...:
+//
+//   --mix   issue, info, key_info                 (default issue=90,info=5,key_info=5)
+//   --keys  p256, p384, rsa2048, rsa4096          (default p256=90,rsa4096=10)
+//   --sans  SAN counts, e.g. 1=80,10=15,100=5     (default 1=100)
+//
+// and --ca-signed percent of the issued certificates are signed by a CA made
+// at start-up instead of self-signed. The lookups use a certificate chain from
+// that CA. A --seed always gives the same mix of requests, but the keys of
+// that CA and of the lookup certificate are new on every run, and so are the
+// keys the issue calls generate. --record saves the workload, CA and all, and
+// --replay runs a saved one, so releases can be compared on the exact same
+// requests.
+//
+// --clients N (default 4) threads run the calls. Without --rate they run in a
+// closed loop, each starting its next call when the last is done. With --rate
+// calls arrive at that many per second (exponential gaps) whether or not a
+// thread is free; latency is then counted from the arrival, so queueing shows.
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cert_calls.hpp"
+#include "cstr.hpp"
+#include "interface_error.hpp"
+#include "interface_ext_key_usage.hpp"
+#include "interface_key.hpp"
+#include "interface_key_usage.hpp"
+#include "interface_md.hpp"
+#include "interface_san.hpp"
+#include "rcomms.hpp"
+#include "vec.hpp"
+#include "wcomms.hpp"
+
+namespace {
+
+const char workload_magic[4] { 'B', 'B', 'W', 'L' };
+const uint32_t workload_version = 1;
+
+enum class operation : uint32_t {
+    issue,
+    cert_info,
+    cert_key_info,
+};
+
+const char* const operation_names[] { "issue", "info", "key_info" };
+const size_t operation_count = 3;
+
+enum file_index {
+    input_file,
+    cert_file,
+    key_file,
+    issuer_cert_file,
+    file_count,
+};
+
+const char* const key_names[] { "p256", "p384", "rsa2048", "rsa4096" };
+const char* const key_labels[] { "P-256", "P-384", "RSA-2048", "RSA-4096" };
+const size_t key_count = 4;
+
+struct Call {
+    // Latencies are reported per class, e.g. "issue ca P-256"
+    bb::cstr class_name;
+    operation op;
+    bb::cstr files[file_count];
+};
+
+struct Weighted {
+    uint32_t value;
+    uint32_t weight;
+};
+
+struct Settings {
+    long requests = 1000;
+    uint64_t seed = 1;
+    bb::vec<Weighted> mix;
+    bb::vec<Weighted> keys;
+    bb::vec<Weighted> sans;
+    uint32_t ca_signed_percent = 0;
+};
+
+double now_ms()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// splitmix64, so a seed always gives the same workload
+struct Rng {
+    uint64_t state;
+
+    uint64_t next()
+    {
+        auto z = (state += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+
+    // [0, 1)
+    double uniform()
+    {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    uint32_t pick(const bb::vec<Weighted>& list)
+    {
+        uint64_t total = 0;
+        for (auto& entry : list)
+            total += entry.weight;
+
+        auto target = next() % total;
+        for (auto& entry : list) {
+            if (target < entry.weight)
+                return entry.value;
+            target -= entry.weight;
+        }
+
+        return list[list.size - 1].value;
+    }
+};
+
+// NAME=WEIGHT,... with names from names, or numbers when names is null
+bool parse_weights(const char* arg, const char* const* names, size_t name_count, bb::vec<Weighted>* out)
+{
+    out->clear();
+    uint64_t total = 0;
+
+    while (*arg) {
+        auto equals = strchr(arg, '=');
+        if (!equals)
+            return false;
+
+        Weighted entry;
+        size_t name_len = equals - arg;
+        if (names) {
+            size_t i = 0;
+            while (i != name_count && (strlen(names[i]) != name_len || memcmp(names[i], arg, name_len) != 0))
+                ++i;
+
+            if (i == name_count)
+                return false;
+
+            entry.value = i;
+        } else {
+            char* end;
+            entry.value = strtoul(arg, &end, 10);
+            if (end != equals)
+                return false;
+        }
+
+        char* end;
+        entry.weight = strtoul(equals + 1, &end, 10);
+        if (*end != ',' && *end != '\0')
+            return false;
+
+        total += entry.weight;
+        out->push_back(entry);
+        arg = *end ? end + 1 : end;
+    }
+
+    return total != 0;
+}
+
+void write_string(bb::wcomms& out, const char* str)
+{
+    out.write_bytelen((void*)str, strlen(str));
+}
+
+// Whatever was written to a memstream, as a cstr
+struct MemoryFile {
+    char* data = nullptr;
+    size_t size = 0;
+
+    MemoryFile() = default;
+    MemoryFile(const MemoryFile&) = delete;
+    MemoryFile& operator=(const MemoryFile&) = delete;
+
+    ~MemoryFile()
+    {
+        free(data);
+    }
+
+    FILE* open()
+    {
+        free(data);
+        data = nullptr;
+        size = 0;
+        return open_memstream(&data, &size);
+    }
+
+    bb::cstr take() const
+    {
+        bb::cstr out{size};
+        memcpy(out.str, data, size);
+        return out;
+    }
+};
+
+// A single byte string, the format of the "cert" and "key" files
+bb::cstr byte_file(const char* data, size_t len)
+{
+    MemoryFile file;
+    {
+        bb::wcomms out{file.open()};
+        out.write_bytelen((void*)data, len);
+    }
+    return file.take();
+}
+
+// What a call produced, the module's "cert" and "key" files
+struct Output {
+    MemoryFile cert;
+    MemoryFile key;
+};
+
+const char* const file_names[file_count] { "input", "cert", "key", "issuer_cert" };
+
+// The files bb::run_call and friends see
+struct CallContext {
+    const Call& call;
+    Output& output;
+};
+
+bb::opt<bb::rcomms> open_file(void* ctx, const char* name)
+{
+    auto& context = *static_cast<CallContext*>(ctx);
+    for (size_t i = 0; i != file_count; ++i) {
+        auto& file = context.call.files[i];
+        if (strcmp(file_names[i], name) != 0 || file.empty())
+            continue;
+
+        auto f = fmemopen(file.str, file.len, "rb");
+        if (!f)
+            return {};
+
+        return bb::rcomms{f};
+    }
+
+    return {};
+}
+
+bb::opt<bb::wcomms> create_file(void* ctx, const char* name)
+{
+    auto& context = *static_cast<CallContext*>(ctx);
+    auto file = strcmp(name, "cert") == 0 ? &context.output.cert
+        : strcmp(name, "key") == 0 ? &context.output.key
+        : nullptr;
+
+    auto f = file ? file->open() : nullptr;
+    if (!f)
+        return {};
+
+    return bb::wcomms{f};
+}
+
+// The same code as the module's run, cert_info and cert_key_info exports
+bb::interface_error run_call(const Call& call, Output& output)
+{
+    CallContext context{call, output};
+
+    bb::CallFiles files;
+    files.ctx = &context;
+    files.open = open_file;
+    files.create = create_file;
+
+    switch (call.op) {
+    case operation::issue:
+        return bb::run_call(files);
+    case operation::cert_info:
+        return bb::cert_info_call(files);
+    case operation::cert_key_info:
+        return bb::cert_key_info_call(files);
+    }
+
+    return bb::interface_error::read_input;
+}
+
+// Workload generation
+
+struct Issuer {
+    bb::cstr cert_pem;
+    bb::cstr key_pem;
+    bb::cstr skid;
+};
+
+// Reads the PEM and SKID back out of a "cert" output
+bool read_cert_output(const Output& output, bb::cstr* pem, bb::cstr* skid)
+{
+    auto f = fmemopen(output.cert.data, output.cert.size, "rb");
+    if (!f)
+        return false;
+
+    bb::rcomms c{f};
+    bool is_ca;
+    bb::cstr subject;
+    return bb::cread(c, pem) && bb::cread(c, &is_ca) && bb::cread(c, &subject) && bb::cread(c, skid);
+}
+
+// Fixed, so the same seed gives the same requests on any day
+const char not_before[] = "20250101000000";
+const char not_after[] = "20250401000000";
+
+Call make_issue(Rng& rng, const Settings& settings, const Issuer* ca, bool is_ca, const char* subject)
+{
+    auto key_type = (bb::gen_key_type)(is_ca ? 0 : rng.pick(settings.keys));
+    auto san_count = is_ca ? 0 : rng.pick(settings.sans);
+
+    Call call;
+    call.op = operation::issue;
+
+    MemoryFile input;
+    {
+        bb::wcomms c{input.open()};
+        write_string(c, ca ? "CN=Load Test CA" : subject);
+        write_string(c, subject);
+        c.write_bool(is_ca);
+        c.write_bool(!ca);
+        if (ca)
+            c.write_string(ca->skid);
+        else
+            write_string(c, "");
+
+        c.write_uint(san_count);
+        for (uint32_t i = 0; i != san_count; ++i) {
+            char name[64];
+            auto len = snprintf(name, sizeof(name), "host-%u.load.example", i);
+            c.write_uint((uint32_t)bb::san_type::dns);
+            c.write_bytelen(name, len);
+        }
+        c.write_bool(false); // Sort SANs
+
+        c.write_uint((uint32_t)key_type);
+        c.write_uint((uint32_t)bb::md_type::sha2_256);
+        write_string(c, not_before);
+        write_string(c, not_after);
+
+        if (is_ca) {
+            c.write_uint(bb::key_usage::key_cert_sign | bb::key_usage::crl_sign);
+            c.write_uint(0);
+        } else {
+            c.write_uint(bb::key_usage::digital_signature);
+            c.write_uint(bb::ext_key_usage::server_auth);
+        }
+    }
+    call.files[input_file] = input.take();
+
+    if (ca) {
+        call.files[key_file] = byte_file(ca->key_pem.str, ca->key_pem.len);
+        call.files[issuer_cert_file] = byte_file(ca->cert_pem.str, ca->cert_pem.len);
+    }
+
+    char class_name[64];
+    snprintf(class_name, sizeof(class_name), "issue %s %s", ca ? "ca" : "self", key_labels[(uint32_t)key_type]);
+    call.class_name = bb::cstr{strlen(class_name)};
+    memcpy(call.class_name.str, class_name, call.class_name.len);
+
+    return call;
+}
+
+// Issues a certificate the lookups and CA-signed calls use
+bool make_fixture(Rng& rng, const Settings& settings, const Issuer* ca, bool is_ca, Issuer* out)
+{
+    auto call = make_issue(rng, settings, ca, is_ca, is_ca ? "CN=Load Test CA" : "CN=lookup.load.example");
+    Output output;
+    if (run_call(call, output) != bb::interface_error::success)
+        return false;
+
+    out->key_pem = output.key.take();
+    return read_cert_output(output, &out->cert_pem, &out->skid);
+}
+
+bb::cstr copy_string(const char* str)
+{
+    bb::cstr out{strlen(str)};
+    memcpy(out.str, str, out.len);
+    return out;
+}
+
+bool generate(const Settings& settings, bb::vec<Call>* out)
+{
+    Rng rng{settings.seed};
+
+    // Lookups and CA-signed calls need something to work with
+    Issuer ca;
+    Issuer leaf;
+    if (!make_fixture(rng, settings, nullptr, true, &ca) || !make_fixture(rng, settings, &ca, false, &leaf))
+        return false;
+
+    bb::cstr chain{leaf.cert_pem.len + ca.cert_pem.len};
+    memcpy(chain.str, leaf.cert_pem.str, leaf.cert_pem.len);
+    memcpy(chain.str + leaf.cert_pem.len, ca.cert_pem.str, ca.cert_pem.len);
+
+    out->clear();
+    for (long i = 0; i != settings.requests; ++i) {
+        switch ((operation)rng.pick(settings.mix)) {
+        case operation::issue: {
+            bool ca_signed = rng.next() % 100 < settings.ca_signed_percent;
+            out->push_back(make_issue(rng, settings, ca_signed ? &ca : nullptr, false, "CN=leaf.load.example"));
+            break;
+        }
+
+        case operation::cert_info: {
+            Call call;
+            call.class_name = copy_string("info");
+            call.op = operation::cert_info;
+            call.files[cert_file] = byte_file(chain.str, chain.len);
+            out->push_back(static_cast<Call&&>(call));
+            break;
+        }
+
+        case operation::cert_key_info: {
+            Call call;
+            call.class_name = copy_string("key_info");
+            call.op = operation::cert_key_info;
+            call.files[cert_file] = byte_file(chain.str, chain.len);
+            call.files[key_file] = byte_file(leaf.key_pem.str, leaf.key_pem.len);
+            out->push_back(static_cast<Call&&>(call));
+            break;
+        }
+        }
+    }
+
+    return true;
+}
+
+// Recording: magic, version and call count, then per call its class, its
+// operation and the files as byte strings
+
+bool save(const char* path, const bb::vec<Call>& calls)
+{
+    auto f = fopen(path, "wb");
+    if (!f)
+        return false;
+
+    bb::wcomms out{f};
+    fwrite(workload_magic, 1, sizeof(workload_magic), f);
+    out.write_uint(workload_version);
+    out.write_uint(calls.size);
+
+    for (auto& call : calls) {
+        out.write_string(call.class_name);
+        out.write_uint((uint32_t)call.op);
+        for (auto& file : call.files)
+            out.write_string(file);
+    }
+
+    return out.good();
+}
+
+bool load(const char* path, bb::vec<Call>* out)
+{
+    auto cc = bb::rcomms::open(path);
+    if (!cc)
+        return false;
+
+    auto& c = *cc;
+
+    char magic[sizeof(workload_magic)];
+    uint32_t version;
+    uint32_t count;
+    if (!c.read_exact(magic, sizeof(magic)) || memcmp(magic, workload_magic, sizeof(magic)) != 0)
+        return false;
+
+    if (!bb::cread(c, &version) || version != workload_version || !bb::cread(c, &count))
+        return false;
+
+    out->clear();
+    for (uint32_t i = 0; i != count; ++i) {
+        Call call;
+        uint32_t op;
+        if (!bb::cread(c, &call.class_name) || !bb::cread(c, &op) || op >= operation_count)
+            return false;
+
+        call.op = (operation)op;
+        for (auto& file : call.files) {
+            if (!bb::cread(c, &file))
+                return false;
+        }
+
+        out->push_back(static_cast<Call&&>(call));
+    }
+
+    return true;
+}
+
+// Running
+
+struct Run {
+    const bb::vec<Call>* calls;
+
+    // Arrival of each call relative to the start, open loop only
+    bb::vec<double> arrivals_ms;
+    double start_ms = 0;
+
+    long next = 0;
+};
+
+struct Client {
+    pthread_t thread;
+    Run* run;
+
+    // Per call index, negative for failures
+    bb::vec<double>* latencies_ms;
+};
+
+void sleep_until_ms(double target)
+{
+    for (;;) {
+        auto left = target - now_ms();
+        if (left <= 0)
+            return;
+
+        timespec ts;
+        ts.tv_sec = (time_t)(left / 1000);
+        ts.tv_nsec = (long)(fmod(left, 1000) * 1e6);
+        nanosleep(&ts, nullptr);
+    }
+}
+
+void* client_main(void* arg)
+{
+    auto& client = *static_cast<Client*>(arg);
+    auto& run = *client.run;
+    auto& calls = *run.calls;
+
+    Output output;
+    for (;;) {
+        auto i = __atomic_fetch_add(&run.next, 1, __ATOMIC_RELAXED);
+        if (i >= (long)calls.size)
+            break;
+
+        double start;
+        if (run.arrivals_ms.empty()) {
+            start = now_ms();
+        } else {
+            start = run.start_ms + run.arrivals_ms[i];
+            sleep_until_ms(start);
+        }
+
+        auto err = run_call(calls[i], output);
+        auto latency = now_ms() - start;
+        (*client.latencies_ms)[i] = err == bb::interface_error::success ? latency : -1;
+    }
+
+    return nullptr;
+}
+
+int compare_double(const void* a, const void* b)
+{
+    auto x = *(const double*)a;
+    auto y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+double percentile(const bb::vec<double>& sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+
+    auto index = (size_t)(p * (sorted.size - 1));
+    return sorted[index];
+}
+
+void report(const char* name, bb::vec<double>& latencies, long failures)
+{
+    qsort(latencies.data, latencies.size, sizeof(double), compare_double);
+    printf("%-24s %7zu %6ld %9.2f %9.2f %9.2f %9.2f\n",
+        name,
+        latencies.size,
+        failures,
+        percentile(latencies, 0.50),
+        percentile(latencies, 0.99),
+        percentile(latencies, 0.999),
+        latencies.empty() ? 0.0 : latencies[latencies.size - 1]);
+}
+
+bool same_class(const bb::cstr& a, const bb::cstr& b)
+{
+    return a.len == b.len && memcmp(a.str, b.str, a.len) == 0;
+}
+
+bool run_workload(const bb::vec<Call>& calls, long client_count, double rate, uint64_t seed)
+{
+    Run run;
+    run.calls = &calls;
+
+    if (rate > 0) {
+        Rng rng{seed ^ 0x5eed};
+        double t = 0;
+        for (size_t i = 0; i != calls.size; ++i) {
+            run.arrivals_ms.push_back(t);
+            t += -log(1 - rng.uniform()) * 1000 / rate;
+        }
+    }
+
+    bb::vec<double> latencies;
+    latencies.resize(calls.size);
+
+    bb::vec<Client> clients;
+    clients.resize(client_count);
+
+    run.start_ms = now_ms();
+    for (auto& client : clients) {
+        client.run = &run;
+        client.latencies_ms = &latencies;
+        if (pthread_create(&client.thread, nullptr, client_main, &client) != 0) {
+            fprintf(stderr, "Couldn't start client thread.\n");
+            return false;
+        }
+    }
+
+    for (auto& client : clients)
+        pthread_join(client.thread, nullptr);
+
+    auto elapsed_ms = now_ms() - run.start_ms;
+
+    // Classes in order of first appearance
+    bb::vec<const bb::cstr*> classes;
+    for (auto& call : calls) {
+        size_t c = 0;
+        while (c != classes.size && !same_class(*classes[c], call.class_name))
+            ++c;
+
+        if (c == classes.size)
+            classes.push_back(&call.class_name);
+    }
+
+    long total_failures = 0;
+    for (auto latency : latencies)
+        total_failures += latency < 0;
+
+    printf("calls:       %zu (%ld failed)\n", calls.size, total_failures);
+    if (rate > 0)
+        printf("mode:        open loop, %.1f calls/s offered, %ld clients\n", rate, client_count);
+    else
+        printf("mode:        closed loop, %ld clients\n", client_count);
+    printf("elapsed:     %.1f ms\n", elapsed_ms);
+    printf("throughput:  %.1f calls/s\n\n", (calls.size - total_failures) * 1000.0 / elapsed_ms);
+
+    printf("%-24s %7s %6s %9s %9s %9s %9s\n", "class", "calls", "failed", "p50 ms", "p99 ms", "p99.9 ms", "max ms");
+
+    bb::vec<double> class_latencies;
+    for (auto class_name : classes) {
+        class_latencies.clear();
+        long failures = 0;
+        for (size_t i = 0; i != calls.size; ++i) {
+            if (!same_class(calls[i].class_name, *class_name))
+                continue;
+
+            if (latencies[i] < 0)
+                ++failures;
+            else
+                class_latencies.push_back(latencies[i]);
+        }
+
+        char name[64];
+        snprintf(name, sizeof(name), "%.*s", (int)class_name->len, class_name->str);
+        report(name, class_latencies, failures);
+    }
+
+    class_latencies.clear();
+    for (auto latency : latencies) {
+        if (latency >= 0)
+            class_latencies.push_back(latency);
+    }
+    report("all", class_latencies, total_failures);
+
+    return total_failures == 0;
+}
+
+void usage()
+{
+    fprintf(stderr,
+        "Usage: loadgen [--requests N] [--seed N] [--mix LIST] [--keys LIST] [--sans LIST]\n"
+        "               [--ca-signed PERCENT] [--record FILE [--no-run]] [--replay FILE]\n"
+        "               [--clients N] [--rate PER_SECOND]\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Settings settings;
+    const char* record_path = nullptr;
+    const char* replay_path = nullptr;
+    bool no_run = false;
+    long client_count = 4;
+    double rate = 0;
+
+    bool ok = parse_weights("issue=90,info=5,key_info=5", operation_names, operation_count, &settings.mix)
+        && parse_weights("p256=90,rsa4096=10", key_names, key_count, &settings.keys)
+        && parse_weights("1=100", nullptr, 0, &settings.sans);
+
+    for (int i = 1; ok && i < argc; ++i) {
+        if (strcmp(argv[i], "--no-run") == 0) {
+            no_run = true;
+            continue;
+        }
+
+        if (i + 1 == argc) {
+            ok = false;
+            break;
+        }
+
+        auto arg = argv[i];
+        auto value = argv[++i];
+        if (strcmp(arg, "--requests") == 0) {
+            settings.requests = strtol(value, nullptr, 10);
+        } else if (strcmp(arg, "--seed") == 0) {
+            settings.seed = strtoull(value, nullptr, 10);
+        } else if (strcmp(arg, "--mix") == 0) {
+            ok = parse_weights(value, operation_names, operation_count, &settings.mix);
+        } else if (strcmp(arg, "--keys") == 0) {
+            ok = parse_weights(value, key_names, key_count, &settings.keys);
+        } else if (strcmp(arg, "--sans") == 0) {
+            ok = parse_weights(value, nullptr, 0, &settings.sans);
+        } else if (strcmp(arg, "--ca-signed") == 0) {
+            settings.ca_signed_percent = strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--record") == 0) {
+            record_path = value;
+        } else if (strcmp(arg, "--replay") == 0) {
+            replay_path = value;
+        } else if (strcmp(arg, "--clients") == 0) {
+            client_count = strtol(value, nullptr, 10);
+        } else if (strcmp(arg, "--rate") == 0) {
+            rate = strtod(value, nullptr);
+        } else {
+            ok = false;
+        }
+    }
+
+    if (!ok || settings.requests < 1 || client_count < 1 || rate < 0 || settings.ca_signed_percent > 100
+        || (no_run && !record_path) || (record_path && replay_path)) {
+        usage();
+        return 2;
+    }
+
+    bb::vec<Call> calls;
+    if (replay_path) {
+        if (!load(replay_path, &calls)) {
+            fprintf(stderr, "Couldn't read workload %s.\n", replay_path);
+            return 1;
+        }
+    } else if (!generate(settings, &calls)) {
+        fprintf(stderr, "Couldn't set up the workload's CA.\n");
+        return 1;
+    }
+
+    if (record_path && !save(record_path, calls)) {
+        fprintf(stderr, "Couldn't write workload %s.\n", record_path);
+        return 1;
+    }
+
+    if (no_run)
+        return 0;
+
+    return run_workload(calls, client_count, rate, settings.seed) ? 0 : 1;
+}
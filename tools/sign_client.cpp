@@ -0,0 +1,266 @@
+// Load tester for signd.
+//
+//   sign_client --socket PATH [--connections N] [--requests N] [--request FILE]
+//
+// Each connection runs on its own thread and sends its share of the requests
+// one after another. Without --request every request is the same self-signed
+// P-256 server certificate. --request sends a file holding a run() input
+// instead, e.g. one saved from the frontend.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cstr.hpp"
+#include "interface_ext_key_usage.hpp"
+#include "interface_key.hpp"
+#include "interface_key_usage.hpp"
+#include "interface_md.hpp"
+#include "interface_san.hpp"
+#include "unix_socket.hpp"
+#include "vec.hpp"
+#include "wcomms.hpp"
+
+namespace {
+
+const char* socket_path = nullptr;
+
+// Length prefixed request, sent as is by every connection.
+bb::vec<unsigned char> request;
+
+struct Connection {
+    pthread_t thread;
+    long requests;
+    long failures;
+    bb::vec<double> latencies_ms;
+};
+
+double now_ms()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+void write_string(bb::wcomms& out, const char* str)
+{
+    out.write_bytelen((void*)str, strlen(str));
+}
+
+bool default_request(bb::vec<unsigned char>* out)
+{
+    char* data = nullptr;
+    size_t size = 0;
+    auto file = open_memstream(&data, &size);
+    if (!file)
+        return false;
+
+    char not_before[16];
+    char not_after[16];
+    time_t now = time(nullptr);
+    time_t tomorrow = now + 24 * 60 * 60;
+    tm t;
+    strftime(not_before, sizeof(not_before), "%Y%m%d%H%M%S", gmtime_r(&now, &t));
+    strftime(not_after, sizeof(not_after), "%Y%m%d%H%M%S", gmtime_r(&tomorrow, &t));
+
+    {
+        bb::wcomms c{file};
+        write_string(c, ""); // Issuer, same as subject when self-signed
+        write_string(c, "CN=localhost");
+        c.write_bool(false); // Is CA
+        c.write_bool(true); // Self-signed
+        write_string(c, ""); // AKID
+        c.write_uint(1);
+        c.write_uint((uint32_t)bb::san_type::dns);
+        write_string(c, "localhost");
+        c.write_bool(false); // Sort SANs
+        c.write_uint((uint32_t)bb::gen_key_type::ec_p_256);
+        c.write_uint((uint32_t)bb::md_type::sha2_256);
+        write_string(c, not_before);
+        write_string(c, not_after);
+        c.write_uint(bb::key_usage::digital_signature);
+        c.write_uint(bb::ext_key_usage::server_auth);
+    }
+
+    out->resize(4);
+    bb::store_le32(out->data, size);
+    out->append((unsigned char*)data, size);
+    free(data);
+
+    return true;
+}
+
+bool file_request(const char* path, bb::vec<unsigned char>* out)
+{
+    auto file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    out->resize(4);
+
+    unsigned char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) != 0)
+        out->append(chunk, n);
+
+    bool ok = !ferror(file);
+    fclose(file);
+
+    bb::store_le32(out->data, out->size - 4);
+    return ok;
+}
+
+bool exchange(int fd, bb::vec<unsigned char>* response)
+{
+    if (!bb::write_full(fd, request.data, request.size))
+        return false;
+
+    unsigned char prefix[4];
+    if (bb::read_full(fd, prefix, sizeof(prefix)) != sizeof(prefix))
+        return false;
+
+    auto len = bb::load_le32(prefix);
+    response->resize(len);
+    if (bb::read_full(fd, response->data, len) != (ssize_t)len)
+        return false;
+
+    // interface_error::success
+    return len >= 4 && bb::load_le32(response->data) == 0;
+}
+
+void* connection_main(void* arg)
+{
+    auto& connection = *static_cast<Connection*>(arg);
+
+    auto fd = bb::connect_unix(socket_path);
+    if (fd < 0) {
+        perror("connect");
+        connection.failures = connection.requests;
+        return nullptr;
+    }
+
+    bb::vec<unsigned char> response;
+    for (long i = 0; i != connection.requests; ++i) {
+        auto start = now_ms();
+        if (!exchange(fd, &response)) {
+            ++connection.failures;
+            continue;
+        }
+        connection.latencies_ms.push_back(now_ms() - start);
+    }
+
+    close(fd);
+    return nullptr;
+}
+
+int compare_double(const void* a, const void* b)
+{
+    auto x = *(const double*)a;
+    auto y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+double percentile(const bb::vec<double>& sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+
+    auto index = (size_t)(p * (sorted.size - 1));
+    return sorted[index];
+}
+
+void usage()
+{
+    fprintf(stderr, "Usage: sign_client --socket PATH [--connections N] [--requests N] [--request FILE]\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const char* request_path = nullptr;
+    long connection_count = 4;
+    long request_count = 1000;
+
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 == argc) {
+            usage();
+            return 2;
+        }
+
+        if (strcmp(argv[i], "--socket") == 0) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--connections") == 0) {
+            connection_count = strtol(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--requests") == 0) {
+            request_count = strtol(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--request") == 0) {
+            request_path = argv[++i];
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    if (!socket_path || connection_count < 1 || request_count < 1) {
+        usage();
+        return 2;
+    }
+
+    bool have_request = request_path
+        ? file_request(request_path, &request)
+        : default_request(&request);
+    if (!have_request) {
+        fprintf(stderr, "Couldn't build request.\n");
+        return 1;
+    }
+
+    bb::vec<Connection> connections;
+    connections.resize(connection_count);
+
+    auto start = now_ms();
+
+    for (long i = 0; i != connection_count; ++i) {
+        auto& connection = connections[i];
+        connection.requests = request_count / connection_count
+            + (i < request_count % connection_count);
+
+        if (pthread_create(&connection.thread, nullptr, connection_main, &connection) != 0) {
+            fprintf(stderr, "Couldn't start connection thread.\n");
+            return 1;
+        }
+    }
+
+    bb::vec<double> latencies;
+    long failures = 0;
+    for (auto& connection : connections) {
+        pthread_join(connection.thread, nullptr);
+        failures += connection.failures;
+        latencies.append(connection.latencies_ms.data, connection.latencies_ms.size);
+    }
+
+    auto elapsed_ms = now_ms() - start;
+
+    qsort(latencies.data, latencies.size, sizeof(double), compare_double);
+
+    double total = 0;
+    for (auto latency : latencies)
+        total += latency;
+
+    printf("requests:    %ld (%ld failed)\n", request_count, failures);
+    printf("connections: %ld\n", connection_count);
+    printf("elapsed:     %.1f ms\n", elapsed_ms);
+    printf("throughput:  %.1f certificates/s\n", latencies.size * 1000.0 / elapsed_ms);
+    if (!latencies.empty()) {
+        printf("latency:     mean %.2f ms, p50 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+            total / latencies.size,
+            percentile(latencies, 0.50),
+            percentile(latencies, 0.99),
+            latencies[latencies.size - 1]);
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,581 @@
+// Issues certificates to local clients over a Unix domain socket.
+//
+//   signd --socket PATH [--ca-key PATH [--ca-cert PATH]] [--threads N]
+//         [--ledger PATH]
+//
+// A request is the same input the module's run export reads, framed as
+// described in unix_socket.hpp. The response starts with a uint32
+// interface_error. On success it's followed by the certificate fields the
+// module writes to its "cert" file, and the rest of the response is the
+// subject key as PEM.
+//
+// The main thread polls every idle connection and queues the ones with a
+// request for a fixed pool of workers. A worker answers one request and hands
+// the connection back, so a few busy clients can't hold on to every worker.
+// Each worker has its own DRBG (random.cpp keeps it per thread) and its own
+// request, response and DER buffers, which only grow. The CA key is parsed
+// once and used by all workers. With --ca-cert the issuer name is copied from
+// the CA certificate's subject, parsed once per worker, instead of from the
+// issuer string in each request.
+//
+// With --ledger every issued certificate is appended to the ledger (ledger.hpp)
+// before it's returned. A serial that was handed out before is rejected there
+// and the certificate is issued again with a fresh one.
+//
+// SIGINT/SIGTERM stops accepting connections and reading new requests.
+// Requests that were already sent are answered, then their connections are
+// closed and the daemon exits.
+
+#include <mbedtls/md.h>
+#include <mbedtls/pk.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cert.hpp"
+#include "cert_io.hpp"
+#include "cstr.hpp"
+#include "interface_error.hpp"
+#include "interface_key.hpp"
+#include "issue.hpp"
+#include "ledger.hpp"
+#include "random.hpp"
+#include "rcomms.hpp"
+#include "unix_socket.hpp"
+#include "vec.hpp"
+#include "wcomms.hpp"
+
+namespace {
+
+const uint32_t max_request_size = 1 << 20;
+const size_t queue_capacity = 256;
+
+// A random 16 byte serial colliding even once is unlikely, give up after a
+// few so a broken RNG doesn't spin.
+const int max_issue_attempts = 4;
+
+// How often the main thread looks at the stop flag.
+const int poll_interval_ms = 200;
+
+bool stopping = false;
+
+void handle_stop_signal(int)
+{
+    __atomic_store_n(&stopping, true, __ATOMIC_RELAXED);
+}
+
+bool should_stop()
+{
+    return __atomic_load_n(&stopping, __ATOMIC_RELAXED);
+}
+
+// Connections with a request waiting for a worker.
+class ConnectionQueue {
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t not_empty = PTHREAD_COND_INITIALIZER;
+    pthread_cond_t not_full = PTHREAD_COND_INITIALIZER;
+    int fds[queue_capacity];
+    size_t head = 0;
+    size_t count = 0;
+    bool closed = false;
+
+public:
+    void push(int fd)
+    {
+        pthread_mutex_lock(&mutex);
+        while (count == queue_capacity)
+            pthread_cond_wait(&not_full, &mutex);
+
+        fds[(head + count) % queue_capacity] = fd;
+        ++count;
+
+        pthread_cond_signal(&not_empty);
+        pthread_mutex_unlock(&mutex);
+    }
+
+    // -1 once the queue is closed and everything in it was handed out.
+    int pop()
+    {
+        pthread_mutex_lock(&mutex);
+        while (count == 0 && !closed)
+            pthread_cond_wait(&not_empty, &mutex);
+
+        int fd = -1;
+        if (count) {
+            fd = fds[head];
+            head = (head + 1) % queue_capacity;
+            --count;
+            pthread_cond_signal(&not_full);
+        }
+
+        pthread_mutex_unlock(&mutex);
+        return fd;
+    }
+
+    void close()
+    {
+        pthread_mutex_lock(&mutex);
+        closed = true;
+        pthread_cond_broadcast(&not_empty);
+        pthread_mutex_unlock(&mutex);
+    }
+};
+
+ConnectionQueue connections;
+
+// Workers write connections they're done with here, for the main thread to
+// poll again. Writes of an fd are atomic, see PIPE_BUF.
+int returned_fds[2] = {-1, -1};
+
+void return_connection(int fd)
+{
+    if (write(returned_fds[1], &fd, sizeof(fd)) != sizeof(fd))
+        close(fd);
+}
+
+// Shared by every worker. Signing doesn't modify an EC key once its group has
+// been used, and the RSA blinding values are guarded by the context's own
+// mutex (MBEDTLS_THREADING_C).
+mbedtls_pk_context* ca_key = nullptr;
+bb::cstr ca_cert;
+
+bb::Ledger* ledger = nullptr;
+pthread_mutex_t ledger_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+bb::ledger_append record_issued(mbedtls_x509_crt* cert)
+{
+    pthread_mutex_lock(&ledger_mutex);
+    auto result = ledger->append(cert);
+    pthread_mutex_unlock(&ledger_mutex);
+    return result;
+}
+
+struct Worker {
+    pthread_t thread;
+    bb::cstr request;
+    bb::cstr response;
+    bb::cstr der_buffer;
+};
+
+void grow(bb::cstr* buffer, size_t size)
+{
+    if (buffer->len >= size)
+        return;
+
+    auto new_size = buffer->len ? buffer->len : 4096;
+    while (new_size < size)
+        new_size *= 2;
+
+    *buffer = bb::cstr(new_size);
+}
+
+// Writes the response body after the length prefix. Returns the body length
+// or -1 when it didn't fit.
+long write_response(
+    Worker& worker,
+    bb::interface_error status,
+    mbedtls_x509_crt* cert,
+    mbedtls_pk_context* subject_key)
+{
+    auto body = worker.response.str + 4;
+    auto body_capacity = worker.response.len - 4;
+
+    auto file = fmemopen(body, body_capacity, "wb");
+    if (!file)
+        return -1;
+
+    bb::wcomms out{file};
+    out.write_uint((uint32_t)status);
+
+    if (status == bb::interface_error::success) {
+        auto err = bb::write_cert(out, cert);
+        if (err != bb::interface_error::success) {
+            fseek(file, 0, SEEK_SET);
+            out.write_uint((uint32_t)err);
+        } else if (!bb::write_key(file, subject_key)) {
+            fseek(file, 0, SEEK_SET);
+            out.write_uint((uint32_t)bb::interface_error::write_key);
+        }
+    }
+
+    if (!out.good())
+        return -1;
+
+    auto len = out.tell();
+    return (size_t)len < body_capacity ? len : -1;
+}
+
+bb::interface_error issue_request(
+    Worker& worker,
+    uint32_t request_size,
+    bb::Key* subject_key,
+    bb::Cert* cert)
+{
+    auto file = fmemopen(worker.request.str, request_size, "rb");
+    if (!file)
+        return bb::interface_error::read_input;
+
+    bb::rcomms in{file};
+
+    bb::IssueRequest request;
+    if (!bb::read_issue_request(in, &request))
+        return bb::interface_error::read_input;
+
+    auto opt_key = bb::generate_key(request.key_type);
+    if (!opt_key) {
+        fprintf(stderr, "Couldn't generate key.\n");
+        return bb::interface_error::generate_key;
+    }
+    *subject_key = static_cast<bb::Key&&>(*opt_key);
+
+    mbedtls_pk_context* authority_key = subject_key;
+    if (!request.self_signed) {
+        if (!ca_key) {
+            fprintf(stderr, "Request isn't self-signed and no CA key was given.\n");
+            return bb::interface_error::read_key;
+        }
+        authority_key = ca_key;
+        if (!ca_cert.empty())
+            request.issuer_cert = &ca_cert;
+    }
+
+    for (int attempt = 0;; ++attempt) {
+        auto err = bb::issue(request, subject_key, authority_key, &worker.der_buffer, cert);
+        if (err != bb::interface_error::success || !ledger)
+            return err;
+
+        switch (record_issued(cert)) {
+        case bb::ledger_append::ok:
+            return bb::interface_error::success;
+
+        case bb::ledger_append::duplicate_serial:
+            if (attempt + 1 == max_issue_attempts) {
+                fprintf(stderr, "Kept issuing serials that are already in the ledger.\n");
+                return bb::interface_error::generate_cert;
+            }
+            *cert = bb::Cert{};
+            continue;
+
+        case bb::ledger_append::io_error:
+            fprintf(stderr, "Couldn't append to the ledger.\n");
+            return bb::interface_error::write_cert;
+        }
+    }
+}
+
+// Returns false when the connection should be closed.
+bool serve_request(Worker& worker, int fd)
+{
+    unsigned char prefix[4];
+    auto n = bb::read_full(fd, prefix, sizeof(prefix));
+    if (n != sizeof(prefix))
+        return false;
+
+    auto request_size = bb::load_le32(prefix);
+    if (request_size == 0 || request_size > max_request_size) {
+        fprintf(stderr, "Bad request size %u.\n", request_size);
+        return false;
+    }
+
+    grow(&worker.request, request_size);
+    if (bb::read_full(fd, worker.request.str, request_size) != (ssize_t)request_size)
+        return false;
+
+    bb::Key subject_key;
+    bb::Cert cert;
+    auto status = issue_request(worker, request_size, &subject_key, &cert);
+
+    long body_len;
+    for (;;) {
+        body_len = write_response(worker, status, &cert, &subject_key);
+        if (body_len >= 0)
+            break;
+
+        grow(&worker.response, worker.response.len * 2);
+    }
+
+    bb::store_le32((unsigned char*)worker.response.str, body_len);
+    return bb::write_full(fd, worker.response.str, 4 + body_len);
+}
+
+void* worker_main(void* arg)
+{
+    auto& worker = *static_cast<Worker*>(arg);
+
+    // Blocked here so the main thread is the one woken by them.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    worker.response = bb::cstr(16384);
+
+    // While draining, the request that got the connection queued is the
+    // last one read from it.
+    for (int fd; (fd = connections.pop()) != -1;) {
+        if (serve_request(worker, fd) && !should_stop())
+            return_connection(fd);
+        else
+            close(fd);
+    }
+
+    bb::free_thread_rng();
+    return nullptr;
+}
+
+bool read_file(const char* path, bb::cstr* out)
+{
+    auto file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    bb::vec<char> data;
+    char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) != 0)
+        data.append(chunk, n);
+
+    bool ok = !ferror(file);
+    fclose(file);
+
+    *out = bb::cstr(data.size);
+    memcpy(out->str, data.data, data.size);
+    return ok;
+}
+
+// Makes one signature up front. If the curve's precomputed table is built
+// lazily that happens here, before the workers share the key.
+bool warm_up_key(mbedtls_pk_context* key)
+{
+    unsigned char hash[32]{};
+    unsigned char signature[MBEDTLS_PK_SIGNATURE_MAX_SIZE];
+    size_t signature_len;
+
+    return mbedtls_pk_sign(
+        key, MBEDTLS_MD_SHA256,
+        hash, sizeof(hash),
+        signature, sizeof(signature), &signature_len,
+        mt_rng, nullptr) == 0;
+}
+
+// Connections the workers handed back, added to the idle ones.
+void take_returned(bb::vec<int>* idle)
+{
+    int fd;
+    while (read(returned_fds[0], &fd, sizeof(fd)) == sizeof(fd))
+        idle->push_back(fd);
+}
+
+// Waits up to timeout_ms for requests on the listening socket and idle
+// connections. Connections with something to read, a request or a hang up,
+// are queued for the workers.
+void poll_connections(int listen_fd, bb::vec<int>* idle, bb::vec<pollfd>* pfds, int timeout_ms)
+{
+    pfds->clear();
+    if (listen_fd >= 0)
+        pfds->push_back(pollfd{listen_fd, POLLIN, 0});
+    pfds->push_back(pollfd{returned_fds[0], POLLIN, 0});
+    auto first_idle = pfds->size;
+    for (auto fd : *idle)
+        pfds->push_back(pollfd{fd, POLLIN, 0});
+
+    if (poll(pfds->data, pfds->size, timeout_ms) <= 0)
+        return;
+
+    // Idle connections keep their order in idle, so walk both together
+    size_t kept = 0;
+    for (size_t i = 0; i != idle->size; ++i) {
+        if ((*pfds)[first_idle + i].revents)
+            connections.push((*idle)[i]);
+        else
+            (*idle)[kept++] = (*idle)[i];
+    }
+    idle->resize(kept);
+
+    if ((*pfds)[first_idle - 1].revents)
+        take_returned(idle);
+
+    if (listen_fd >= 0 && (*pfds)[0].revents) {
+        auto fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd >= 0)
+            idle->push_back(fd);
+    }
+}
+
+int listen_unix(const char* path)
+{
+    sockaddr_un address;
+    if (!bb::unix_address(path, &address)) {
+        fprintf(stderr, "Socket path is too long.\n");
+        return -1;
+    }
+
+    auto fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    unlink(path);
+    if (bind(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+
+    if (listen(fd, SOMAXCONN) != 0) {
+        perror("listen");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+void usage()
+{
+    fprintf(stderr, "Usage: signd --socket PATH [--ca-key PATH [--ca-cert PATH]] [--threads N] [--ledger PATH]\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const char* socket_path = nullptr;
+    const char* ca_key_path = nullptr;
+    const char* ca_cert_path = nullptr;
+    const char* ledger_path = nullptr;
+    long thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 == argc) {
+            usage();
+            return 2;
+        }
+
+        if (strcmp(argv[i], "--socket") == 0) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--ca-key") == 0) {
+            ca_key_path = argv[++i];
+        } else if (strcmp(argv[i], "--ca-cert") == 0) {
+            ca_cert_path = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            thread_count = strtol(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--ledger") == 0) {
+            ledger_path = argv[++i];
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    if (!socket_path || thread_count < 1 || (ca_cert_path && !ca_key_path)) {
+        usage();
+        return 2;
+    }
+
+    bb::Key ca_key_owner;
+    if (ca_key_path) {
+        bb::cstr pem;
+        if (!read_file(ca_key_path, &pem)) {
+            fprintf(stderr, "Couldn't read %s.\n", ca_key_path);
+            return 1;
+        }
+
+        auto opt_key = bb::parse_key(pem);
+        if (!opt_key)
+            return 1;
+
+        ca_key_owner = static_cast<bb::Key&&>(*opt_key);
+        if (!warm_up_key(&ca_key_owner)) {
+            fprintf(stderr, "CA key can't sign.\n");
+            return 1;
+        }
+        ca_key = &ca_key_owner;
+    }
+
+    if (ca_cert_path) {
+        if (!read_file(ca_cert_path, &ca_cert)) {
+            fprintf(stderr, "Couldn't read %s.\n", ca_cert_path);
+            return 1;
+        }
+
+        // Checked here so a bad file is reported once, not per request
+        if (!bb::parse_cert(ca_cert))
+            return 1;
+    }
+
+    auto opt_ledger = ledger_path ? bb::Ledger::open(ledger_path) : bb::opt<bb::Ledger>{};
+    if (ledger_path) {
+        if (!opt_ledger) {
+            fprintf(stderr, "Couldn't open ledger %s.\n", ledger_path);
+            return 1;
+        }
+        ledger = &*opt_ledger;
+        fprintf(stderr, "Ledger has %llu certificates.\n", (unsigned long long)ledger->size());
+    }
+
+    struct sigaction action{};
+    action.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    auto listen_fd = listen_unix(socket_path);
+    if (listen_fd < 0)
+        return 1;
+
+    if (pipe2(returned_fds, O_CLOEXEC | O_NONBLOCK) != 0) {
+        perror("pipe2");
+        return 1;
+    }
+
+    bb::vec<Worker> workers;
+    workers.resize(thread_count);
+    for (auto& worker : workers) {
+        if (pthread_create(&worker.thread, nullptr, worker_main, &worker) != 0) {
+            fprintf(stderr, "Couldn't start worker.\n");
+            return 1;
+        }
+    }
+
+    fprintf(stderr, "Listening on %s with %ld workers.\n", socket_path, thread_count);
+
+    bb::vec<int> idle;
+    bb::vec<pollfd> pfds;
+    while (!should_stop())
+        poll_connections(listen_fd, &idle, &pfds, poll_interval_ms);
+
+    fprintf(stderr, "Draining.\n");
+
+    close(listen_fd);
+    unlink(socket_path);
+
+    // Requests that already arrived are still answered, the rest of the idle
+    // connections are closed
+    take_returned(&idle);
+    poll_connections(-1, &idle, &pfds, 0);
+    for (auto fd : idle)
+        close(fd);
+
+    connections.close();
+    for (auto& worker : workers)
+        pthread_join(worker.thread, nullptr);
+
+    // Handed back just before the workers saw the stop flag
+    idle.clear();
+    take_returned(&idle);
+    for (auto fd : idle)
+        close(fd);
+
+    return 0;
+}
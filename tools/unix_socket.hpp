@@ -0,0 +1,92 @@
+#ifndef BB_TOOLS_UNIX_SOCKET_HPP
+#define BB_TOOLS_UNIX_SOCKET_HPP
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "endian.hpp"
+
+// Framing used between signd and its clients: every message is a
+// little-endian uint32 length followed by that many bytes.
+
+namespace bb {
+
+// Returns the number of bytes read, less than len only on end of stream.
+// -1 on error.
+inline ssize_t read_full(int fd, void* data, size_t len)
+{
+    auto bytes = (unsigned char*)data;
+    size_t done = 0;
+    while (done != len) {
+        auto n = recv(fd, bytes + done, len - done, 0);
+        if (n == 0)
+            break;
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        done += n;
+    }
+
+    return done;
+}
+
+inline bool write_full(int fd, const void* data, size_t len)
+{
+    auto bytes = (const unsigned char*)data;
+    while (len) {
+        auto n = send(fd, bytes, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        bytes += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+inline bool unix_address(const char* path, sockaddr_un* out)
+{
+    memset(out, 0, sizeof(*out));
+    out->sun_family = AF_UNIX;
+
+    auto len = strlen(path);
+    if (len >= sizeof(out->sun_path))
+        return false;
+
+    memcpy(out->sun_path, path, len);
+    return true;
+}
+
+inline int connect_unix(const char* path)
+{
+    sockaddr_un address;
+    if (!unix_address(path, &address))
+        return -1;
+
+    auto fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+} // namespace bb
+
+#endif // Header guard